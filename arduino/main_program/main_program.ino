@@ -37,6 +37,13 @@ debug). Data are sent only when the state of a key change.
 #define KEY_FLOAT 0b01
 #define KEY_DOWN  0b00
 
+// The pedal is connected as the key 48 (7th key of sat. board 7). Its position is sent at each
+// change (0: up, 127: down). Between the 2 switches the pedal is half down (half pedal).
+#define PEDAL_KEY_INDEX      48
+#define PEDAL_POSITION_UP    0
+#define PEDAL_POSITION_FLOAT 64
+#define PEDAL_POSITION_DOWN  127
+
 /**** Variables ****/
 unsigned char cur_keys_state[NB_KEYS];
 unsigned char prev_keys_state[NB_KEYS];
@@ -98,7 +105,14 @@ void loop(void)
 
   for (unsigned char key_index=0; key_index < NB_KEYS; key_index++)
   {
-    manage_key(key_index);
+    if (key_index == PEDAL_KEY_INDEX)
+    {
+      manage_pedal();
+    }
+    else
+    {
+      manage_key(key_index);
+    }
   }
 }
 
@@ -248,6 +262,32 @@ void manage_key(unsigned char key_index)
   prev_keys_state[key_index] = cur_key_state; 
 }
 
+/* Manage the pedal: send its position at each change of state */
+void manage_pedal(void) 
+{
+  unsigned char cur_pedal_state;
+
+  cur_pedal_state = cur_keys_state[PEDAL_KEY_INDEX];
+  
+  if (cur_pedal_state != prev_keys_state[PEDAL_KEY_INDEX]) 
+  {
+    if (cur_pedal_state == KEY_UP)
+    {
+      send_pedal_msg(PEDAL_POSITION_UP);
+    }
+    else if (cur_pedal_state == KEY_FLOAT)
+    {
+      send_pedal_msg(PEDAL_POSITION_FLOAT);
+    }
+    else if (cur_pedal_state == KEY_DOWN)
+    {
+      send_pedal_msg(PEDAL_POSITION_DOWN);
+    }
+  }
+
+  prev_keys_state[PEDAL_KEY_INDEX] = cur_pedal_state; 
+}
+
 /* Send the KEY_DOWN message on the UART Serial and Serial1 */
 void send_key_down_msg(unsigned char key_index, unsigned long time)
 {
@@ -275,3 +315,15 @@ void send_key_up_msg(unsigned char key_index)
         Serial1.print(key_index);
         Serial1.println();
 }
+
+/* Send the PEDAL message (position of the pedal) on the UART Serial and Serial1 */
+void send_pedal_msg(unsigned char position)
+{
+        Serial.print("SP ");
+        Serial.print(position);
+        Serial.println();
+
+        Serial1.print("SP ");
+        Serial1.print(position);
+        Serial1.println();
+}
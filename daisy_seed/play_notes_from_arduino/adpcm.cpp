@@ -0,0 +1,484 @@
+/*
+ * This module decodes the notes stored compressed in RAM (IMA ADPCM, 4 bits per sample instead
+ * of 16), to hold several sound banks in RAM.
+ *
+ * The compressed files (.adp, written by tools/encode_adpcm_bank.py) contain a header
+ * (TAdpcmFileHeader) followed by blocks of ADPCM_BLOCK_NB_FRAMES frames. Each block starts with
+ * a header per channel: the first sample of the block and the step index of the quantizer. The
+ * other frames are 4 bits codes (channels interleaved, low nibble first). A block is decoded
+ * without the previous blocks. The blocks are loaded as they are in g_sample_data.
+ *
+ * The audio callback decodes the samples of each compressed voice in a decoding window (one
+ * per voice): the frames of the current block are decoded on demand, up to
+ * ADPCM_DECODE_AHEAD_NB_FRAMES frames after the read position. After the last frame of the
+ * block, the first frame of the next block (block header) is added to the window so that the
+ * interpolation of a pitch shifted voice can read it.
+ */
+
+/*************************************************************************************************
+* Includes
+*************************************************************************************************/
+#include "daisy_seed.h"
+#include "fatfs.h"
+#include "common.h"
+#include "adpcm.h"
+
+using namespace daisy;
+
+/*************************************************************************************************
+* Defines
+*************************************************************************************************/
+#define ADPCM_NB_STEPS              89
+#define ADPCM_NO_BLOCK              0xFFFFFFFF
+
+/*************************************************************************************************
+* Types
+*************************************************************************************************/
+// Decoder of a voice.
+typedef struct
+{
+    const uint8_t *data;        // First block of the sound.
+    uint8_t nb_channels;        // Number of channels of the sound.
+    uint32_t nb_frames;         // Number of frames of the sound.
+    size_t first_sample_pos;    // Position of the first sample of the sound (in g_sample_data).
+    uint32_t block_idx;         // Block decoded in the window (ADPCM_NO_BLOCK: none).
+    uint32_t nb_block_frames;   // Number of frames of the block.
+    uint32_t nb_decoded_frames; // Number of frames of the block decoded in the window.
+    uint32_t nb_window_frames;  // Number of frames of the window (with the next block header).
+    int32_t predictor[2];       // Last sample decoded for each channel.
+    int32_t step_index[2];      // Step index of the quantizer for each channel.
+    int16_t window[(ADPCM_BLOCK_NB_FRAMES + 1) * 2]; // Frames decoded (interleaved).
+} TAdpcmDecoder;
+
+/*************************************************************************************************
+* Variables
+*************************************************************************************************/
+// Step of the quantizer for each step index (IMA ADPCM).
+static const int16_t k_adpcm_step_table[ADPCM_NB_STEPS] =
+{
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45, 50, 55, 60, 66,
+    73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307, 337, 371, 408,
+    449, 494, 544, 598, 658, 724, 796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+    2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630,
+    9493, 10442, 11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+// Change of the step index for each code magnitude (IMA ADPCM).
+static const int8_t k_adpcm_index_table[8] = {-1, -1, -1, -1, 2, 4, 6, 8};
+
+// Decoders of the voices.
+static TAdpcmDecoder g_adpcm_decoders[NB_VOICES];
+
+/*************************************************************************************************
+* Functions implementation
+*************************************************************************************************/
+
+/* Decode a 4 bits code and update the predictor and the step index. Return the sample. */
+static inline int16_t decode_adpcm_code(uint8_t code, int32_t *p_predictor, int32_t *p_step_index)
+{
+    int32_t step = k_adpcm_step_table[*p_step_index];
+    int32_t diff = step >> 3;
+
+    if (code & 4)
+    {
+        diff += step;
+    }
+    if (code & 2)
+    {
+        diff += step >> 1;
+    }
+    if (code & 1)
+    {
+        diff += step >> 2;
+    }
+    *p_predictor += (code & 8) ? -diff : diff;
+
+    if (*p_predictor > 32767)
+    {
+        *p_predictor = 32767;
+    }
+    else if (*p_predictor < -32768)
+    {
+        *p_predictor = -32768;
+    }
+
+    *p_step_index += k_adpcm_index_table[code & 7];
+    if (*p_step_index < 0)
+    {
+        *p_step_index = 0;
+    }
+    else if (*p_step_index >= ADPCM_NB_STEPS)
+    {
+        *p_step_index = ADPCM_NB_STEPS - 1;
+    }
+
+    return (int16_t)*p_predictor;
+}
+
+/* Return the code of a sample and update the predictor and the step index as the decoder. */
+static uint8_t encode_adpcm_sample(int16_t sample, int32_t *p_predictor, int32_t *p_step_index)
+{
+    int32_t step = k_adpcm_step_table[*p_step_index];
+    int32_t diff = (int32_t)sample - *p_predictor;
+    uint8_t code = 0;
+
+    if (diff < 0)
+    {
+        code = 8;
+        diff = -diff;
+    }
+    if (diff >= step)
+    {
+        code |= 4;
+        diff -= step;
+    }
+    step >>= 1;
+    if (diff >= step)
+    {
+        code |= 2;
+        diff -= step;
+    }
+    step >>= 1;
+    if (diff >= step)
+    {
+        code |= 1;
+    }
+
+    decode_adpcm_code(code, p_predictor, p_step_index);
+
+    return code;
+}
+
+/* Return the step index giving the lowest error over the first block of a channel of 
+   nb_frames frames (interleaved samples). The quantizer then follows the attack of the sound 
+   from its first frame. */
+static int32_t find_adpcm_first_step_index(const int16_t *samples, size_t nb_frames, 
+                                           uint8_t nb_channels, uint8_t channel)
+{
+    int32_t predictor;
+    int32_t step_index;
+    int64_t error;
+    int64_t total_error;
+    int64_t min_total_error = INT64_MAX;
+    int32_t best_step_index = 0;
+
+    if (nb_frames == 0)
+    {
+        return best_step_index;
+    }
+    if (nb_frames > ADPCM_BLOCK_NB_FRAMES)
+    {
+        nb_frames = ADPCM_BLOCK_NB_FRAMES;
+    }
+
+    for (int32_t first_step_index = 0; first_step_index < ADPCM_NB_STEPS; first_step_index++)
+    {
+        predictor   = samples[channel];
+        step_index  = first_step_index;
+        total_error = 0;
+        for (size_t frame = 1; frame < nb_frames; frame++)
+        {
+            encode_adpcm_sample(samples[frame * nb_channels + channel], &predictor, &step_index);
+            error = samples[frame * nb_channels + channel] - predictor;
+            total_error += error * error;
+        }
+        if (total_error < min_total_error)
+        {
+            min_total_error = total_error;
+            best_step_index = first_step_index;
+        }
+    }
+
+    return best_step_index;
+}
+
+/* Read the block header of each channel: first sample and step index. */
+static void read_adpcm_block_header(const uint8_t *block, uint8_t nb_channels, int32_t *predictor,
+                                    int32_t *step_index)
+{
+    for (uint8_t channel = 0; channel < nb_channels; channel++)
+    {
+        predictor[channel]  = (int16_t)(block[ADPCM_BLOCK_HEADER_SIZE * channel]
+                                        | (block[ADPCM_BLOCK_HEADER_SIZE * channel + 1] << 8));
+        step_index[channel] = block[ADPCM_BLOCK_HEADER_SIZE * channel + 2];
+        if (step_index[channel] >= ADPCM_NB_STEPS)
+        {
+            step_index[channel] = ADPCM_NB_STEPS - 1;
+        }
+    }
+}
+
+/* Decode the frames first_frame to last_frame - 1 of a block (first_frame > 0, the frame 0 is
+   the block header) in samples (interleaved, sample of first_frame first). */
+static void decode_adpcm_frames(const uint8_t *block, uint8_t nb_channels, uint32_t first_frame,
+                                uint32_t last_frame, int32_t *predictor, int32_t *step_index,
+                                int16_t *samples)
+{
+    const uint8_t *codes = &block[ADPCM_BLOCK_HEADER_SIZE * nb_channels];
+    uint32_t code_idx = (first_frame - 1) * nb_channels;
+
+    if (nb_channels == 1)
+    {
+        for (uint32_t frame = first_frame; frame < last_frame; frame++)
+        {
+            *samples++ = decode_adpcm_code((codes[code_idx >> 1] >> ((code_idx & 1) * 4)) & 0x0F,
+                                           &predictor[0], &step_index[0]);
+            code_idx++;
+        }
+    }
+    else
+    {
+        // One byte per frame: left channel in the low nibble, right channel in the high nibble.
+        for (uint32_t frame = first_frame; frame < last_frame; frame++)
+        {
+            *samples++ = decode_adpcm_code(codes[code_idx >> 1] & 0x0F, &predictor[0], &step_index[0]);
+            *samples++ = decode_adpcm_code(codes[code_idx >> 1] >> 4, &predictor[1], &step_index[1]);
+            code_idx += 2;
+        }
+    }
+}
+
+/* Return true if a file is a compressed file (extension ADPCM_FILE_EXTENSION). */
+bool is_adpcm_file(const char *file_name)
+{
+    return (strstr(file_name, ADPCM_FILE_EXTENSION) != NULL) || (strstr(file_name, ".ADP") != NULL);
+}
+
+/* Read the header of a compressed file. Return false if the file can't be played. */
+static bool read_adpcm_file_header(char *file_name, TAdpcmFileHeader *pHeader)
+{
+    static FIL SDFile;
+    size_t bytesRead = 0;
+    FRESULT result;
+
+    result = f_open(&SDFile, file_name, FA_READ);
+    if (result != FR_OK)
+    {
+        g_hw.PrintLine("f_open result KO. result=%d", result);
+        return false;
+    }
+    result = f_read(&SDFile, pHeader, sizeof(TAdpcmFileHeader), &bytesRead);
+    f_close(&SDFile);
+
+    if ((result != FR_OK) || (bytesRead != sizeof(TAdpcmFileHeader)))
+    {
+        g_hw.PrintLine("f_read result KO. result=%d", result);
+        return false;
+    }
+    if (   (memcmp(pHeader->magic, ADPCM_FILE_MAGIC, 4) != 0) || (pHeader->nb_channels == 0)
+        || (pHeader->nb_channels > 2)
+        || (pHeader->nb_blocks != (pHeader->nb_frames + ADPCM_BLOCK_NB_FRAMES - 1) / ADPCM_BLOCK_NB_FRAMES))
+    {
+        g_hw.PrintLine("Error: invalid ADPCM file");
+        return false;
+    }
+    if (pHeader->sample_rate != SAMPLE_RATE_HZ)
+    {
+        g_hw.PrintLine("Error: ADPCM file at %ld Hz (%d Hz only)", pHeader->sample_rate, SAMPLE_RATE_HZ);
+        return false;
+    }
+    if (get_loaded_nb_channels(pHeader->nb_channels) != pHeader->nb_channels)
+    {
+        g_hw.PrintLine("Error: stereo ADPCM file and stereo samples disabled");
+        return false;
+    }
+
+    return true;
+}
+
+/* Return the number of words (16 bits) of a compressed file once loaded in RAM. Only the
+   header of the file is read. */
+size_t get_adpcm_file_nb_words(char *file_name)
+{
+    static TAdpcmFileHeader header;
+
+    if (read_adpcm_file_header(file_name, &header) == false)
+    {
+        return 0;
+    }
+
+    return header.nb_blocks * ADPCM_BLOCK_SIZE_WORD * header.nb_channels;
+}
+
+/* Read the format of a compressed file: set the number of samples (once decoded), the number of 
+   channels and the compressed flag of pSound. The blocks follow the header of the file 
+   (TAdpcmFileHeader), they are copied as they are in RAM (see start_note_load in main.cpp).
+   Return the number of words of the blocks (0 if the file is invalid). */
+size_t read_adpcm_file_format(char *file_name, TSoundData *pSound)
+{
+    static TAdpcmFileHeader header;
+
+    pSound->nb_samples  = 0;
+    pSound->nb_channels = 1;
+
+    if (read_adpcm_file_header(file_name, &header) == false)
+    {
+        return 0;
+    }
+
+    pSound->nb_channels = header.nb_channels;
+    pSound->nb_samples  = header.nb_frames * header.nb_channels;
+    pSound->compressed  = true;
+
+    return header.nb_blocks * ADPCM_BLOCK_SIZE_WORD * header.nb_channels;
+}
+
+/* Encode nb_frames frames (interleaved samples) in data (same format as the compressed files,
+   without header). The step index is kept from one block to the next (the step index of the 
+   first block is searched).
+   Return the number of words written. */
+size_t encode_adpcm(const int16_t *samples, size_t nb_frames, uint8_t nb_channels, int16_t *data)
+{
+    uint8_t *block = (uint8_t *)data;
+    uint8_t *codes;
+    int32_t predictor[2] = {0, 0};
+    int32_t step_index[2] = {0, 0};
+    size_t nb_blocks = (nb_frames + ADPCM_BLOCK_NB_FRAMES - 1) / ADPCM_BLOCK_NB_FRAMES;
+    size_t code_idx;
+    uint8_t code;
+
+    memset(data, 0, nb_blocks * ADPCM_BLOCK_SIZE_BYTES * nb_channels);
+    for (uint8_t channel = 0; channel < nb_channels; channel++)
+    {
+        step_index[channel] = find_adpcm_first_step_index(samples, nb_frames, nb_channels, channel);
+    }
+
+    for (size_t frame = 0; frame < nb_frames; frame++)
+    {
+        if (frame % ADPCM_BLOCK_NB_FRAMES == 0)
+        {
+            if (frame != 0)
+            {
+                block += ADPCM_BLOCK_SIZE_BYTES * nb_channels;
+            }
+            codes = &block[ADPCM_BLOCK_HEADER_SIZE * nb_channels];
+            code_idx = 0;
+
+            for (uint8_t channel = 0; channel < nb_channels; channel++)
+            {
+                predictor[channel] = samples[frame * nb_channels + channel];
+                block[ADPCM_BLOCK_HEADER_SIZE * channel]     = (uint8_t)(predictor[channel] & 0xFF);
+                block[ADPCM_BLOCK_HEADER_SIZE * channel + 1] = (uint8_t)((predictor[channel] >> 8) & 0xFF);
+                block[ADPCM_BLOCK_HEADER_SIZE * channel + 2] = (uint8_t)step_index[channel];
+            }
+            continue;
+        }
+
+        for (uint8_t channel = 0; channel < nb_channels; channel++)
+        {
+            code = encode_adpcm_sample(samples[frame * nb_channels + channel],
+                                       &predictor[channel], &step_index[channel]);
+            codes[code_idx >> 1] |= code << ((code_idx & 1) * 4);
+            code_idx++;
+        }
+    }
+
+    return nb_blocks * ADPCM_BLOCK_SIZE_WORD * nb_channels;
+}
+
+/* Decode nb_frames frames of compressed data (without header) in samples (interleaved). */
+void decode_adpcm(const int16_t *data, size_t nb_frames, uint8_t nb_channels, int16_t *samples)
+{
+    const uint8_t *block = (const uint8_t *)data;
+    int32_t predictor[2];
+    int32_t step_index[2];
+    size_t nb_block_frames;
+
+    for (size_t frame = 0; frame < nb_frames; frame += ADPCM_BLOCK_NB_FRAMES)
+    {
+        nb_block_frames = nb_frames - frame;
+        if (nb_block_frames > ADPCM_BLOCK_NB_FRAMES)
+        {
+            nb_block_frames = ADPCM_BLOCK_NB_FRAMES;
+        }
+
+        read_adpcm_block_header(block, nb_channels, predictor, step_index);
+        for (uint8_t channel = 0; channel < nb_channels; channel++)
+        {
+            samples[frame * nb_channels + channel] = (int16_t)predictor[channel];
+        }
+        decode_adpcm_frames(block, nb_channels, 1, nb_block_frames, predictor, step_index,
+                            &samples[(frame + 1) * nb_channels]);
+
+        block += ADPCM_BLOCK_SIZE_BYTES * nb_channels;
+    }
+}
+
+/* Start decoding a sound in the decoder of a voice (called by the audio callback). */
+void start_adpcm_decoder(uint16_t decoder_idx, const TSoundData *pSound)
+{
+    TAdpcmDecoder *pDecoder = &g_adpcm_decoders[decoder_idx];
+
+    pDecoder->data             = (const uint8_t *)&g_sample_data[pSound->first_sample_pos];
+    pDecoder->nb_channels      = pSound->nb_channels;
+    pDecoder->nb_frames        = pSound->nb_samples / pSound->nb_channels;
+    pDecoder->first_sample_pos = pSound->first_sample_pos;
+    pDecoder->block_idx        = ADPCM_NO_BLOCK;
+}
+
+/* Return the decoded samples at position sample_pos of the sound of a decoder and in
+   p_nb_frames the number of contiguous frames decoded from this position (called by the audio
+   callback). */
+const int16_t *get_adpcm_samples(uint16_t decoder_idx, size_t sample_pos, size_t *p_nb_frames)
+{
+    TAdpcmDecoder *pDecoder = &g_adpcm_decoders[decoder_idx];
+    uint8_t nb_channels = pDecoder->nb_channels;
+    uint32_t frame = (sample_pos - pDecoder->first_sample_pos) / nb_channels;
+    uint32_t block_idx = frame / ADPCM_BLOCK_NB_FRAMES;
+    uint32_t block_frame = frame - block_idx * ADPCM_BLOCK_NB_FRAMES;
+    const uint8_t *block;
+    uint32_t nb_needed_frames;
+
+    // New block: the first frame is in the block header.
+    if (block_idx != pDecoder->block_idx)
+    {
+        block = &pDecoder->data[block_idx * ADPCM_BLOCK_SIZE_BYTES * nb_channels];
+        read_adpcm_block_header(block, nb_channels, pDecoder->predictor, pDecoder->step_index);
+        for (uint8_t channel = 0; channel < nb_channels; channel++)
+        {
+            pDecoder->window[channel] = (int16_t)pDecoder->predictor[channel];
+        }
+
+        pDecoder->block_idx         = block_idx;
+        pDecoder->nb_block_frames   = pDecoder->nb_frames - block_idx * ADPCM_BLOCK_NB_FRAMES;
+        if (pDecoder->nb_block_frames > ADPCM_BLOCK_NB_FRAMES)
+        {
+            pDecoder->nb_block_frames = ADPCM_BLOCK_NB_FRAMES;
+        }
+        pDecoder->nb_decoded_frames = 1;
+        pDecoder->nb_window_frames  = 1;
+    }
+
+    nb_needed_frames = block_frame + ADPCM_DECODE_AHEAD_NB_FRAMES;
+    if (nb_needed_frames > pDecoder->nb_block_frames)
+    {
+        nb_needed_frames = pDecoder->nb_block_frames;
+    }
+
+    if (pDecoder->nb_decoded_frames < nb_needed_frames)
+    {
+        block = &pDecoder->data[block_idx * ADPCM_BLOCK_SIZE_BYTES * nb_channels];
+        decode_adpcm_frames(block, nb_channels, pDecoder->nb_decoded_frames, nb_needed_frames,
+                            pDecoder->predictor, pDecoder->step_index,
+                            &pDecoder->window[pDecoder->nb_decoded_frames * nb_channels]);
+        pDecoder->nb_decoded_frames = nb_needed_frames;
+        pDecoder->nb_window_frames  = nb_needed_frames;
+
+        // End of the block: first frame of the next block.
+        if (   (nb_needed_frames == ADPCM_BLOCK_NB_FRAMES)
+            && ((block_idx + 1) * ADPCM_BLOCK_NB_FRAMES < pDecoder->nb_frames))
+        {
+            block += ADPCM_BLOCK_SIZE_BYTES * nb_channels;
+            for (uint8_t channel = 0; channel < nb_channels; channel++)
+            {
+                pDecoder->window[ADPCM_BLOCK_NB_FRAMES * nb_channels + channel] =
+                    (int16_t)(block[ADPCM_BLOCK_HEADER_SIZE * channel] | (block[ADPCM_BLOCK_HEADER_SIZE * channel + 1] << 8));
+            }
+            pDecoder->nb_window_frames++;
+        }
+    }
+
+    *p_nb_frames = pDecoder->nb_window_frames - block_frame;
+
+    return &pDecoder->window[block_frame * nb_channels];
+}
@@ -0,0 +1,61 @@
+/*
+ *  Header file of adpcm.cpp. See this file for more details
+ */
+#ifndef ADPCM
+#define ADPCM
+
+/*************************************************************************************************
+* Includes
+*************************************************************************************************/
+#include "daisy_seed.h"
+#include "common.h"
+#include "audio_engine.h"
+
+/*************************************************************************************************
+* Defines
+*************************************************************************************************/
+// Extension of the compressed files (written by tools/encode_adpcm_bank.py).
+#define ADPCM_FILE_EXTENSION        ".adp"
+#define ADPCM_FILE_MAGIC            "ADPC"
+
+// Blocks: the first frame is stored in the block header, the 504 other frames are 4 bits codes.
+#define ADPCM_BLOCK_NB_FRAMES       505
+#define ADPCM_BLOCK_HEADER_SIZE     4       // Bytes per channel (first sample, step index, 0).
+#define ADPCM_BLOCK_SIZE_BYTES      256     // Bytes per channel.
+#define ADPCM_BLOCK_SIZE_WORD       (ADPCM_BLOCK_SIZE_BYTES / 2)
+
+// Frames decoded ahead of the read position of a voice: the frames read by a render segment
+// (pitch step of 2 at most and interpolation).
+#define ADPCM_DECODE_AHEAD_NB_FRAMES (2 * MAX_RENDER_BLOCK_SIZE + 2)
+
+static_assert(MAX_ROOT_KEY_DISTANCE <= 12, "The pitch step must be 2 at most for the ADPCM decoder");
+
+/*************************************************************************************************
+* Types
+*************************************************************************************************/
+// Header of a compressed file, followed by the blocks.
+typedef struct
+{
+    char magic[4];           // ADPCM_FILE_MAGIC
+    uint8_t nb_channels;     // Number of channels (1: mono, 2: stereo).
+    uint8_t reserved[3];
+    uint32_t sample_rate;    // Sample rate in Hertz (SAMPLE_RATE_HZ only).
+    uint32_t nb_frames;      // Number of frames once decoded.
+    uint32_t nb_blocks;      // Number of blocks (the last block may be incomplete).
+} TAdpcmFileHeader;
+
+/*************************************************************************************************
+* Functions
+*************************************************************************************************/
+// Main loop side
+extern bool is_adpcm_file(const char *file_name);
+extern size_t get_adpcm_file_nb_words(char *file_name);
+extern size_t read_adpcm_file_format(char *file_name, TSoundData *pSound);
+extern size_t encode_adpcm(const int16_t *samples, size_t nb_frames, uint8_t nb_channels, int16_t *data);
+extern void decode_adpcm(const int16_t *data, size_t nb_frames, uint8_t nb_channels, int16_t *samples);
+
+// Audio callback side
+extern void start_adpcm_decoder(uint16_t decoder_idx, const TSoundData *pSound);
+extern const int16_t *get_adpcm_samples(uint16_t decoder_idx, size_t sample_pos, size_t *p_nb_frames);
+
+#endif //#ifndef ADPCM
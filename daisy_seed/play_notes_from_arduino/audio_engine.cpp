@@ -0,0 +1,1344 @@
+/*
+ * This module plays the sounds (notes and special sounds) loaded in g_sample_data.
+ *
+ * The audio callback renders the sounds block by block: each sound playing is rendered over the 
+ * whole block in one tight loop and added to a mix buffer. The wav enveloppe (attack, sustain, 
+ * release) is evaluated once per block and per sound from the tables of envelope.cpp: inside 
+ * the block the amplification is a linear ramp (gain and gain step).
+ *
+ * The voices are mixed at unity gain in fixed point (see mixing_kernel.h). The mix is converted 
+ * to float once per frame and processed by the master bus (headroom gain adapted to the number 
+ * of voices and limiter, see master_bus.cpp).
+ *
+ * The release of the key is managed by a decrease of the signal amplitude (WAV_ENV_END_MS, or 
+ * the release time of the key set by the release file of the sound bank, see envelope.cpp).
+ * To avoid a click sound at the note start (a.k.a. attack) an increase of the signal 
+ * amplitude is added (~10 milliseconds).
+ *
+ * A sound being played is a voice. The number of voices is bounded (MAX_NB_VOICES) to bound the 
+ * duration of the audio callback: when all the voices are playing, a voice is stolen according 
+ * to VOICE_STEALING_POLICY. A stolen voice is not cut, it gets a fast release 
+ * (STOLEN_VOICE_RELEASE_MS) in one of the NB_STOLEN_VOICES extra voices to avoid a click sound.
+ *
+ * A key without samples (sparse multisamples) is played with the samples of the nearest key 
+ * (root key) at another pitch: the read position of the voice is fractional and the samples are 
+ * interpolated (see mixing_kernel.h). The sounds with their own samples are played at the 
+ * original pitch with the non interpolating kernel.
+ *
+ * The notes can have several velocity layers (see load_sound_bank in main.cpp). The layer 
+ * played is selected from the amplification of the note. Between two layers, the two layers 
+ * are crossfaded (equal power): the voice mixes the samples of both layers at the same position.
+ *
+ * The samples are mono or stereo (interleaved left/right, see TSoundData). The mono voices are 
+ * mixed in a mono buffer (same signal on both outputs). The stereo voices are mixed in a left 
+ * and a right buffer, only cleared and added to the output when a stereo voice is playing. The 
+ * notes of a mono bank can be panned by key (constant-power pan, see set_key_pan_width): the 
+ * panned voices are mixed in the left and right buffers.
+ *
+ * The tail of the notes of the sound banks bigger than the RAM is streamed from the SD card 
+ * (see disk_streamer.cpp): a streamed voice reads its head in g_sample_data and its tail in its 
+ * stream buffer. The segments are split so that the frames read are always contiguous.
+ *
+ * The looped notes (loop points of the wav file) are played from the end of the loop back to its 
+ * start until the end of the release: the voice does not end with its samples. The crossfade 
+ * between the end and the start of the loop is applied to the samples at load time.
+ *
+ * The notes compressed in RAM (see adpcm.cpp) are decoded by their voice block by block, a few 
+ * frames ahead of the read position, and read like the streamed tails (contiguous segments).
+ *
+ * The pedal position is continuous (half pedal): the release of the keys up is longer when the 
+ * dampers are partly on the strings, and stops when the pedal goes down again. The damping is 
+ * applied to the voices once per block by the audio callback (see update_damper). The sostenuto
+ * pedal holds the voices whose key is down when it goes down, and the una corda pedal softens the 
+ * notes started while it is down: both are bits of the voice (pedals), set when the pedal moves 
+ * or when the note starts (see apply_pedal).
+ *
+ * The voices are owned by the audio callback. The main loop never modifies them: the note 
+ * starts, key releases and pedal changes are posted in the event queue (see event_queue.cpp) 
+ * and applied by the audio callback.
+ *
+ * A new sound bank is loaded in the slot of g_sound_banks not played, in RAM not used by the 
+ * bank played, while the voices of the bank played go on. The switch to the new bank is an event
+ * too (see switch_sound_bank): the voices of the old bank get a fast release, and the sounds, the
+ * sound map and the envelope of the new bank are used from the next voice started.
+ *
+ * The events are timestamped by the main loop with the sample time (number of frames since the 
+ * startup, see get_sample_time) at the reception of the message. An event is applied 
+ * EVENT_LATENCY_NB_SAMPLES + one block after its timestamp: the block is rendered up to the 
+ * frame of the event, the event is applied, then the rest of the block is rendered. The timing 
+ * of the notes (fast trills, repeated notes) does not depend on the block size or on the 
+ * duration of the message processing.
+ */
+
+/*************************************************************************************************
+* Includes
+*************************************************************************************************/
+#include "daisy_seed.h"
+#include "common.h"
+#include "audio_engine.h"
+#include "mixing_kernel.h"
+#include "master_bus.h"
+#include "event_queue.h"
+#include "disk_streamer.h"
+#include "adpcm.h"
+#include <math.h>
+
+using namespace daisy;
+using namespace daisy::seed;
+
+/*************************************************************************************************
+* Variables
+*************************************************************************************************/
+// Damping of the strings of the keys up (see audio_engine.h).
+uint8_t         g_pedal_damping;
+
+// Define if the sostenuto and una corda pedals are down (bit (1 << e_pedal) of each pedal).
+static uint8_t  g_pedals_down;
+
+// Sample time of the first frame of the current block and time (in microseconds) of the start 
+// of the current block. Used by the main loop to compute the sample time.
+volatile uint32_t g_block_start_frame;
+static volatile uint32_t g_block_start_us;
+
+// Sample time of the first frame of the next block.
+static uint32_t g_next_block_frame;
+
+// Measure of the CPU load of the audio callback.
+static CpuLoadMeter g_cpu_load_meter;
+
+// Voices and indexes of the voices currently playing (see audio_engine.h).
+TVoice          g_voices[NB_VOICES];
+uint16_t        g_active_voices[NB_VOICES];
+volatile size_t g_nb_active_voices;
+
+// Number of active voices in fast release (stolen voices).
+static size_t   g_nb_stolen_voices;
+
+// Last voice started for each sound (NO_VOICE if the sound is not playing).
+static uint16_t g_sound_voices[NB_SOUNDS];
+
+// Samples played for each sound, for the sound bank of each slot and for the sound bank played
+// (see build_sound_map).
+static TSoundMap g_sound_maps[NB_SOUND_BANK_SLOTS][NB_SOUNDS];
+static TSoundMap *g_sound_map = g_sound_maps[0];
+
+// Counter incremented at each voice start (the oldest voice has the lowest start order).
+static uint32_t g_voice_start_counter;
+
+// The voices are summed at unity gain: all the voices at full scale must fit in the guard bits
+// of the mix buffer.
+static_assert(NB_VOICES <= (1L << (31 - MIX_ACC_SHIFT)), "Too many voices for the mix buffer");
+
+// Sum of the mono voices for the current block (fixed point, see mixing_kernel.h).
+static int32_t  g_mix_buffer[MAX_RENDER_BLOCK_SIZE];
+
+// Sum of the stereo and panned voices for the current block (left and right channels) and 
+// define if these buffers are used for the current block.
+static int32_t  g_mix_buffer_left[MAX_RENDER_BLOCK_SIZE];
+static int32_t  g_mix_buffer_right[MAX_RENDER_BLOCK_SIZE];
+static bool     g_stereo_mix;
+
+// Sum of all the voices converted to float and processed by the master bus.
+static float    g_master_buffer_left[MAX_RENDER_BLOCK_SIZE];
+static float    g_master_buffer_right[MAX_RENDER_BLOCK_SIZE];
+
+// Amplification of the left and right channels of each key (mono banks only, see 
+// set_key_pan_width) and define if the keys are panned.
+static float    g_key_pan_left_gains[NB_KEYS];
+static float    g_key_pan_right_gains[NB_KEYS];
+static bool     g_key_pan_enabled;
+
+/*************************************************************************************************
+* Local functions declaration
+*************************************************************************************************/
+static void remove_voice_from_active_list(size_t list_idx);
+static void apply_event(const TEvent *pEvent);
+
+/*************************************************************************************************
+* Functions implementation
+*************************************************************************************************/
+
+/* Compute the amplification of a voice at its current position in the wav enveloppe. */
+static float compute_envelope_gain(TVoice *pVoice)
+{
+    float gain;
+
+    if (pVoice->env_stage == ENV_ATTACK)
+    {
+        gain = envelope_attack_gain(pVoice->env_pos, pVoice->volume);
+    }
+    else if (pVoice->env_stage == ENV_SUSTAIN)
+    {
+        gain = pVoice->volume;
+    }
+    else if (pVoice->env_stage == ENV_RELEASE)
+    {
+        gain = envelope_release_gain(&pVoice->env_release, pVoice->env_pos, pVoice->env_release_level);
+    }
+    else // ENV_FAST_RELEASE
+    {
+        gain =   pVoice->env_release_level 
+               * (1.0f - (float)pVoice->env_pos * (1.0f / STOLEN_VOICE_RELEASE_NB_SAMPLES));
+    }
+
+    return gain;
+}
+
+/* Start the release of a voice from its current amplification. */
+static void start_release(TVoice *pVoice)
+{
+    pVoice->env_release_level = compute_envelope_gain(pVoice);
+    pVoice->env_stage         = ENV_RELEASE;
+    pVoice->env_pos           = 0;
+}
+
+/* Return the number of frames a voice can play reading at most nb_sample_frames frames from its 
+   read position. With a pitch shift, the frame after the read position is read too 
+   (interpolation). */
+static size_t get_nb_playable_frames(const TVoice *pVoice, size_t nb_sample_frames)
+{
+    if (pVoice->pitch_step == MIX_PHASE_UNITY)
+    {
+        return nb_sample_frames;
+    }
+    if (nb_sample_frames <= 1)
+    {
+        return 0;
+    }
+
+    // Number of frames whose read position is before the last frame.
+    return (size_t)(  (((uint64_t)(nb_sample_frames - 1) << MIX_PHASE_SHIFT) 
+                       - pVoice->pos_frac + pVoice->pitch_step - 1) 
+                    / pVoice->pitch_step);
+}
+
+/* Return the number of frames a voice can still play before the end of its samples, or before 
+   the end of the loop for a looped voice (the frame at the end of the loop can be read by the 
+   interpolation). */
+static size_t get_nb_remaining_frames(const TVoice *pVoice)
+{
+    if (pVoice->looped == true)
+    {
+        if (pVoice->cur_playing_pos >= pVoice->loop_end_pos)
+        {
+            return 0;
+        }
+        if (pVoice->pitch_step == MIX_PHASE_UNITY)
+        {
+            return (pVoice->loop_end_pos - pVoice->cur_playing_pos) / pVoice->nb_channels;
+        }
+        return get_nb_playable_frames(pVoice, (pVoice->loop_end_pos - pVoice->cur_playing_pos) / pVoice->nb_channels + 1);
+    }
+
+    return get_nb_playable_frames(pVoice, (pVoice->last_sample_pos - pVoice->cur_playing_pos) / pVoice->nb_channels);
+}
+
+/* Update the release of a voice whose key is up from the damping of the pedal (once per block):
+   - Damping 0 (pedal down): no release. A damped release is stopped, the voice keeps its 
+     current amplification (the dampers leave the strings again).
+   - Damping > 0 (half pedal or pedal up): release PEDAL_NB_DAMPING_LEVELS / damping times 
+     longer than the release of the key (ending before the end of the samples). A change of 
+     damping restarts the release from the current amplification.
+   A voice held by the sostenuto pedal is not damped.
+   The release of a stolen voice and the release at the end of the samples are not changed. */
+static void update_damper(TVoice *pVoice)
+{
+    uint64_t release_nb_samples;
+    size_t nb_remaining_frames;
+    uint8_t damping = ((pVoice->pedals & VOICE_PEDAL_SOSTENUTO) != 0) ? 0 : g_pedal_damping;
+
+    if (   (pVoice->env_stage == ENV_FAST_RELEASE)
+        || ((pVoice->env_stage == ENV_RELEASE) && (pVoice->damping == 0))
+        || (pVoice->damping == damping))
+    {
+        return;
+    }
+
+    if (damping == 0)
+    {
+        // Damped release stopped.
+        pVoice->volume    = compute_envelope_gain(pVoice);
+        pVoice->env_stage = ENV_SUSTAIN;
+        pVoice->env_pos   = 0;
+        pVoice->damping   = 0;
+        set_release_time(&pVoice->env_release, pVoice->key_release_nb_samples);
+        return;
+    }
+
+    release_nb_samples =   (uint64_t)pVoice->key_release_nb_samples * PEDAL_NB_DAMPING_LEVELS 
+                         / damping;
+    if (pVoice->looped == false)
+    {
+        nb_remaining_frames = get_nb_remaining_frames(pVoice);
+        if (release_nb_samples > nb_remaining_frames)
+        {
+            release_nb_samples = nb_remaining_frames;
+        }
+    }
+
+    start_release(pVoice);
+    set_release_time(&pVoice->env_release, (uint32_t)release_nb_samples);
+    pVoice->damping = damping;
+}
+
+/* Return the samples of a voice at its read position. For a streamed or compressed voice, the 
+   number of contiguous frames that can be read from the returned pointer is set in p_nb_frames,
+   and NULL is returned when the frames of the tail are not loaded yet. */
+static const int16_t *get_voice_samples(const TVoice *pVoice, size_t *p_nb_frames)
+{
+    *p_nb_frames = 0;
+
+    if (pVoice->compressed == true)
+    {
+        return get_adpcm_samples((uint16_t)(pVoice - g_voices), pVoice->cur_playing_pos, p_nb_frames);
+    }
+    if (pVoice->streamed == false)
+    {
+        return &g_sample_data[pVoice->cur_playing_pos];
+    }
+
+    // Head: the frames after the head are loaded in RAM too (guard frames).
+    if (pVoice->cur_playing_pos < pVoice->head_end_pos)
+    {
+        *p_nb_frames =   (pVoice->head_end_pos - pVoice->cur_playing_pos) / pVoice->nb_channels 
+                       + STREAM_GUARD_NB_FRAMES;
+        return &g_sample_data[pVoice->cur_playing_pos];
+    }
+
+    return get_stream_samples((uint16_t)(pVoice - g_voices), 
+                              (pVoice->cur_playing_pos - pVoice->head_end_pos) / pVoice->nb_channels, 
+                              p_nb_frames);
+}
+
+/* Mix nb_frames mono samples of a voice in a mix buffer with a linear gain ramp. 
+   Return the read phase after the last frame (relatively to samples). */
+static uint32_t mix_mono_samples(const TVoice *pVoice, int32_t *mix, const int16_t *samples, 
+                                 size_t nb_frames, float gain, float gain_step)
+{
+    if (pVoice->pitch_step == MIX_PHASE_UNITY)
+    {
+        mix_samples_q(mix, samples, nb_frames, mix_gain_to_q(gain), mix_gain_to_q(gain_step));
+
+        return nb_frames << MIX_PHASE_SHIFT;
+    }
+
+    return mix_samples_q_interp(mix, samples, nb_frames, mix_gain_to_q(gain), 
+                                mix_gain_to_q(gain_step), pVoice->pos_frac, pVoice->pitch_step);
+}
+
+/* Mix nb_frames frames of a voice from samples with a linear gain ramp, at frame first_frame 
+   of the mix buffers. Return the read phase after the last frame (relatively to samples). */
+static uint32_t mix_voice_samples(const TVoice *pVoice, size_t first_frame, const int16_t *samples, 
+                                  size_t nb_frames, float gain, float gain_step)
+{
+    uint32_t phase;
+
+    if (pVoice->nb_channels == 2)
+    {
+        if (pVoice->pitch_step == MIX_PHASE_UNITY)
+        {
+            mix_samples_q_stereo(&g_mix_buffer_left[first_frame], &g_mix_buffer_right[first_frame], 
+                                 samples, nb_frames, mix_gain_to_q(gain), mix_gain_to_q(gain_step));
+
+            phase = nb_frames << MIX_PHASE_SHIFT;
+        }
+        else
+        {
+            phase = mix_samples_q_interp_stereo(&g_mix_buffer_left[first_frame], &g_mix_buffer_right[first_frame], 
+                                                samples, nb_frames, mix_gain_to_q(gain), mix_gain_to_q(gain_step), 
+                                                pVoice->pos_frac, pVoice->pitch_step);
+        }
+    }
+    else if (pVoice->panned == true)
+    {
+        mix_mono_samples(pVoice, &g_mix_buffer_left[first_frame], samples, nb_frames, 
+                         gain * pVoice->pan_left_gain, gain_step * pVoice->pan_left_gain);
+        phase = mix_mono_samples(pVoice, &g_mix_buffer_right[first_frame], samples, nb_frames, 
+                                 gain * pVoice->pan_right_gain, gain_step * pVoice->pan_right_gain);
+    }
+    else
+    {
+        phase = mix_mono_samples(pVoice, &g_mix_buffer[first_frame], samples, nb_frames, gain, gain_step);
+    }
+
+    return phase;
+}
+
+/* Render nb_frames frames of a voice and add them to the mix buffers.
+   The block is split in segments where the amplification is a linear ramp. A new segment
+   starts at each change of enveloppe stage and at each point of the enveloppe tables.
+   Return false when the voice has ended (end of the release). */
+static bool render_voice(TVoice *pVoice, size_t nb_frames)
+{
+    size_t frame_idx = 0;
+    size_t nb_seg_frames;
+    size_t nb_remaining_frames;
+    size_t nb_sample_frames;
+    size_t nb_playable_frames;
+    const int16_t *samples;
+    uint32_t phase;
+    float gain = 0.0f;
+    float gain_step = 0.0f;
+
+    // The release of a key up depends on the damping of the pedal.
+    if (pVoice->key_up == true)
+    {
+        update_damper(pVoice);
+    }
+
+    // The left and right buffers are cleared by the first stereo or panned voice of the block.
+    if (((pVoice->nb_channels == 2) || (pVoice->panned == true)) && (g_stereo_mix == false))
+    {
+        memset(g_mix_buffer_left, 0, nb_frames * sizeof(int32_t));
+        memset(g_mix_buffer_right, 0, nb_frames * sizeof(int32_t));
+        g_stereo_mix = true;
+    }
+
+    while (frame_idx < nb_frames)
+    {
+        nb_seg_frames = nb_frames - frame_idx;
+        nb_remaining_frames = get_nb_remaining_frames(pVoice);
+
+        if (pVoice->looped == true)
+        {
+            // End of the loop: back to the start of the loop (same fraction of position).
+            if (nb_remaining_frames == 0)
+            {
+                pVoice->cur_playing_pos -= pVoice->loop_end_pos - pVoice->loop_start_pos;
+                continue;
+            }
+            if (nb_seg_frames > nb_remaining_frames)
+            {
+                nb_seg_frames = nb_remaining_frames;
+            }
+        }
+        else if (pVoice->env_stage < ENV_RELEASE)
+        {
+            // Before the note end, we simulate a normal release to avoid a click sound.
+            if (nb_remaining_frames <= pVoice->env_release.nb_samples)
+            {
+                pVoice->damping = 0;
+                start_release(pVoice);
+                continue;
+            }
+            if (nb_seg_frames > nb_remaining_frames - pVoice->env_release.nb_samples)
+            {
+                nb_seg_frames = nb_remaining_frames - pVoice->env_release.nb_samples;
+            }
+        }
+        else if (nb_remaining_frames == 0)
+        {
+            // End of the note.
+            return false;
+        }
+        else if (nb_seg_frames > nb_remaining_frames)
+        {
+            nb_seg_frames = nb_remaining_frames;
+        }
+
+        if (pVoice->env_stage == ENV_ATTACK)
+        {
+            // The attack factor avoids a tick sound at the note start.
+            if (pVoice->env_pos >= WAV_ENV_START_NB_SAMPLES)
+            {
+                pVoice->env_stage = ENV_SUSTAIN;
+                pVoice->env_pos   = 0;
+                continue;
+            }
+            if (nb_seg_frames > WAV_ENV_START_NB_SAMPLES - pVoice->env_pos)
+            {
+                nb_seg_frames = WAV_ENV_START_NB_SAMPLES - pVoice->env_pos;
+            }
+            nb_seg_frames = envelope_attack_ramp(pVoice->env_pos, pVoice->volume, nb_seg_frames, 
+                                                 &gain, &gain_step);
+        }
+        else if (pVoice->env_stage == ENV_SUSTAIN)
+        {
+            gain      = pVoice->volume;
+            gain_step = 0.0f;
+        }
+        else if (pVoice->env_stage == ENV_RELEASE)
+        {
+            // End of the release.
+            if (pVoice->env_pos >= pVoice->env_release.nb_samples)
+            {
+                return false;
+            }
+            if (nb_seg_frames > pVoice->env_release.nb_samples - pVoice->env_pos)
+            {
+                nb_seg_frames = pVoice->env_release.nb_samples - pVoice->env_pos;
+            }
+            nb_seg_frames = envelope_release_ramp(&pVoice->env_release, pVoice->env_pos, 
+                                                  pVoice->env_release_level, nb_seg_frames, 
+                                                  &gain, &gain_step);
+        }
+        else // ENV_FAST_RELEASE
+        {
+            // End of the release of a stolen voice.
+            if (pVoice->env_pos >= STOLEN_VOICE_RELEASE_NB_SAMPLES)
+            {
+                return false;
+            }
+            if (nb_seg_frames > STOLEN_VOICE_RELEASE_NB_SAMPLES - pVoice->env_pos)
+            {
+                nb_seg_frames = STOLEN_VOICE_RELEASE_NB_SAMPLES - pVoice->env_pos;
+            }
+            gain      = compute_envelope_gain(pVoice);
+            gain_step = -pVoice->env_release_level * (1.0f / STOLEN_VOICE_RELEASE_NB_SAMPLES);
+        }
+
+        // The frames read by the segment of a streamed or compressed voice must be contiguous 
+        // and loaded (or decoded).
+        samples = get_voice_samples(pVoice, &nb_sample_frames);
+        nb_playable_frames = nb_seg_frames;
+        if ((pVoice->streamed == true) || (pVoice->compressed == true))
+        {
+            nb_playable_frames = (samples == NULL) ? 0 : get_nb_playable_frames(pVoice, nb_sample_frames);
+            if (nb_playable_frames > 0)
+            {
+                if (nb_seg_frames > nb_playable_frames)
+                {
+                    nb_seg_frames = nb_playable_frames;
+                }
+            }
+            else
+            {
+                g_nb_stream_underruns = g_nb_stream_underruns + 1;
+            }
+        }
+
+        // Tight loop over the segment (silent segment when the frames are not loaded).
+        if (nb_playable_frames == 0)
+        {
+            phase = pVoice->pos_frac + nb_seg_frames * pVoice->pitch_step;
+        }
+        else if (pVoice->xfade == false)
+        {
+            phase = mix_voice_samples(pVoice, frame_idx, samples, nb_seg_frames, gain, gain_step);
+        }
+        else
+        {
+            mix_voice_samples(pVoice, frame_idx, samples + pVoice->xfade_offset, nb_seg_frames, 
+                              gain * pVoice->xfade_high_gain, gain_step * pVoice->xfade_high_gain);
+            phase = mix_voice_samples(pVoice, frame_idx, samples, nb_seg_frames, 
+                                      gain * pVoice->xfade_low_gain, gain_step * pVoice->xfade_low_gain);
+        }
+        pVoice->cur_playing_pos += (phase >> MIX_PHASE_SHIFT) * pVoice->nb_channels;
+        pVoice->pos_frac         = phase & MIX_PHASE_FRAC_MASK;
+        pVoice->env_pos         += nb_seg_frames;
+        frame_idx               += nb_seg_frames;
+    }
+
+    // Amplification reached at the end of the block (used to find the quietest voice).
+    pVoice->cur_gain = gain + gain_step * (float)nb_seg_frames;
+
+    if (pVoice->streamed == true)
+    {
+        set_stream_read_frame((uint16_t)(pVoice - g_voices), 
+                              (int32_t)((ptrdiff_t)pVoice->cur_playing_pos - (ptrdiff_t)pVoice->head_end_pos) 
+                              / pVoice->nb_channels);
+    }
+
+    return true;
+}
+
+/* Render all the voices playing over nb_frames frames (nb_frames <= MAX_RENDER_BLOCK_SIZE) 
+   in the mix buffers. */
+static void render_all_voices(size_t nb_frames)
+{
+    size_t list_idx;
+
+    memset(g_mix_buffer, 0, nb_frames * sizeof(int32_t));
+    g_stereo_mix = false;
+
+    // The list index is incremented only if the current voice is not removed from the list.
+    list_idx = 0;
+    while (list_idx < g_nb_active_voices)
+    {
+        if (render_voice(&g_voices[g_active_voices[list_idx]], nb_frames) == false)
+        {
+            // End of the release or end of the note.
+            remove_voice_from_active_list(list_idx);
+        }
+        else
+        {
+            list_idx++;
+        }
+    }
+}
+
+/* Render nb_frames frames of the output block from frame first_block_frame. */
+static void render_frames(AudioHandle::InterleavingOutputBuffer out, 
+                          size_t first_block_frame, size_t nb_frames)
+{
+    size_t nb_part_frames;
+
+    // The frames are rendered in parts of at most MAX_RENDER_BLOCK_SIZE frames.
+    for (size_t first_frame = first_block_frame; 
+         first_frame < first_block_frame + nb_frames; 
+         first_frame += nb_part_frames)
+    {
+        nb_part_frames = first_block_frame + nb_frames - first_frame;
+        if (nb_part_frames > MAX_RENDER_BLOCK_SIZE)
+        {
+            nb_part_frames = MAX_RENDER_BLOCK_SIZE;
+        }
+
+        render_all_voices(nb_part_frames);
+
+        for (size_t frame_idx = 0; frame_idx < nb_part_frames; frame_idx++)
+        {
+            g_master_buffer_left[frame_idx]  = mix_acc_to_float(g_mix_buffer[frame_idx]);
+            g_master_buffer_right[frame_idx] = g_master_buffer_left[frame_idx];
+        }
+
+        if (g_stereo_mix == true)
+        {
+            for (size_t frame_idx = 0; frame_idx < nb_part_frames; frame_idx++)
+            {
+                g_master_buffer_left[frame_idx]  += mix_acc_to_float(g_mix_buffer_left[frame_idx]);
+                g_master_buffer_right[frame_idx] += mix_acc_to_float(g_mix_buffer_right[frame_idx]);
+            }
+        }
+
+        process_master_bus(g_master_buffer_left, g_master_buffer_right, nb_part_frames, g_nb_active_voices);
+
+        for (size_t frame_idx = 0; frame_idx < nb_part_frames; frame_idx++)
+        {
+            // Left signal out
+            out[2 * (first_frame + frame_idx)]     = g_master_buffer_left[frame_idx];
+
+            // Right signal out
+            out[2 * (first_frame + frame_idx) + 1] = g_master_buffer_right[frame_idx];
+        }
+    }
+}
+
+/* Return the offset (in frames from the start of the current block) of the frame where an event 
+   must be applied. An event timestamped before the start of the audio callback or too late is 
+   applied at the start of the block. */
+static int32_t get_event_offset(const TEvent *pEvent, size_t nb_frames)
+{
+    int32_t offset = (int32_t)(  pEvent->timestamp + EVENT_LATENCY_NB_SAMPLES + nb_frames 
+                               - g_block_start_frame);
+
+    if ((offset < 0) || (offset > (int32_t)(EVENT_LATENCY_NB_SAMPLES + 2 * nb_frames)))
+    {
+        offset = 0;
+    }
+
+    return offset;
+}
+
+/* Audio call back function */
+void AudioCallback(AudioHandle::InterleavingInputBuffer in,
+                   AudioHandle::InterleavingOutputBuffer out,
+                   size_t                                size)
+{
+    size_t nb_frames = size / 2;
+    size_t cur_frame = 0;
+    int32_t event_offset;
+    TEvent event;
+
+    g_cpu_load_meter.OnBlockStart();
+
+    g_block_start_frame = g_next_block_frame;
+    g_block_start_us    = System::GetUs();
+    g_next_block_frame += nb_frames;
+
+    // Apply the events of this block at their frame: the block is rendered up to the frame of 
+    // each event. The events of the next blocks stay in the queue.
+    while (peek_event(&event) == true)
+    {
+        event_offset = get_event_offset(&event, nb_frames);
+        if (event_offset >= (int32_t)nb_frames)
+        {
+            break;
+        }
+
+        if (event_offset > (int32_t)cur_frame)
+        {
+            render_frames(out, cur_frame, event_offset - cur_frame);
+            cur_frame = event_offset;
+        }
+
+        apply_event(&event);
+        pop_event(&event);
+    }
+
+    render_frames(out, cur_frame, nb_frames - cur_frame);
+
+    g_cpu_load_meter.OnBlockEnd();
+}
+
+/* Start the audio callback with block_size frames per callback. */
+void start_audio(size_t block_size)
+{
+    // The samples are resampled to SAMPLE_RATE_HZ when they are loaded.
+    static_assert(SAMPLE_RATE_HZ == 48000, "SAMPLE_RATE_HZ must be the rate of the SAI");
+
+    g_hw.SetAudioBlockSize(block_size);
+    g_hw.SetAudioSampleRate(SaiHandle::Config::SampleRate::SAI_48KHZ);
+    g_cpu_load_meter.Init(g_hw.AudioSampleRate(), block_size);
+    g_hw.StartAudio(AudioCallback);
+}
+
+/* Stop the audio callback. */
+void stop_audio(void)
+{
+    g_hw.StopAudio();
+}
+
+/* Display the CPU load of the audio callback since the last call and the theoretical latency
+   of the current block size:
+   - Output latency: a block is output while the next one is rendered (DMA double buffering).
+   - Note latency: an event is applied EVENT_LATENCY_NB_SAMPLES + one block after its 
+     timestamp, in a block output one block later. */
+void display_audio_load(void)
+{
+    size_t block_size = g_hw.AudioBlockSize();
+    float output_latency_ms = (2.0f * block_size * 1000.0f) / SAMPLE_RATE_HZ;
+    float note_latency_ms = EVENT_LATENCY_MS + output_latency_ms;
+
+    g_hw.Print("AUDIO block_size=%d", block_size);
+    g_hw.Print(" cpu_avg="FLT_FMT3"%%", FLT_VAR3(100.0f * g_cpu_load_meter.GetAvgCpuLoad()));
+    g_hw.Print(" cpu_max="FLT_FMT3"%%", FLT_VAR3(100.0f * g_cpu_load_meter.GetMaxCpuLoad()));
+    g_hw.Print(" output_latency="FLT_FMT3"ms", FLT_VAR3(output_latency_ms));
+    g_hw.PrintLine(" note_latency="FLT_FMT3"ms", FLT_VAR3(note_latency_ms));
+
+    g_cpu_load_meter.Reset();
+}
+
+/* Return the current sample time: number of frames since the startup. Between two audio 
+   callbacks, the sample time is estimated with the microseconds counter. Used by the main loop 
+   to timestamp the events. */
+uint32_t get_sample_time(void)
+{
+    uint32_t block_start_frame;
+    uint32_t block_start_us;
+
+    // AudioCallback can modify the start of the block between the two readings.
+    do
+    {
+        block_start_frame = g_block_start_frame;
+        block_start_us    = g_block_start_us;
+    } while (block_start_frame != g_block_start_frame);
+
+    return   block_start_frame 
+           + (uint32_t)(((uint64_t)(System::GetUs() - block_start_us) * SAMPLE_RATE_HZ) / 1000000);
+}
+
+/* Remove the voice at index list_idx from the list of voices rendered by AudioCallback.
+   The last voice of the list is moved at list_idx (the order of the list does not matter). */
+static void remove_voice_from_active_list(size_t list_idx)
+{
+    size_t last_idx = g_nb_active_voices - 1;
+    uint16_t voice_idx = g_active_voices[list_idx];
+    TVoice *pVoice = &g_voices[voice_idx];
+
+    if (g_sound_voices[pVoice->sound_idx] == voice_idx)
+    {
+        g_sound_voices[pVoice->sound_idx] = NO_VOICE;
+    }
+    if (pVoice->env_stage == ENV_FAST_RELEASE)
+    {
+        g_nb_stolen_voices--;
+    }
+    if (pVoice->streamed == true)
+    {
+        stop_stream(voice_idx);
+    }
+
+    // The removed voice index is kept after the last valid element (free voice).
+    g_active_voices[list_idx] = g_active_voices[last_idx];
+    g_active_voices[last_idx] = voice_idx;
+    g_nb_active_voices = last_idx;
+}
+
+/* Steal a voice: start a fast release from its current amplification. */
+static void steal_voice(TVoice *pVoice)
+{
+    pVoice->env_release_level = compute_envelope_gain(pVoice);
+    pVoice->env_stage         = ENV_FAST_RELEASE;
+    pVoice->env_pos           = 0;
+
+    if (g_sound_voices[pVoice->sound_idx] == (uint16_t)(pVoice - g_voices))
+    {
+        g_sound_voices[pVoice->sound_idx] = NO_VOICE;
+    }
+    g_nb_stolen_voices++;
+}
+
+/* Find the voice to steal according to the stealing policy (among the voices not already 
+   stolen). Return the index of the voice in the list of active voices. */
+static size_t find_voice_to_steal(void)
+{
+    size_t found_list_idx = 0;
+    bool found = false;
+    TVoice *pVoice;
+    TVoice *pFoundVoice = NULL;
+
+    for (size_t list_idx = 0; list_idx < g_nb_active_voices; list_idx++)
+    {
+        pVoice = &g_voices[g_active_voices[list_idx]];
+
+        if (pVoice->env_stage == ENV_FAST_RELEASE)
+        {
+            continue;
+        }
+
+        #if (VOICE_STEALING_POLICY == VOICE_STEALING_QUIETEST)
+            found = (pFoundVoice == NULL) || (pVoice->cur_gain < pFoundVoice->cur_gain);
+        #else
+            found = (pFoundVoice == NULL) || (pVoice->start_order < pFoundVoice->start_order);
+        #endif
+
+        if (found == true)
+        {
+            pFoundVoice = pVoice;
+            found_list_idx = list_idx;
+        }
+    }
+
+    return found_list_idx;
+}
+
+/* Find a free voice. If all the voices are used (many voices stolen at once), the quietest 
+   stolen voice is stopped immediately. Return the index of the free voice in g_voices. */
+static uint16_t get_free_voice(void)
+{
+    size_t found_list_idx = NB_VOICES;
+    TVoice *pVoice;
+
+    if (g_nb_active_voices >= NB_VOICES)
+    {
+        for (size_t list_idx = 0; list_idx < g_nb_active_voices; list_idx++)
+        {
+            pVoice = &g_voices[g_active_voices[list_idx]];
+
+            if (   (pVoice->env_stage == ENV_FAST_RELEASE)
+                && (   (found_list_idx == NB_VOICES)
+                    || (pVoice->cur_gain < g_voices[g_active_voices[found_list_idx]].cur_gain)))
+            {
+                found_list_idx = list_idx;
+            }
+        }
+        remove_voice_from_active_list(found_list_idx);
+    }
+
+    // The free voices are stored after the active voices in g_active_voices.
+    return g_active_voices[g_nb_active_voices];
+}
+
+/* Return the index in g_sounds of the samples of a velocity layer of a sound. 
+   The special sounds have one layer. */
+static uint16_t get_layer_sound_idx(uint16_t sound_idx, uint8_t layer_idx)
+{
+    if (sound_idx < NB_SPECIAL_SOUNDS)
+    {
+        return sound_idx;
+    }
+
+    return sound_idx + layer_idx * NB_KEYS;
+}
+
+/* Select the velocity layers played by a voice from the amplification of the note and set the 
+   positions of the samples played. Layer k is centered on the amplification 
+   (k + 0.5) / g_nb_velocity_layers. Between two layers, the two layers are crossfaded over 
+   VELOCITY_XFADE_WIDTH of a layer (not when the layers are streamed or compressed: one stream 
+   and one decoder per voice, nor when they are looped: loops of different lengths).
+   Return the index in g_sounds of the samples of the lower layer. */
+static uint16_t select_velocity_layers(TVoice *pVoice, float amplification)
+{
+    float layer_pos = amplification * (float)g_nb_velocity_layers - 0.5f;
+    uint8_t low_layer_idx = 0;
+    float xfade = 0.0f;
+    const TSoundData *pLowSound;
+    const TSoundData *pHighSound;
+
+    if (layer_pos >= (float)(g_nb_velocity_layers - 1))
+    {
+        low_layer_idx = g_nb_velocity_layers - 1;
+    }
+    else if (layer_pos > 0.0f)
+    {
+        low_layer_idx = (uint8_t)layer_pos;
+
+        #if (ENABLE_VELOCITY_XFADE == 1)
+            xfade = (layer_pos - (float)low_layer_idx - 0.5f) / VELOCITY_XFADE_WIDTH + 0.5f;
+        #else
+            xfade = (layer_pos - (float)low_layer_idx >= 0.5f) ? 1.0f : 0.0f;
+        #endif
+
+        if (xfade >= 1.0f)
+        {
+            low_layer_idx++;
+            xfade = 0.0f;
+        }
+    }
+
+    // A layer without samples for this sound is replaced by the layer below.
+    while ((low_layer_idx > 0) && (g_sounds[get_layer_sound_idx(pVoice->root_sound_idx, low_layer_idx)].nb_samples == 0))
+    {
+        low_layer_idx--;
+    }
+
+    pLowSound = &g_sounds[get_layer_sound_idx(pVoice->root_sound_idx, low_layer_idx)];
+    pVoice->cur_playing_pos = pLowSound->first_sample_pos;
+    pVoice->last_sample_pos = pLowSound->last_sample_pos;
+    pVoice->nb_channels     = (pLowSound->nb_channels == 2) ? 2 : 1;
+    pVoice->streamed        = (pLowSound->nb_head_samples != 0);
+    pVoice->head_end_pos    = pLowSound->first_sample_pos + pLowSound->nb_head_samples;
+    pVoice->compressed      = pLowSound->compressed;
+    pVoice->looped          = pLowSound->looped;
+    pVoice->loop_start_pos  = pLowSound->loop_start_pos;
+    pVoice->loop_end_pos    = pLowSound->loop_end_pos;
+    pVoice->xfade           = false;
+
+    if ((xfade > 0.0f) && (low_layer_idx + 1 < g_nb_velocity_layers))
+    {
+        pHighSound = &g_sounds[get_layer_sound_idx(pVoice->root_sound_idx, low_layer_idx + 1)];
+
+        // The two layers are mixed with the same kernel: same number of channels.
+        if (   (pHighSound->nb_samples != 0) && (pHighSound->nb_channels == pLowSound->nb_channels)
+            && (pLowSound->nb_head_samples == 0) && (pHighSound->nb_head_samples == 0)
+            && (pLowSound->compressed == false) && (pHighSound->compressed == false)
+            && (pLowSound->looped == false) && (pHighSound->looped == false))
+        {
+            // The voice ends with the shortest layer.
+            if (pHighSound->nb_samples < pLowSound->nb_samples)
+            {
+                pVoice->last_sample_pos = pLowSound->first_sample_pos + pHighSound->nb_samples;
+            }
+
+            pVoice->xfade           = true;
+            pVoice->xfade_offset    = (ptrdiff_t)pHighSound->first_sample_pos - (ptrdiff_t)pLowSound->first_sample_pos;
+            pVoice->xfade_low_gain  = cosf(xfade * (float)M_PI / 2.0f);
+            pVoice->xfade_high_gain = sinf(xfade * (float)M_PI / 2.0f);
+        }
+    }
+
+    return (uint16_t)(pLowSound - g_sounds);
+}
+
+/* Shorten the release of a voice longer than WAV_ENV_END_MS to half the duration of its samples
+   at most: the release before the end of the samples must not start during the attack. */
+static void limit_release_time(TVoice *pVoice)
+{
+    uint64_t nb_voice_frames;
+
+    if (   (pVoice->looped == true)
+        || (pVoice->env_release.nb_samples <= WAV_ENV_END_NB_SAMPLES))
+    {
+        return;
+    }
+
+    nb_voice_frames = (  ((uint64_t)((pVoice->last_sample_pos - pVoice->cur_playing_pos) / pVoice->nb_channels)
+                          << MIX_PHASE_SHIFT)
+                       / pVoice->pitch_step);
+    if (pVoice->env_release.nb_samples > nb_voice_frames / 2)
+    {
+        set_release_time(&pVoice->env_release, (nb_voice_frames / 2 > WAV_ENV_END_NB_SAMPLES) ? 
+                                               nb_voice_frames / 2 : WAV_ENV_END_NB_SAMPLES);
+    }
+}
+
+/* Start playing a sound from its first sample in a new voice (called by AudioCallback). */
+static void start_playing_a_sound(uint16_t sound_idx, float amplification)
+{
+    uint16_t voice_idx;
+    uint16_t layer_sound_idx;
+    uint8_t pedals = 0;
+    TVoice *pVoice;
+
+    // Una corda: softer note.
+    if (((g_pedals_down & (1 << PEDAL_UNA_CORDA)) != 0) && (sound_idx >= NB_SPECIAL_SOUNDS))
+    {
+        pedals |= VOICE_PEDAL_UNA_CORDA;
+        amplification *= UNA_CORDA_AMPLIFICATION;
+    }
+
+    // The previous voice of the same sound is stolen (same key first policy) or released as if
+    // the key was up. A key held by the sostenuto pedal stays held.
+    voice_idx = g_sound_voices[sound_idx];
+    if (voice_idx != NO_VOICE)
+    {
+        pedals |= g_voices[voice_idx].pedals & VOICE_PEDAL_SOSTENUTO;
+        #if (VOICE_STEALING_POLICY == VOICE_STEALING_SAME_KEY_FIRST)
+            steal_voice(&g_voices[voice_idx]);
+        #else
+            g_voices[voice_idx].key_up = true;
+        #endif
+    }
+
+    // Steal a voice if the maximum number of voices is reached.
+    if (g_nb_active_voices - g_nb_stolen_voices >= MAX_NB_VOICES)
+    {
+        steal_voice(&g_voices[g_active_voices[find_voice_to_steal()]]);
+    }
+
+    voice_idx = get_free_voice();
+    pVoice = &g_voices[voice_idx];
+
+    pVoice->sound_idx       = sound_idx;
+    pVoice->root_sound_idx  = g_sound_map[sound_idx].root_sound_idx;
+    pVoice->pitch_step      = g_sound_map[sound_idx].pitch_step;
+    pVoice->pos_frac        = 0;
+    pVoice->volume          = amplification;
+    layer_sound_idx         = select_velocity_layers(pVoice, amplification);
+    pVoice->panned          = (g_key_pan_enabled == true) && (sound_idx >= NB_SPECIAL_SOUNDS) 
+                              && (pVoice->nb_channels == 1);
+    if (pVoice->panned == true)
+    {
+        pVoice->pan_left_gain  = g_key_pan_left_gains[sound_idx - NB_SPECIAL_SOUNDS];
+        pVoice->pan_right_gain = g_key_pan_right_gains[sound_idx - NB_SPECIAL_SOUNDS];
+    }
+    pVoice->env_stage       = ENV_ATTACK;
+    pVoice->env_pos         = 0;
+    pVoice->env_release     = *get_sound_release(sound_idx);
+    limit_release_time(pVoice);
+    pVoice->key_release_nb_samples = pVoice->env_release.nb_samples;
+    pVoice->damping         = 0;
+    pVoice->pedals          = pedals;
+    pVoice->cur_gain        = 0.0f;
+    pVoice->key_up          = false;
+    pVoice->start_order     = g_voice_start_counter++;
+
+    if (pVoice->streamed == true)
+    {
+        start_stream(voice_idx, layer_sound_idx);
+    }
+    if (pVoice->compressed == true)
+    {
+        start_adpcm_decoder(voice_idx, &g_sounds[layer_sound_idx]);
+    }
+
+    // Start the voice playing.
+    g_sound_voices[sound_idx] = voice_idx;
+    g_nb_active_voices = g_nb_active_voices + 1;
+}
+
+/* Return the damping of the strings of the keys up for a pedal position from 0.0 (up) to 1.0 
+   (down): from PEDAL_NB_DAMPING_LEVELS (dampers on the strings) to 0 (dampers off). */
+static uint8_t compute_pedal_damping(float position)
+{
+    float damping =   (PEDAL_DAMPERS_OFF_POSITION - position) 
+                    / (PEDAL_DAMPERS_OFF_POSITION - PEDAL_DAMPERS_ON_POSITION);
+
+    if (damping <= 0.0f)
+    {
+        return 0;
+    }
+    if (damping >= 1.0f)
+    {
+        return PEDAL_NB_DAMPING_LEVELS;
+    }
+
+    return (uint8_t)ceilf(damping * PEDAL_NB_DAMPING_LEVELS);
+}
+
+/* Apply a change of position of a pedal (0.0: up, 1.0: down):
+   - Sustain: damping of the strings of the keys up (see update_damper).
+   - Sostenuto: the voices whose key is down when the pedal goes down are held until it goes up.
+   - Una corda: applied to the notes started while the pedal is down. */
+static void apply_pedal(uint16_t pedal, float position)
+{
+    uint8_t pedal_mask = 1 << pedal;
+    bool pedal_down = (position >= 0.5f);
+    TVoice *pVoice;
+
+    if (pedal == PEDAL_SUSTAIN)
+    {
+        g_pedal_damping = compute_pedal_damping(position);
+        return;
+    }
+
+    if (pedal == PEDAL_SOSTENUTO)
+    {
+        for (size_t list_idx = 0; list_idx < g_nb_active_voices; list_idx++)
+        {
+            pVoice = &g_voices[g_active_voices[list_idx]];
+            if (pedal_down == false)
+            {
+                pVoice->pedals &= ~VOICE_PEDAL_SOSTENUTO;
+            }
+            else if (   ((g_pedals_down & pedal_mask) == 0) && (pVoice->key_up == false) 
+                     && (pVoice->env_stage < ENV_RELEASE))
+            {
+                pVoice->pedals |= VOICE_PEDAL_SOSTENUTO;
+            }
+        }
+    }
+
+    if (pedal_down == true)
+    {
+        g_pedals_down |= pedal_mask;
+    }
+    else
+    {
+        g_pedals_down &= ~pedal_mask;
+    }
+}
+
+/* Switch to the sound bank of a slot: the voices of the bank played get a fast release (their 
+   samples stay in RAM, the new bank is loaded elsewhere), then the sounds, the sound map and the
+   envelope of the new bank are used. */
+static void apply_sound_bank_switch(uint8_t bank_slot)
+{
+    TVoice *pVoice;
+
+    for (size_t list_idx = 0; list_idx < g_nb_active_voices; list_idx++)
+    {
+        pVoice = &g_voices[g_active_voices[list_idx]];
+        if (pVoice->env_stage != ENV_FAST_RELEASE)
+        {
+            steal_voice(pVoice);
+        }
+    }
+
+    g_sounds             = g_sound_banks[bank_slot].sounds;
+    g_nb_velocity_layers = g_sound_banks[bank_slot].nb_velocity_layers;
+    g_sound_map          = g_sound_maps[bank_slot];
+    g_sound_bank_slot    = bank_slot;
+}
+
+/* Apply an event posted by the main loop (called by AudioCallback at the frame of the event). */
+static void apply_event(const TEvent *pEvent)
+{
+    uint16_t voice_idx;
+
+    if (pEvent->type == EVENT_SOUND_START)
+    {
+        start_playing_a_sound(pEvent->sound_idx, pEvent->amplification);
+    }
+    else if (pEvent->type == EVENT_KEY_UP)
+    {
+        // The release depends on the damping of the pedal (see update_damper).
+        voice_idx = g_sound_voices[pEvent->sound_idx];
+        if (voice_idx != NO_VOICE)
+        {
+            g_voices[voice_idx].key_up = true;
+        }
+    }
+    else if (pEvent->type == EVENT_PEDAL)
+    {
+        apply_pedal(pEvent->sound_idx, pEvent->amplification);
+    }
+    else // EVENT_BANK_SWITCH
+    {
+        apply_sound_bank_switch(pEvent->sound_idx);
+    }
+}
+
+/* Post an event to the audio callback. Log an error if the event queue is full. */
+static void post_event_to_audio_callback(e_event_type type, uint16_t sound_idx, float amplification,
+                                         uint32_t timestamp)
+{
+    TEvent event;
+
+    event.type          = type;
+    event.timestamp     = timestamp;
+    event.sound_idx     = sound_idx;
+    event.amplification = amplification;
+
+    if (post_event(&event) == false)
+    {
+        g_hw.PrintLine("Event queue full. Nb events lost=%ld", get_nb_lost_events());
+    }
+}
+
+/* Start playing a note with a certain amplification factor from 0.0 to 1.0.
+   timestamp is the sample time of the key down (see get_sample_time). */
+void start_playing_a_note(uint16_t key_index, float amplification, uint32_t timestamp)
+{
+    post_event_to_audio_callback(EVENT_SOUND_START, NB_SPECIAL_SOUNDS + key_index, amplification,
+                                 timestamp);
+}
+
+/* Stop playing a note. The release depends on the position of the pedal (see update_damper).
+   timestamp is the sample time of the key up (see get_sample_time). */
+void stop_playing_a_note(uint16_t key_index, uint32_t timestamp)
+{
+    post_event_to_audio_callback(EVENT_KEY_UP, NB_SPECIAL_SOUNDS + key_index, 0.0f, timestamp);
+}
+
+/* Play a special sound */
+void play_special_sound(uint8_t sound_idx)
+{
+    post_event_to_audio_callback(EVENT_SOUND_START, sound_idx, 1.0f, get_sample_time());
+}
+
+/* Set the position of a pedal from 0.0 (up) to 1.0 (down). The release of the notes whose key 
+   is up depends on the position of the sustain pedal (half pedal, see update_damper). The 
+   sostenuto and una corda pedals are up or down (see apply_pedal). timestamp is the sample time 
+   of the pedal change (see get_sample_time). */
+void set_pedal_position(e_pedal pedal, float position, uint32_t timestamp)
+{
+    post_event_to_audio_callback(EVENT_PEDAL, pedal, position, timestamp);
+}
+
+/* Switch to the sound bank loaded in a slot (see apply_sound_bank_switch) and wait until the 
+   audio callback has switched. The audio must be started. */
+void switch_sound_bank(uint8_t bank_slot)
+{
+    TEvent event;
+
+    event.type          = EVENT_BANK_SWITCH;
+    event.timestamp     = get_sample_time();
+    event.sound_idx     = bank_slot;
+    event.amplification = 0.0f;
+
+    // The switch must not be lost: wait for a free element in the queue.
+    while (post_event(&event) == false)
+    {
+    }
+    while (g_sound_bank_slot != bank_slot)
+    {
+    }
+}
+
+/* Stop immediately all the voices (without release), initialise the list of voices and empty 
+   the event queue. Must not be called while the audio callback is running. */
+void stop_all_sounds(void)
+{
+    init_event_queue();
+    stop_all_streams();
+    g_pedal_damping = PEDAL_NB_DAMPING_LEVELS;
+    g_pedals_down   = 0;
+
+    for (uint16_t voice_idx = 0; voice_idx < NB_VOICES; voice_idx++)
+    {
+        g_active_voices[voice_idx] = voice_idx;
+    }
+    for (uint16_t sound_idx = 0; sound_idx < NB_SOUNDS; sound_idx++)
+    {
+        g_sound_voices[sound_idx] = NO_VOICE;
+    }
+
+    g_nb_active_voices = 0;
+    g_nb_stolen_voices = 0;
+}
+
+/* Display data of the voices playing. Useful for debugging.
+   The voices are read while the audio callback can modify them: the data can be inconsistent.
+   Positions are displayed relatively to the first position of the sound.*/
+void display_active_voices_data(void)
+{
+    TVoice *pVoice;
+
+    for (size_t list_idx = 0; list_idx < g_nb_active_voices; list_idx++)
+    {
+        pVoice = &g_voices[g_active_voices[list_idx]];
+
+        g_hw.Print("voice=%d ", g_active_voices[list_idx]);
+        g_hw.Print("sound=%d ", pVoice->sound_idx);
+        g_hw.Print("key_up=%d ", pVoice->key_up);
+        g_hw.Print("root_sound=%d ", pVoice->root_sound_idx);
+        g_hw.Print("cur_pos=%d ", pVoice->cur_playing_pos - g_sounds[pVoice->root_sound_idx].first_sample_pos);
+        g_hw.Print("env_stage=%d ", pVoice->env_stage);
+        g_hw.PrintLine("env_pos=%d", pVoice->env_pos);
+    }
+}
+
+/* Build the map of the samples played for each sound of the sound bank of a slot. A key without 
+   samples is played with the samples of the nearest key with samples (the lower key if two keys 
+   are at the same distance), with a pitch step of 2^(distance / 12). A key without samples 
+   nearby is silent. Called after the samples are loaded, or while the bank is played and its 
+   keys are loaded one by one (see service_progressive_load in main.cpp): the map is built aside 
+   and replaced at once. */
+void build_sound_map(uint8_t bank_slot)
+{
+    static TSoundMap sound_map[NB_SOUNDS];
+    const TSoundData *pSounds = g_sound_banks[bank_slot].sounds;
+    uint16_t nb_root_keys = 0;
+    uint16_t nb_mapped_keys = 0;
+    uint16_t root_key;
+    uint32_t primask;
+    bool found;
+
+    // Special sounds and keys with samples: original samples.
+    for (uint16_t sound_idx = 0; sound_idx < NB_SOUNDS; sound_idx++)
+    {
+        sound_map[sound_idx].root_sound_idx = sound_idx;
+        sound_map[sound_idx].pitch_step     = MIX_PHASE_UNITY;
+    }
+
+    for (int16_t key_idx = 0; key_idx < NB_KEYS; key_idx++)
+    {
+        if (pSounds[NB_SPECIAL_SOUNDS + key_idx].nb_samples != 0)
+        {
+            nb_root_keys++;
+            continue;
+        }
+
+        found = false;
+        for (int16_t distance = 1; (distance <= MAX_ROOT_KEY_DISTANCE) && (found == false); distance++)
+        {
+            if (   (key_idx - distance >= 0) 
+                && (pSounds[NB_SPECIAL_SOUNDS + key_idx - distance].nb_samples != 0))
+            {
+                root_key = key_idx - distance;
+                found = true;
+            }
+            else if (   (key_idx + distance < NB_KEYS) 
+                     && (pSounds[NB_SPECIAL_SOUNDS + key_idx + distance].nb_samples != 0))
+            {
+                root_key = key_idx + distance;
+                found = true;
+            }
+        }
+
+        if (found == true)
+        {
+            sound_map[NB_SPECIAL_SOUNDS + key_idx].root_sound_idx = NB_SPECIAL_SOUNDS + root_key;
+            sound_map[NB_SPECIAL_SOUNDS + key_idx].pitch_step     = 
+                (uint32_t)(powf(2.0f, (float)(key_idx - root_key) / 12.0f) * MIX_PHASE_UNITY + 0.5f);
+            nb_mapped_keys++;
+        }
+    }
+
+    // The audio callback never reads a map partly replaced.
+    primask = __get_PRIMASK();
+    __disable_irq();
+    memcpy(g_sound_maps[bank_slot], sound_map, sizeof(sound_map));
+    __set_PRIMASK(primask);
+
+    g_hw.PrintLine("Sound map: %d keys with samples, %d keys pitch shifted, %d keys silent", 
+                   nb_root_keys, nb_mapped_keys, NB_KEYS - nb_root_keys - nb_mapped_keys);
+}
+
+/* Set the data of a sound of the sound bank of a slot (the sound may be played: the audio 
+   callback never reads a sound partly written). */
+void set_sound_data(uint8_t bank_slot, uint16_t sound_idx, const TSoundData *pSound)
+{
+    uint32_t primask = __get_PRIMASK();
+
+    __disable_irq();
+    g_sound_banks[bank_slot].sounds[sound_idx] = *pSound;
+    __set_PRIMASK(primask);
+}
+
+/* Set the pan of the keys of the mono banks: the low keys on the left, the high keys on the 
+   right, over width_percent of the stereo width (0: no pan, the mono notes are centered). 
+   The pan is constant-power (left = cos, right = sin): a centered key is 3 dB lower on each 
+   channel. The stereo samples are never panned. Applied to the notes started after the call. */
+void set_key_pan_width(uint8_t width_percent)
+{
+    float angle;
+
+    if (width_percent > 100)
+    {
+        width_percent = 100;
+    }
+
+    for (uint16_t key_idx = 0; key_idx < NB_KEYS; key_idx++)
+    {
+        // From pi/4 * (1 - width) for the lowest key to pi/4 * (1 + width) for the highest key.
+        angle =   ((float)M_PI / 4.0f) 
+                * (1.0f + ((float)width_percent / 100.0f) * (2.0f * (float)key_idx / (float)(NB_KEYS - 1) - 1.0f));
+        g_key_pan_left_gains[key_idx]  = cosf(angle);
+        g_key_pan_right_gains[key_idx] = sinf(angle);
+    }
+
+    g_key_pan_enabled = (width_percent != 0);
+}
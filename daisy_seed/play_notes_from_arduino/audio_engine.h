@@ -0,0 +1,159 @@
+/* 
+ *  Header file of audio_engine.cpp. See this file for more details
+ */ 
+#ifndef AUDIO_ENGINE
+#define AUDIO_ENGINE
+
+/*************************************************************************************************
+* Includes
+*************************************************************************************************/
+#include "daisy_seed.h"
+#include "common.h"
+#include "envelope.h"
+
+using namespace daisy;
+
+/*************************************************************************************************
+* Defines
+*************************************************************************************************/
+// Maximum number of frames rendered at once. Bigger audio blocks are rendered in several parts.
+#define MAX_RENDER_BLOCK_SIZE       64
+
+// Voices
+#define MAX_NB_VOICES               32      // Maximum number of voices playing (not stolen).
+#define NB_STOLEN_VOICES            8       // Extra voices for the fast release of stolen voices.
+#define NB_VOICES                   (MAX_NB_VOICES + NB_STOLEN_VOICES)
+#define NO_VOICE                    0xFFFF
+#define STOLEN_VOICE_RELEASE_MS     5       // Release of a stolen voice in milliseconds.
+#define STOLEN_VOICE_RELEASE_NB_SAMPLES ((SAMPLE_RATE_HZ * STOLEN_VOICE_RELEASE_MS) / 1000)
+
+// Voice stealing policies (voice stopped when MAX_NB_VOICES voices are already playing).
+#define VOICE_STEALING_OLDEST           0   // The voice started first.
+#define VOICE_STEALING_QUIETEST         1   // The voice with the lowest amplification.
+#define VOICE_STEALING_SAME_KEY_FIRST   2   // The voice of the same key, else the oldest voice.
+#define VOICE_STEALING_POLICY           VOICE_STEALING_SAME_KEY_FIRST
+
+// Maximum distance (in semitones) between a key without samples and the key whose samples are 
+// played at another pitch instead (root key).
+#define MAX_ROOT_KEY_DISTANCE       12
+
+// Velocity layers: the layer played is selected from the amplification of the note. Between two 
+// layers, the two layers can be crossfaded (value: 0 or 1) over VELOCITY_XFADE_WIDTH of a layer.
+#define ENABLE_VELOCITY_XFADE       1
+#define VELOCITY_XFADE_WIDTH        0.5f
+
+// Half pedal: the dampers of the keys up are fully on the strings below the pedal position 
+// PEDAL_DAMPERS_ON_POSITION (normal release) and off the strings above the pedal position 
+// PEDAL_DAMPERS_OFF_POSITION (no release). In between, the damping has PEDAL_NB_DAMPING_LEVELS 
+// levels: the release time of the key is multiplied by PEDAL_NB_DAMPING_LEVELS / damping.
+#define PEDAL_DAMPERS_ON_POSITION   0.2f
+#define PEDAL_DAMPERS_OFF_POSITION  0.8f
+#define PEDAL_NB_DAMPING_LEVELS     16
+
+// Una corda: the notes played with the una corda pedal down have their amplification multiplied 
+// by UNA_CORDA_AMPLIFICATION. The velocity layer is selected from this amplification too (softer 
+// timbre).
+#define UNA_CORDA_AMPLIFICATION     0.6f
+
+// Pedals of a voice (bitmask).
+#define VOICE_PEDAL_SOSTENUTO       0x01    // The voice is held by the sostenuto pedal.
+#define VOICE_PEDAL_UNA_CORDA       0x02    // The voice was started with the una corda pedal down.
+
+// Delay between the timestamp of an event and the frame where it is applied, in addition to one 
+// audio block. It must be longer than the reception and the processing of a message.
+#define EVENT_LATENCY_MS            2
+#define EVENT_LATENCY_NB_SAMPLES    ((SAMPLE_RATE_HZ * EVENT_LATENCY_MS) / 1000)
+
+/*************************************************************************************************
+* Types
+*************************************************************************************************/
+// Pedals.
+typedef enum {PEDAL_SUSTAIN, PEDAL_SOSTENUTO, PEDAL_UNA_CORDA, NB_PEDALS} e_pedal;
+
+// Stages of the wav enveloppe of a voice.
+typedef enum {ENV_ATTACK, ENV_SUSTAIN, ENV_RELEASE, ENV_FAST_RELEASE} e_env_stage;
+
+// Samples played for a sound: its own samples, or the samples of another sound (root sound) at 
+// another pitch when the sound has no samples.
+typedef struct
+{
+    uint16_t root_sound_idx; // Index in g_sounds of the sound whose samples are played.
+    uint32_t pitch_step;     // Read position increment per frame (Q16, MIX_PHASE_UNITY = same pitch).
+} TSoundMap;
+
+// Structure defining a voice (a sound being played).
+typedef struct
+{
+    uint16_t sound_idx;      // Index of the sound played in g_sounds (key or special sound).
+    uint16_t root_sound_idx; // Index in g_sounds of the samples played (see TSoundMap).
+    uint32_t pitch_step;     // Read position increment per frame (Q16).
+    uint32_t pos_frac;       // Fraction of the read position (Q16).
+    size_t cur_playing_pos;  // Define the position of the sample to play (in g_sample_data).
+    size_t last_sample_pos;  // Position of the end of the samples played.
+    uint8_t nb_channels;     // Number of channels of the samples played (1: mono, 2: stereo).
+    bool panned;             // Define if the mono samples are panned (see set_key_pan_width).
+    float pan_left_gain;     // Amplification of the left channel (panned voice only).
+    float pan_right_gain;    // Amplification of the right channel (panned voice only).
+    bool streamed;           // Define if the tail of the samples is streamed from the SD card.
+    size_t head_end_pos;     // Position of the end of the head of the samples (streamed voice only).
+    bool compressed;         // Define if the samples are compressed (decoded by the voice).
+    bool looped;             // Define if the samples are looped (see TSoundData).
+    size_t loop_start_pos;   // Position of the start of the loop (looped voice only).
+    size_t loop_end_pos;     // Position of the end of the loop (looped voice only).
+    bool xfade;              // Define if two velocity layers are crossfaded.
+    ptrdiff_t xfade_offset;  // Position of the samples of the upper layer relatively to cur_playing_pos.
+    float xfade_low_gain;    // Amplification of the lower layer (crossfade only).
+    float xfade_high_gain;   // Amplification of the upper layer (crossfade only).
+    bool key_up;             // Define if the key is up (the release starts when the pedal is up).
+    float volume;            // Define the amplification wich depends on the attack time.
+    e_env_stage env_stage;   // Define the current stage of the wav enveloppe.
+    size_t env_pos;          // Define the number of samples played since the start of the stage.
+    float env_release_level; // Define the amplification at the start of the release.
+    TEnvRelease env_release; // Release time and curve of the release stage (see envelope.cpp).
+    uint32_t key_release_nb_samples; // Release time of the key (dampers fully on the strings).
+    uint8_t damping;         // Damping of the release started by the dampers (0: other release).
+    uint8_t pedals;          // Pedals applied to the voice (VOICE_PEDAL_xxx bits).
+    float cur_gain;          // Define the amplification at the end of the last block.
+    uint32_t start_order;    // Define the order in which the voices were started.
+} TVoice;
+
+/*************************************************************************************************
+* Variables 
+*************************************************************************************************/
+// Voices (playing or free).
+extern TVoice          g_voices[NB_VOICES];
+
+// Indexes (in g_voices) of the voices currently playing. Only these voices are rendered by 
+// AudioCallback. The first g_nb_active_voices elements are valid.
+extern uint16_t        g_active_voices[NB_VOICES];
+extern volatile size_t g_nb_active_voices;
+
+// Damping of the strings of the keys up (modified by the audio callback only): from 0 (pedal 
+// down) to PEDAL_NB_DAMPING_LEVELS (pedal up).
+extern uint8_t         g_pedal_damping;
+
+// Sample time (number of frames since the startup) of the first frame of the current block.
+extern volatile uint32_t g_block_start_frame;
+
+/*************************************************************************************************
+* Functions 
+*************************************************************************************************/
+extern void AudioCallback(AudioHandle::InterleavingInputBuffer in,
+                          AudioHandle::InterleavingOutputBuffer out,
+                          size_t size);
+extern void start_audio(size_t block_size);
+extern void stop_audio(void);
+extern void display_audio_load(void);
+extern uint32_t get_sample_time(void);
+extern void start_playing_a_note(uint16_t key_index, float amplification, uint32_t timestamp);
+extern void stop_playing_a_note(uint16_t key_index, uint32_t timestamp);
+extern void play_special_sound(uint8_t sound_idx);
+extern void set_pedal_position(e_pedal pedal, float position, uint32_t timestamp);
+extern void stop_all_sounds(void);
+extern void display_active_voices_data(void);
+extern void switch_sound_bank(uint8_t bank_slot);
+extern void build_sound_map(uint8_t bank_slot);
+extern void set_sound_data(uint8_t bank_slot, uint16_t sound_idx, const TSoundData *pSound);
+extern void set_key_pan_width(uint8_t width_percent);
+
+#endif //#ifndef AUDIO_ENGINE
@@ -0,0 +1,181 @@
+/*
+ * This module reads the image file of a sound bank: one file (BANK_IMAGE_FILE_NAME in the bank
+ * directory) with the notes of all the velocity layers, written by tools/pack_bank_image.py.
+ *
+ * Loading 85 wav files per layer opens each file twice and reads its header with small reads.
+ * In the image, the data of the notes is stored as it is loaded in RAM, one note after the
+ * other, each note on a new sector (BANK_IMAGE_ALIGN_BYTES): the data of all the notes is read
+ * in g_sample_data with a few big reads (BANK_IMAGE_READ_CHUNK_BYTES), that FatFS transfers
+ * directly from the SD card to the RAM with multi-block reads (one per cluster). The padding
+ * between two notes is loaded too (less than one sector per note).
+ *
+ * The image file contains a header (TBankImageHeader) and a table with one entry per note
+ * (TBankImageEntry), followed by the data. The notes are set from the table by load_bank_image
+ * (main.cpp). While a bank is played, the data is read note by note instead, in small chunks,
+ * by the progressive load (see start_image_note_load in main.cpp).
+ */
+
+/*************************************************************************************************
+* Includes
+*************************************************************************************************/
+#include "daisy_seed.h"
+#include "fatfs.h"
+#include "common.h"
+#include "bank_index.h"
+#include "bank_image.h"
+#include "disk_streamer.h"
+#include "adpcm.h"
+
+using namespace daisy;
+
+/*************************************************************************************************
+* Functions implementation
+*************************************************************************************************/
+/* Return true if the entry of a note (pEntry) of an image (header pHeader) is valid: its data is 
+   in the data of the image (sums computed on 64 bits: no wrap around), with 1 or 2 channels, and
+   its size matches its number of samples (samples of 16 bits, or compressed blocks). */
+static bool is_bank_image_entry_valid(const TBankImageHeader *pHeader, const TBankImageEntry *pEntry)
+{
+    uint32_t nb_frames;
+    uint32_t nb_blocks;
+
+    if (pEntry->data_size == 0)
+    {
+        return true;
+    }
+
+    if (   (pEntry->data_offset < pHeader->data_offset)
+        || (pEntry->data_offset % BANK_IMAGE_ALIGN_BYTES != 0)
+        || (  (uint64_t)pEntry->data_offset + pEntry->data_size
+            > (uint64_t)pHeader->data_offset + pHeader->data_size)
+        || ((pEntry->nb_channels != 1) && (pEntry->nb_channels != 2))
+        || (pEntry->nb_samples % pEntry->nb_channels != 0))
+    {
+        return false;
+    }
+
+    if (pEntry->compressed == 1)
+    {
+        nb_frames = pEntry->nb_samples / pEntry->nb_channels;
+        nb_blocks = (nb_frames + ADPCM_BLOCK_NB_FRAMES - 1) / ADPCM_BLOCK_NB_FRAMES;
+        return ((uint64_t)nb_blocks * ADPCM_BLOCK_SIZE_BYTES * pEntry->nb_channels == pEntry->data_size);
+    }
+
+    return (pEntry->compressed == 0) && ((uint64_t)pEntry->nb_samples * 2 <= pEntry->data_size);
+}
+
+/* Read the header and the table of an image file (file_path). pEntries receives the entries of
+   the layers (MAX_NB_VELOCITY_LAYERS * NB_KEYS entries at most, layer 0 first).
+   Return false if the file is missing or invalid. */
+bool read_bank_image_table(const char *file_path, TBankImageHeader *pHeader, TBankImageEntry *pEntries)
+{
+    static FIL SDFile;
+    size_t header_bytes_read = 0;
+    size_t entries_bytes_read = 0;
+    size_t entries_size;
+    FRESULT result;
+
+    result = f_open(&SDFile, file_path, FA_READ);
+    if (result != FR_OK)
+    {
+        g_hw.PrintLine("No image file %s", file_path);
+        return false;
+    }
+
+    result = f_read(&SDFile, pHeader, sizeof(TBankImageHeader), &header_bytes_read);
+    if (   (result != FR_OK) || (header_bytes_read != sizeof(TBankImageHeader))
+        || (memcmp(pHeader->magic, BANK_IMAGE_MAGIC, 4) != 0) || (pHeader->version != BANK_IMAGE_VERSION)
+        || (pHeader->nb_layers == 0) || (pHeader->nb_layers > MAX_NB_VELOCITY_LAYERS)
+        || (pHeader->nb_keys != NB_KEYS) || (pHeader->data_offset % BANK_IMAGE_ALIGN_BYTES != 0))
+    {
+        g_hw.PrintLine("Image %s: invalid header. result=%d", file_path, result);
+        f_close(&SDFile);
+        return false;
+    }
+
+    entries_size = pHeader->nb_layers * NB_KEYS * sizeof(TBankImageEntry);
+    result = f_read(&SDFile, pEntries, entries_size, &entries_bytes_read);
+    f_close(&SDFile);
+
+    if (   (result != FR_OK) || (entries_bytes_read != entries_size)
+        || (pHeader->checksum != compute_fnv_checksum(pEntries, entries_size)))
+    {
+        g_hw.PrintLine("Image %s: invalid table. result=%d", file_path, result);
+        return false;
+    }
+
+    // The data of each note must be in the data of the image and match its number of samples.
+    for (size_t entry_idx = 0; entry_idx < pHeader->nb_layers * NB_KEYS; entry_idx++)
+    {
+        if (is_bank_image_entry_valid(pHeader, &pEntries[entry_idx]) == false)
+        {
+            g_hw.PrintLine("Image %s: invalid entry %d", file_path, entry_idx);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* Read the data of all the notes of an image file (file_path, header pHeader) at RAM address
+   ram_address (aligned on BANK_IMAGE_RAM_ALIGN_WORD). The streams of the bank played are served
+   between two reads. Display the read speed. Return false if the data is not read. */
+bool read_bank_image_data(const char *file_path, const TBankImageHeader *pHeader, int16_t *ram_address)
+{
+    static FIL SDFile;
+    uint8_t *pDest = (uint8_t *)ram_address;
+    size_t nb_bytes_left = pHeader->data_size;
+    size_t nb_bytes_to_read;
+    size_t bytesRead = 0;
+    uint32_t start_us;
+    uint32_t elapsed_us = 0;
+    float speed_mb_per_s;
+    FRESULT result;
+
+    result = f_open(&SDFile, file_path, FA_READ);
+    if (result != FR_OK)
+    {
+        g_hw.PrintLine("f_open result KO. result=%d", result);
+        return false;
+    }
+
+    result = f_lseek(&SDFile, pHeader->data_offset);
+    while ((nb_bytes_left > 0) && (result == FR_OK))
+    {
+        nb_bytes_to_read = nb_bytes_left;
+        if (nb_bytes_to_read > BANK_IMAGE_READ_CHUNK_BYTES)
+        {
+            nb_bytes_to_read = BANK_IMAGE_READ_CHUNK_BYTES;
+        }
+
+        start_us = System::GetUs();
+        result = f_read(&SDFile, pDest, nb_bytes_to_read, &bytesRead);
+        elapsed_us += System::GetUs() - start_us;
+        if ((result == FR_OK) && (bytesRead != nb_bytes_to_read))
+        {
+            // End of the file before the end of the data.
+            result = FR_INT_ERR;
+        }
+        pDest += bytesRead;
+        nb_bytes_left -= bytesRead;
+
+        // The voices of the bank played go on while the bank is loaded.
+        toggle_right_led();
+        service_streams();
+    }
+    f_close(&SDFile);
+
+    if (result != FR_OK)
+    {
+        g_hw.PrintLine("f_read result KO. result=%d", result);
+        return false;
+    }
+
+    // Time of the reads only (without the service of the streams). Bytes per microsecond = 
+    // Mbytes per second.
+    speed_mb_per_s = (elapsed_us > 0) ? (float)pHeader->data_size / (float)elapsed_us : 0.0f;
+    g_hw.PrintLine("Image %s: %d bytes read in %d ms, "FLT_FMT3" MB/s", file_path, pHeader->data_size,
+                   elapsed_us / 1000, FLT_VAR3(speed_mb_per_s));
+
+    return true;
+}
@@ -0,0 +1,74 @@
+/*
+ *  Header file of bank_image.cpp. See this file for more details
+ */
+#ifndef BANK_IMAGE
+#define BANK_IMAGE
+
+/*************************************************************************************************
+* Includes
+*************************************************************************************************/
+#include "daisy_seed.h"
+#include "common.h"
+
+/*************************************************************************************************
+* Defines
+*************************************************************************************************/
+// Load the notes of a bank from its image file when the bank directory has one (1), or always
+// from the wav files (0).
+#define ENABLE_BANK_IMAGE           1
+
+// Image file of a bank, in the bank directory (written by tools/pack_bank_image.py).
+#define BANK_IMAGE_FILE_NAME        "bank.img"
+#define BANK_IMAGE_MAGIC            "BIMG"
+#define BANK_IMAGE_VERSION          1
+
+// The table and the data of each note start on a sector of the SD card.
+#define BANK_IMAGE_ALIGN_BYTES      512
+
+// The data is loaded at a position of g_sample_data aligned on a cache line (DMA transfers).
+#define BANK_IMAGE_RAM_ALIGN_WORD   16
+
+// Size of the reads of the data (the streams of the bank played are served between two reads).
+#define BANK_IMAGE_READ_CHUNK_BYTES (256 * 1024)
+
+/*************************************************************************************************
+* Types
+*************************************************************************************************/
+// Header of an image file, followed by nb_layers * NB_KEYS entries (TBankImageEntry, layer 0
+// first), then by the data of the notes.
+typedef struct
+{
+    char magic[4];              // BANK_IMAGE_MAGIC
+    uint32_t version;           // BANK_IMAGE_VERSION
+    uint32_t nb_layers;         // Number of velocity layers (1 to MAX_NB_VELOCITY_LAYERS).
+    uint32_t nb_keys;           // NB_KEYS
+    uint32_t data_offset;       // Position of the data of the first note (bytes, aligned).
+    uint32_t data_size;         // Size of the data of all the notes (bytes, with the padding).
+    uint32_t checksum;          // FNV-1a of the entries.
+    uint32_t reserved;
+} TBankImageHeader;
+
+// Data of a note in the image: samples at SAMPLE_RATE_HZ as loaded in RAM (16 bits,
+// interleaved channels), or blocks of a compressed file (see adpcm.cpp).
+typedef struct
+{
+    uint32_t data_offset;       // Position of the data in the image file (bytes, aligned).
+    uint32_t data_size;         // Size of the data in bytes (0: the key has no note).
+    uint32_t nb_samples;        // Number of samples of the note (all channels, once decoded).
+    uint8_t nb_channels;        // 1: mono, 2: stereo.
+    uint8_t compressed;         // 1: compressed blocks, 0: samples.
+    uint16_t reserved;
+    uint32_t loop_start;        // First sample loop in frames, loop_end excluded
+    uint32_t loop_end;          // (loop_end = 0: no loop).
+} TBankImageEntry;
+
+static_assert(sizeof(TBankImageHeader) == 32, "TBankImageHeader must not be padded");
+static_assert(sizeof(TBankImageEntry) == 24, "TBankImageEntry must not be padded");
+
+/*************************************************************************************************
+* Functions
+*************************************************************************************************/
+extern bool read_bank_image_table(const char *file_path, TBankImageHeader *pHeader, TBankImageEntry *pEntries);
+extern bool read_bank_image_data(const char *file_path, const TBankImageHeader *pHeader, int16_t *ram_address);
+
+#endif //#ifndef BANK_IMAGE
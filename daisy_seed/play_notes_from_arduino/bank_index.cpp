@@ -0,0 +1,157 @@
+/*
+ * This module reads and writes the index file of a directory of notes (bank directory or
+ * velocity layer directory), so that loading a sound bank does not scan the directory nor
+ * parse the header of each file.
+ *
+ * The index file (BANK_INDEX_FILE_NAME in the directory of the notes) contains a header
+ * (TBankIndexHeader) followed by one entry per key (TBankIndexEntry): the name of the file of
+ * the key, its size and date, and the format of its data. It is written by the loader when the
+ * index is missing or stale (see build_notes_index in main.cpp), or by tools/build_bank_index.py.
+ *
+ * The index is stale when one of its files has been modified or removed (size, date or time
+ * different from the index). A file added for a key without file is not seen: the index must
+ * be deleted (or rebuilt by the tool) when files are added.
+ */
+
+/*************************************************************************************************
+* Includes
+*************************************************************************************************/
+#include "daisy_seed.h"
+#include "fatfs.h"
+#include "common.h"
+#include "bank_index.h"
+
+using namespace daisy;
+
+/*************************************************************************************************
+* Defines
+*************************************************************************************************/
+#define FNV_OFFSET_BASIS            2166136261UL
+#define FNV_PRIME                   16777619UL
+
+/*************************************************************************************************
+* Functions implementation
+*************************************************************************************************/
+/* Return the checksum (FNV-1a) of size bytes (entries of an index or of a bank image). */
+uint32_t compute_fnv_checksum(const void *pData, size_t size)
+{
+    const uint8_t *data = (const uint8_t *)pData;
+    uint32_t checksum = FNV_OFFSET_BASIS;
+
+    for (size_t idx = 0; idx < size; idx++)
+    {
+        checksum = (checksum ^ data[idx]) * FNV_PRIME;
+    }
+
+    return checksum;
+}
+
+/* Build the path of a file of a directory. */
+static void build_file_path(const char *dir_path, const char *file_name, char *file_path)
+{
+    strcpy(file_path, dir_path);
+    strcat(file_path, "/");
+    strcat(file_path, file_name);
+}
+
+/* Read the index file of a directory of notes (dir_path) in pEntries (NB_KEYS entries).
+   Return false if the index is missing, corrupted or stale. */
+bool read_bank_index(const char *dir_path, TBankIndexEntry *pEntries)
+{
+    static FIL SDFile;
+    static FILINFO finf;
+    TBankIndexHeader header;
+    char file_path[MAX_FILE_PATH_LEN];
+    size_t header_bytes_read = 0;
+    size_t entries_bytes_read = 0;
+    FRESULT result;
+
+    build_file_path(dir_path, BANK_INDEX_FILE_NAME, file_path);
+    result = f_open(&SDFile, file_path, FA_READ);
+    if (result != FR_OK)
+    {
+        g_hw.PrintLine("No index file in %s", dir_path);
+        return false;
+    }
+
+    result = f_read(&SDFile, &header, sizeof(header), &header_bytes_read);
+    if (result == FR_OK)
+    {
+        result = f_read(&SDFile, pEntries, NB_KEYS * sizeof(TBankIndexEntry), &entries_bytes_read);
+    }
+    f_close(&SDFile);
+
+    if (   (result != FR_OK) || (header_bytes_read != sizeof(header))
+        || (entries_bytes_read != NB_KEYS * sizeof(TBankIndexEntry)))
+    {
+        g_hw.PrintLine("Index of %s: f_read result KO. result=%d", dir_path, result);
+        return false;
+    }
+    if (   (memcmp(header.magic, BANK_INDEX_MAGIC, 4) != 0) || (header.version != BANK_INDEX_VERSION)
+        || (header.nb_entries != NB_KEYS) 
+        || (header.checksum != compute_fnv_checksum(pEntries, NB_KEYS * sizeof(TBankIndexEntry))))
+    {
+        g_hw.PrintLine("Index of %s: invalid file", dir_path);
+        return false;
+    }
+
+    // The files of the index must not have changed.
+    for (uint16_t key_idx = 0; key_idx < NB_KEYS; key_idx++)
+    {
+        if (pEntries[key_idx].file_name[0] == 0)
+        {
+            continue;
+        }
+
+        pEntries[key_idx].file_name[MAX_FILE_NAME_LEN - 1] = 0;
+        build_file_path(dir_path, pEntries[key_idx].file_name, file_path);
+        if (   (f_stat(file_path, &finf) != FR_OK) || (finf.fsize != pEntries[key_idx].file_size)
+            || (finf.fdate != pEntries[key_idx].file_date) || (finf.ftime != pEntries[key_idx].file_time))
+        {
+            g_hw.PrintLine("Index of %s: stale (%s)", dir_path, pEntries[key_idx].file_name);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* Write the index file of a directory of notes (dir_path) from pEntries (NB_KEYS entries). */
+void write_bank_index(const char *dir_path, const TBankIndexEntry *pEntries)
+{
+    static FIL SDFile;
+    TBankIndexHeader header;
+    char file_path[MAX_FILE_PATH_LEN];
+    size_t header_bytes_written = 0;
+    size_t entries_bytes_written = 0;
+    FRESULT result;
+
+    memcpy(header.magic, BANK_INDEX_MAGIC, 4);
+    header.version    = BANK_INDEX_VERSION;
+    header.nb_entries = NB_KEYS;
+    header.checksum   = compute_fnv_checksum(pEntries, NB_KEYS * sizeof(TBankIndexEntry));
+
+    build_file_path(dir_path, BANK_INDEX_FILE_NAME, file_path);
+    result = f_open(&SDFile, file_path, FA_WRITE | FA_CREATE_ALWAYS);
+    if (result != FR_OK)
+    {
+        g_hw.PrintLine("Index of %s: f_open result KO. result=%d", dir_path, result);
+        return;
+    }
+
+    result = f_write(&SDFile, &header, sizeof(header), &header_bytes_written);
+    if (result == FR_OK)
+    {
+        result = f_write(&SDFile, pEntries, NB_KEYS * sizeof(TBankIndexEntry), &entries_bytes_written);
+    }
+    f_close(&SDFile);
+
+    if (   (result != FR_OK) || (header_bytes_written != sizeof(header))
+        || (entries_bytes_written != NB_KEYS * sizeof(TBankIndexEntry)))
+    {
+        g_hw.PrintLine("Index of %s: f_write result KO. result=%d", dir_path, result);
+        return;
+    }
+
+    g_hw.PrintLine("Index file written: %s", file_path);
+}
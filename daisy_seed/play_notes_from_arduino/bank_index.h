@@ -0,0 +1,60 @@
+/*
+ *  Header file of bank_index.cpp. See this file for more details
+ */
+#ifndef BANK_INDEX
+#define BANK_INDEX
+
+/*************************************************************************************************
+* Includes
+*************************************************************************************************/
+#include "daisy_seed.h"
+#include "common.h"
+
+/*************************************************************************************************
+* Defines
+*************************************************************************************************/
+// Index file of a directory of notes (written by the loader or by tools/build_bank_index.py).
+#define BANK_INDEX_FILE_NAME        "index.bin"
+#define BANK_INDEX_MAGIC            "BIDX"
+#define BANK_INDEX_VERSION          3       // 3: float samples.
+
+/*************************************************************************************************
+* Types
+*************************************************************************************************/
+// Header of an index file, followed by NB_KEYS entries (TBankIndexEntry).
+typedef struct
+{
+    char magic[4];              // BANK_INDEX_MAGIC
+    uint32_t version;           // BANK_INDEX_VERSION
+    uint32_t nb_entries;        // NB_KEYS
+    uint32_t checksum;          // FNV-1a of the entries.
+} TBankIndexHeader;
+
+// File of a key (wav or compressed file) and format of its data, read from the file header.
+typedef struct
+{
+    char file_name[MAX_FILE_NAME_LEN]; // Empty if the key has no file.
+    uint32_t file_size;         // Size of the file in bytes.
+    uint16_t file_date;         // Date and time of the last modification of the file (FAT format).
+    uint16_t file_time;
+    uint8_t compressed;         // 1: compressed file (see adpcm.cpp), 0: wav file.
+    uint8_t nb_channels;        // Number of channels of the file (1: mono, 2: stereo).
+    uint8_t bits_per_sample;    // Samples of a wav file: 16, 24 or 32 bits integers, or 32 bits 
+    uint8_t float_samples;      // floats (float_samples = 1).
+    uint32_t sample_rate;       // Sample rate of the file in Hertz.
+    uint32_t data_offset;       // Position of the first sample in the file (bytes).
+    uint32_t data_size;         // Size of the samples (wav) or of the blocks (compressed) in bytes.
+    uint32_t loop_start;        // First sample loop in frames of the file, loop_end excluded
+    uint32_t loop_end;          // (loop_end = 0: no loop).
+} TBankIndexEntry;
+
+static_assert(sizeof(TBankIndexEntry) == MAX_FILE_NAME_LEN + 32, "TBankIndexEntry must not be padded");
+
+/*************************************************************************************************
+* Functions
+*************************************************************************************************/
+extern uint32_t compute_fnv_checksum(const void *pData, size_t size);
+extern bool read_bank_index(const char *dir_path, TBankIndexEntry *pEntries);
+extern void write_bank_index(const char *dir_path, const TBankIndexEntry *pEntries);
+
+#endif //#ifndef BANK_INDEX
@@ -0,0 +1,628 @@
+/*
+ * This module measures the CPU cost of the audio callback with the Cortex-M7 cycle counter (DWT).
+ * The audio callback is called directly (audio not started) with a given number of notes 
+ * playing, and the average number of cycles per callback is logged.
+ *
+ * The reference callback is the first version of AudioCallback which scans all the sounds for 
+ * every frame. It is kept here (with its own copy of the sounds data) to compare the current 
+ * AudioCallback with it.
+ *
+ * The DSP mixing kernels (mono and stereo) are also checked against the scalar reference 
+ * kernels (bit-exact results).
+ *
+ * The render paths are compared with MAX_NB_VOICES notes playing: mono notes, panned mono notes
+ * and stereo notes (the samples of the bank are played as if they were stereo).
+ *
+ * The timing of the events is checked too: notes timestamped at different frames of a block 
+ * must start exactly at their frame.
+ *
+ * The resampler is checked with a A4 (440 Hz) at 44100 Hz: the pitch after resampling to 
+ * SAMPLE_RATE_HZ is measured with the zero crossings.
+ *
+ * The ADPCM codec is measured with a decaying piano like tone: signal to noise ratio after 
+ * encoding and decoding, and cycles of the decoder per frame.
+ *
+ * The block size sweep measures the CPU load of the audio callback (audio started) for several 
+ * block sizes with the worst case chord, to choose the audio_block_size of the config file.
+ */
+
+/*************************************************************************************************
+* Includes
+*************************************************************************************************/
+#include "daisy_seed.h"
+#include "common.h"
+#include "audio_engine.h"
+#include "envelope.h"
+#include "benchmark.h"
+#include "mixing_kernel.h"
+#include "config.h"
+#include "resampler.h"
+#include "adpcm.h"
+#include <math.h>
+
+using namespace daisy;
+using namespace daisy::seed;
+
+/*************************************************************************************************
+* Defines
+*************************************************************************************************/
+#define REFERENCE_NB_SIMULTANEOUS_NOTES 10 // Polyphony factor of the reference callback.
+#define BENCHMARK_BLOCK_SIZE    DEFAULT_AUDIO_BLOCK_SIZE // Number of frames per callback.
+#define BENCHMARK_NB_CALLBACKS  1000    // Number of callbacks measured for each test.
+#define BENCHMARK_NB_TESTS      3       // Number of tests (number of notes playing).
+#define KERNEL_CHECK_NB_FRAMES  61      // Odd number of frames to check the last frame too.
+#define KERNEL_CHECK_NB_TESTS   1000    // Number of random tests of the mixing kernel.
+#define EVENT_CHECK_BLOCK_SIZE  48      // Number of frames per callback of the event timing check.
+#define EVENT_CHECK_NB_NOTES    12      // Number of notes started (a fast trill over 2 blocks).
+#define EVENT_CHECK_NOTE_FRAMES 7       // Number of frames between 2 notes.
+#define PITCH_CHECK_FREQ_HZ     440     // Frequency of the A4.
+#define PITCH_CHECK_RATE_HZ     44100   // Sample rate of the A4 before resampling.
+#define PITCH_CHECK_CHUNK_SIZE  256     // Number of samples resampled at once.
+#define PITCH_CHECK_MAX_ERROR   0.1f    // Maximum frequency error in Hertz.
+#define ADPCM_CHECK_NB_BLOCKS   8       // Number of ADPCM blocks of the tone.
+#define ADPCM_CHECK_NB_FRAMES   (ADPCM_CHECK_NB_BLOCKS * ADPCM_BLOCK_NB_FRAMES)
+#define ADPCM_CHECK_FREQ_HZ     220     // Fundamental frequency of the tone.
+#define ADPCM_CHECK_NB_HARMONICS 8      // Number of harmonics of the tone.
+#define ADPCM_CHECK_MIN_SNR_DB  25.0f   // Minimum signal to noise ratio.
+#define SWEEP_NB_BLOCK_SIZES    7       // Number of block sizes measured by the sweep.
+#define SWEEP_DURATION_MS       2000    // Duration of the measure of each block size.
+
+/*************************************************************************************************
+* Types
+*************************************************************************************************/
+// Sound data used by the reference callback (first version of TSoundData).
+typedef struct
+{
+    size_t first_sample_pos;
+    size_t last_sample_pos;
+    bool playing;
+    size_t cur_playing_pos;
+    bool key_up;
+    size_t key_up_pos;
+    size_t pedal_up_pos;
+    float volume;
+    bool sound_end_soon;
+} TReferenceSoundData;
+
+/*************************************************************************************************
+* Variables
+*************************************************************************************************/
+// Sounds data of the reference callback.
+static TReferenceSoundData g_reference_sounds[NB_SOUNDS];
+
+// Number of notes playing for each test.
+static const uint16_t k_nb_notes_per_test[BENCHMARK_NB_TESTS] = {0, 10, 40};
+
+// Block sizes measured by the sweep.
+static const size_t k_sweep_block_sizes[SWEEP_NB_BLOCK_SIZES] = {1, 2, 4, 8, 16, 32, 64};
+
+// Output buffer of the callback (interleaved left/right).
+static float g_benchmark_out[2 * BENCHMARK_BLOCK_SIZE];
+
+// Buffers of the mixing kernel check (one extra sample to test unaligned positions).
+static int16_t g_kernel_samples[KERNEL_CHECK_NB_FRAMES + 1];
+static int32_t g_kernel_acc_ref[KERNEL_CHECK_NB_FRAMES];
+static int32_t g_kernel_acc_dsp[KERNEL_CHECK_NB_FRAMES];
+
+// Buffers of the stereo mixing kernel check (interleaved samples, left and right accumulators).
+static int16_t g_kernel_stereo_samples[2 * KERNEL_CHECK_NB_FRAMES + 1];
+static int32_t g_kernel_acc_right_ref[KERNEL_CHECK_NB_FRAMES];
+static int32_t g_kernel_acc_right_dsp[KERNEL_CHECK_NB_FRAMES];
+
+// Number of channels of the sounds, saved during the render path comparison.
+static uint8_t g_saved_nb_channels[NB_SOUND_DATA];
+
+// Samples of the A4 before and after resampling.
+static int16_t g_pitch_check_in[PITCH_CHECK_CHUNK_SIZE];
+static int16_t g_pitch_check_out[2 * PITCH_CHECK_CHUNK_SIZE];
+
+// Tone of the ADPCM check before and after the codec, and compressed tone.
+static int16_t g_adpcm_check_in[ADPCM_CHECK_NB_FRAMES];
+static int16_t g_adpcm_check_out[ADPCM_CHECK_NB_FRAMES];
+static int16_t g_adpcm_check_data[ADPCM_CHECK_NB_BLOCKS * ADPCM_BLOCK_SIZE_WORD];
+
+// Output buffer of the event timing check.
+static float g_event_check_out[2 * EVENT_CHECK_BLOCK_SIZE];
+
+/*************************************************************************************************
+* Functions implementation
+*************************************************************************************************/
+/* Reference audio callback: all the NB_SOUNDS sounds are scanned for every frame. */
+static void reference_audio_callback(AudioHandle::InterleavingInputBuffer in,
+    AudioHandle::InterleavingOutputBuffer out,
+    size_t                                size)
+{
+    float sig_float;
+    int16_t note_sig_int16;
+    float note_sig_float;
+    float release_factor;
+    float attack_factor;
+    TReferenceSoundData *pCurSounds;
+    size_t release_pos;
+
+    for(size_t block_idx = 0; block_idx < size; block_idx += 2)
+    {
+        sig_float = 0.0;
+        
+        for (size_t sound_idx = 0; sound_idx < NB_SOUNDS; sound_idx++)
+        {
+            pCurSounds = &g_reference_sounds[sound_idx];
+            
+            if (pCurSounds->playing == true)
+            {
+                note_sig_int16 = g_sample_data[pCurSounds->cur_playing_pos] / REFERENCE_NB_SIMULTANEOUS_NOTES;
+                note_sig_float = s162f(note_sig_int16);
+                note_sig_float *= pCurSounds->volume;
+
+                if (pCurSounds->cur_playing_pos - pCurSounds->first_sample_pos < WAV_ENV_START_NB_SAMPLES)
+                {
+                    attack_factor = (float)(pCurSounds->cur_playing_pos - pCurSounds->first_sample_pos);
+                    attack_factor /= (float)WAV_ENV_START_NB_SAMPLES;
+                    note_sig_float *= attack_factor;
+                }
+
+                if (   (pCurSounds->last_sample_pos - pCurSounds->cur_playing_pos <= WAV_ENV_END_NB_SAMPLES)
+                    && (pCurSounds->sound_end_soon == false) )
+                {
+                    pCurSounds->sound_end_soon = true;
+                    pCurSounds->key_up_pos     = pCurSounds->cur_playing_pos;
+                    pCurSounds->pedal_up_pos   = pCurSounds->cur_playing_pos;
+                }
+
+                if (   ((pCurSounds->key_up == true) && (g_pedal_damping == PEDAL_NB_DAMPING_LEVELS))
+                    || (pCurSounds->sound_end_soon == true) )
+                {
+                    if (pCurSounds->key_up_pos < pCurSounds->pedal_up_pos)
+                    {
+                        release_pos = pCurSounds->pedal_up_pos;
+                    }
+                    else
+                    {
+                        release_pos = pCurSounds->key_up_pos;
+                    }
+
+                    if (pCurSounds->cur_playing_pos - release_pos >= WAV_ENV_END_NB_SAMPLES)
+                    {
+                        pCurSounds->cur_playing_pos = pCurSounds->first_sample_pos;
+                        pCurSounds->key_up_pos      = pCurSounds->first_sample_pos;
+                        pCurSounds->pedal_up_pos    = pCurSounds->first_sample_pos;
+                        pCurSounds->playing         = false;
+                        pCurSounds->key_up          = false;
+                        pCurSounds->sound_end_soon  = false;
+                        pCurSounds->volume          = 0.0;
+                        release_factor              = 0.0;
+                    }
+                    else
+                    {
+                        release_factor = (float)(release_pos + WAV_ENV_END_NB_SAMPLES - pCurSounds->cur_playing_pos);
+                        release_factor /= (float)WAV_ENV_END_NB_SAMPLES;
+                    }
+                    
+                    note_sig_float *= release_factor;
+                }
+                
+                sig_float += note_sig_float;
+                
+                if (pCurSounds->cur_playing_pos < pCurSounds->last_sample_pos)
+                {
+                    pCurSounds->cur_playing_pos++;
+                }
+            }
+        }
+        
+        out[block_idx] = sig_float;
+        out[block_idx + 1] = sig_float;
+    }
+}
+
+/* Enable the cycle counter of the Cortex-M7 (DWT unit). */
+static void enable_cycle_counter(void)
+{
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->LAR = 0xC5ACCE55; // Unlock the DWT registers.
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+/* Start nb_notes notes, spread over the keyboard, for the reference callback and for the 
+   current callback. */
+static void start_benchmark_notes(uint16_t nb_notes)
+{
+    uint16_t key_index;
+    TReferenceSoundData *pRefSound;
+
+    stop_all_sounds();
+    memset(g_reference_sounds, 0, sizeof(g_reference_sounds));
+
+    for (uint16_t note_idx = 0; note_idx < nb_notes; note_idx++)
+    {
+        key_index = (note_idx * NB_KEYS) / nb_notes;
+
+        pRefSound = &g_reference_sounds[NB_SPECIAL_SOUNDS + key_index];
+        pRefSound->first_sample_pos = g_sounds[NB_SPECIAL_SOUNDS + key_index].first_sample_pos;
+        pRefSound->last_sample_pos  = g_sounds[NB_SPECIAL_SOUNDS + key_index].last_sample_pos;
+        pRefSound->cur_playing_pos  = pRefSound->first_sample_pos;
+        pRefSound->key_up_pos       = pRefSound->first_sample_pos;
+        pRefSound->pedal_up_pos     = pRefSound->first_sample_pos;
+        pRefSound->volume           = 1.0f;
+        pRefSound->playing          = true;
+
+        start_playing_a_note(key_index, 1.0f, get_sample_time());
+    }
+}
+
+/* Measure the average number of cycles per call of an audio callback with nb_notes playing. */
+static uint32_t measure_audio_callback(AudioHandle::InterleavingAudioCallback audio_callback, 
+                                       uint16_t nb_notes)
+{
+    uint32_t start_cycles;
+    uint32_t total_cycles = 0;
+
+    start_benchmark_notes(nb_notes);
+
+    for (uint32_t call_idx = 0; call_idx < BENCHMARK_NB_CALLBACKS; call_idx++)
+    {
+        start_cycles = DWT->CYCCNT;
+        audio_callback(NULL, g_benchmark_out, 2 * BENCHMARK_BLOCK_SIZE);
+        total_cycles += DWT->CYCCNT - start_cycles;
+    }
+
+    stop_all_sounds();
+
+    return total_cycles / BENCHMARK_NB_CALLBACKS;
+}
+
+/* Check that the DSP mixing kernel gives exactly the same results as the scalar reference 
+   kernel with random samples, gains and gain steps. Log the cycles of both kernels. */
+static void check_mixing_kernel(void)
+{
+#if defined(__ARM_FEATURE_DSP)
+    const int16_t *samples;
+    int32_t gain;
+    int32_t gain_step;
+    uint32_t start_cycles;
+    uint32_t ref_cycles = 0;
+    uint32_t dsp_cycles = 0;
+    uint32_t nb_errors = 0;
+
+    for (uint32_t test_idx = 0; test_idx < KERNEL_CHECK_NB_TESTS; test_idx++)
+    {
+        for (size_t idx = 0; idx <= KERNEL_CHECK_NB_FRAMES; idx++)
+        {
+            g_kernel_samples[idx] = (int16_t)rand();
+        }
+        for (size_t idx = 0; idx < KERNEL_CHECK_NB_FRAMES; idx++)
+        {
+            g_kernel_acc_ref[idx] = rand() - (RAND_MAX / 2);
+            g_kernel_acc_dsp[idx] = g_kernel_acc_ref[idx];
+        }
+        samples   = &g_kernel_samples[test_idx % 2];
+        gain      = rand() % MIX_GAIN_UNITY;
+        gain_step = (rand() % (MIX_GAIN_UNITY / 256)) - (MIX_GAIN_UNITY / 512);
+
+        start_cycles = DWT->CYCCNT;
+        mix_samples_q_ref(g_kernel_acc_ref, samples, KERNEL_CHECK_NB_FRAMES, gain, gain_step);
+        ref_cycles += DWT->CYCCNT - start_cycles;
+
+        start_cycles = DWT->CYCCNT;
+        mix_samples_q_dsp(g_kernel_acc_dsp, samples, KERNEL_CHECK_NB_FRAMES, gain, gain_step);
+        dsp_cycles += DWT->CYCCNT - start_cycles;
+
+        if (memcmp(g_kernel_acc_ref, g_kernel_acc_dsp, sizeof(g_kernel_acc_ref)) != 0)
+        {
+            nb_errors++;
+        }
+    }
+
+    g_hw.PrintLine("Mixing kernel (%d frames): reference=%ld dsp=%ld cycles nb_errors=%ld", 
+                   KERNEL_CHECK_NB_FRAMES, ref_cycles / KERNEL_CHECK_NB_TESTS, 
+                   dsp_cycles / KERNEL_CHECK_NB_TESTS, nb_errors);
+#else
+    g_hw.PrintLine("Mixing kernel: no DSP instructions, scalar kernel used.");
+#endif
+}
+
+/* Check that the DSP stereo mixing kernel gives exactly the same results as the scalar 
+   reference stereo kernel. Log the cycles of both kernels. */
+static void check_stereo_mixing_kernel(void)
+{
+#if defined(__ARM_FEATURE_DSP)
+    const int16_t *samples;
+    int32_t gain;
+    int32_t gain_step;
+    uint32_t start_cycles;
+    uint32_t ref_cycles = 0;
+    uint32_t dsp_cycles = 0;
+    uint32_t nb_errors = 0;
+
+    for (uint32_t test_idx = 0; test_idx < KERNEL_CHECK_NB_TESTS; test_idx++)
+    {
+        for (size_t idx = 0; idx <= 2 * KERNEL_CHECK_NB_FRAMES; idx++)
+        {
+            g_kernel_stereo_samples[idx] = (int16_t)rand();
+        }
+        for (size_t idx = 0; idx < KERNEL_CHECK_NB_FRAMES; idx++)
+        {
+            g_kernel_acc_ref[idx]       = rand() - (RAND_MAX / 2);
+            g_kernel_acc_dsp[idx]       = g_kernel_acc_ref[idx];
+            g_kernel_acc_right_ref[idx] = rand() - (RAND_MAX / 2);
+            g_kernel_acc_right_dsp[idx] = g_kernel_acc_right_ref[idx];
+        }
+        samples   = &g_kernel_stereo_samples[test_idx % 2];
+        gain      = rand() % MIX_GAIN_UNITY;
+        gain_step = (rand() % (MIX_GAIN_UNITY / 256)) - (MIX_GAIN_UNITY / 512);
+
+        start_cycles = DWT->CYCCNT;
+        mix_samples_q_stereo_ref(g_kernel_acc_ref, g_kernel_acc_right_ref, samples, 
+                                 KERNEL_CHECK_NB_FRAMES, gain, gain_step);
+        ref_cycles += DWT->CYCCNT - start_cycles;
+
+        start_cycles = DWT->CYCCNT;
+        mix_samples_q_stereo_dsp(g_kernel_acc_dsp, g_kernel_acc_right_dsp, samples, 
+                                 KERNEL_CHECK_NB_FRAMES, gain, gain_step);
+        dsp_cycles += DWT->CYCCNT - start_cycles;
+
+        if (   (memcmp(g_kernel_acc_ref, g_kernel_acc_dsp, sizeof(g_kernel_acc_ref)) != 0)
+            || (memcmp(g_kernel_acc_right_ref, g_kernel_acc_right_dsp, sizeof(g_kernel_acc_right_ref)) != 0))
+        {
+            nb_errors++;
+        }
+    }
+
+    g_hw.PrintLine("Stereo mixing kernel (%d frames): reference=%ld dsp=%ld cycles nb_errors=%ld", 
+                   KERNEL_CHECK_NB_FRAMES, ref_cycles / KERNEL_CHECK_NB_TESTS, 
+                   dsp_cycles / KERNEL_CHECK_NB_TESTS, nb_errors);
+#endif
+}
+
+/* Compare the cost of the render paths with MAX_NB_VOICES notes playing: mono notes, mono notes
+   panned by key and stereo notes (the samples of the bank are played as interleaved stereo 
+   samples). The number of channels of the sounds and the pan are restored afterwards. */
+static void compare_render_paths(AudioHandle::InterleavingAudioCallback audio_callback)
+{
+    uint32_t mono_cycles;
+    uint32_t panned_cycles;
+    uint32_t stereo_cycles;
+
+    for (size_t sound_idx = 0; sound_idx < NB_SOUND_DATA; sound_idx++)
+    {
+        g_saved_nb_channels[sound_idx] = g_sounds[sound_idx].nb_channels;
+        g_sounds[sound_idx].nb_channels = 1;
+    }
+
+    set_key_pan_width(0);
+    mono_cycles = measure_audio_callback(audio_callback, MAX_NB_VOICES);
+
+    set_key_pan_width(100);
+    panned_cycles = measure_audio_callback(audio_callback, MAX_NB_VOICES);
+
+    // The compressed sounds keep their number of channels (format of the blocks).
+    for (size_t sound_idx = 0; sound_idx < NB_SOUND_DATA; sound_idx++)
+    {
+        if (g_sounds[sound_idx].compressed == false)
+        {
+            g_sounds[sound_idx].nb_channels = 2;
+        }
+    }
+    stereo_cycles = measure_audio_callback(audio_callback, MAX_NB_VOICES);
+
+    for (size_t sound_idx = 0; sound_idx < NB_SOUND_DATA; sound_idx++)
+    {
+        g_sounds[sound_idx].nb_channels = g_saved_nb_channels[sound_idx];
+    }
+    set_key_pan_width(g_config.key_pan_width);
+
+    g_hw.PrintLine("Render paths (%d notes, cycles per callback): mono=%ld panned=%ld stereo=%ld", 
+                   MAX_NB_VOICES, mono_cycles, panned_cycles, stereo_cycles);
+}
+
+/* Check that the notes start at the frame of their timestamp: EVENT_CHECK_NB_NOTES notes are 
+   timestamped every EVENT_CHECK_NOTE_FRAMES frames from the start of a block (the last notes 
+   are in the next block) and the playing position of each voice is checked after 2 blocks. */
+static void check_event_timing(AudioHandle::InterleavingAudioCallback audio_callback)
+{
+    uint32_t first_note_frame;
+    uint16_t sound_idx;
+    size_t expected_pos;
+    size_t pos;
+    bool found;
+    uint32_t nb_errors = 0;
+    TVoice *pVoice;
+
+    stop_all_sounds();
+
+    // First block to know the sample time of the next block.
+    audio_callback(NULL, g_event_check_out, 2 * EVENT_CHECK_BLOCK_SIZE);
+    first_note_frame = g_block_start_frame + EVENT_CHECK_BLOCK_SIZE;
+
+    // An event is applied EVENT_LATENCY_NB_SAMPLES + one block after its timestamp.
+    for (uint16_t note_idx = 0; note_idx < EVENT_CHECK_NB_NOTES; note_idx++)
+    {
+        start_playing_a_note(note_idx, 1.0f,   first_note_frame + note_idx * EVENT_CHECK_NOTE_FRAMES 
+                                             - EVENT_LATENCY_NB_SAMPLES - EVENT_CHECK_BLOCK_SIZE);
+    }
+
+    audio_callback(NULL, g_event_check_out, 2 * EVENT_CHECK_BLOCK_SIZE);
+    audio_callback(NULL, g_event_check_out, 2 * EVENT_CHECK_BLOCK_SIZE);
+
+    for (uint16_t note_idx = 0; note_idx < EVENT_CHECK_NB_NOTES; note_idx++)
+    {
+        sound_idx = NB_SPECIAL_SOUNDS + note_idx;
+        expected_pos = 2 * EVENT_CHECK_BLOCK_SIZE - note_idx * EVENT_CHECK_NOTE_FRAMES;
+        found = false;
+
+        for (size_t list_idx = 0; list_idx < g_nb_active_voices; list_idx++)
+        {
+            pVoice = &g_voices[g_active_voices[list_idx]];
+            if (pVoice->sound_idx == sound_idx)
+            {
+                pos = (pVoice->cur_playing_pos - g_sounds[sound_idx].first_sample_pos) / pVoice->nb_channels;
+                found = (pos == expected_pos);
+                if (found == false)
+                {
+                    g_hw.PrintLine("Note %d: pos=%d expected=%d", note_idx, pos, expected_pos);
+                }
+            }
+        }
+
+        if (found == false)
+        {
+            nb_errors++;
+        }
+    }
+
+    stop_all_sounds();
+
+    g_hw.PrintLine("Event timing (%d notes, %d frames per callback): nb_errors=%ld", 
+                   EVENT_CHECK_NB_NOTES, EVENT_CHECK_BLOCK_SIZE, nb_errors);
+}
+
+/* Resample one second of a A4 from PITCH_CHECK_RATE_HZ to SAMPLE_RATE_HZ and measure its pitch
+   (time between the first and the last rising zero crossings). */
+static void check_resampler_pitch(void)
+{
+    size_t nb_out_samples;
+    size_t out_pos = 0;
+    int16_t prev_sample = 0;
+    float crossing_pos;
+    float first_crossing_pos = 0.0f;
+    float last_crossing_pos = 0.0f;
+    uint32_t nb_crossings = 0;
+    float freq;
+
+    init_resampler(PITCH_CHECK_RATE_HZ, SAMPLE_RATE_HZ, 1);
+
+    for (uint32_t chunk_pos = 0; chunk_pos < PITCH_CHECK_RATE_HZ; chunk_pos += PITCH_CHECK_CHUNK_SIZE)
+    {
+        for (uint32_t idx = 0; idx < PITCH_CHECK_CHUNK_SIZE; idx++)
+        {
+            // Exact phase: PITCH_CHECK_FREQ_HZ periods per second.
+            g_pitch_check_in[idx] = (int16_t)(16000.0f * sinf(  2.0f * (float)M_PI / PITCH_CHECK_RATE_HZ
+                                                              * (float)(((chunk_pos + idx) * PITCH_CHECK_FREQ_HZ) 
+                                                                        % PITCH_CHECK_RATE_HZ)));
+        }
+
+        nb_out_samples = resample(g_pitch_check_in, PITCH_CHECK_CHUNK_SIZE, g_pitch_check_out, 
+                                  2 * PITCH_CHECK_CHUNK_SIZE);
+
+        for (size_t idx = 0; idx < nb_out_samples; idx++)
+        {
+            // Rising zero crossing, linear interpolation between the 2 samples. The start of 
+            // the filter output (transient) is skipped.
+            if ((prev_sample < 0) && (g_pitch_check_out[idx] >= 0) && (out_pos > PITCH_CHECK_CHUNK_SIZE))
+            {
+                crossing_pos =   (float)out_pos - 1.0f 
+                               + (float)(-prev_sample) / (float)(g_pitch_check_out[idx] - prev_sample);
+                if (nb_crossings == 0)
+                {
+                    first_crossing_pos = crossing_pos;
+                }
+                last_crossing_pos = crossing_pos;
+                nb_crossings++;
+            }
+            prev_sample = g_pitch_check_out[idx];
+            out_pos++;
+        }
+    }
+
+    freq = (float)(nb_crossings - 1) * SAMPLE_RATE_HZ / (last_crossing_pos - first_crossing_pos);
+
+    g_hw.Print("Resampler pitch (A4 %d Hz -> %d Hz): freq="FLT_FMT3"Hz ", 
+               PITCH_CHECK_RATE_HZ, SAMPLE_RATE_HZ, FLT_VAR3(freq));
+    g_hw.PrintLine("%s", (fabsf(freq - PITCH_CHECK_FREQ_HZ) <= PITCH_CHECK_MAX_ERROR) ? "OK" : "KO");
+}
+
+/* Encode and decode a decaying tone (harmonics of ADPCM_CHECK_FREQ_HZ) with the ADPCM codec.
+   Log the signal to noise ratio and the cycles of the decoder per frame. */
+static void check_adpcm_codec(void)
+{
+    float sample;
+    float signal_energy = 0.0f;
+    float noise_energy = 0.0f;
+    float error;
+    float snr_db;
+    uint32_t start_cycles;
+    uint32_t decode_cycles;
+
+    for (size_t frame = 0; frame < ADPCM_CHECK_NB_FRAMES; frame++)
+    {
+        sample = 0.0f;
+        for (uint8_t harmonic = 1; harmonic <= ADPCM_CHECK_NB_HARMONICS; harmonic++)
+        {
+            sample += sinf(  2.0f * (float)M_PI * (float)(harmonic * ADPCM_CHECK_FREQ_HZ) 
+                           * (float)frame / SAMPLE_RATE_HZ) / (float)harmonic;
+        }
+        g_adpcm_check_in[frame] = (int16_t)(10000.0f * sample * expf(-8.0f * (float)frame / ADPCM_CHECK_NB_FRAMES));
+    }
+
+    encode_adpcm(g_adpcm_check_in, ADPCM_CHECK_NB_FRAMES, 1, g_adpcm_check_data);
+
+    start_cycles = DWT->CYCCNT;
+    decode_adpcm(g_adpcm_check_data, ADPCM_CHECK_NB_FRAMES, 1, g_adpcm_check_out);
+    decode_cycles = DWT->CYCCNT - start_cycles;
+
+    for (size_t frame = 0; frame < ADPCM_CHECK_NB_FRAMES; frame++)
+    {
+        error = (float)g_adpcm_check_out[frame] - (float)g_adpcm_check_in[frame];
+        signal_energy += (float)g_adpcm_check_in[frame] * (float)g_adpcm_check_in[frame];
+        noise_energy  += error * error;
+    }
+    snr_db = 10.0f * log10f(signal_energy / (noise_energy + 1.0f));
+
+    g_hw.Print("ADPCM codec (%d frames): SNR="FLT_FMT3"dB decoder=%ld cycles per 100 frames ", 
+               ADPCM_CHECK_NB_FRAMES, FLT_VAR3(snr_db), (decode_cycles * 100) / ADPCM_CHECK_NB_FRAMES);
+    g_hw.PrintLine("%s", (snr_db >= ADPCM_CHECK_MIN_SNR_DB) ? "OK" : "KO");
+}
+
+/* Compare the reference audio callback with the audio callback given in parameter for 
+   0, 10 and 40 notes playing. Must be called before the audio is started. */
+void run_audio_callback_benchmark(AudioHandle::InterleavingAudioCallback audio_callback)
+{
+    uint16_t nb_notes;
+    uint32_t reference_cycles;
+    uint32_t current_cycles;
+
+    enable_cycle_counter();
+
+    g_hw.PrintLine("Audio callback benchmark (%d frames per callback, cycles per callback):", 
+                   BENCHMARK_BLOCK_SIZE);
+
+    for (uint8_t test_idx = 0; test_idx < BENCHMARK_NB_TESTS; test_idx++)
+    {
+        nb_notes = k_nb_notes_per_test[test_idx];
+
+        reference_cycles = measure_audio_callback(reference_audio_callback, nb_notes);
+        current_cycles   = measure_audio_callback(audio_callback, nb_notes);
+
+        g_hw.PrintLine("nb_notes=%d reference=%ld current=%ld", nb_notes, reference_cycles, current_cycles);
+    }
+
+    compare_render_paths(audio_callback);
+    check_mixing_kernel();
+    check_stereo_mixing_kernel();
+    check_event_timing(audio_callback);
+    check_resampler_pitch();
+    check_adpcm_codec();
+}
+
+/* Measure the CPU load of the audio callback and display the theoretical latency for several 
+   block sizes, with the worst case chord (MAX_NB_VOICES notes playing). 
+   Must be called before the audio is started. */
+void run_block_size_sweep(void)
+{
+    g_hw.PrintLine("Block size sweep (%d notes playing):", MAX_NB_VOICES);
+
+    for (uint8_t test_idx = 0; test_idx < SWEEP_NB_BLOCK_SIZES; test_idx++)
+    {
+        // The notes are started by the first audio callback.
+        start_benchmark_notes(MAX_NB_VOICES);
+        start_audio(k_sweep_block_sizes[test_idx]);
+
+        System::Delay(SWEEP_DURATION_MS);
+        display_audio_load();
+
+        stop_audio();
+    }
+
+    stop_all_sounds();
+}
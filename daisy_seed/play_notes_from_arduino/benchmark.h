@@ -0,0 +1,20 @@
+/* 
+ *  Header file of benchmark.cpp. See this file for more details
+ */ 
+#ifndef BENCHMARK
+#define BENCHMARK
+
+/*************************************************************************************************
+* Includes
+*************************************************************************************************/
+#include "daisy_seed.h"
+
+using namespace daisy;
+
+/*************************************************************************************************
+* Functions
+*************************************************************************************************/
+extern void run_audio_callback_benchmark(AudioHandle::InterleavingAudioCallback audio_callback);
+extern void run_block_size_sweep(void);
+
+#endif //#ifndef BENCHMARK
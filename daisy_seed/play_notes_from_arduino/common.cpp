@@ -17,8 +17,17 @@ using namespace daisy::seed;
 // Daisy Seed hardware
 DaisySeed      g_hw;
 
-// Variable defining all the notes and special sounds. 
-TSoundData     g_sounds[NB_SOUNDS];
+// Sound banks loaded in RAM.
+TSoundBank     g_sound_banks[NB_SOUND_BANK_SLOTS];
+
+// Slot of the sound bank played (changed by the audio callback only).
+volatile uint8_t g_sound_bank_slot = 0;
+
+// Notes and special sounds of the sound bank played.
+TSoundData     *g_sounds = g_sound_banks[0].sounds;
+
+// Number of velocity layers of the notes of the sound bank played.
+uint8_t        g_nb_velocity_layers = 1;
 
 /*************************************************************************************************
 * Functions implementation
@@ -33,30 +42,12 @@ void toggle_right_led(void)
     g_hw.SetLed(led_state);
 }
 
-/* Start playing a note with a certain amplification factor from 0.0 to 1.0. */
-void start_playing_a_note(uint16_t key_index, float amplification)
-{
-    TSoundData *pCurNote;
-    pCurNote = &g_sounds[NB_SPECIAL_SOUNDS + key_index];
-
-    pCurNote->volume = amplification;
-
-    pCurNote->cur_playing_pos = pCurNote->first_sample_pos;
-    pCurNote->key_up_pos      = pCurNote->first_sample_pos;
-    pCurNote->pedal_up_pos    = pCurNote->first_sample_pos;
-    pCurNote->key_up          = false;
-    pCurNote->sound_end_soon  = false;
-
-    // Start the note playing by the AudioCallback function.
-    pCurNote->playing = true;
-}
-
-/* Stop playing a note. */
-void stop_playing_a_note(uint16_t key_index)
+/* Return the number of channels of the data of a file once loaded in RAM. */
+uint8_t get_loaded_nb_channels(uint8_t file_nb_channels)
 {
-    TSoundData *pCurNote;
-    pCurNote = &g_sounds[NB_SPECIAL_SOUNDS + key_index];
-
-    pCurNote->key_up_pos = pCurNote->cur_playing_pos;
-    pCurNote->key_up = true;
+    #if (ENABLE_STEREO_SAMPLES == 1)
+        return file_nb_channels;
+    #else
+        return 1;
+    #endif
 }
@@ -30,6 +30,20 @@ using namespace daisy::seed;
 // Sounds
 #define NB_SOUNDS                   (NB_KEYS + NB_SPECIAL_SOUNDS)
 
+// Velocity layers of the notes. g_sounds contains the special sounds, then the notes of 
+// layer 0 (softest), the notes of layer 1... The special sounds have one layer.
+#define MAX_NB_VELOCITY_LAYERS      4
+#define NB_SOUND_DATA               (NB_SOUNDS + (MAX_NB_VELOCITY_LAYERS - 1) * NB_KEYS)
+
+// Sound banks in RAM: the bank played and the bank loaded while it plays (see 
+// switch_sound_bank in audio_engine.cpp).
+#define NB_SOUND_BANK_SLOTS         2
+
+#define SAMPLE_RATE_HZ              48000   // Hertz (sample rate of the audio output, SAI_48KHZ)
+
+// Load the stereo files in stereo (1), or mix the wav files down to mono to use half the RAM (0).
+#define ENABLE_STEREO_SAMPLES       1
+
 /*************************************************************************************************
 * Types
 *************************************************************************************************/
@@ -38,32 +52,64 @@ using namespace daisy::seed;
 typedef struct
 {
     // All ..._pos fields define positions in the buffer g_sample_data.
+    // The samples of a stereo sound are interleaved (left, right): a frame is 2 samples.
     size_t first_sample_pos; // Position of the first sample of a note.
     size_t last_sample_pos;  // Position of the last sample of a note.
-    size_t nb_samples;       // Number of samples of a note.
-    bool playing;            // Define if the note is currently playing (key down).
-    size_t cur_playing_pos;  // Define the position of the sample to play.
-    bool key_up;             // Define if the note is in the release phase (key up).
-    size_t key_up_pos;       // Define the position where the key was released.
-    size_t pedal_up_pos;     // Define the position where the pedal was released.
-    float volume;            // Define the amplification wich depends on the attack time.
-    bool sound_end_soon;     // Define if the note is reaching the end of the sample.
+    size_t nb_samples;       // Number of samples of a note (all channels).
+    uint8_t nb_channels;     // Number of channels (1: mono, 2: stereo).
+
+    // Sound streamed from the SD card (see disk_streamer.cpp): only the head is in RAM, the 
+    // positions after the head are not in g_sample_data.
+    size_t nb_head_samples;      // Number of samples of the head (0: the sound is not streamed).
+    uint32_t stream_file_offset; // Position in the wav file of the first sample of the tail (bytes).
+
+    // Sound compressed in RAM (see adpcm.cpp): the positions after first_sample_pos are the 
+    // positions of the decoded samples, the compressed data in g_sample_data is smaller.
+    bool compressed;
+
+    // Loop of the sound (see set_sound_loop in main.cpp): the frames from loop_start_pos to 
+    // loop_end_pos (excluded) are played again and again until the end of the release. The frame
+    // at loop_end_pos is a copy of the frame at loop_start_pos.
+    bool looped;
+    size_t loop_start_pos;
+    size_t loop_end_pos;
 } TSoundData;
 
+// Sound bank loaded in a slot. The notes are in g_sample_data from first_note_pos to 
+// end_note_pos (excluded), the special sounds are shared by all the slots.
+typedef struct
+{
+    TSoundData sounds[NB_SOUND_DATA];
+    uint8_t nb_velocity_layers;
+    size_t first_note_pos;
+    size_t end_note_pos;
+} TSoundBank;
+
 /*************************************************************************************************
 * Variables 
 *************************************************************************************************/
 // Daisy Seed hardware
 extern DaisySeed      g_hw;
 
-// Variable defining all the notes and special sounds. 
-extern TSoundData     g_sounds[NB_SOUNDS];
+// Sound banks loaded in RAM.
+extern TSoundBank     g_sound_banks[NB_SOUND_BANK_SLOTS];
+
+// Slot of the sound bank played (changed by the audio callback only).
+extern volatile uint8_t g_sound_bank_slot;
+
+// Notes and special sounds of the sound bank played (g_sound_banks[g_sound_bank_slot].sounds).
+extern TSoundData     *g_sounds;
+
+// Number of velocity layers of the notes of the sound bank played.
+extern uint8_t        g_nb_velocity_layers;
+
+// Buffer in external RAM containing all the samples
+extern int16_t        g_sample_data[];
 
 /*************************************************************************************************
 * Functions 
 *************************************************************************************************/
 extern void toggle_right_led(void);
-extern void start_playing_a_note(uint16_t key_index, float amplification);
-extern void stop_playing_a_note(uint16_t key_index);
+extern uint8_t get_loaded_nb_channels(uint8_t file_nb_channels);
 
 #endif //#ifndef COMMON
\ No newline at end of file
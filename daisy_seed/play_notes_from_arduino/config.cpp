@@ -0,0 +1,129 @@
+/*
+ * This module reads the config file of the SD card (CONFIG_FILE_PATH).
+ *
+ * The config file is a text file with one parameter per line: "name=value". Unknown names and 
+ * lines starting with '#' are ignored. A missing parameter or a missing file keeps the default 
+ * value. Example:
+ *
+ *     # Number of frames per audio callback (1 to 256).
+ *     audio_block_size=8
+ *     # Measure the CPU load of all the block sizes at startup (0 or 1).
+ *     block_size_sweep=0
+ *     # Pan of the keys of the mono banks, low keys on the left (0 to 100 percent, 0: no pan).
+ *     key_pan_width=50
+ */
+
+/*************************************************************************************************
+* Includes
+*************************************************************************************************/
+#include "daisy_seed.h"
+#include "fatfs.h"
+#include "common.h"
+#include "config.h"
+#include <stdlib.h>
+
+using namespace daisy;
+
+/*************************************************************************************************
+* Variables
+*************************************************************************************************/
+// Parameters of the config file.
+TConfig g_config;
+
+// Content of the config file (null terminated).
+static char g_config_file_data[CONFIG_FILE_MAX_SIZE + 1];
+
+/*************************************************************************************************
+* Functions implementation
+*************************************************************************************************/
+
+/* Set the default value of all the parameters. */
+static void set_default_config(void)
+{
+    g_config.audio_block_size = DEFAULT_AUDIO_BLOCK_SIZE;
+    g_config.block_size_sweep = false;
+    g_config.key_pan_width    = 0;
+}
+
+/* Set a parameter from a line "name=value" of the config file. */
+static void parse_config_line(char *line)
+{
+    char *value_str = strchr(line, '=');
+    long value;
+
+    if ((line[0] == '#') || (value_str == NULL))
+    {
+        return;
+    }
+    *value_str = 0;
+    value = strtol(value_str + 1, NULL, 10);
+
+    if (strcmp(line, "audio_block_size") == 0)
+    {
+        if ((value >= 1) && (value <= MAX_AUDIO_BLOCK_SIZE))
+        {
+            g_config.audio_block_size = value;
+        }
+        else
+        {
+            g_hw.PrintLine("Error: audio_block_size=%ld not in [1, %d]", value, MAX_AUDIO_BLOCK_SIZE);
+        }
+    }
+    else if (strcmp(line, "block_size_sweep") == 0)
+    {
+        g_config.block_size_sweep = (value != 0);
+    }
+    else if (strcmp(line, "key_pan_width") == 0)
+    {
+        if ((value >= 0) && (value <= 100))
+        {
+            g_config.key_pan_width = value;
+        }
+        else
+        {
+            g_hw.PrintLine("Error: key_pan_width=%ld not in [0, 100]", value);
+        }
+    }
+    else
+    {
+        g_hw.PrintLine("Unknown config parameter %s", line);
+    }
+}
+
+/* Read the config file and set the parameters in g_config. */
+void read_config_file(void)
+{
+    static FIL SDFile;
+    FRESULT result;
+    UINT nb_bytes_read;
+    char *line;
+
+    set_default_config();
+
+    result = f_open(&SDFile, CONFIG_FILE_PATH, FA_READ);
+    if (result != FR_OK)
+    {
+        g_hw.PrintLine("No config file. Default parameters used. result=%d", result);
+        return;
+    }
+
+    result = f_read(&SDFile, g_config_file_data, CONFIG_FILE_MAX_SIZE, &nb_bytes_read);
+    if (result != FR_OK)
+    {
+        g_hw.PrintLine("f_read result KO. result=%d", result);
+        nb_bytes_read = 0;
+    }
+    f_close(&SDFile);
+
+    g_config_file_data[nb_bytes_read] = 0;
+
+    line = strtok(g_config_file_data, "\r\n");
+    while (line != NULL)
+    {
+        parse_config_line(line);
+        line = strtok(NULL, "\r\n");
+    }
+
+    g_hw.PrintLine("Config: audio_block_size=%d block_size_sweep=%d key_pan_width=%d", 
+                   g_config.audio_block_size, g_config.block_size_sweep, g_config.key_pan_width);
+}
@@ -0,0 +1,43 @@
+/* 
+ *  Header file of config.cpp. See this file for more details
+ */ 
+#ifndef CONFIG
+#define CONFIG
+
+/*************************************************************************************************
+* Includes
+*************************************************************************************************/
+#include "daisy_seed.h"
+
+/*************************************************************************************************
+* Defines
+*************************************************************************************************/
+#define CONFIG_FILE_PATH            "/piano_wav/config.txt"
+#define CONFIG_FILE_MAX_SIZE        1024    // Maximum size of the config file in bytes.
+
+// Audio block size (number of frames handled per audio callback).
+#define DEFAULT_AUDIO_BLOCK_SIZE    4
+#define MAX_AUDIO_BLOCK_SIZE        256
+
+/*************************************************************************************************
+* Types
+*************************************************************************************************/
+// Parameters read from the config file.
+typedef struct
+{
+    size_t audio_block_size;    // Number of frames handled per audio callback.
+    bool block_size_sweep;      // Measure the CPU load of all the block sizes at startup.
+    uint8_t key_pan_width;      // Pan of the keys of the mono banks in percent (0: no pan).
+} TConfig;
+
+/*************************************************************************************************
+* Variables 
+*************************************************************************************************/
+extern TConfig g_config;
+
+/*************************************************************************************************
+* Functions 
+*************************************************************************************************/
+extern void read_config_file(void);
+
+#endif //#ifndef CONFIG
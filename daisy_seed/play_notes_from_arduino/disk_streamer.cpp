@@ -0,0 +1,336 @@
+/*
+ * This module streams the end of the notes from the SD card, to play sound banks bigger than
+ * the RAM.
+ *
+ * When a sound bank does not fit in RAM (see load_sound_bank in main.cpp), only the first
+ * STREAM_HEAD_MS of each note (head) are loaded in RAM. The rest of the note (tail) is read from
+ * the wav file while the note is played, in a stream buffer of the voice (one stream per voice).
+ *
+ * The stream buffer is a ring buffer of two halves of STREAM_HALF_NB_FRAMES frames. The loader
+ * (service_streams, called by the main loop) reads the next half from the SD card (SDMMC DMA)
+ * as soon as the voice has played the previous content of this half. The first half is read
+ * while the head is played. The STREAM_GUARD_NB_FRAMES frames after the end of the buffer are a
+ * copy of its first frames: the frames read by a render segment are always contiguous.
+ *
+ * The loader serves first the stream with the fewest frames loaded ahead of the voice. When a
+ * voice reaches frames not loaded yet, the segment is played silent and counted as an underrun.
+ * A stream whose file can't be read (error or short read) is closed: the rest of its tail is
+ * played silent.
+ *
+ * The streams are started and stopped by the audio callback (start of a voice, end of a voice).
+ * Each start or stop increments the request counter of the stream: the loader handles the last
+ * request only, and the frames loaded for a previous request are never committed.
+ *
+ * The wav file of a stream is the file of the sound in the sound bank played at the start of the
+ * stream: a voice of the previous sound bank goes on reading its tail after a bank switch.
+ */
+
+/*************************************************************************************************
+* Includes
+*************************************************************************************************/
+#include "daisy_seed.h"
+#include "fatfs.h"
+#include "common.h"
+#include "audio_engine.h"
+#include "disk_streamer.h"
+
+using namespace daisy;
+
+/*************************************************************************************************
+* Defines
+*************************************************************************************************/
+#define NO_STREAM_SOUND             0xFFFF
+
+/*************************************************************************************************
+* Types
+*************************************************************************************************/
+// State of the stream of a voice.
+typedef struct
+{
+    volatile uint32_t request;          // Incremented by the audio callback at each start or stop.
+    uint32_t served_request;            // Last request handled by the loader.
+    uint16_t sound_idx;                 // Sound streamed (NO_STREAM_SOUND: stream stopped).
+    const char *file_path;              // Wav file of the sound streamed.
+    uint32_t file_offset;               // Position of the tail in the wav file (bytes).
+    uint8_t nb_channels;                // Number of channels of the sound streamed.
+    uint32_t nb_tail_frames;            // Number of frames of the tail of the sound.
+    volatile uint32_t nb_loaded_frames; // Number of frames of the tail loaded since the start.
+    volatile int32_t read_frame;        // Frame of the tail played (negative in the head).
+    bool file_open;                     // Define if the wav file is open (loader only).
+} TStream;
+
+/*************************************************************************************************
+* Variables
+*************************************************************************************************/
+// Number of render segments played without their samples.
+volatile uint32_t g_nb_stream_underruns;
+
+// Streams of the voices.
+static TStream g_streams[NB_VOICES];
+
+// Wav files of the streams (loader only).
+static FIL g_stream_files[NB_VOICES];
+
+// Stream buffers of the voices (interleaved frames, followed by the guard frames).
+static int16_t DSY_SDRAM_BSS g_stream_buffers[NB_VOICES][(STREAM_BUFFER_NB_FRAMES + STREAM_GUARD_NB_FRAMES) * 2]
+                             __attribute__((aligned(32)));
+
+// Path of the wav file of each sound streamed, for the sound bank of each slot.
+static char DSY_SDRAM_BSS g_stream_file_paths[NB_SOUND_BANK_SLOTS][NB_SOUND_DATA][MAX_FILE_PATH_LEN];
+
+// Number of underruns displayed by the last call of display_stream_activity.
+static uint32_t g_displayed_nb_underruns;
+
+/*************************************************************************************************
+* Functions implementation
+*************************************************************************************************/
+
+/* Set the path of the wav file of a sound whose tail is streamed (see TSoundData), in the sound 
+   bank of a slot. */
+void set_stream_file_path(uint8_t bank_slot, uint16_t sound_idx, const char *file_path)
+{
+    strcpy(g_stream_file_paths[bank_slot][sound_idx], file_path);
+}
+
+/* Start streaming the tail of a sound for a voice (called by the audio callback). */
+void start_stream(uint16_t stream_idx, uint16_t sound_idx)
+{
+    TStream *pStream = &g_streams[stream_idx];
+    const TSoundData *pSound = &g_sounds[sound_idx];
+
+    pStream->sound_idx        = sound_idx;
+    pStream->file_path        = g_stream_file_paths[g_sound_bank_slot][sound_idx];
+    pStream->file_offset      = pSound->stream_file_offset;
+    pStream->nb_channels      = pSound->nb_channels;
+    pStream->nb_tail_frames   = (pSound->nb_samples - pSound->nb_head_samples) / pSound->nb_channels;
+    pStream->nb_loaded_frames = 0;
+    pStream->read_frame       = -(int32_t)(pSound->nb_head_samples / pSound->nb_channels);
+
+    __DMB();
+    pStream->request = pStream->request + 1;
+}
+
+/* Stop the stream of a voice (called by the audio callback). */
+void stop_stream(uint16_t stream_idx)
+{
+    TStream *pStream = &g_streams[stream_idx];
+
+    pStream->sound_idx        = NO_STREAM_SOUND;
+    pStream->nb_loaded_frames = 0;
+
+    __DMB();
+    pStream->request = pStream->request + 1;
+}
+
+/* Stop all the streams (audio stopped or no sound playing). */
+void stop_all_streams(void)
+{
+    for (uint16_t stream_idx = 0; stream_idx < NB_VOICES; stream_idx++)
+    {
+        stop_stream(stream_idx);
+    }
+}
+
+/* Set the frame of the tail played by the voice of a stream (called by the audio callback). */
+void set_stream_read_frame(uint16_t stream_idx, int32_t read_frame)
+{
+    g_streams[stream_idx].read_frame = read_frame;
+}
+
+/* Return the samples of the frame tail_frame of the tail of a stream and in p_nb_frames the
+   number of contiguous frames loaded from this frame (called by the audio callback).
+   Return NULL if the frame is not loaded yet. */
+const int16_t *get_stream_samples(uint16_t stream_idx, uint32_t tail_frame, size_t *p_nb_frames)
+{
+    TStream *pStream = &g_streams[stream_idx];
+    uint32_t nb_loaded_frames = pStream->nb_loaded_frames;
+    uint32_t buffer_frame = tail_frame % STREAM_BUFFER_NB_FRAMES;
+
+    if (tail_frame >= nb_loaded_frames)
+    {
+        *p_nb_frames = 0;
+        return NULL;
+    }
+
+    *p_nb_frames = nb_loaded_frames - tail_frame;
+    if (*p_nb_frames > STREAM_BUFFER_NB_FRAMES + STREAM_GUARD_NB_FRAMES - buffer_frame)
+    {
+        *p_nb_frames = STREAM_BUFFER_NB_FRAMES + STREAM_GUARD_NB_FRAMES - buffer_frame;
+    }
+
+    return &g_stream_buffers[stream_idx][buffer_frame * pStream->nb_channels];
+}
+
+/* Copy the state of a stream written by the audio callback and return the request copied. */
+static uint32_t read_stream_request(uint16_t stream_idx, TStream *pCopy)
+{
+    uint32_t primask = __get_PRIMASK();
+
+    __disable_irq();
+    *pCopy = g_streams[stream_idx];
+    __set_PRIMASK(primask);
+
+    return pCopy->request;
+}
+
+/* Add frames to the frames loaded of a stream if the request has not changed. */
+static void commit_stream_frames(uint16_t stream_idx, uint32_t request, uint32_t nb_frames)
+{
+    uint32_t primask = __get_PRIMASK();
+
+    __disable_irq();
+    if (g_streams[stream_idx].request == request)
+    {
+        g_streams[stream_idx].nb_loaded_frames += nb_frames;
+    }
+    __set_PRIMASK(primask);
+}
+
+/* Handle a new request of a stream: close the previous wav file and open the new one at the
+   start of the tail. */
+static void open_stream_file(uint16_t stream_idx, const TStream *pCopy)
+{
+    TStream *pStream = &g_streams[stream_idx];
+    FRESULT result;
+
+    if (pStream->file_open == true)
+    {
+        f_close(&g_stream_files[stream_idx]);
+        pStream->file_open = false;
+    }
+    pStream->served_request = pCopy->request;
+
+    if (pCopy->sound_idx == NO_STREAM_SOUND)
+    {
+        return;
+    }
+
+    result = f_open(&g_stream_files[stream_idx], pCopy->file_path, FA_READ);
+    if (result == FR_OK)
+    {
+        result = f_lseek(&g_stream_files[stream_idx], pCopy->file_offset);
+        if (result == FR_OK)
+        {
+            pStream->file_open = true;
+        }
+        else
+        {
+            f_close(&g_stream_files[stream_idx]);
+        }
+    }
+    if (result != FR_OK)
+    {
+        g_hw.PrintLine("Stream %d: f_open/f_lseek result KO. result=%d", stream_idx, result);
+    }
+}
+
+/* Read the next half of the stream buffer of a stream from its wav file. */
+static void load_stream_frames(uint16_t stream_idx, const TStream *pCopy)
+{
+    uint32_t buffer_frame = pCopy->nb_loaded_frames % STREAM_BUFFER_NB_FRAMES;
+    uint32_t nb_frames = pCopy->nb_tail_frames - pCopy->nb_loaded_frames;
+    int16_t *pBuffer = g_stream_buffers[stream_idx];
+    size_t frame_size = 2 * pCopy->nb_channels;
+    size_t bytesRead = 0;
+    FRESULT result;
+
+    if (nb_frames > STREAM_HALF_NB_FRAMES)
+    {
+        nb_frames = STREAM_HALF_NB_FRAMES;
+    }
+
+    // The cache must not hold old samples of this half (the SD card writes in RAM by DMA).
+    SCB_CleanInvalidateDCache_by_Addr((uint32_t *)&pBuffer[buffer_frame * pCopy->nb_channels],
+                                      nb_frames * frame_size);
+
+    result = f_read(&g_stream_files[stream_idx], &pBuffer[buffer_frame * pCopy->nb_channels],
+                    nb_frames * frame_size, &bytesRead);
+    if ((result != FR_OK) || (bytesRead != nb_frames * frame_size))
+    {
+        // The position in the file is lost: the stream is not read any more (the voice plays 
+        // the rest of its tail silent, counted as underruns) until its next request.
+        g_hw.PrintLine("Stream %d: f_read result KO. result=%d", stream_idx, result);
+        f_close(&g_stream_files[stream_idx]);
+        g_streams[stream_idx].file_open = false;
+        return;
+    }
+
+    // Guard frames: copy of the first frames after the end of the buffer.
+    if (buffer_frame == 0)
+    {
+        memcpy(&pBuffer[STREAM_BUFFER_NB_FRAMES * pCopy->nb_channels], pBuffer,
+               STREAM_GUARD_NB_FRAMES * frame_size);
+    }
+
+    __DMB();
+    commit_stream_frames(stream_idx, pCopy->request, nb_frames);
+}
+
+/* Loader of the streams (called by the main loop): handle one new request or read one half
+   stream buffer, the stream with the fewest frames loaded ahead of its voice first. */
+void service_streams(void)
+{
+    TStream copy;
+    uint16_t found_stream_idx = NB_VOICES;
+    int32_t nb_frames_ahead;
+    int32_t min_nb_frames_ahead = 0;
+    int32_t first_needed_frame;
+
+    for (uint16_t stream_idx = 0; stream_idx < NB_VOICES; stream_idx++)
+    {
+        if (read_stream_request(stream_idx, &copy) != g_streams[stream_idx].served_request)
+        {
+            open_stream_file(stream_idx, &copy);
+            return;
+        }
+
+        if (   (copy.sound_idx == NO_STREAM_SOUND) || (g_streams[stream_idx].file_open == false)
+            || (copy.nb_loaded_frames >= copy.nb_tail_frames))
+        {
+            continue;
+        }
+
+        // The next half can be read when the voice has played the previous content of the half.
+        first_needed_frame = (copy.read_frame > 0) ? copy.read_frame : 0;
+        if ((int32_t)(copy.nb_loaded_frames + STREAM_HALF_NB_FRAMES - STREAM_BUFFER_NB_FRAMES) > first_needed_frame)
+        {
+            continue;
+        }
+
+        nb_frames_ahead = (int32_t)copy.nb_loaded_frames - copy.read_frame;
+        if ((found_stream_idx == NB_VOICES) || (nb_frames_ahead < min_nb_frames_ahead))
+        {
+            found_stream_idx = stream_idx;
+            min_nb_frames_ahead = nb_frames_ahead;
+        }
+    }
+
+    if (found_stream_idx != NB_VOICES)
+    {
+        read_stream_request(found_stream_idx, &copy);
+        load_stream_frames(found_stream_idx, &copy);
+    }
+}
+
+/* Wait time_ms milliseconds while serving the streams. */
+void wait_and_service_streams(uint32_t time_ms)
+{
+    uint32_t start_ms = System::GetNow();
+
+    while (System::GetNow() - start_ms < time_ms)
+    {
+        service_streams();
+    }
+}
+
+/* Display the number of underruns if it has changed since the last display. */
+void display_stream_activity(void)
+{
+    uint32_t nb_underruns = g_nb_stream_underruns;
+
+    if (nb_underruns != g_displayed_nb_underruns)
+    {
+        g_hw.PrintLine("STREAM underruns=%ld", nb_underruns);
+        g_displayed_nb_underruns = nb_underruns;
+    }
+}
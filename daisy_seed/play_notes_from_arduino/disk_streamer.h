@@ -0,0 +1,58 @@
+/*
+ *  Header file of disk_streamer.cpp. See this file for more details
+ */
+#ifndef DISK_STREAMER
+#define DISK_STREAMER
+
+/*************************************************************************************************
+* Includes
+*************************************************************************************************/
+#include "daisy_seed.h"
+#include "common.h"
+#include "audio_engine.h"
+
+/*************************************************************************************************
+* Defines
+*************************************************************************************************/
+// Stream the end of the notes from the SD card when the sound bank does not fit in RAM
+// (value: 0 or 1).
+#define ENABLE_DISK_STREAMING       1
+
+// Duration of the start of the notes kept in RAM (head) when the end is streamed (tail).
+// The head must last longer than the loading of the first frames of the tails of a chord.
+#define STREAM_HEAD_MS              500
+#define STREAM_HEAD_NB_FRAMES       ((SAMPLE_RATE_HZ * STREAM_HEAD_MS) / 1000)
+
+// Frames read from the SD card at once (half of the stream buffer of a voice).
+#define STREAM_HALF_NB_FRAMES       8192
+#define STREAM_BUFFER_NB_FRAMES     (2 * STREAM_HALF_NB_FRAMES)
+
+// Frames after the end of the head and of the stream buffer so that the frames read by a
+// render segment are contiguous (pitch step of 2 at most and interpolation).
+#define STREAM_GUARD_NB_FRAMES      (2 * MAX_RENDER_BLOCK_SIZE + 2)
+
+static_assert(MAX_ROOT_KEY_DISTANCE <= 12, "The pitch step must be 2 at most for the stream guard");
+
+/*************************************************************************************************
+* Variables
+*************************************************************************************************/
+// Number of render segments played without their samples (streamed frames not loaded in time).
+extern volatile uint32_t g_nb_stream_underruns;
+
+/*************************************************************************************************
+* Functions
+*************************************************************************************************/
+// Main loop side
+extern void set_stream_file_path(uint8_t bank_slot, uint16_t sound_idx, const char *file_path);
+extern void service_streams(void);
+extern void wait_and_service_streams(uint32_t time_ms);
+extern void display_stream_activity(void);
+
+// Audio callback side
+extern void start_stream(uint16_t stream_idx, uint16_t sound_idx);
+extern void stop_stream(uint16_t stream_idx);
+extern void stop_all_streams(void);
+extern void set_stream_read_frame(uint16_t stream_idx, int32_t read_frame);
+extern const int16_t *get_stream_samples(uint16_t stream_idx, uint32_t tail_frame, size_t *p_nb_frames);
+
+#endif //#ifndef DISK_STREAMER
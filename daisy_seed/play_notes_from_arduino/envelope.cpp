@@ -0,0 +1,430 @@
+/*
+ * This module computes the attack and release of the wav enveloppe.
+ *
+ * The attack and release curves (linear, exponential or equal power) are precomputed at 
+ * startup in tables containing one gain every ENV_TABLE_STEP_NB_SAMPLES samples. The audio 
+ * engine reads the tables once per block and per sound: between two table points the gain is 
+ * a linear ramp, so the audio loop only does a multiply-add per sample.
+ *
+ * The curve is selected per sound bank with select_envelope_curve(). The curve and the releases
+ * are kept for each slot of g_sound_banks: the bank loaded while another bank plays gets its 
+ * own envelope, used from the switch to this bank (see switch_sound_bank).
+ *
+ * The release time and curve can be set per key by the release file of a sound bank 
+ * (RELEASE_FILE_NAME in the bank directory). The release table has the same number of points 
+ * for all the release times: a release is precomputed (TEnvRelease) as the increment of the 
+ * position in its table per ramp of ENV_TABLE_STEP_NB_SAMPLES samples (Q16), and copied in the 
+ * voice at the note start. The ramps of a release keep ENV_TABLE_STEP_NB_SAMPLES samples (the 
+ * gain at their ends is interpolated between two points of the table), so a short release does not cut the blocks in
+ * more segments than a long one. The release file
+ * is a text file with one line per key or range of keys (0: lowest key): 
+ * "first_key-last_key=release_ms,curve" or "key=release_ms,curve". The curve is linear, 
+ * exponential or equal_power (the curve of the bank when it is missing). The last line of a key
+ * is applied. Lines starting with '#' are ignored. Example:
+ *
+ *     # Long and natural release of the bass keys.
+ *     0-39=600,exponential
+ *     40-84=300,exponential
+ *     # Short release of the highest keys (no dampers).
+ *     80-84=150
+ */
+
+/*************************************************************************************************
+* Includes
+*************************************************************************************************/
+#include "daisy_seed.h"
+#include "common.h"
+#include "envelope.h"
+#include "fatfs.h"
+#include <math.h>
+#include <stdlib.h>
+
+using namespace daisy;
+
+/*************************************************************************************************
+* Defines
+*************************************************************************************************/
+// Number of points of the tables. The last point is after the end of the stage.
+#define ENV_ATTACK_TABLE_SIZE   ((WAV_ENV_START_NB_SAMPLES >> ENV_TABLE_STEP_SHIFT) + 2)
+#define ENV_RELEASE_TABLE_SIZE  (ENV_RELEASE_NB_STEPS + 2)
+
+// Decay constant of the exponential curve (amplitude of exp(-5) = -43 dB at the end of the
+// release before normalisation).
+#define ENV_EXP_DECAY           5.0f
+
+/*************************************************************************************************
+* Variables
+*************************************************************************************************/
+// Attack gains (0.0 to 1.0) and release gains (1.0 to 0.0) for each curve.
+static float g_env_attack_tables[NB_ENV_CURVES][ENV_ATTACK_TABLE_SIZE];
+static float g_env_release_tables[NB_ENV_CURVES][ENV_RELEASE_TABLE_SIZE];
+
+// Curve selected for the sound bank of each slot (default curve of the release file).
+static e_env_curve g_bank_env_curves[NB_SOUND_BANK_SLOTS];
+
+// Release of each sound (special sounds and keys) for the sound bank of each slot.
+static TEnvRelease g_sound_releases[NB_SOUND_BANK_SLOTS][NB_SOUNDS];
+
+// Content of the release file (null terminated).
+static char g_release_file_data[RELEASE_FILE_MAX_SIZE + 1];
+
+// Names of the curves in the release file.
+static const char *k_env_curve_names[NB_ENV_CURVES] = {"linear", "exponential", "equal_power"};
+
+/*************************************************************************************************
+* Functions implementation
+*************************************************************************************************/
+/* Gain of the attack curve at the relative position x (0.0 at the stage start, 1.0 at the end). */
+static float attack_curve(e_env_curve curve, float x)
+{
+    float gain;
+
+    if (curve == ENV_CURVE_EXPONENTIAL)
+    {
+        gain = (1.0f - expf(-ENV_EXP_DECAY * x)) / (1.0f - expf(-ENV_EXP_DECAY));
+    }
+    else if (curve == ENV_CURVE_EQUAL_POWER)
+    {
+        gain = sinf(x * (float)M_PI_2);
+    }
+    else // ENV_CURVE_LINEAR
+    {
+        gain = x;
+    }
+
+    return gain;
+}
+
+/* Gain of the release curve at the relative position x (0.0 at the stage start, 1.0 at the end). */
+static float release_curve(e_env_curve curve, float x)
+{
+    float gain;
+
+    if (curve == ENV_CURVE_EXPONENTIAL)
+    {
+        gain = (expf(-ENV_EXP_DECAY * x) - expf(-ENV_EXP_DECAY)) / (1.0f - expf(-ENV_EXP_DECAY));
+    }
+    else if (curve == ENV_CURVE_EQUAL_POWER)
+    {
+        gain = cosf(x * (float)M_PI_2);
+    }
+    else // ENV_CURVE_LINEAR
+    {
+        gain = 1.0f - x;
+    }
+
+    return gain;
+}
+
+/* Compute the attack and release tables of all the curves. The points after the end of a stage
+   extend the curve so that the interpolation is right up to the last sample of the stage. 
+   Set the default release of all the sounds. */
+void init_envelope_tables(void)
+{
+    float x;
+
+    for (uint8_t curve = 0; curve < NB_ENV_CURVES; curve++)
+    {
+        for (size_t idx = 0; idx < ENV_ATTACK_TABLE_SIZE; idx++)
+        {
+            x = (float)(idx << ENV_TABLE_STEP_SHIFT) / (float)WAV_ENV_START_NB_SAMPLES;
+            g_env_attack_tables[curve][idx] = attack_curve((e_env_curve)curve, x);
+        }
+
+        for (size_t idx = 0; idx < ENV_RELEASE_TABLE_SIZE; idx++)
+        {
+            x = (float)idx / (float)ENV_RELEASE_NB_STEPS;
+            g_env_release_tables[curve][idx] = release_curve((e_env_curve)curve, x);
+        }
+    }
+
+    // Default release of all the sounds.
+    for (uint8_t bank_slot = 0; bank_slot < NB_SOUND_BANK_SLOTS; bank_slot++)
+    {
+        select_envelope_curve(bank_slot, ENV_CURVE_LINEAR);
+    }
+}
+
+/* Select the attack curve and the default release curve of the sound bank of a slot. The 
+   release of all the sounds is reset to WAV_ENV_END_MS with this curve (see read_release_file).
+   For the slot played, the change is taken into account at the next block (attack) or at the 
+   next note (release). */
+void select_envelope_curve(uint8_t bank_slot, e_env_curve curve)
+{
+    g_bank_env_curves[bank_slot] = curve;
+
+    for (uint16_t sound_idx = 0; sound_idx < NB_SOUNDS; sound_idx++)
+    {
+        set_release(&g_sound_releases[bank_slot][sound_idx], WAV_ENV_END_NB_SAMPLES, curve);
+    }
+}
+
+/* Precompute a release of release_nb_samples samples with the curve curve. */
+void set_release(TEnvRelease *pRelease, uint32_t release_nb_samples, e_env_curve curve)
+{
+    pRelease->table = g_env_release_tables[curve];
+    set_release_time(pRelease, release_nb_samples);
+}
+
+/* Change the duration of a release to release_nb_samples samples, with the same curve. The 
+   increment of the position in the table is rounded up: the end of the table is reached at the 
+   end of the release at the latest. */
+void set_release_time(TEnvRelease *pRelease, uint32_t release_nb_samples)
+{
+    if (release_nb_samples == 0)
+    {
+        release_nb_samples = 1;
+    }
+
+    pRelease->index_step = (uint32_t)(  (((uint64_t)ENV_RELEASE_END_INDEX << ENV_TABLE_STEP_SHIFT) 
+                                          + release_nb_samples - 1) / release_nb_samples);
+    pRelease->nb_samples = release_nb_samples;
+}
+
+/* Set the release of the keys from a line "first_key-last_key=release_ms,curve" or 
+   "key=release_ms,curve" of the release file of the sound bank of a slot. */
+static void parse_release_line(uint8_t bank_slot, char *line)
+{
+    char *value_str = strchr(line, '=');
+    char *curve_str;
+    size_t curve_len;
+    bool curve_found;
+    char *key_str;
+    char *end_str;
+    long first_key;
+    long last_key;
+    long release_ms;
+    e_env_curve curve = g_bank_env_curves[bank_slot];
+
+    if ((line[0] == '#') || (value_str == NULL))
+    {
+        return;
+    }
+
+    // Keys
+    first_key = strtol(line, &end_str, 10);
+    last_key  = first_key;
+    if ((end_str != line) && (*end_str == '-'))
+    {
+        key_str   = end_str + 1;
+        last_key  = strtol(key_str, &end_str, 10);
+        if (end_str == key_str)
+        {
+            end_str = line;
+        }
+    }
+    if (end_str == line)
+    {
+        g_hw.PrintLine("Error: no release keys in the line \"%s\"", line);
+        return;
+    }
+    if ((first_key < 0) || (last_key < first_key) || (last_key >= NB_KEYS))
+    {
+        g_hw.PrintLine("Error: release keys %ld-%ld not in [0, %d]", first_key, last_key, NB_KEYS - 1);
+        return;
+    }
+
+    // Release time and curve
+    release_ms = strtol(value_str + 1, &end_str, 10);
+    if (end_str == value_str + 1)
+    {
+        g_hw.PrintLine("Error: no release time in the line \"%s\"", line);
+        return;
+    }
+    if ((release_ms < MIN_RELEASE_MS) || (release_ms > MAX_RELEASE_MS))
+    {
+        g_hw.PrintLine("Error: release time %ld ms not in [%d, %d]", release_ms, MIN_RELEASE_MS, MAX_RELEASE_MS);
+        return;
+    }
+    curve_str = strchr(end_str, ',');
+    if (curve_str != NULL)
+    {
+        curve_str++;
+        while (*curve_str == ' ')
+        {
+            curve_str++;
+        }
+        curve_len = strcspn(curve_str, " \t\r\n");
+        curve_found = false;
+        for (uint8_t curve_idx = 0; curve_idx < NB_ENV_CURVES; curve_idx++)
+        {
+            if (   (strlen(k_env_curve_names[curve_idx]) == curve_len)
+                && (strncmp(curve_str, k_env_curve_names[curve_idx], curve_len) == 0))
+            {
+                curve = (e_env_curve)curve_idx;
+                curve_found = true;
+            }
+        }
+        if (curve_found == false)
+        {
+            g_hw.PrintLine("Error: unknown release curve in the line \"%s\"", line);
+            return;
+        }
+    }
+
+    for (long key = first_key; key <= last_key; key++)
+    {
+        set_release(&g_sound_releases[bank_slot][NB_SPECIAL_SOUNDS + key], 
+                    (uint32_t)((SAMPLE_RATE_HZ * release_ms) / 1000), curve);
+    }
+}
+
+/* Read the release file of a sound bank (file_path) and set the release of its keys in the slot
+   of the bank. The keys not in the file (or all the keys without file) keep the default release
+   (see select_envelope_curve, which must be called first). */
+void read_release_file(uint8_t bank_slot, const char *file_path)
+{
+    static FIL SDFile;
+    FRESULT result;
+    UINT nb_bytes_read;
+    char *line;
+
+    result = f_open(&SDFile, file_path, FA_READ);
+    if (result != FR_OK)
+    {
+        g_hw.PrintLine("No release file. Release of %d ms for all the keys", WAV_ENV_END_MS);
+        return;
+    }
+
+    result = f_read(&SDFile, g_release_file_data, RELEASE_FILE_MAX_SIZE, &nb_bytes_read);
+    if (result != FR_OK)
+    {
+        g_hw.PrintLine("f_read result KO. result=%d", result);
+        nb_bytes_read = 0;
+    }
+    f_close(&SDFile);
+
+    g_release_file_data[nb_bytes_read] = 0;
+
+    line = strtok(g_release_file_data, "\r\n");
+    while (line != NULL)
+    {
+        parse_release_line(bank_slot, line);
+        line = strtok(NULL, "\r\n");
+    }
+
+    g_hw.PrintLine("Release file read: %s", file_path);
+}
+
+/* Return the release of a sound (special sound or key, index < NB_SOUNDS) of the sound bank 
+   played. */
+const TEnvRelease *get_sound_release(uint16_t sound_idx)
+{
+    return &g_sound_releases[g_sound_bank_slot][sound_idx];
+}
+
+/* Compute a linear ramp from a table at position env_pos, multiplied by level. There are 
+   step_nb_samples samples between two points of the table (step_inv = 1.0 / step_nb_samples).
+   The ramp stops at the next point of the table.
+   Return the number of frames of the ramp (<= nb_frames). */
+static size_t table_ramp(const float *table, size_t step_nb_samples, float step_inv, size_t env_pos, 
+                         float level, size_t nb_frames, float *p_gain, float *p_gain_step)
+{
+    size_t table_idx = env_pos / step_nb_samples;
+    size_t offset    = env_pos - table_idx * step_nb_samples;
+    float gain_step;
+
+    gain_step = (table[table_idx + 1] - table[table_idx]) * (level * step_inv);
+
+    *p_gain      = table[table_idx] * level + gain_step * (float)offset;
+    *p_gain_step = gain_step;
+
+    if (nb_frames > step_nb_samples - offset)
+    {
+        nb_frames = step_nb_samples - offset;
+    }
+
+    return nb_frames;
+}
+
+/* Gain of a release at position env_pos (<= pRelease->nb_samples): the position in the table 
+   (Q16) is interpolated between two points of the table. */
+static float release_table_gain(const TEnvRelease *pRelease, size_t env_pos)
+{
+    uint32_t index = ENV_RELEASE_END_INDEX;
+    uint32_t table_idx;
+    float frac;
+
+    if (env_pos < pRelease->nb_samples)
+    {
+        index = ((uint32_t)env_pos * pRelease->index_step) >> ENV_TABLE_STEP_SHIFT;
+        if (index > ENV_RELEASE_END_INDEX)
+        {
+            index = ENV_RELEASE_END_INDEX;
+        }
+    }
+    table_idx = index >> ENV_INDEX_SHIFT;
+    frac      = (float)(index & ((1 << ENV_INDEX_SHIFT) - 1)) * (1.0f / (1 << ENV_INDEX_SHIFT));
+
+    return pRelease->table[table_idx] + (pRelease->table[table_idx + 1] - pRelease->table[table_idx]) * frac;
+}
+
+/* Ramp of the attack at position env_pos (< WAV_ENV_START_NB_SAMPLES) for a sound of volume level. */
+size_t envelope_attack_ramp(size_t env_pos, float level, size_t nb_frames, 
+                            float *p_gain, float *p_gain_step)
+{
+    const float *attack_table = g_env_attack_tables[g_bank_env_curves[g_sound_bank_slot]];
+
+    return table_ramp(attack_table, ENV_TABLE_STEP_NB_SAMPLES, 1.0f / ENV_TABLE_STEP_NB_SAMPLES, 
+                      env_pos, level, nb_frames, p_gain, p_gain_step);
+}
+
+/* Ramp of a release at position env_pos (< pRelease->nb_samples) starting from gain level. The 
+   ramps have ENV_TABLE_STEP_NB_SAMPLES samples whatever the release time (the last one ends at 
+   the end of the release). */
+size_t envelope_release_ramp(const TEnvRelease *pRelease, size_t env_pos, float level, 
+                             size_t nb_frames, float *p_gain, float *p_gain_step)
+{
+    size_t ramp_start_pos = env_pos & ~(size_t)(ENV_TABLE_STEP_NB_SAMPLES - 1);
+    size_t ramp_nb_samples = ENV_TABLE_STEP_NB_SAMPLES;
+    float ramp_start_gain;
+    float gain_step;
+
+    if (ramp_nb_samples > pRelease->nb_samples - ramp_start_pos)
+    {
+        ramp_nb_samples = pRelease->nb_samples - ramp_start_pos;
+    }
+
+    ramp_start_gain = release_table_gain(pRelease, ramp_start_pos);
+    gain_step       = (release_table_gain(pRelease, ramp_start_pos + ramp_nb_samples) - ramp_start_gain) * level;
+    if (ramp_nb_samples == ENV_TABLE_STEP_NB_SAMPLES)
+    {
+        gain_step *= 1.0f / ENV_TABLE_STEP_NB_SAMPLES;
+    }
+    else
+    {
+        gain_step /= (float)ramp_nb_samples;
+    }
+
+    *p_gain      = ramp_start_gain * level + gain_step * (float)(env_pos - ramp_start_pos);
+    *p_gain_step = gain_step;
+
+    if (nb_frames > ramp_start_pos + ramp_nb_samples - env_pos)
+    {
+        nb_frames = ramp_start_pos + ramp_nb_samples - env_pos;
+    }
+
+    return nb_frames;
+}
+
+/* Gain of the attack at position env_pos for a sound of volume level. */
+float envelope_attack_gain(size_t env_pos, float level)
+{
+    float gain;
+    float gain_step;
+
+    envelope_attack_ramp(env_pos, level, 1, &gain, &gain_step);
+
+    return gain;
+}
+
+/* Gain of a release at position env_pos starting from gain level. */
+float envelope_release_gain(const TEnvRelease *pRelease, size_t env_pos, float level)
+{
+    float gain;
+    float gain_step;
+
+    envelope_release_ramp(pRelease, env_pos, level, 1, &gain, &gain_step);
+
+    return gain;
+}
@@ -0,0 +1,75 @@
+/* 
+ *  Header file of envelope.cpp. See this file for more details
+ */ 
+#ifndef ENVELOPE
+#define ENVELOPE
+
+/*************************************************************************************************
+* Includes
+*************************************************************************************************/
+#include "daisy_seed.h"
+#include "common.h"
+
+/*************************************************************************************************
+* Defines
+*************************************************************************************************/
+#define WAV_ENV_START_MS            10      // Wav enveloppe for the attack in milliseconds. 
+#define WAV_ENV_END_MS              250     // Default wav enveloppe for the release in milliseconds.
+#define WAV_ENV_START_NB_SAMPLES    ((SAMPLE_RATE_HZ * WAV_ENV_START_MS) / 1000) // Conversion from ms to nb of samples
+#define WAV_ENV_END_NB_SAMPLES      ((SAMPLE_RATE_HZ * WAV_ENV_END_MS) / 1000)   // Conversion from ms to nb of samples
+
+// The enveloppe tables contain one gain every ENV_TABLE_STEP_NB_SAMPLES samples.
+#define ENV_TABLE_STEP_SHIFT        5
+#define ENV_TABLE_STEP_NB_SAMPLES   (1 << ENV_TABLE_STEP_SHIFT)
+
+// The release table has ENV_RELEASE_NB_STEPS steps whatever the release time: a release of 
+// WAV_ENV_END_MS has one point every ENV_TABLE_STEP_NB_SAMPLES samples.
+#define ENV_RELEASE_NB_STEPS        (WAV_ENV_END_NB_SAMPLES >> ENV_TABLE_STEP_SHIFT)
+
+// Position in the release table in Q16 (16 bits for the fraction between two points).
+#define ENV_INDEX_SHIFT             16
+#define ENV_RELEASE_END_INDEX       ((uint32_t)ENV_RELEASE_NB_STEPS << ENV_INDEX_SHIFT)
+
+// Release times of the release file of a sound bank (see read_release_file).
+#define RELEASE_FILE_NAME           "release.txt"
+#define RELEASE_FILE_MAX_SIZE       2048    // Maximum size of the release file in bytes.
+#define MIN_RELEASE_MS              10
+#define MAX_RELEASE_MS              10000
+
+/*************************************************************************************************
+* Types
+*************************************************************************************************/
+// Shape of the attack and release of the wav enveloppe.
+typedef enum 
+{
+    ENV_CURVE_LINEAR,       // Linear increase/decrease of the amplitude.
+    ENV_CURVE_EXPONENTIAL,  // Exponential increase/decrease of the amplitude (natural decay).
+    ENV_CURVE_EQUAL_POWER,  // Sine/cosine amplitude (constant power when crossfading).
+    NB_ENV_CURVES
+} e_env_curve;
+
+// Release of a sound, precomputed from its release time and curve.
+typedef struct
+{
+    const float *table;         // Release table of the curve.
+    uint32_t index_step;        // Increment of the position in the table per ramp (Q16).
+    uint32_t nb_samples;        // Duration of the release.
+} TEnvRelease;
+
+/*************************************************************************************************
+* Functions 
+*************************************************************************************************/
+extern void init_envelope_tables(void);
+extern void select_envelope_curve(uint8_t bank_slot, e_env_curve curve);
+extern void set_release(TEnvRelease *pRelease, uint32_t release_nb_samples, e_env_curve curve);
+extern void set_release_time(TEnvRelease *pRelease, uint32_t release_nb_samples);
+extern void read_release_file(uint8_t bank_slot, const char *file_path);
+extern const TEnvRelease *get_sound_release(uint16_t sound_idx);
+extern size_t envelope_attack_ramp(size_t env_pos, float level, size_t nb_frames, 
+                                   float *p_gain, float *p_gain_step);
+extern size_t envelope_release_ramp(const TEnvRelease *pRelease, size_t env_pos, float level, 
+                                    size_t nb_frames, float *p_gain, float *p_gain_step);
+extern float envelope_attack_gain(size_t env_pos, float level);
+extern float envelope_release_gain(const TEnvRelease *pRelease, size_t env_pos, float level);
+
+#endif //#ifndef ENVELOPE
@@ -0,0 +1,113 @@
+/*
+ * This module is the queue of the events (note start, key up, pedal) sent by the main loop to 
+ * the audio callback.
+ *
+ * There is exactly one producer (the main loop) and one consumer (the audio callback), so the 
+ * queue is a ring buffer without lock: the write index is only modified by the producer and 
+ * the read index is only modified by the consumer. An event is written in the ring buffer 
+ * before the write index is published (memory barrier), so the consumer never reads an event 
+ * partially written. Neither side disables the interrupts or waits for the other side.
+ */
+
+/*************************************************************************************************
+* Includes
+*************************************************************************************************/
+#include "daisy_seed.h"
+#include "event_queue.h"
+
+using namespace daisy;
+
+/*************************************************************************************************
+* Variables
+*************************************************************************************************/
+// Ring buffer of the events.
+static TEvent            g_events[EVENT_QUEUE_SIZE];
+
+// Index of the next event written (modified by the producer only).
+static volatile uint32_t g_write_idx;
+
+// Index of the next event read (modified by the consumer only).
+static volatile uint32_t g_read_idx;
+
+// Number of events lost because the queue was full.
+static uint32_t          g_nb_lost_events;
+
+/*************************************************************************************************
+* Functions implementation
+*************************************************************************************************/
+
+/* Empty the queue. Must not be called while the producer or the consumer is running. */
+void init_event_queue(void)
+{
+    g_write_idx = 0;
+    g_read_idx = 0;
+    g_nb_lost_events = 0;
+}
+
+/* Add an event at the end of the queue (producer side).
+   Return false if the queue is full (the event is lost). */
+bool post_event(const TEvent *pEvent)
+{
+    uint32_t write_idx = g_write_idx;
+    uint32_t next_write_idx = (write_idx + 1) & (EVENT_QUEUE_SIZE - 1);
+
+    if (next_write_idx == g_read_idx)
+    {
+        g_nb_lost_events++;
+        return false;
+    }
+
+    g_events[write_idx] = *pEvent;
+
+    // The event must be written before it is published to the consumer.
+    __DMB();
+    g_write_idx = next_write_idx;
+
+    return true;
+}
+
+/* Read the first event of the queue without removing it (consumer side).
+   Return false if the queue is empty. */
+bool peek_event(TEvent *pEvent)
+{
+    uint32_t read_idx = g_read_idx;
+
+    if (read_idx == g_write_idx)
+    {
+        return false;
+    }
+
+    // The event must be read after the write index.
+    __DMB();
+    *pEvent = g_events[read_idx];
+
+    return true;
+}
+
+/* Remove the first event of the queue (consumer side).
+   Return false if the queue is empty. */
+bool pop_event(TEvent *pEvent)
+{
+    uint32_t read_idx = g_read_idx;
+
+    if (read_idx == g_write_idx)
+    {
+        return false;
+    }
+
+    // The event must be read after the write index.
+    __DMB();
+    *pEvent = g_events[read_idx];
+
+    // The event must be read before its element is given back to the producer.
+    __DMB();
+    g_read_idx = (read_idx + 1) & (EVENT_QUEUE_SIZE - 1);
+
+    return true;
+}
+
+/* Return the number of events lost because the queue was full. */
+uint32_t get_nb_lost_events(void)
+{
+    return g_nb_lost_events;
+}
@@ -0,0 +1,46 @@
+/* 
+ *  Header file of event_queue.cpp. See this file for more details
+ */ 
+#ifndef EVENT_QUEUE
+#define EVENT_QUEUE
+
+/*************************************************************************************************
+* Includes
+*************************************************************************************************/
+#include "daisy_seed.h"
+
+/*************************************************************************************************
+* Defines
+*************************************************************************************************/
+// Number of elements of the queue (power of 2). The queue can contain EVENT_QUEUE_SIZE - 1 events.
+#define EVENT_QUEUE_SIZE            64
+
+static_assert((EVENT_QUEUE_SIZE & (EVENT_QUEUE_SIZE - 1)) == 0, "EVENT_QUEUE_SIZE must be a power of 2");
+
+/*************************************************************************************************
+* Types
+*************************************************************************************************/
+// Types of the events sent to the audio callback.
+typedef enum {EVENT_SOUND_START, EVENT_KEY_UP, EVENT_PEDAL, EVENT_BANK_SWITCH} e_event_type;
+
+// Structure defining an event sent to the audio callback.
+typedef struct
+{
+    e_event_type type;          // Type of the event.
+    uint32_t timestamp;         // Sample time of the event (see get_sample_time).
+    uint16_t sound_idx;         // Index of the sound in g_sounds, or pedal (EVENT_PEDAL, e_pedal),
+                                // or slot of the sound bank (EVENT_BANK_SWITCH).
+    float amplification;        // Amplification of the sound (EVENT_SOUND_START), or position of 
+                                // the pedal (EVENT_PEDAL, 0.0: up, 1.0: down).
+} TEvent;
+
+/*************************************************************************************************
+* Functions 
+*************************************************************************************************/
+extern void init_event_queue(void);
+extern bool post_event(const TEvent *pEvent);
+extern bool peek_event(TEvent *pEvent);
+extern bool pop_event(TEvent *pEvent);
+extern uint32_t get_nb_lost_events(void);
+
+#endif //#ifndef EVENT_QUEUE
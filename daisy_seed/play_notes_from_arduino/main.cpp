@@ -1,14 +1,13 @@
 /*************************************************************************************************
 * This program:
-* - reads wav files from a SD card directory (one wav file per note).
+* - reads wav files from a SD card directory (one wav file per note, or one compressed file, 
+*   see adpcm.cpp).
 * - loads the wav data samples in external RAM memory (65 Mbytes).
 * - manages a simple communication protocol with the Arduino (note_on, note_off).
 * - plays the notes.
 * - takey into account the pedal.
 *
-* The release of the key is managed by a linear decrease of the signal amplitude (~250 milliseconds).
-* To avoid a click sound at the note start (a.k.a. attack) a linear increase of the signal 
-* amplitude is added (~10 milliseconds).
+* The notes are played by the audio callback of audio_engine.cpp.
 *************************************************************************************************/
 
 /*************************************************************************************************
@@ -17,7 +16,18 @@
 #include "daisy_seed.h"
 #include "fatfs.h"
 #include "common.h"
+#include "audio_engine.h"
+#include "envelope.h"
+#include "master_bus.h"
 #include "play_midi_files.h"
+#include "benchmark.h"
+#include "config.h"
+#include "resampler.h"
+#include "disk_streamer.h"
+#include "adpcm.h"
+#include "bank_index.h"
+#include "bank_image.h"
+#include "wav_format.h"
 #include <stdlib.h>
 
 using namespace daisy;
@@ -28,21 +38,31 @@ using namespace daisy::seed;
 *************************************************************************************************/
 
 // Notes, samples and keys
-#define MAX_NB_SIMULTANEOUS_NOTES   10      // 10 notes at 100% volume can be played without saturation.
-#define WAV_ENV_START_MS            10      // Wav enveloppe for the attack in milliseconds. 
-#define WAV_ENV_END_MS              250     // Wav enveloppe for the release in milliseconds.
-#define SAMPLE_RATE_HZ              44000   // Hertz
 #define MAX_ATTACK_TIME             100000  // Maximum key velocity (arbitrary unit based on arduino time).
 #define MIN_ATTACK_TIME             10000   // Minimum key velocity (arbitrary unit based on arduino time).
 #define PEDAL_KEY_IDX               85      // We consider for convenience that the pedal key is the 86th key.
-#define WAV_ENV_START_NB_SAMPLES    ((SAMPLE_RATE_HZ * WAV_ENV_START_MS) / 1000) // Conversion from ms to nb of samples
-#define WAV_ENV_END_NB_SAMPLES      ((SAMPLE_RATE_HZ * WAV_ENV_END_MS) / 1000)   // Conversion from ms to nb of samples
+#define PEDAL_MAX_POSITION          127     // Position of the pedal down in the pedal message (0: up).
+#define SOSTENUTO_KEY_IDX           86      // Sostenuto pedal, connected to the 7th key of board 1.
+#define UNA_CORDA_KEY_IDX           87      // Una corda pedal, connected to the 7th key of board 13.
 
 // Wav files on the SD card
 #define WAV_NOTES_BASE_FILE_PATH "/piano_wav"
 #define WAV_SPECIAL_SOUNDS_FILE_PATH "/piano_wav/special"
 #define MAX_WAV_DATA_SIZE_BYTES (60*1000*1000) // 60 Mbytes 
 #define MAX_WAV_DATA_SIZE_WORD (MAX_WAV_DATA_SIZE_BYTES / 2)
+#define WAV_READ_CHUNK_NB_SAMPLES 4096 // Number of samples read at once when resampling.
+
+// Sustain loops: the notes whose wav file has loop points (smpl chunk) are loaded up to the end 
+// of the loop and looped until the end of the release (value: 0 or 1). The end of the loop is 
+// crossfaded with the frames before the start of the loop.
+#define ENABLE_SAMPLE_LOOPS 1
+#define LOOP_XFADE_MS 20
+#define LOOP_XFADE_NB_FRAMES (LOOP_XFADE_MS * SAMPLE_RATE_HZ / 1000)
+#define MIN_LOOP_NB_FRAMES 64
+
+// Velocity layers: optional sub-directories layer_1 (softest) to layer_N (loudest) of a bank 
+// directory. Without sub-directory, the wav files of the bank directory are the only layer.
+#define WAV_LAYER_DIR_NAME "layer_"
 
 // File defining the current program
 #define CURRENT_PROG_FILE_PATH "/piano_wav/current_prog"
@@ -50,6 +70,9 @@ using namespace daisy::seed;
 // Number of programs
 #define NB_PROGRAMS 4
 
+// Number of sound banks (one sound bank for 2 programs: normal and demo mode)
+#define NB_SOUND_BANKS (NB_PROGRAMS / 2)
+
 // Message received from arduino
 #define MAX_MESSAGE_SIZE 20
 
@@ -59,23 +82,145 @@ using namespace daisy::seed;
 // Wait or not for the uart host connection (value: 0 or 1).
 #define WAIT_UART_HOST_CONNECTION_TO_START 0
 
+// Run the audio callback benchmark at startup before starting the audio (value: 0 or 1).
+#define ENABLE_AUDIO_BENCHMARK 0
+
+// Start the audio at startup before the notes of the sound bank are loaded from its wav files, 
+// and load the notes key by key while the keys are played (value: 0 or 1). The middle keys are 
+// loaded first, and a key pressed before its notes are loaded is loaded next. Until then, the 
+// key is played with the samples of the nearest key loaded (see build_sound_map), or is silent.
+#define ENABLE_PROGRESSIVE_LOAD 1
+
+// First key loaded (C4), then the keys above and below it alternately.
+#define PROGRESSIVE_LOAD_FIRST_KEY 39
+
+// Number of keys pressed before their notes are loaded, loaded first (last key pressed first).
+#define PROGRESSIVE_LOAD_NB_REQUESTS 8
+
+// Bytes of a wav file read by each call of service_progressive_load (the main loop polls the 
+// UART between two calls): one chunk of g_wav_read_buffer.
+#define PROGRESSIVE_LOAD_CHUNK_BYTES (WAV_READ_CHUNK_NB_SAMPLES * 2)
+
+// Bytes of a wav file read at once when the notes are loaded before they are played: the whole
+// data of the note (see continue_note_load).
+#define NOTE_LOAD_CHUNK_BYTES_ALL SIZE_MAX
+
+// Index of the next file of a layer read by the progressive load when the index of the layer is
+// not started (see build_progressive_index).
+#define PROGRESSIVE_INDEX_START 0xFFFF
+
 // Message received from arduino
-typedef enum {KEY_UP_MSG, KEY_DOWN_MSG} e_msg_type;
+typedef enum {KEY_UP_MSG, KEY_DOWN_MSG, PEDAL_MSG} e_msg_type;
+
+// Data of a file read chunk by chunk in RAM (see open_wav_reader): copied as it is, or 
+// converted while it is read (wav samples, see read_wav_file).
+typedef struct
+{
+    FIL file;
+    bool open;                                  // The file is open: data left to read.
+    const TBankIndexEntry *pFormat;             // Format of the wav samples (NULL: data copied).
+    bool converted;                             // Read in g_wav_read_buffer and converted.
+    int16_t *ram_address;
+    size_t nb_bytes_left;                       // Bytes of the file left to read.
+    size_t max_nb_frames;                       // Frames that fit at ram_address.
+    size_t nb_frames;                           // Frames written at ram_address.
+    uint8_t nb_channels;                        // Channels written (1 for a copy).
+} TWavReader;
+
+// Note loaded from its file (see start_note_load): the file is read chunk by chunk, the note is
+// set in its sound bank once loaded.
+typedef struct
+{
+    TWavReader reader;
+    TSoundData note;
+    const TBankIndexEntry *pEntry;
+    uint8_t bank_slot;
+    uint16_t sound_idx;
+    bool looped;                                // Loop from loop_start to loop_end (frames).
+    size_t loop_start;
+    size_t loop_end;
+    bool streamed;                              // Head in RAM, tail streamed from the SD card.
+    size_t nb_copied_samples;                   // Samples of a head or of compressed blocks.
+    char file_path[MAX_FILE_PATH_LEN];
+} TNoteLoad;
+
+// Image file of a sound bank whose notes fit in RAM (see open_bank_image): its table is read in
+// g_image_entries.
+typedef struct
+{
+    TBankImageHeader header;
+    size_t ram_pos;                             // Position of the data in g_sample_data.
+    char file_path[MAX_FILE_PATH_LEN];
+} TBankImageLoad;
+
+// Step of the progressive load: index of the layers, then notes.
+typedef enum {LOAD_PHASE_INDEX, LOAD_PHASE_NOTES} e_load_phase;
+
+// Sound bank loaded while the sound bank of a slot is played (see service_progressive_load): the
+// bank played at startup, or a new bank loaded in the other slot (see swap_sound_bank). The 
+// layers of the bank are indexed in g_layer_indexes.
+typedef struct
+{
+    bool active;                                // Steps left.
+    e_load_phase phase;
+    uint8_t sound_bank_idx;
+    uint8_t bank_slot;
+    bool swap;                                  // Switch to the bank once loaded (slot not played).
+    bool demo_mode;                             // Play the midi file once the bank is swapped.
+    uint8_t nb_layer_dirs;                      // Layer directories indexed (see build_progressive_index).
+    uint8_t index_layer_idx;
+    uint16_t index_file_idx;
+    uint8_t first_layer_dir;                    // Directory of layer 0 (see build_notes_wav_file_path).
+    uint8_t first_layer_idx;                    // Index of layer 0 in g_layer_indexes.
+    uint8_t nb_layers;
+    bool from_image;                            // Notes read from the image file of the bank.
+    TBankImageLoad image;
+    size_t first_pos;
+    size_t cur_note_pos;                        // Position of the next note in g_sample_data.
+    size_t end_pos;
+    uint8_t key_order[NB_KEYS];                 // Keys in the order of the loading.
+    uint8_t next_order_idx;
+    uint8_t nb_layers_loaded[NB_KEYS];          // Layers loaded of each key (from layer 0).
+    uint8_t requested_keys[PROGRESSIVE_LOAD_NB_REQUESTS];  // Keys pressed, last key pressed last.
+    uint8_t nb_requested_keys;
+    uint32_t start_ms;
+    bool note_loading;                          // note_load is reading the file of a note.
+    uint8_t note_key_idx;                       // Key and layer of the note loaded.
+    uint8_t note_layer_idx;
+    TNoteLoad note_load;
+} TProgressiveLoad;
 
 /*************************************************************************************************
 * Variables
 *************************************************************************************************/
+// Shape of the attack and release of the wav enveloppe for each sound bank.
+const e_env_curve k_bank_env_curves[NB_SOUND_BANKS] = {ENV_CURVE_LINEAR, ENV_CURVE_LINEAR};
+
 // Variables containing all the notes wav file names on the SD card.
 char           g_wav_notes_file_name_list[NB_KEYS * MAX_FILE_NAME_LEN];
 
+// Index of the notes of each velocity layer directory of the sound bank loaded (see 
+// build_notes_index).
+TBankIndexEntry g_layer_indexes[MAX_NB_VELOCITY_LAYERS][NB_KEYS];
+
+// Table of the notes of the image file of the sound bank loaded (see load_bank_image).
+TBankImageEntry g_image_entries[MAX_NB_VELOCITY_LAYERS * NB_KEYS];
+
 // Variables containing all the special sounds wav file names on the SD card.
 char           g_wav_special_sounds_file_name_list[NB_SPECIAL_SOUNDS * MAX_FILE_NAME_LEN];
 
 // Buffer in external RAM containing all the samples
 int16_t        DSY_SDRAM_BSS g_sample_data[MAX_WAV_DATA_SIZE_WORD];
 
-// Define if the pedal is up or down.
-bool g_pedal_up;               
+// Buffer of the samples read from a wav file before conversion (16 bits, mix down, resampling).
+int16_t        g_wav_read_buffer[WAV_READ_CHUNK_NB_SAMPLES];
+
+// Define if the tails of the notes of the current sound bank are streamed from the SD card 
+// (the sound bank does not fit in RAM, see disk_streamer.cpp).
+bool           g_stream_note_tails;
+
+// Notes of the sound bank loaded while it is played.
+TProgressiveLoad g_progressive_load;
 
 // Variable defining the position of the first note in g_sample_data buffer.
 // Notes are after special sounds. This variable does not depend on the 
@@ -87,143 +232,43 @@ size_t g_first_note_position;
 *************************************************************************************************/
 uint16_t arduino_to_piano_key_index(uint16_t key_index_arduino);
 float compute_volume(uint32_t attack_time);
-size_t read_wav_file(char *file_name, uint8_t* ram_address);
+size_t read_wav_file(char *file_name, const TBankIndexEntry *pEntry, int16_t* ram_address, 
+                     size_t max_nb_samples, uint8_t* p_nb_channels);
+bool read_wav_format(char *file_name, TBankIndexEntry *pEntry);
+bool get_wav_loop_points(const TBankIndexEntry *pEntry, size_t *p_loop_start, size_t *p_loop_end);
+size_t get_note_nb_samples(const TBankIndexEntry *pEntry);
+bool is_wav_file_streamable(const TBankIndexEntry *pEntry);
+size_t set_sound_loop(TSoundData *pSound, int16_t* ram_address, size_t loop_start, size_t loop_end);
+void mix_down_to_mono(int16_t *samples, size_t nb_frames);
+bool is_wav_file_16_bits(const TBankIndexEntry *pEntry);
+void convert_samples_to_16_bits(void *buffer, size_t nb_samples, const TBankIndexEntry *pEntry);
+bool open_wav_reader(TWavReader *pReader, char *file_name, uint32_t data_offset, size_t data_size,
+                     const TBankIndexEntry *pFormat, int16_t* ram_address, size_t max_nb_samples);
+bool read_wav_reader_chunk(TWavReader *pReader, size_t max_nb_bytes);
+void close_wav_reader(TWavReader *pReader);
+size_t compute_notes_nb_samples(const TBankIndexEntry *pEntries);
+uint8_t count_velocity_layer_dirs(uint8_t sound_bank_idx);
+bool open_bank_image(uint8_t sound_bank_idx, size_t first_pos, size_t end_pos, TBankImageLoad *pImage);
+void set_bank_image_note(const TBankImageLoad *pImage, uint8_t bank_slot, uint16_t entry_idx, bool data_read);
+bool load_bank_image(uint8_t sound_bank_idx, uint8_t bank_slot, size_t first_pos, size_t end_pos);
+bool compute_memory_budget(uint8_t nb_layer_dirs, size_t nb_samples_available, bool must_fit, 
+                           uint8_t *p_first_layer_dir, uint8_t *p_first_layer_idx, uint8_t *p_nb_layers);
+void prepare_sound_bank(uint8_t sound_bank_idx, uint8_t bank_slot);
+bool load_sound_bank(uint8_t sound_bank_idx, uint8_t bank_slot, size_t first_pos, size_t end_pos, bool must_fit);
 void display_all_sounds_data(void);
 uint8_t read_current_program(void);
 void write_current_program(uint8_t prog_idx);
-void play_special_sound(uint8_t sound_idx);
 
 /*************************************************************************************************
 * Functions implementation
 *************************************************************************************************/
 
-// Audio call back function
-static void AudioCallback(AudioHandle::InterleavingInputBuffer in,
-    AudioHandle::InterleavingOutputBuffer out,
-    size_t                                size)
-{
-    float sig_float;
-    int16_t note_sig_int16;
-    float note_sig_float;
-    float release_factor;
-    float attack_factor;
-    TSoundData *pCurSounds;
-    size_t release_pos;
-
-    // Several samples must be generated.
-    for(size_t block_idx = 0; block_idx < size; block_idx += 2)
-    {
-        sig_float = 0.0; // Initialize the signal value.
-        
-        // Scan all the sounds of the g_sounds array.
-        for (size_t sound_idx = 0; sound_idx < NB_SOUNDS; sound_idx++)
-        {
-            pCurSounds = &g_sounds[sound_idx];
-            
-            if (pCurSounds->playing == true) // This sound is playing.
-            {
-                // Compute the note signal taking into account: 
-                // - the polyphony factor (10 simulatenous notes at max volume without saturation).
-                // - the volume which depends on the attack time (key velocity).
-                note_sig_int16 = g_sample_data[pCurSounds->cur_playing_pos] / MAX_NB_SIMULTANEOUS_NOTES;
-                note_sig_float = s162f(note_sig_int16);
-                note_sig_float *= pCurSounds->volume;
-
-                // Attack
-                // The attack factor avoids a tick sound at the note start.
-                // It is a linear wav enveloppe applied at the note start.
-                if (pCurSounds->cur_playing_pos - pCurSounds->first_sample_pos < WAV_ENV_START_NB_SAMPLES)
-                {
-                    attack_factor = (float)(pCurSounds->cur_playing_pos - pCurSounds->first_sample_pos);
-                    attack_factor /= (float)WAV_ENV_START_NB_SAMPLES;
-                    note_sig_float *= attack_factor;
-                }
-
-                /* Before the note end, we simulate a normal release to avoid a click sound */
-                if (   (pCurSounds->last_sample_pos - pCurSounds->cur_playing_pos <= WAV_ENV_END_NB_SAMPLES)
-                    && (pCurSounds->sound_end_soon == false) )
-                {
-                    pCurSounds->sound_end_soon = true;
-                    pCurSounds->key_up_pos     = pCurSounds->cur_playing_pos;
-                    pCurSounds->pedal_up_pos   = pCurSounds->cur_playing_pos;
-                }
-
-                /* Release
-                   At the end of the release the notes data are re-initialised. The release factor 
-                   allows a more natural sound at key release (avoid a click sound).
-                   It is a linear wav enveloppe applied at the note end. */
-                if (   ((pCurSounds->key_up == true) && (g_pedal_up == true))
-                    || (pCurSounds->sound_end_soon == true) )
-                {
-                    // Take into account the position when the pedal or the key was up
-                    // depending on the time order.
-                    if (pCurSounds->key_up_pos < pCurSounds->pedal_up_pos)
-                    {
-                        // The pedal was up after the key.
-                        release_pos = pCurSounds->pedal_up_pos;
-                    }
-                    else
-                    {
-                        // The key was up after the pedal.
-                        release_pos = pCurSounds->key_up_pos;
-                    }
-
-                    if (pCurSounds->cur_playing_pos - release_pos >= WAV_ENV_END_NB_SAMPLES)
-                    {
-                        // End of the release or end of the note -> data re-initialisation.
-                        pCurSounds->cur_playing_pos = pCurSounds->first_sample_pos;
-                        pCurSounds->key_up_pos      = pCurSounds->first_sample_pos;
-                        pCurSounds->pedal_up_pos    = pCurSounds->first_sample_pos;
-                        pCurSounds->playing         = false;
-                        pCurSounds->key_up          = false;
-                        pCurSounds->sound_end_soon  = false;
-                        pCurSounds->volume          = 0.0;
-                        release_factor              = 0.0;
-                    }
-                    else
-                    {
-                        // Compute the release factor
-                        release_factor = (float)(release_pos + WAV_ENV_END_NB_SAMPLES - pCurSounds->cur_playing_pos);
-                        release_factor /= (float)WAV_ENV_END_NB_SAMPLES;
-                    }
-                    
-                    note_sig_float *= release_factor;
- 
-                } // if (pCurSounds->key_up
-                
-                // Sum all the note signals (polyphony)
-                sig_float += note_sig_float;
-                
-                // Increment current read position (if end of note not reached).
-                if (pCurSounds->cur_playing_pos < pCurSounds->last_sample_pos)
-                {
-                    pCurSounds->cur_playing_pos++;
-                }
-            } // if (pCurSounds->playing  
-        } // for (size_t sound_idx
-        
-        // Left signal out
-        out[block_idx] = sig_float;
-
-        // Right signal out
-        out[block_idx + 1] = sig_float;
-    
-    } // for(size_t block_idx
-}
-
 /* Initialise global variables */
 void initialize_global_variables(void)
 {
-    g_pedal_up = true;
-    
-    // We consider that fields of type bool are false when set to 0.
-    memset(g_sounds, 0, sizeof(g_sounds));
-    for (size_t idx = 0; idx < NB_SOUNDS; idx++)
-    {
-        g_sounds[idx].key_up = true;
-        g_sounds[idx].volume = 0.0;
-    }
+    memset(g_sound_banks, 0, sizeof(g_sound_banks));
     memset(g_wav_notes_file_name_list, 0, sizeof(g_wav_notes_file_name_list));
+    memset(&g_progressive_load, 0, sizeof(g_progressive_load));
     
     // Special sounds
     memset(g_wav_special_sounds_file_name_list, 0, sizeof(g_wav_special_sounds_file_name_list));
@@ -270,10 +315,11 @@ void mount_sd_card(void)
     }
 }
 
-/* Build the full path where the note wav files are located */
-void build_notes_wav_file_path(uint8_t sound_bank_idx, char* path_str)
+/* Build the full path where the note wav files are located.
+   layer_dir_idx is the index of the velocity layer directory (1 to N), 0 for the bank directory. */
+void build_notes_wav_file_path(uint8_t sound_bank_idx, uint8_t layer_dir_idx, char* path_str)
 {
-    char index_str[3];
+    char index_str[4];
     
     // Convert program index into a string
     itoa(sound_bank_idx, index_str, 10);
@@ -283,23 +329,32 @@ void build_notes_wav_file_path(uint8_t sound_bank_idx, char* path_str)
     strcat(path_str, "/");
     strcat(path_str, "bank_");
     strcat(path_str, index_str);    
+
+    if (layer_dir_idx != 0)
+    {
+        itoa(layer_dir_idx, index_str, 10);
+        strcat(path_str, "/");
+        strcat(path_str, WAV_LAYER_DIR_NAME);
+        strcat(path_str, index_str);
+    }
 }
 
-/* Build a list of all wav files name in the wav directory of the SD card containing notes. */
-void build_notes_wav_notes_file_name_list(uint8_t sound_bank_idx)
+/* Build a list of all wav files name in the wav directory of the SD card containing notes. 
+   The compressed files (ADPCM_FILE_EXTENSION) are listed as the wav files. */
+void build_notes_wav_notes_file_name_list(char* search_path)
 {
     DIR     dir;
     FRESULT result;
     FILINFO finf;
     size_t file_index;
-    char search_path[MAX_FILE_PATH_LEN];
     char index_str[4];
     uint16_t nb_wav_files = 0;
 
     memset(index_str, 0, sizeof(index_str));
 
-    // Build the search path
-    build_notes_wav_file_path(sound_bank_idx, search_path);
+    // The keys without wav file keep an empty name (played with the samples of another key).
+    memset(g_wav_notes_file_name_list, 0, sizeof(g_wav_notes_file_name_list));
+
     g_hw.PrintLine("search_path=%s", search_path);
 
     // Open the directory containing the wav files.
@@ -333,7 +388,7 @@ void build_notes_wav_notes_file_name_list(uint8_t sound_bank_idx)
         // Check if its a wav file. If yes, add it to the list.
         g_hw.PrintLine("finf.fname=%s", finf.fname);
 
-        if(strstr(finf.fname, ".wav") || strstr(finf.fname, ".WAV"))
+        if(strstr(finf.fname, ".wav") || strstr(finf.fname, ".WAV") || is_adpcm_file(finf.fname))
         {
             g_hw.PrintLine("Wav file found:%s", finf.fname);
             
@@ -364,17 +419,93 @@ void build_notes_wav_notes_file_name_list(uint8_t sound_bank_idx)
     f_closedir(&dir);
 }
 
+/* Start the building of the index of the files of a directory of notes (dir_path) in pEntries 
+   (NB_KEYS entries, see build_notes_index): read the index file of the directory, or scan the 
+   directory if the index file is missing or stale (file names of the entries). 
+   Return true if the index file is read: the index is built. */
+bool start_notes_index(char* dir_path, TBankIndexEntry *pEntries)
+{
+    if (read_bank_index(dir_path, pEntries) == true)
+    {
+        g_hw.PrintLine("Index file read: %s", dir_path);
+        return true;
+    }
+
+    g_hw.PrintLine("Building the index of %s...", dir_path);
+    build_notes_wav_notes_file_name_list(dir_path);
+    memset(pEntries, 0, NB_KEYS * sizeof(TBankIndexEntry));
+
+    for (uint16_t file_idx = 0; file_idx < NB_KEYS; file_idx++)
+    {
+        strcpy(pEntries[file_idx].file_name, &g_wav_notes_file_name_list[file_idx * MAX_FILE_NAME_LEN]);
+    }
+
+    return false;
+}
+
+/* Read the format of the file of an index entry (file name set by start_notes_index) of a 
+   directory of notes (dir_path). */
+void read_notes_index_entry(char* dir_path, TBankIndexEntry *pEntry)
+{
+    static FILINFO finf;
+    char file_path_and_name[MAX_FILE_PATH_LEN];
+
+    if (pEntry->file_name[0] == 0)
+    {
+        return;
+    }
+
+    strcpy(file_path_and_name, dir_path);
+    strcat(file_path_and_name, "/");
+    strcat(file_path_and_name, pEntry->file_name);
+
+    if (f_stat(file_path_and_name, &finf) == FR_OK)
+    {
+        pEntry->file_size = finf.fsize;
+        pEntry->file_date = finf.fdate;
+        pEntry->file_time = finf.ftime;
+    }
+
+    if (is_adpcm_file(pEntry->file_name) == true)
+    {
+        pEntry->compressed = 1;
+        pEntry->data_size  = get_adpcm_file_nb_words(file_path_and_name) * 2;
+    }
+    else if (read_wav_format(file_path_and_name, pEntry) == false)
+    {
+        // Not loaded: the key is played with the samples of another key.
+        memset(pEntry, 0, sizeof(TBankIndexEntry));
+    }
+}
+
+/* Build the index of the files of a directory of notes (dir_path) in pEntries (NB_KEYS 
+   entries): read the index file of the directory, or scan the directory and read the header of
+   each file if the index file is missing or stale, and write the new index file. */
+void build_notes_index(char* dir_path, TBankIndexEntry *pEntries)
+{
+    if (start_notes_index(dir_path, pEntries) == true)
+    {
+        return;
+    }
+
+    for (uint16_t file_idx = 0; file_idx < NB_KEYS; file_idx++)
+    {
+        read_notes_index_entry(dir_path, &pEntries[file_idx]);
+    }
+
+    write_bank_index(dir_path, pEntries);
+}
+
 /* Read and load the special wav file data in external RAM. 
    At the beginning of external RAM.
    Update the position where to load the first note in exernal RAM.
    Update the g_sounds array fields first_sample_pos, last_sample_pos, nb_samples... */
 void load_special_sounds_wav_files_in_ram(void)
 {
+    static TBankIndexEntry wav_format;
     size_t cur_sound_pos = 0;
     TSoundData *pCurSound;
     char file_path_and_name[MAX_FILE_PATH_LEN];
-    size_t wav_data_size_bytes;
-    uint8_t* ram_address;
 
     for (uint16_t sound_idx = 0; sound_idx < NB_SPECIAL_SOUNDS; sound_idx++)
     {
@@ -388,70 +519,910 @@ void load_special_sounds_wav_files_in_ram(void)
         g_hw.PrintLine("file_path_and_name=%s", file_path_and_name);
 
         // Load the wav data at the current sound position.
-        ram_address = (uint8_t*)(&g_sample_data[cur_sound_pos]);
-        wav_data_size_bytes = read_wav_file(file_path_and_name, ram_address);
+        pCurSound->nb_samples  = 0;
+        pCurSound->nb_channels = 1;
+        if (read_wav_format(file_path_and_name, &wav_format) == true)
+        {
+            pCurSound->nb_samples = read_wav_file(file_path_and_name, &wav_format, &g_sample_data[cur_sound_pos],
+                                                  MAX_WAV_DATA_SIZE_WORD - cur_sound_pos, 
+                                                  &pCurSound->nb_channels);
+        }
 
         // For each sound record the position of the first sample, last sample and number of samples.
         pCurSound->first_sample_pos = cur_sound_pos;
-        pCurSound->nb_samples = wav_data_size_bytes / 2; // bytes to word size
         pCurSound->last_sample_pos = pCurSound->first_sample_pos + pCurSound->nb_samples;
-        
-        // Initialise some fields with the first sample position.
-        pCurSound->cur_playing_pos = pCurSound->first_sample_pos;
-        pCurSound->key_up_pos      = pCurSound->first_sample_pos;
-        pCurSound->pedal_up_pos    = pCurSound->first_sample_pos;
 
         g_hw.PrintLine("Special sound start_position=%d nb_samples=%d", pCurSound->first_sample_pos, pCurSound->nb_samples);
 
-        // Compute the next note position.
-        cur_sound_pos += pCurSound->nb_samples;
+        // Compute the next note position.
+        cur_sound_pos += pCurSound->nb_samples;
+    }
+    
+    // Update global variable g_first_note_position
+    g_first_note_position = cur_sound_pos;
+}
+
+/* Start the loading of the wav file of a note in external RAM (see load_note_wav_file) in pLoad:
+   dir_path is the directory of the file of the index entry pEntry (see build_notes_index), the 
+   data is loaded at position cur_note_pos, before end_pos, for the sound sound_idx of the sound 
+   bank of a slot. Return true if the file is open and its data is left to read (see 
+   continue_note_load), false if the note can be set at once (see finish_note_load). */
+bool start_note_load(TNoteLoad *pLoad, char* dir_path, const TBankIndexEntry *pEntry, uint8_t bank_slot, 
+                     uint16_t sound_idx, size_t cur_note_pos, size_t end_pos)
+{
+    int16_t *ram_address = &g_sample_data[cur_note_pos];
+    size_t max_nb_samples = end_pos - cur_note_pos;
+
+    // Build the full file path
+    strcpy(pLoad->file_path, dir_path);
+    strcat(pLoad->file_path, "/");
+    strcat(pLoad->file_path, pEntry->file_name);
+    g_hw.PrintLine("file_path_and_name=%s", pLoad->file_path);
+
+    // A note without wav file has no samples: it is played with the samples of the nearest note
+    // (see build_sound_map).
+    memset(&pLoad->reader, 0, sizeof(TWavReader));
+    memset(&pLoad->note, 0, sizeof(TSoundData));
+    pLoad->note.nb_channels      = 1;
+    pLoad->note.first_sample_pos = cur_note_pos;
+    pLoad->pEntry                = pEntry;
+    pLoad->bank_slot             = bank_slot;
+    pLoad->sound_idx             = sound_idx;
+    pLoad->looped                = false;
+    pLoad->streamed              = false;
+    pLoad->nb_copied_samples     = 0;
+    if (pEntry->file_name[0] == 0)
+    {
+        return false;
+    }
+
+    if (pEntry->compressed == 1)
+    {
+        // Compressed samples, decoded by the audio callback: the blocks are copied.
+        pLoad->nb_copied_samples = read_adpcm_file_format(pLoad->file_path, &pLoad->note);
+        if (pLoad->nb_copied_samples > max_nb_samples)
+        {
+            g_hw.PrintLine("Error: not enough RAM. Sound not loaded");
+            pLoad->nb_copied_samples = 0;
+        }
+        return    (pLoad->nb_copied_samples > 0)
+               && (open_wav_reader(&pLoad->reader, pLoad->file_path, sizeof(TAdpcmFileHeader), 
+                                   pLoad->nb_copied_samples * 2, NULL, ram_address, max_nb_samples) == true);
+    }
+
+    if (get_wav_loop_points(pEntry, &pLoad->loop_start, &pLoad->loop_end) == true)
+    {
+        // Looped note: whole samples in RAM, the frames after the loop are dropped.
+        pLoad->looped = true;
+    }
+    else if (is_wav_file_streamable(pEntry) == true)
+    {
+        // Head in RAM (with the guard frames), tail streamed from the SD card.
+        pLoad->streamed          = true;
+        pLoad->nb_copied_samples = (STREAM_HEAD_NB_FRAMES + STREAM_GUARD_NB_FRAMES) * pEntry->nb_channels;
+        if (pLoad->nb_copied_samples > max_nb_samples)
+        {
+            g_hw.PrintLine("Error: not enough RAM. Sound not loaded");
+            return false;
+        }
+        return open_wav_reader(&pLoad->reader, pLoad->file_path, pEntry->data_offset, 
+                               pLoad->nb_copied_samples * 2, NULL, ram_address, max_nb_samples);
+    }
+
+    return open_wav_reader(&pLoad->reader, pLoad->file_path, pEntry->data_offset, pEntry->data_size, 
+                           pEntry, ram_address, max_nb_samples);
+}
+
+/* Read the next chunk of the file of a note (at most max_nb_bytes bytes, see 
+   read_wav_reader_chunk). Return true while data is left to read. */
+bool continue_note_load(TNoteLoad *pLoad, size_t max_nb_bytes)
+{
+    return read_wav_reader_chunk(&pLoad->reader, max_nb_bytes);
+}
+
+/* Finish the loading of a note (see start_note_load): set its loop or its stream, and set the 
+   fields first_sample_pos, last_sample_pos, nb_samples... of its sound in the sound bank of its 
+   slot at once: the note may be played. Return the number of samples loaded in RAM. */
+size_t finish_note_load(TNoteLoad *pLoad)
+{
+    TSoundData *pNote = &pLoad->note;
+    int16_t *ram_address = &g_sample_data[pNote->first_sample_pos];
+    size_t nb_read_samples = pLoad->reader.nb_frames * pLoad->reader.nb_channels;
+    size_t nb_loaded_samples = nb_read_samples;
+    uint8_t nb_channels = pLoad->pEntry->nb_channels;
+
+    close_wav_reader(&pLoad->reader);
+
+    if ((pLoad->pEntry->compressed == 1) || (pLoad->streamed == true))
+    {
+        // Blocks or head copied: not loaded if they are not all read.
+        if ((nb_read_samples != pLoad->nb_copied_samples) || (nb_read_samples == 0))
+        {
+            pNote->nb_samples = 0;
+            nb_loaded_samples = 0;
+        }
+        else if (pLoad->streamed == true)
+        {
+            pNote->nb_channels        = nb_channels;
+            pNote->nb_samples         = (pLoad->pEntry->data_size / (2 * nb_channels)) * nb_channels;
+            pNote->nb_head_samples    = STREAM_HEAD_NB_FRAMES * nb_channels;
+            pNote->stream_file_offset = pLoad->pEntry->data_offset + STREAM_HEAD_NB_FRAMES * nb_channels * 2;
+            set_stream_file_path(pLoad->bank_slot, pLoad->sound_idx, pLoad->file_path);
+        }
+    }
+    else if (pLoad->pEntry->file_name[0] != 0)
+    {
+        pNote->nb_channels = pLoad->reader.nb_channels;
+        pNote->nb_samples  = nb_read_samples;
+        if (pLoad->looped == true)
+        {
+            nb_loaded_samples = set_sound_loop(pNote, ram_address, pLoad->loop_start, pLoad->loop_end);
+        }
+    }
+
+    // Record the position of the first sample, last sample and number of samples.
+    pNote->last_sample_pos = pNote->first_sample_pos + pNote->nb_samples;
+    if (pNote->looped == true)
+    {
+        pNote->loop_start_pos += pNote->first_sample_pos;
+        pNote->loop_end_pos   += pNote->first_sample_pos;
+    }
+    set_sound_data(pLoad->bank_slot, pLoad->sound_idx, pNote);
+
+    g_hw.PrintLine("Note start_position=%d nb_samples=%d nb_channels=%d nb_head_samples=%d compressed=%d looped=%d", 
+                   pNote->first_sample_pos, pNote->nb_samples, pNote->nb_channels,
+                   pNote->nb_head_samples, pNote->compressed, pNote->looped);
+
+    return nb_loaded_samples;
+}
+
+/* Read and load the wav file data of a note in external RAM at once (see start_note_load). The 
+   data is loaded at position *p_cur_note_pos, updated to the position after the note, and before
+   end_pos. When the tails of the notes are streamed, only the head is loaded. A looped note is 
+   loaded up to the end of its loop. */
+void load_note_wav_file(char* dir_path, const TBankIndexEntry *pEntry, uint8_t bank_slot, uint16_t sound_idx,
+                        size_t* p_cur_note_pos, size_t end_pos)
+{
+    static TNoteLoad note_load;
+
+    if (start_note_load(&note_load, dir_path, pEntry, bank_slot, sound_idx, *p_cur_note_pos, end_pos) == true)
+    {
+        while (continue_note_load(&note_load, NOTE_LOAD_CHUNK_BYTES_ALL) == true)
+        {
+        }
+    }
+
+    // Compute the next note position.
+    *p_cur_note_pos += finish_note_load(&note_load);
+}
+
+/* Read and load the notes wav file data of a velocity layer in external RAM. One file per note
+   (see load_note_wav_file), loaded at position *p_cur_note_pos, updated to the position after 
+   the layer, and before end_pos. The streams of the bank played are served between two files. */
+void load_notes_wav_files_in_ram(char* dir_path, const TBankIndexEntry *pEntries, uint8_t layer_idx, 
+                                 uint8_t bank_slot, size_t* p_cur_note_pos, size_t end_pos)
+{
+    for (uint16_t file_idx = 0; file_idx < NB_KEYS; file_idx++)
+    {
+        load_note_wav_file(dir_path, &pEntries[file_idx], bank_slot, 
+                           NB_SPECIAL_SOUNDS + layer_idx * NB_KEYS + file_idx, p_cur_note_pos, end_pos);
+
+        // The voices of the bank played go on while the bank is loaded.
+        service_streams();
+    }
+}
+
+/* Order of the keys loaded by the progressive load: PROGRESSIVE_LOAD_FIRST_KEY, then the keys 
+   above and below it alternately (outer keys last). */
+void build_progressive_key_order(TProgressiveLoad *pLoad)
+{
+    uint8_t nb_keys = 0;
+
+    pLoad->key_order[nb_keys++] = PROGRESSIVE_LOAD_FIRST_KEY;
+    for (int16_t distance = 1; nb_keys < NB_KEYS; distance++)
+    {
+        if (PROGRESSIVE_LOAD_FIRST_KEY + distance < NB_KEYS)
+        {
+            pLoad->key_order[nb_keys++] = PROGRESSIVE_LOAD_FIRST_KEY + distance;
+        }
+        if (PROGRESSIVE_LOAD_FIRST_KEY - distance >= 0)
+        {
+            pLoad->key_order[nb_keys++] = PROGRESSIVE_LOAD_FIRST_KEY - distance;
+        }
+    }
+}
+
+/* Start the loading of a sound bank in the slot bank_slot of g_sound_banks while the sound bank
+   of a slot is played, in g_sample_data from first_pos to end_pos (excluded). The load is done 
+   step by step by service_progressive_load: index of the velocity layers (see 
+   build_progressive_index), memory budget (see start_progressive_notes), then the notes one by 
+   one. The notes of a bank with an image file are read from the image, without index and 
+   memory budget (see open_bank_image, ENABLE_BANK_IMAGE). If swap is true, the bank is loaded in the slot not played, and the sound bank played 
+   switches to it once it is loaded (see swap_sound_bank). */
+void start_progressive_load(uint8_t sound_bank_idx, uint8_t bank_slot, size_t first_pos, size_t end_pos, 
+                            bool swap, bool demo_mode)
+{
+    TProgressiveLoad *pLoad = &g_progressive_load;
+    TSoundBank *pBank = &g_sound_banks[bank_slot];
+
+    memset(pLoad, 0, sizeof(TProgressiveLoad));
+    pLoad->sound_bank_idx = sound_bank_idx;
+    pLoad->bank_slot      = bank_slot;
+    pLoad->swap           = swap;
+    pLoad->demo_mode      = demo_mode;
+    pLoad->first_pos      = first_pos;
+    pLoad->cur_note_pos   = first_pos;
+    pLoad->end_pos        = end_pos;
+    pLoad->start_ms       = System::GetNow();
+
+    // The part of g_sample_data up to end_pos is kept for the bank while it is loaded.
+    prepare_sound_bank(sound_bank_idx, bank_slot);
+    pBank->first_note_pos = first_pos;
+    pBank->end_note_pos   = end_pos;
+    build_sound_map(bank_slot);
+
+    #if (ENABLE_BANK_IMAGE == 1)
+        if (open_bank_image(sound_bank_idx, first_pos, end_pos, &pLoad->image) == true)
+        {
+            // No index, no memory budget: the notes are read from the image (all the layers, no
+            // streaming), at the position of their data in the image.
+            pLoad->from_image   = true;
+            pLoad->nb_layers    = pLoad->image.header.nb_layers;
+            pLoad->cur_note_pos = pLoad->image.ram_pos + pLoad->image.header.data_size / 2;
+            g_stream_note_tails = false;
+            pBank->nb_velocity_layers = pLoad->nb_layers;
+            if (bank_slot == g_sound_bank_slot)
+            {
+                g_nb_velocity_layers = pLoad->nb_layers;
+            }
+            build_progressive_key_order(pLoad);
+            pLoad->phase  = LOAD_PHASE_NOTES;
+            pLoad->active = true;
+            return;
+        }
+    #endif
+
+    // Layer directories (the wav files of the bank directory are the only layer without them).
+    pLoad->nb_layer_dirs   = count_velocity_layer_dirs(sound_bank_idx);
+    pLoad->first_layer_dir = 1;
+    if (pLoad->nb_layer_dirs == 0)
+    {
+        pLoad->first_layer_dir = 0;
+        pLoad->nb_layer_dirs   = 1;
+    }
+    pLoad->phase          = LOAD_PHASE_INDEX;
+    pLoad->index_file_idx = PROGRESSIVE_INDEX_START;
+    pLoad->active         = true;
+}
+
+/* Load a swapped sound bank in place of the bank played (the loudest layer of the bank doesn't 
+   fit beside the bank played): the voices of the bank played are stopped (fast release) before
+   their samples are overwritten, and the bank is loaded at once. */
+void load_sound_bank_in_place(TProgressiveLoad *pLoad)
+{
+    g_hw.PrintLine("Loading the sound bank in place of the bank played...");
+    switch_sound_bank(pLoad->bank_slot);
+    wait_and_service_streams(2 * STOLEN_VOICE_RELEASE_MS);
+    play_special_sound(SOUND_PROGRAM_CHARGING_IDX);
+    load_sound_bank(pLoad->sound_bank_idx, pLoad->bank_slot, g_first_note_position, MAX_WAV_DATA_SIZE_WORD, false);
+}
+
+/* End of the swap of a sound bank (see swap_sound_bank): play the midi file in demo mode, then 
+   the sound "Piano ready". */
+void end_sound_bank_swap(bool demo_mode)
+{
+    if (demo_mode == true)
+    {
+        g_hw.PrintLine("Play midi file...");
+        play_one_midi_file(0, 1, 26);
+    }
+
+    g_hw.PrintLine("Play the sound piano ready...");
+    play_special_sound(SOUND_READY_IDX);
+}
+
+/* Compute the memory budget of the bank loaded by the progressive load once its layers are 
+   indexed (see compute_memory_budget), and start the loading of its notes: the keys are loaded
+   from PROGRESSIVE_LOAD_FIRST_KEY to the outer keys. If the loudest layer of a swapped bank does
+   not fit, the bank is loaded in place of the bank played. */
+void start_progressive_notes(TProgressiveLoad *pLoad)
+{
+    TSoundBank *pBank = &g_sound_banks[pLoad->bank_slot];
+
+    pLoad->first_layer_idx = 0;
+    if (compute_memory_budget(pLoad->nb_layer_dirs, pLoad->end_pos - pLoad->first_pos, pLoad->swap,
+                              &pLoad->first_layer_dir, &pLoad->first_layer_idx, &pLoad->nb_layers) == false)
+    {
+        pLoad->active = false;
+        load_sound_bank_in_place(pLoad);
+        end_sound_bank_swap(pLoad->demo_mode);
+        return;
+    }
+
+    // The layers of the slot played (bank loaded at startup) are used at once.
+    pBank->nb_velocity_layers = pLoad->nb_layers;
+    if (pLoad->bank_slot == g_sound_bank_slot)
+    {
+        g_nb_velocity_layers = pLoad->nb_layers;
+    }
+
+    build_progressive_key_order(pLoad);
+    pLoad->phase = LOAD_PHASE_NOTES;
+}
+
+/* Build the index of the velocity layers of the bank loaded by the progressive load, one step 
+   per call: read the index file of the next layer (or scan its directory, see 
+   start_notes_index), or read the format of the next file of the layer when its index file is 
+   missing or stale (see read_notes_index_entry). The notes are started once all the layers are
+   indexed (see start_progressive_notes). */
+void build_progressive_index(TProgressiveLoad *pLoad)
+{
+    char dir_path[MAX_FILE_PATH_LEN];
+    TBankIndexEntry *pEntries = g_layer_indexes[pLoad->index_layer_idx];
+    bool layer_indexed = false;
+
+    build_notes_wav_file_path(pLoad->sound_bank_idx, pLoad->first_layer_dir + pLoad->index_layer_idx, dir_path);
+    if (pLoad->index_file_idx == PROGRESSIVE_INDEX_START)
+    {
+        g_hw.PrintLine("Building the index of the wav files of layer %d...", pLoad->index_layer_idx);
+        layer_indexed = start_notes_index(dir_path, pEntries);
+        pLoad->index_file_idx = 0;
+    }
+    else
+    {
+        read_notes_index_entry(dir_path, &pEntries[pLoad->index_file_idx]);
+        pLoad->index_file_idx++;
+        if (pLoad->index_file_idx == NB_KEYS)
+        {
+            write_bank_index(dir_path, pEntries);
+            layer_indexed = true;
+        }
+    }
+
+    if (layer_indexed == true)
+    {
+        pLoad->index_layer_idx++;
+        pLoad->index_file_idx = PROGRESSIVE_INDEX_START;
+        if (pLoad->index_layer_idx == pLoad->nb_layer_dirs)
+        {
+            start_progressive_notes(pLoad);
+        }
+    }
+}
+
+/* Start the loading of the data of the next note of the image file of the bank loaded by the 
+   progressive load (see open_bank_image): the data is read chunk by chunk, copied as it is at 
+   its position in the data of the image. Return true if the data is left to read, false if the
+   key has no note in the layer (or the file can't be read). */
+bool start_image_note_load(TProgressiveLoad *pLoad)
+{
+    TBankImageLoad *pImage = &pLoad->image;
+    const TBankImageEntry *pEntry = &g_image_entries[pLoad->note_layer_idx * NB_KEYS + pLoad->note_key_idx];
+    size_t note_pos = pImage->ram_pos + (pEntry->data_offset - pImage->header.data_offset) / 2;
+
+    memset(&pLoad->note_load.reader, 0, sizeof(TWavReader));
+    if (pEntry->data_size == 0)
+    {
+        return false;
+    }
+
+    return open_wav_reader(&pLoad->note_load.reader, pImage->file_path, pEntry->data_offset, pEntry->data_size,
+                           NULL, &g_sample_data[note_pos], pLoad->end_pos - note_pos);
+}
+
+/* Set the note loaded by the progressive load in its sound bank (see finish_note_load, or 
+   set_bank_image_note for a note of the image file). The sound map of the bank is rebuilt when 
+   the first layer of a key is loaded. */
+void finish_progressive_note(TProgressiveLoad *pLoad)
+{
+    uint16_t entry_idx = pLoad->note_layer_idx * NB_KEYS + pLoad->note_key_idx;
+    uint16_t sound_idx = NB_SPECIAL_SOUNDS + entry_idx;
+    bool data_read;
+
+    if (pLoad->from_image == true)
+    {
+        close_wav_reader(&pLoad->note_load.reader);
+        data_read = (pLoad->note_load.reader.nb_frames * 2 == g_image_entries[entry_idx].data_size);
+        set_bank_image_note(&pLoad->image, pLoad->bank_slot, entry_idx, data_read);
+    }
+    else
+    {
+        pLoad->cur_note_pos += finish_note_load(&pLoad->note_load);
+    }
+    pLoad->note_loading = false;
+    pLoad->nb_layers_loaded[pLoad->note_key_idx]++;
+
+    // The key and the keys near it without samples are played with the samples of the key.
+    if ((pLoad->note_layer_idx == 0) && (g_sound_banks[pLoad->bank_slot].sounds[sound_idx].nb_samples != 0))
+    {
+        build_sound_map(pLoad->bank_slot);
+    }
+}
+
+/* Do the next step of the sound bank loaded while a bank is played (see start_progressive_load):
+   a step of the index of its layers, or at most PROGRESSIVE_LOAD_CHUNK_BYTES bytes of the file of
+   the note being loaded (wav file, or image file of the bank), so that the main loop receives the UART messages while the bank is 
+   loaded. The note is set in the bank once it is loaded. The next note is the next layer (from
+   layer 0) of the last key pressed whose notes are not all loaded, else of the next key of the 
+   loading order. A swapped bank is played once all its notes are loaded.
+   Return false when all the notes are loaded. */
+bool service_progressive_load(void)
+{
+    TProgressiveLoad *pLoad = &g_progressive_load;
+    char dir_path[MAX_FILE_PATH_LEN];
+    uint16_t sound_idx;
+    uint8_t key_idx;
+    uint8_t layer_idx;
+
+    if (pLoad->active == false)
+    {
+        return false;
+    }
+
+    if (pLoad->phase == LOAD_PHASE_INDEX)
+    {
+        build_progressive_index(pLoad);
+        return pLoad->active;
+    }
+
+    // Next chunk of the note being loaded.
+    if (pLoad->note_loading == true)
+    {
+        if (continue_note_load(&pLoad->note_load, PROGRESSIVE_LOAD_CHUNK_BYTES) == false)
+        {
+            finish_progressive_note(pLoad);
+        }
+        return true;
+    }
+
+    // Keys pressed whose notes are all loaded.
+    while (   (pLoad->nb_requested_keys > 0)
+           && (pLoad->nb_layers_loaded[pLoad->requested_keys[pLoad->nb_requested_keys - 1]] == pLoad->nb_layers))
+    {
+        pLoad->nb_requested_keys--;
+    }
+
+    if (pLoad->nb_requested_keys > 0)
+    {
+        key_idx = pLoad->requested_keys[pLoad->nb_requested_keys - 1];
+    }
+    else
+    {
+        while (   (pLoad->next_order_idx < NB_KEYS) 
+               && (pLoad->nb_layers_loaded[pLoad->key_order[pLoad->next_order_idx]] == pLoad->nb_layers))
+        {
+            pLoad->next_order_idx++;
+        }
+
+        if (pLoad->next_order_idx == NB_KEYS)
+        {
+            // All the notes are loaded: the rest of g_sample_data is free.
+            g_sound_banks[pLoad->bank_slot].end_note_pos = pLoad->cur_note_pos;
+            pLoad->active = false;
+            g_hw.PrintLine("Sound bank loaded in %d ms", System::GetNow() - pLoad->start_ms);
+            if (pLoad->swap == true)
+            {
+                switch_sound_bank(pLoad->bank_slot);
+                end_sound_bank_swap(pLoad->demo_mode);
+            }
+            return false;
+        }
+        key_idx = pLoad->key_order[pLoad->next_order_idx];
+    }
+
+    layer_idx = pLoad->nb_layers_loaded[key_idx];
+    pLoad->note_key_idx   = key_idx;
+    pLoad->note_layer_idx = layer_idx;
+    if (pLoad->from_image == true)
+    {
+        pLoad->note_loading = start_image_note_load(pLoad);
+    }
+    else
+    {
+        sound_idx = NB_SPECIAL_SOUNDS + layer_idx * NB_KEYS + key_idx;
+        build_notes_wav_file_path(pLoad->sound_bank_idx, pLoad->first_layer_dir + layer_idx, dir_path);
+        pLoad->note_loading = start_note_load(&pLoad->note_load, dir_path, 
+                                              &g_layer_indexes[pLoad->first_layer_idx + layer_idx][key_idx],
+                                              pLoad->bank_slot, sound_idx, pLoad->cur_note_pos, pLoad->end_pos);
+    }
+
+    // Note without data to read (no file, error).
+    if (pLoad->note_loading == false)
+    {
+        finish_progressive_note(pLoad);
+    }
+
+    return true;
+}
+
+/* Load the notes of a key (pressed) before the other keys when the sound bank is loaded while 
+   it is played. The last key requested is loaded first. The keys of a bank loaded in the slot 
+   not played (swap) are not requested. */
+void request_progressive_load(uint16_t key_idx)
+{
+    TProgressiveLoad *pLoad = &g_progressive_load;
+
+    if (   (pLoad->active == false) || (pLoad->bank_slot != g_sound_bank_slot) || (key_idx >= NB_KEYS) 
+        || ((pLoad->phase == LOAD_PHASE_NOTES) && (pLoad->nb_layers_loaded[key_idx] == pLoad->nb_layers)))
+    {
+        return;
+    }
+
+    // The oldest request is dropped when there are too many requests.
+    if (pLoad->nb_requested_keys == PROGRESSIVE_LOAD_NB_REQUESTS)
+    {
+        memmove(&pLoad->requested_keys[0], &pLoad->requested_keys[1], PROGRESSIVE_LOAD_NB_REQUESTS - 1);
+        pLoad->nb_requested_keys--;
+    }
+    pLoad->requested_keys[pLoad->nb_requested_keys++] = key_idx;
+}
+
+/* Load all the notes left of the sound bank loaded while it is played. The streams of the bank
+   played are served between two chunks. */
+void finish_progressive_load(void)
+{
+    if (g_progressive_load.active == true)
+    {
+        g_hw.PrintLine("Loading the notes left of the sound bank...");
+    }
+
+    while (service_progressive_load() == true)
+    {
+        toggle_right_led();
+        service_streams();
+    }
+}
+
+/* Stop the loading of the sound bank loaded while it is played: the notes loaded are kept, the 
+   other keys are played with the samples of the nearest key loaded. The note being loaded is 
+   dropped (its file is closed, it was not set in the bank). */
+void stop_progressive_load(void)
+{
+    TProgressiveLoad *pLoad = &g_progressive_load;
+
+    if (pLoad->active == true)
+    {
+        if (pLoad->note_loading == true)
+        {
+            close_wav_reader(&pLoad->note_load.reader);
+            pLoad->note_loading = false;
+        }
+        g_sound_banks[pLoad->bank_slot].end_note_pos = pLoad->cur_note_pos;
+        pLoad->active = false;
+        g_hw.PrintLine("Loading of the sound bank stopped");
+    }
+}
+
+/* Return the number of samples needed in RAM by the files of the index pEntries (after 
+   resampling, or compressed data). */
+size_t compute_notes_nb_samples(const TBankIndexEntry *pEntries)
+{
+    size_t nb_samples = 0;
+
+    for (uint16_t file_idx = 0; file_idx < NB_KEYS; file_idx++)
+    {
+        nb_samples += get_note_nb_samples(&pEntries[file_idx]);
+    }
+
+    return nb_samples;
+}
+
+/* Return the number of velocity layer directories (layer_1 to layer_N) of a sound bank. */
+uint8_t count_velocity_layer_dirs(uint8_t sound_bank_idx)
+{
+    char dir_path[MAX_FILE_PATH_LEN];
+    FILINFO finf;
+    uint8_t nb_layer_dirs = 0;
+
+    while (nb_layer_dirs < MAX_NB_VELOCITY_LAYERS)
+    {
+        build_notes_wav_file_path(sound_bank_idx, nb_layer_dirs + 1, dir_path);
+        if (f_stat(dir_path, &finf) != FR_OK)
+        {
+            break;
+        }
+        nb_layer_dirs++;
+    }
+
+    return nb_layer_dirs;
+}
+
+/* Open the image file of a sound bank (see bank_image.cpp): read its header in pImage and its 
+   table in g_image_entries, and place its data in g_sample_data from first_pos to end_pos 
+   (excluded): the position of the data is returned in pImage->ram_pos. 
+   Return false if the bank has no image file (or an invalid one) or if its notes don't fit: the
+   notes are then loaded from the wav files. */
+bool open_bank_image(uint8_t sound_bank_idx, size_t first_pos, size_t end_pos, TBankImageLoad *pImage)
+{
+    build_notes_wav_file_path(sound_bank_idx, 0, pImage->file_path);
+    strcat(pImage->file_path, "/");
+    strcat(pImage->file_path, BANK_IMAGE_FILE_NAME);
+    if (read_bank_image_table(pImage->file_path, &pImage->header, g_image_entries) == false)
+    {
+        return false;
+    }
+
+    // The data of all the notes is loaded (no streaming, no dropped layer).
+    pImage->ram_pos = ((first_pos + BANK_IMAGE_RAM_ALIGN_WORD - 1) / BANK_IMAGE_RAM_ALIGN_WORD) * BANK_IMAGE_RAM_ALIGN_WORD;
+    if ((pImage->ram_pos > end_pos) || (pImage->header.data_size / 2 > end_pos - pImage->ram_pos))
+    {
+        g_hw.PrintLine("Not enough RAM for the image: %d samples needed, %d samples available", 
+                       pImage->header.data_size / 2, (pImage->ram_pos < end_pos) ? end_pos - pImage->ram_pos : 0);
+        return false;
+    }
+
+    return true;
+}
+
+/* Set the note of the entry entry_idx of the image file pImage (see open_bank_image) in the slot
+   bank_slot of g_sound_banks, once its data is read at its position in the data of the image: 
+   the note is mixed down and looped if needed, then set at once (the slot may be the slot 
+   played). If data_read is false (read error), the note has no samples. */
+void set_bank_image_note(const TBankImageLoad *pImage, uint8_t bank_slot, uint16_t entry_idx, bool data_read)
+{
+    const TBankImageEntry *pEntry = &g_image_entries[entry_idx];
+    TSoundData note;
+
+    memset(&note, 0, sizeof(note));
+    note.first_sample_pos = pImage->ram_pos + (pEntry->data_offset - pImage->header.data_offset) / 2;
+    note.nb_channels      = 1;
+    if ((pEntry->data_size != 0) && (data_read == true))
+    {
+        note.nb_channels = pEntry->nb_channels;
+        note.nb_samples  = pEntry->nb_samples;
+        note.compressed  = (pEntry->compressed == 1);
+    }
+
+    if ((note.compressed == false) && (note.nb_channels == 2) && (get_loaded_nb_channels(2) == 1))
+    {
+        mix_down_to_mono(&g_sample_data[note.first_sample_pos], note.nb_samples / 2);
+        note.nb_channels = 1;
+        note.nb_samples /= 2;
+    }
+
+    #if (ENABLE_SAMPLE_LOOPS == 1)
+        if ((note.compressed == false) && (note.nb_samples != 0) && (pEntry->loop_end > pEntry->loop_start))
+        {
+            set_sound_loop(&note, &g_sample_data[note.first_sample_pos], pEntry->loop_start, pEntry->loop_end);
+        }
+    #endif
+
+    note.last_sample_pos = note.first_sample_pos + note.nb_samples;
+    if (note.looped == true)
+    {
+        note.loop_start_pos += note.first_sample_pos;
+        note.loop_end_pos   += note.first_sample_pos;
+    }
+    set_sound_data(bank_slot, NB_SPECIAL_SOUNDS + entry_idx, &note);
+}
+
+/* Load the notes of a sound bank from its image file (see open_bank_image) in the slot bank_slot
+   of g_sound_banks at once, in g_sample_data from first_pos to end_pos (excluded): the data of 
+   all the notes is read with a few big reads (see read_bank_image_data). 
+   Return false if the image file can't be used: the notes are then loaded from the wav files. */
+bool load_bank_image(uint8_t sound_bank_idx, uint8_t bank_slot, size_t first_pos, size_t end_pos)
+{
+    static TBankImageLoad image;
+    TSoundBank *pBank = &g_sound_banks[bank_slot];
+
+    if (open_bank_image(sound_bank_idx, first_pos, end_pos, &image) == false)
+    {
+        return false;
+    }
+
+    g_hw.PrintLine("Loading the image of %d velocity layers in RAM...", image.header.nb_layers);
+    if (read_bank_image_data(image.file_path, &image.header, &g_sample_data[image.ram_pos]) == false)
+    {
+        return false;
+    }
+
+    // Notes of each layer, at the position of their data in the image.
+    for (uint16_t entry_idx = 0; entry_idx < image.header.nb_layers * NB_KEYS; entry_idx++)
+    {
+        set_bank_image_note(&image, bank_slot, entry_idx, true);
+    }
+
+    g_stream_note_tails = false;
+    pBank->nb_velocity_layers = image.header.nb_layers;
+    if (bank_slot == g_sound_bank_slot)
+    {
+        g_nb_velocity_layers = image.header.nb_layers;
+    }
+    pBank->first_note_pos = first_pos;
+    pBank->end_note_pos   = image.ram_pos + image.header.data_size / 2;
+
+    return true;
+}
+
+/* Memory budget of the velocity layers of a sound bank, indexed in g_layer_indexes 
+   (nb_layer_dirs layers, from the directory *p_first_layer_dir): the samples of all the layers 
+   must fit in nb_samples_available samples. If they don't, the tails of the notes are streamed 
+   from the SD card (ENABLE_DISK_STREAMING, see g_stream_note_tails) and only the heads are 
+   loaded. If the heads don't fit either, the softest layers are not loaded. The loudest layer is
+   always loaded (truncated if needed), except if must_fit is true: false is returned.
+   The layers loaded are returned in *p_first_layer_dir (directory of layer 0), 
+   *p_first_layer_idx (index of layer 0 in g_layer_indexes) and *p_nb_layers. */
+bool compute_memory_budget(uint8_t nb_layer_dirs, size_t nb_samples_available, bool must_fit, 
+                           uint8_t *p_first_layer_dir, uint8_t *p_first_layer_idx, uint8_t *p_nb_layers)
+{
+    size_t layer_nb_samples;
+    size_t nb_samples_needed = 0;
+
+    *p_first_layer_idx = 0;
+    *p_nb_layers = nb_layer_dirs;
+
+    // The tails of the notes are streamed if the whole samples of the layers don't fit in RAM.
+    g_stream_note_tails = false;
+    #if (ENABLE_DISK_STREAMING == 1)
+        for (uint8_t layer_idx = 0; layer_idx < nb_layer_dirs; layer_idx++)
+        {
+            nb_samples_needed += compute_notes_nb_samples(g_layer_indexes[layer_idx]);
+        }
+        g_stream_note_tails = (nb_samples_needed > nb_samples_available);
+        g_hw.PrintLine("Whole samples: %d samples needed. Streaming of the note tails=%d", 
+                       nb_samples_needed, g_stream_note_tails);
+        nb_samples_needed = 0;
+    #endif
+
+    // Memory budget: samples needed by each layer (from the loudest layer).
+    g_hw.PrintLine("Computing the memory budget of %d velocity layers...", nb_layer_dirs);
+    for (int16_t layer_idx = nb_layer_dirs - 1; layer_idx >= 0; layer_idx--)
+    {
+        layer_nb_samples = compute_notes_nb_samples(g_layer_indexes[layer_idx]);
+
+        if (   (layer_nb_samples > nb_samples_available) && (must_fit == true)
+            && (layer_idx == nb_layer_dirs - 1))
+        {
+            g_hw.PrintLine("Not enough RAM: %d samples needed by the loudest layer, %d samples available", 
+                           layer_nb_samples, nb_samples_available);
+            return false;
+        }
+        if (   (nb_samples_needed + layer_nb_samples > nb_samples_available) 
+            && (layer_idx != nb_layer_dirs - 1))
+        {
+            g_hw.PrintLine("Not enough RAM: layers 1 to %d not loaded", layer_idx + 1);
+            *p_first_layer_dir += layer_idx + 1;
+            *p_first_layer_idx = layer_idx + 1;
+            *p_nb_layers = nb_layer_dirs - (layer_idx + 1);
+            break;
+        }
+        nb_samples_needed += layer_nb_samples;
+    }
+    g_hw.PrintLine("Memory budget: %d samples needed, %d samples available", 
+                   nb_samples_needed, nb_samples_available);
+
+    return true;
+}
+
+/* Load all the velocity layers of a sound bank from its wav files in the slot bank_slot of 
+   g_sound_banks, in g_sample_data from first_pos to end_pos (excluded), within the memory 
+   budget (see compute_memory_budget, must_fit). Return false if nothing is loaded. */
+bool load_sound_bank_wav_files(uint8_t sound_bank_idx, uint8_t bank_slot, size_t first_pos, size_t end_pos, 
+                               bool must_fit)
+{
+    TSoundBank *pBank = &g_sound_banks[bank_slot];
+    char dir_path[MAX_FILE_PATH_LEN];
+    size_t cur_note_pos = first_pos;
+    uint8_t nb_layer_dirs;
+    uint8_t first_layer_dir;
+    uint8_t first_layer_idx;
+    uint8_t nb_layers;
+
+    nb_layer_dirs = count_velocity_layer_dirs(sound_bank_idx);
+    first_layer_dir = 1;
+    if (nb_layer_dirs == 0)
+    {
+        // The wav files of the bank directory are the only layer.
+        first_layer_dir = 0;
+        nb_layer_dirs = 1;
+    }
+
+    // Index of the files of each layer (one file per note).
+    for (uint8_t layer_idx = 0; layer_idx < nb_layer_dirs; layer_idx++)
+    {
+        g_hw.PrintLine("Building the index of the wav files of layer %d...", layer_idx);
+        toggle_right_led();
+        build_notes_wav_file_path(sound_bank_idx, first_layer_dir + layer_idx, dir_path);
+        build_notes_index(dir_path, g_layer_indexes[layer_idx]);
+    }
+
+    if (compute_memory_budget(nb_layer_dirs, end_pos - first_pos, must_fit, 
+                              &first_layer_dir, &first_layer_idx, &nb_layers) == false)
+    {
+        return false;
+    }
+
+    // Load the layers (layer 0 is the softest). The layers of the slot played (bank loaded in 
+    // place of the bank played) are used at once.
+    pBank->nb_velocity_layers = nb_layers;
+    if (bank_slot == g_sound_bank_slot)
+    {
+        g_nb_velocity_layers = nb_layers;
+    }
+    pBank->first_note_pos = first_pos;
+    for (uint8_t layer_idx = 0; layer_idx < nb_layers; layer_idx++)
+    {
+        // Read notes wav files and load them in RAM.
+        g_hw.PrintLine("Loading notes wav files of layer %d in RAM...", layer_idx);
+        toggle_right_led();
+        build_notes_wav_file_path(sound_bank_idx, first_layer_dir + layer_idx, dir_path);
+        load_notes_wav_files_in_ram(dir_path, g_layer_indexes[first_layer_idx + layer_idx], layer_idx, 
+                                    bank_slot, &cur_note_pos, end_pos);
+    }
+
+    pBank->end_note_pos = cur_note_pos;
+
+    return true;
+}
+
+/* Prepare the slot bank_slot of g_sound_banks for a sound bank: special sounds of the bank 
+   played, all the notes of all the layers without samples, envelope curve of the bank and 
+   release time of each key (release file of the bank). */
+void prepare_sound_bank(uint8_t sound_bank_idx, uint8_t bank_slot)
+{
+    TSoundBank *pBank = &g_sound_banks[bank_slot];
+    char dir_path[MAX_FILE_PATH_LEN];
+
+    if (pBank->sounds != g_sounds)
+    {
+        memcpy(pBank->sounds, g_sounds, NB_SPECIAL_SOUNDS * sizeof(TSoundData));
     }
-    
-    // Update global variable g_first_note_position
-    g_first_note_position = cur_sound_pos;
+    memset(&pBank->sounds[NB_SPECIAL_SOUNDS], 0, (NB_SOUND_DATA - NB_SPECIAL_SOUNDS) * sizeof(TSoundData));
+
+    select_envelope_curve(bank_slot, k_bank_env_curves[sound_bank_idx]);
+    build_notes_wav_file_path(sound_bank_idx, 0, dir_path);
+    strcat(dir_path, "/");
+    strcat(dir_path, RELEASE_FILE_NAME);
+    read_release_file(bank_slot, dir_path);
 }
 
-/* Read and load the notes wav file data in external RAM. One file per note.
-   After special sounds in external RAM.
-   Update the sounds array fields first_sample_pos, last_sample_pos, nb_samples... */
-void load_notes_wav_files_in_ram(uint8_t sound_bank_idx)
+/* Load all the velocity layers of a sound bank in the slot bank_slot of g_sound_banks at once
+   (see start_progressive_load to load it while a bank is played) and build its sound map. The 
+   notes are loaded in g_sample_data from first_pos to end_pos (excluded), from the image file of
+   the bank if it has one (ENABLE_BANK_IMAGE), else from its wav files (see 
+   load_sound_bank_wav_files, must_fit). 
+   Return false if nothing is loaded. */
+bool load_sound_bank(uint8_t sound_bank_idx, uint8_t bank_slot, size_t first_pos, size_t end_pos, bool must_fit)
 {
-    char file_path_and_name[MAX_FILE_PATH_LEN];
-    size_t wav_data_size_bytes = 0;
-    size_t cur_note_pos = g_first_note_position;
-    uint8_t* ram_address = NULL;
-    TSoundData *pCurNote;
+    bool image_loaded = false;
 
-    for (uint16_t file_idx = 0; file_idx < NB_KEYS; file_idx++)
+    prepare_sound_bank(sound_bank_idx, bank_slot);
+
+    #if (ENABLE_BANK_IMAGE == 1)
+        image_loaded = load_bank_image(sound_bank_idx, bank_slot, first_pos, end_pos);
+    #endif
+    if (   (image_loaded == false) 
+        && (load_sound_bank_wav_files(sound_bank_idx, bank_slot, first_pos, end_pos, must_fit) == false))
     {
-        // Current note data
-        pCurNote = &g_sounds[NB_SPECIAL_SOUNDS + file_idx];
+        return false;
+    }
 
-        // Build the full file path
-        build_notes_wav_file_path(sound_bank_idx, file_path_and_name);
-        strcat(file_path_and_name, "/");
-        strcat(file_path_and_name, &g_wav_notes_file_name_list[file_idx * MAX_FILE_NAME_LEN]);
-        g_hw.PrintLine("file_path_and_name=%s", file_path_and_name);
-        
-        // Load the wav data at the current note position.
-        ram_address = (uint8_t*)(&g_sample_data[cur_note_pos]);
-        wav_data_size_bytes = read_wav_file(file_path_and_name, ram_address);
-
-        // For each note record the position of the first sample, last sample and number of samples.
-        pCurNote->first_sample_pos = cur_note_pos;
-        pCurNote->nb_samples = wav_data_size_bytes / 2; // bytes to word size
-        pCurNote->last_sample_pos = pCurNote->first_sample_pos + pCurNote->nb_samples;
-        
-        // Initialise some fields with the first sample position.
-        pCurNote->cur_playing_pos = pCurNote->first_sample_pos;
-        pCurNote->key_up_pos      = pCurNote->first_sample_pos;
-        pCurNote->pedal_up_pos    = pCurNote->first_sample_pos;
+    build_sound_map(bank_slot);
+
+    return true;
+}
 
-        g_hw.PrintLine("Note start_position=%d nb_samples=%d", pCurNote->first_sample_pos, pCurNote->nb_samples);
+/* Load a sound bank while the sound bank played goes on, then switch to the new bank (see 
+   start_progressive_load): the midi file is played in demo mode, then the sound "Piano ready". 
+   The new bank is loaded in the other slot, in the biggest part of g_sample_data not used by the
+   bank played (before or after its notes), streamed if needed (see compute_memory_budget). If 
+   its loudest layer does not fit there, the voices of the bank played are stopped (fast release)
+   and the new bank is loaded in place of the bank played (see load_sound_bank_in_place). */
+void swap_sound_bank(uint8_t sound_bank_idx, bool demo_mode)
+{
+    const TSoundBank *pPlayedBank = &g_sound_banks[g_sound_bank_slot];
+    uint8_t bank_slot = (g_sound_bank_slot + 1) % NB_SOUND_BANK_SLOTS;
+    size_t first_pos = g_first_note_position;
+    size_t end_pos = pPlayedBank->first_note_pos;
 
-        // Compute the next note position.
-        cur_note_pos += pCurNote->nb_samples;
+    if (MAX_WAV_DATA_SIZE_WORD - pPlayedBank->end_note_pos > end_pos - first_pos)
+    {
+        first_pos = pPlayedBank->end_note_pos;
+        end_pos   = MAX_WAV_DATA_SIZE_WORD;
     }
+    g_hw.PrintLine("Loading the sound bank in slot %d, samples %d to %d...", bank_slot, first_pos, end_pos);
+
+    start_progressive_load(sound_bank_idx, bank_slot, first_pos, end_pos, true, demo_mode);
 }
 
 /* Configure UART */
@@ -491,8 +1462,9 @@ void flush_uart(UartHandler* p_uart)
     }
 }
 
-/* Wait for a message on UART */
-int receive_msg_on_uart(UartHandler* p_uart, char msg_rec[MAX_MESSAGE_SIZE])
+/* Wait for a message on UART.
+   The sample time of the reception of the start of the message is returned in p_timestamp. */
+int receive_msg_on_uart(UartHandler* p_uart, char msg_rec[MAX_MESSAGE_SIZE], uint32_t* p_timestamp)
 {
     enum UartHandler::Result uart_result;
     uint8_t char_rec = 0;
@@ -505,8 +1477,13 @@ int receive_msg_on_uart(UartHandler* p_uart, char msg_rec[MAX_MESSAGE_SIZE])
         uart_result = p_uart->BlockingReceive(&char_rec, 1, 0);
         if ((uart_result == UartHandler::Result::OK) && (char_rec == 'S'))
         {
+            *p_timestamp = get_sample_time();
             break;
         }
+
+        // Load the streamed samples and the notes left while no message is received.
+        service_streams();
+        service_progressive_load();
     }
 
     // Receive characters until end of message (character 0x0a).
@@ -549,7 +1526,11 @@ int receive_msg_on_uart(UartHandler* p_uart, char msg_rec[MAX_MESSAGE_SIZE])
     return result;
 }
 
-/* Analyze messages received from Arduino. */
+/* Analyze messages received from Arduino:
+   - "D <key> <attack time>": key down.
+   - "U <key>": key up.
+   - "P <position>": position of the pedal (0: up to PEDAL_MAX_POSITION: down), returned in 
+     p_time with key index PEDAL_KEY_IDX. */
 int analyze_msg_received(char msg_rec[MAX_MESSAGE_SIZE], uint16_t *p_key_index, e_msg_type *p_msg_type, uint32_t* p_time)
 {
     int result = 0;
@@ -607,6 +1588,21 @@ int analyze_msg_received(char msg_rec[MAX_MESSAGE_SIZE], uint16_t *p_key_index,
         }
         *p_key_index = arduino_to_piano_key_index(key_index);
     }
+    else if (msg_rec[0] == 'P')
+    {
+        // Message type
+        *p_msg_type = PEDAL_MSG;
+        *p_key_index = PEDAL_KEY_IDX;
+
+        // Pedal position
+        result_2 = sscanf(&msg_rec[2], "%d", &temp_int);
+        if ((result_2 != 1) || (temp_int < 0) || (temp_int > PEDAL_MAX_POSITION))
+        {
+            g_hw.PrintLine("Error: Problem to convert pedal position received");
+            result = -1;
+        }
+        *p_time = temp_int;
+    }
     else
     {
         g_hw.PrintLine("Error: Unknown message received");
@@ -616,17 +1612,23 @@ int analyze_msg_received(char msg_rec[MAX_MESSAGE_SIZE], uint16_t *p_key_index,
     return result;
 }
 
-/* This function manages the messages received (KEY_UP_MSG, KEY_DOWN_MSG) in normal 
-   mode (aka not programming mode).
-   It works in collaboration with function AudioCallback which is called in parallel. 
-   Be careful, as AudioCallback is called asynchronously, the order in which variables 
-   are set can matter.
+/* This function manages the messages received (KEY_UP_MSG, KEY_DOWN_MSG, PEDAL_MSG) in normal 
+   mode (aka not programming mode). For PEDAL_MSG, attack_time is the position of the pedal.
+   The notes and the pedal changes are posted to AudioCallback in the event queue with the 
+   sample time of the message reception (timestamp).
 */
-void manage_msg_received_in_normal_mode(uint16_t key_index, e_msg_type msg_type, uint32_t attack_time)
+void manage_msg_received_in_normal_mode(uint16_t key_index, e_msg_type msg_type, uint32_t attack_time,
+                                        uint32_t timestamp)
 {
-    uint16_t idx;
-    
-    if (key_index != PEDAL_KEY_IDX)
+    if ((key_index == SOSTENUTO_KEY_IDX) || (key_index == UNA_CORDA_KEY_IDX))
+    {
+        // The sostenuto or una corda pedal is up or down (sent as a key).
+        e_pedal pedal = (key_index == SOSTENUTO_KEY_IDX) ? PEDAL_SOSTENUTO : PEDAL_UNA_CORDA;
+
+        g_hw.PrintLine("PEDAL %d down=%d", pedal, (msg_type == KEY_DOWN_MSG));
+        set_pedal_position(pedal, (msg_type == KEY_DOWN_MSG) ? 1.0f : 0.0f, timestamp);
+    }
+    else if (key_index != PEDAL_KEY_IDX)
     {
         // A key from the keyboard has changed state.
         if (msg_type == KEY_DOWN_MSG) 
@@ -639,45 +1641,42 @@ void manage_msg_received_in_normal_mode(uint16_t key_index, e_msg_type msg_type,
                 g_hw.PrintLine(" volume="FLT_FMT3, FLT_VAR3(amplification));
             #endif
 
-            start_playing_a_note(key_index, amplification);
+            request_progressive_load(key_index);
+            start_playing_a_note(key_index, amplification, timestamp);
         } 
         else if (msg_type == KEY_UP_MSG) 
         {
             // The key is up
             #if (ENABLED_ALL_LOGS == 1)
                 g_hw.PrintLine("KEY_UP index=%d", key_index);
+                display_limiter_activity();
+                display_audio_load();
+                display_stream_activity();
             #endif
 
-            stop_playing_a_note(key_index);
+            stop_playing_a_note(key_index, timestamp);
         }
     } 
     else // key_index == PEDAL_KEY_IDX
     {
-        // The pedal has changed state.
-        if (msg_type == KEY_DOWN_MSG) 
+        // The pedal has moved. The release of the notes whose key is up depends on the pedal 
+        // position in AudioCallback (half pedal). The pedal sent as a key is up or down.
+        if (msg_type == PEDAL_MSG)
+        {
+            g_hw.PrintLine("PEDAL position=%ld", attack_time);
+            set_pedal_position(PEDAL_SUSTAIN, (float)attack_time / PEDAL_MAX_POSITION, timestamp);
+        }
+        else if (msg_type == KEY_DOWN_MSG) 
         {
             // The pedal is down
             g_hw.PrintLine("PEDAL_DOWN");
-            g_pedal_up = false;
-            
-            // The position is reinitialised for all notes (different position for ech note).
-            for (idx = 0; idx < NB_KEYS; idx++)
-            {
-                g_sounds[NB_SPECIAL_SOUNDS + idx].pedal_up_pos = g_sounds[NB_SPECIAL_SOUNDS + idx].first_sample_pos;
-            }
+            set_pedal_position(PEDAL_SUSTAIN, 1.0f, timestamp);
         } 
         else if (msg_type == KEY_UP_MSG) 
         {
             // The pedal is up
             g_hw.PrintLine("PEDAL_UP");
-
-            // The position when the pedal is up is set for all notes (different positions for 
-            // each note).
-            for (idx = 0; idx < NB_KEYS; idx++)
-            {
-                g_sounds[NB_SPECIAL_SOUNDS + idx].pedal_up_pos = g_sounds[NB_SPECIAL_SOUNDS + idx].cur_playing_pos;
-            }
-            g_pedal_up = true;
+            set_pedal_position(PEDAL_SUSTAIN, 0.0f, timestamp);
         }
     }
 }
@@ -708,54 +1707,24 @@ void manage_msg_received_in_programming_mode(uint16_t key_index, e_msg_type msg_
         write_current_program(prog_index);
 
         // Compute sound bank and demo mode
-        sound_bank_idx = prog_index % (NB_PROGRAMS / 2);
+        sound_bank_idx = prog_index % NB_SOUND_BANKS;
         demo_mode = (prog_index >= (NB_PROGRAMS / 2));
 
-        // Build a sorted list of wav file name (one per note).
-        g_hw.PrintLine("Building the list of wav files...");
-        toggle_right_led();
-        build_notes_wav_notes_file_name_list(sound_bank_idx);
-
-        // Read notes wav files and load them in RAM.
-        g_hw.PrintLine("Loading notes wav files in RAM...");
-        toggle_right_led();
-        load_notes_wav_files_in_ram(sound_bank_idx);
-
-        // Play all midi files in demo mode
-        if (demo_mode == true)
-        {
-            g_hw.PrintLine("Play midi file...");
-            play_one_midi_file(0, 1, 26);
-        }
-
-        // Play sound "Piano ready"
-        g_hw.PrintLine("Play the sound piano ready...");
-        play_special_sound(SOUND_READY_IDX);
+        // Read notes wav files of all the velocity layers and load them in RAM while the 
+        // current sound bank goes on playing (with the notes loaded if it is still loaded). The
+        // midi file (demo mode) and the sound "Piano ready" are played once the bank is loaded.
+        g_hw.PrintLine("Loading the sound bank in RAM...");
+        stop_progressive_load();
+        swap_sound_bank(sound_bank_idx, demo_mode);
     }
 }
 
-/* Play a special sound */
-void play_special_sound(uint8_t sound_idx)
-{
-    TSoundData *pCurSound = &g_sounds[sound_idx];
-
-    pCurSound->volume          = 1.0f;
-    pCurSound->cur_playing_pos = pCurSound->first_sample_pos;
-    pCurSound->key_up_pos      = pCurSound->first_sample_pos;
-    pCurSound->pedal_up_pos    = pCurSound->first_sample_pos;
-    pCurSound->key_up          = false;
-    pCurSound->sound_end_soon  = false;
-
-    // Start the sound playing by the AudioCallback function.
-    pCurSound->playing = true;
-}
-
-/* This function manages the messages received (KEY_UP_MSG, KEY_DOWN_MSG).
+/* This function manages the messages received (KEY_UP_MSG, KEY_DOWN_MSG, PEDAL_MSG).
    It works in collaboration with function AudioCallback which is called in parallel. 
    Be careful, as AudioCallback is called asynchronously, the order in which variables 
    are set can matter.
 */
-void manage_msg_received(uint16_t key_index, e_msg_type msg_type, uint32_t attack_time)
+void manage_msg_received(uint16_t key_index, e_msg_type msg_type, uint32_t attack_time, uint32_t timestamp)
 {
     toggle_right_led();
 
@@ -767,7 +1736,7 @@ void manage_msg_received(uint16_t key_index, e_msg_type msg_type, uint32_t attac
     }
     else
     {
-        manage_msg_received_in_normal_mode(key_index, msg_type, attack_time);
+        manage_msg_received_in_normal_mode(key_index, msg_type, attack_time, timestamp);
     }
 }
 
@@ -784,87 +1753,520 @@ void play_notes_received_from_arduino(UartHandler* p_uart)
     uint16_t key_index;
     e_msg_type msg_type;
     uint32_t attack_time;
+    uint32_t timestamp;
 
     // Receive messages from UART
     while(true)
     {
-        result = receive_msg_on_uart(p_uart, msg_rec);
+        result = receive_msg_on_uart(p_uart, msg_rec, &timestamp);
         if (result == 0)
         {   
             result = analyze_msg_received(msg_rec, &key_index, &msg_type, &attack_time);
 
             if (result == 0)
             {
-                manage_msg_received(key_index, msg_type, attack_time);
+                manage_msg_received(key_index, msg_type, attack_time, timestamp);
             
             } // if (result == 0)
         } // if (result == 0)
     } // while(true)
 }
 
-/* Read the wav data of a wav file. Copy the data at RAM address ram_address.
-   Return the wav data size (in bytes). */
-size_t read_wav_file(char *file_name, uint8_t* ram_address)
+/* Read size bytes at position pos of a file opened with FatFS (context: its FIL) in buffer (see 
+   parse_wav_format). */
+static bool read_sd_file_at(void *context, uint32_t pos, void *buffer, size_t size)
+{
+    FIL *pFile = (FIL *)context;
+    size_t bytesRead = 0;
+
+    return    (f_lseek(pFile, pos) == FR_OK) && (f_read(pFile, buffer, size, &bytesRead) == FR_OK)
+           && (bytesRead == size);
+}
+
+/* Read the format of the data of a wav file (number of channels, sample rate, bits per sample,
+   position and size of the samples, first sample loop) in the index entry of the file. The file
+   is opened once and its chunks are walked by parse_wav_format (see wav_format.cpp).
+   Return false if the file can't be opened, is not a wav file with fmt and data chunks, or if 
+   its format is not supported. */
+bool read_wav_format(char *file_name, TBankIndexEntry *pEntry)
 {
     static FIL SDFile;
-    static WavFileInfo wav_file_info;
-    size_t bytesRead;
     FRESULT result;
-    size_t wav_data_size = 0;
+    bool format_read;
 
-    // Read wav file info (file size and size to skip to reach sample data)
     result = f_open(&SDFile, file_name, FA_READ);
-    if (result == FR_OK)
+    if (result != FR_OK)
     {
-        result = f_read(&SDFile, (void *)&wav_file_info.raw_data, sizeof(WAV_FormatTypeDef), &bytesRead);
-        if (result != FR_OK)
+        g_hw.PrintLine("f_open result KO. result=%d", result);
+        return false;
+    }
+
+    format_read = parse_wav_format(file_name, f_size(&SDFile), read_sd_file_at, &SDFile, pEntry);
+    f_close(&SDFile);
+
+    return format_read;
+}
+
+/* Return the loop points of a wav file (format pEntry) in frames at SAMPLE_RATE_HZ (after 
+   resampling): the loop is from *p_loop_start to *p_loop_end (excluded).
+   Return false if the file has no loop (or loops are disabled, or the loop is too short). */
+bool get_wav_loop_points(const TBankIndexEntry *pEntry, size_t *p_loop_start, size_t *p_loop_end)
+{
+    #if (ENABLE_SAMPLE_LOOPS == 0)
+        return false;
+    #endif
+
+    if ((pEntry->loop_end <= pEntry->loop_start) || (pEntry->sample_rate == 0))
+    {
+        return false;
+    }
+
+    // Loop points of the resampled data (the resampler delays the data by half its filter).
+    if (pEntry->sample_rate == SAMPLE_RATE_HZ)
+    {
+        *p_loop_start = pEntry->loop_start;
+        *p_loop_end   = pEntry->loop_end;
+    }
+    else
+    {
+        *p_loop_start = (size_t)(((uint64_t)pEntry->loop_start + RESAMPLER_NB_TAPS / 2) * SAMPLE_RATE_HZ / pEntry->sample_rate);
+        *p_loop_end   = (size_t)(((uint64_t)pEntry->loop_end + RESAMPLER_NB_TAPS / 2) * SAMPLE_RATE_HZ / pEntry->sample_rate);
+    }
+
+    return (*p_loop_end - *p_loop_start >= MIN_LOOP_NB_FRAMES);
+}
+
+/* Return the number of samples of the file of a key (index entry pEntry) once loaded in RAM 
+   (after resampling to SAMPLE_RATE_HZ, all channels), or the number of words of a compressed 
+   file. */
+size_t get_note_nb_samples(const TBankIndexEntry *pEntry)
+{
+    uint16_t file_nb_channels = pEntry->nb_channels;
+    uint64_t nb_file_frames;
+    uint8_t nb_channels;
+    size_t loop_start;
+    size_t loop_end;
+
+    if (pEntry->file_name[0] == 0)
+    {
+        return 0;
+    }
+    if (pEntry->compressed == 1)
+    {
+        return pEntry->data_size / 2;
+    }
+    if (   (pEntry->sample_rate == 0) || (file_nb_channels == 0) || (file_nb_channels > 2)
+        || (get_wav_frame_size(pEntry) == 0))
+    {
+        return 0;
+    }
+    nb_channels = get_loaded_nb_channels(file_nb_channels);
+
+    // Only the frames up to the end of the loop of a looped file are kept (with the guard frame).
+    if (get_wav_loop_points(pEntry, &loop_start, &loop_end) == true)
+    {
+        return (loop_end + 1) * nb_channels;
+    }
+
+    // Only the head of a streamed file is loaded (with the guard frames).
+    if (is_wav_file_streamable(pEntry) == true)
+    {
+        return (STREAM_HEAD_NB_FRAMES + STREAM_GUARD_NB_FRAMES) * file_nb_channels;
+    }
+
+    nb_file_frames = pEntry->data_size / get_wav_frame_size(pEntry);
+    if (pEntry->sample_rate == SAMPLE_RATE_HZ)
+    {
+        return nb_file_frames * nb_channels;
+    }
+
+    // Resampled data and frames of the end of the resampling filter.
+    return (  (size_t)((nb_file_frames * SAMPLE_RATE_HZ) / pEntry->sample_rate) 
+            + RESAMPLER_NB_TAPS) * nb_channels;
+}
+
+/* Return true if the tail of a wav file (format pEntry) can be streamed from the SD card: the 
+   tails of the notes are streamed, the data is played as it is in the file (16 bits samples, 
+   sample rate SAMPLE_RATE_HZ, no mix down) and the file is longer than the head. */
+bool is_wav_file_streamable(const TBankIndexEntry *pEntry)
+{
+    uint16_t file_nb_channels = pEntry->nb_channels;
+
+    if (   (g_stream_note_tails == false) || (pEntry->sample_rate != SAMPLE_RATE_HZ)
+        || (is_wav_file_16_bits(pEntry) == false) || (file_nb_channels == 0) || (file_nb_channels > 2) 
+        || (get_loaded_nb_channels(file_nb_channels) != file_nb_channels))
+    {
+        return false;
+    }
+
+    return (pEntry->data_size / (2 * file_nb_channels) > STREAM_HEAD_NB_FRAMES + STREAM_GUARD_NB_FRAMES);
+}
+
+/* Set the loop of a sound loaded at RAM address ram_address (nb_samples and nb_channels set): 
+   the loop is from frame loop_start to frame loop_end (excluded). The LOOP_XFADE_NB_FRAMES 
+   frames before the end of the loop are crossfaded with the frames before the start of the loop
+   (the jump from the end to the start of the loop is seamless), and the frame at the end of the 
+   loop is a copy of the frame at its start (read by the interpolation). The frames after it are 
+   dropped.
+   Return the number of samples kept. */
+size_t set_sound_loop(TSoundData *pSound, int16_t* ram_address, size_t loop_start, size_t loop_end)
+{
+    uint8_t nb_channels = pSound->nb_channels;
+    size_t nb_frames = pSound->nb_samples / nb_channels;
+    size_t nb_xfade_frames;
+    size_t end_pos;
+    size_t start_pos;
+    float gain;
+
+    // The loop must end before the last frame (guard frame).
+    if (loop_end >= nb_frames)
+    {
+        loop_end = (nb_frames > 0) ? nb_frames - 1 : 0;
+    }
+    if ((loop_end <= loop_start) || (loop_end - loop_start < MIN_LOOP_NB_FRAMES))
+    {
+        g_hw.PrintLine("Error: loop too short. Sound not looped");
+        return pSound->nb_samples;
+    }
+
+    nb_xfade_frames = LOOP_XFADE_NB_FRAMES;
+    if (nb_xfade_frames > loop_start)
+    {
+        nb_xfade_frames = loop_start;
+    }
+    if (nb_xfade_frames > (loop_end - loop_start) / 2)
+    {
+        nb_xfade_frames = (loop_end - loop_start) / 2;
+    }
+
+    // Linear crossfade: the last frame of the loop is the frame before the start of the loop.
+    for (size_t frame_idx = 0; frame_idx < nb_xfade_frames; frame_idx++)
+    {
+        gain = (float)(frame_idx + 1) / (float)nb_xfade_frames;
+        end_pos = (loop_end - nb_xfade_frames + frame_idx) * nb_channels;
+        start_pos = (loop_start - nb_xfade_frames + frame_idx) * nb_channels;
+        for (uint8_t channel = 0; channel < nb_channels; channel++)
         {
-            g_hw.PrintLine("f_read result KO. result=%d", result);
+            ram_address[end_pos + channel] = (int16_t)(  (1.0f - gain) * ram_address[end_pos + channel] 
+                                                       + gain * ram_address[start_pos + channel]);
         }
-        f_close(&SDFile);
     }
-    else
+
+    // Guard frame.
+    for (uint8_t channel = 0; channel < nb_channels; channel++)
     {
-        g_hw.PrintLine("f_open result KO. result=%d", result);
+        ram_address[loop_end * nb_channels + channel] = ram_address[loop_start * nb_channels + channel];
     }
 
-    // Read wav file data
-    uint32_t file_size = wav_file_info.raw_data.FileSize;
-    uint32_t size_to_skip = sizeof(WAV_FormatTypeDef) + wav_file_info.raw_data.SubChunk1Size;
+    // Positions relative to the first sample of the sound (see load_notes_wav_files_in_ram).
+    pSound->looped         = true;
+    pSound->loop_start_pos = loop_start * nb_channels;
+    pSound->loop_end_pos   = loop_end * nb_channels;
+    pSound->nb_samples     = (loop_end + 1) * nb_channels;
 
-    result = f_open(&SDFile, file_name, FA_READ);
+    return pSound->nb_samples;
+}
 
-    if (result == FR_OK)
+/* Mix down nb_frames stereo frames (interleaved left, right) to mono frames, in place. */
+void mix_down_to_mono(int16_t *samples, size_t nb_frames)
+{
+    for (size_t frame_idx = 0; frame_idx < nb_frames; frame_idx++)
     {
-        f_lseek(&SDFile, size_to_skip);
+        samples[frame_idx] = (int16_t)(((int32_t)samples[2 * frame_idx] + samples[2 * frame_idx + 1]) / 2);
+    }
+}
 
-        result = f_read(&SDFile, ram_address, file_size - size_to_skip, &bytesRead);
-        if (result != FR_OK)
+/* Return true if the samples of a wav file (format pEntry) are 16 bits integers, the format of 
+   the samples in RAM. */
+bool is_wav_file_16_bits(const TBankIndexEntry *pEntry)
+{
+    return (pEntry->bits_per_sample == 16) && (pEntry->float_samples == 0);
+}
+
+/* Convert nb_samples samples of a wav file (format pEntry: 24 or 32 bits integers, or 32 bits 
+   floats) to 16 bits integers, in place: the 16 bits samples are written from the start of 
+   buffer. A triangular dither of 1 LSB (16 bits) is added before the rounding, so that the 
+   quantization error is a low noise rather than a distortion of the quiet end of the notes. */
+void convert_samples_to_16_bits(void *buffer, size_t nb_samples, const TBankIndexEntry *pEntry)
+{
+    static uint32_t dither_seed = 22222;
+    const uint8_t *pSrc = (const uint8_t *)buffer;
+    int16_t *pDest = (int16_t *)buffer;
+    uint8_t sample_size = pEntry->bits_per_sample / 8;
+    int32_t sample; // Full scale on 32 bits.
+    int32_t dither;
+    int64_t rounded;
+    float float_sample;
+
+    for (size_t sample_idx = 0; sample_idx < nb_samples; sample_idx++)
+    {
+        if (pEntry->float_samples == 1)
+        {
+            memcpy(&float_sample, pSrc, sizeof(float_sample));
+            if (float_sample >= 1.0f)
+            {
+                sample = INT32_MAX;
+            }
+            else if (float_sample <= -1.0f)
+            {
+                sample = INT32_MIN;
+            }
+            else if (float_sample == float_sample)
+            {
+                sample = (int32_t)(float_sample * 2147483648.0f);
+            }
+            else
+            {
+                sample = 0; // NaN
+            }
+        }
+        else if (sample_size == 3)
         {
-            g_hw.PrintLine("f_read result KO. result=%d", result);
+            sample = (int32_t)(((uint32_t)pSrc[0] << 8) | ((uint32_t)pSrc[1] << 16) | ((uint32_t)pSrc[2] << 24));
         }
-    
-        f_close(&SDFile);
+        else
+        {
+            memcpy(&sample, pSrc, sizeof(sample));
+        }
+        pSrc += sample_size;
+
+        // Triangular dither: difference of two uniform random values of 1 LSB (16 bits).
+        dither_seed = dither_seed * 1664525 + 1013904223;
+        dither = (int32_t)(dither_seed >> 16);
+        dither_seed = dither_seed * 1664525 + 1013904223;
+        dither -= (int32_t)(dither_seed >> 16);
 
-        wav_data_size = bytesRead;
+        rounded = ((int64_t)sample + dither + 32768) >> 16;
+        if (rounded > INT16_MAX)
+        {
+            rounded = INT16_MAX;
+        }
+        else if (rounded < INT16_MIN)
+        {
+            rounded = INT16_MIN;
+        }
+        *pDest++ = (int16_t)rounded;
     }
-    else
+}
+
+/* Open a file to read its data (data_size bytes at position data_offset) chunk by chunk at RAM
+   address ram_address (see read_wav_reader_chunk), at most max_nb_samples samples. pFormat is the
+   format of wav samples, converted while they are read (see read_wav_file), or NULL for data 
+   copied as it is (head of a streamed note, compressed blocks).
+   Return false if the file can't be read (nothing to read). */
+bool open_wav_reader(TWavReader *pReader, char *file_name, uint32_t data_offset, size_t data_size,
+                     const TBankIndexEntry *pFormat, int16_t* ram_address, size_t max_nb_samples)
+{
+    FRESULT result;
+    uint16_t file_nb_channels = 1;
+
+    memset(pReader, 0, sizeof(TWavReader));
+    pReader->pFormat       = pFormat;
+    pReader->ram_address   = ram_address;
+    pReader->nb_bytes_left = data_size;
+    pReader->nb_channels   = 1;
+
+    if (pFormat != NULL)
+    {
+        file_nb_channels = pFormat->nb_channels;
+        if ((file_nb_channels == 0) || (file_nb_channels > 2))
+        {
+            g_hw.PrintLine("Error: %d channels not supported", file_nb_channels);
+            return false;
+        }
+        pReader->nb_channels = get_loaded_nb_channels(file_nb_channels);
+        pReader->converted   =    (pFormat->sample_rate != SAMPLE_RATE_HZ) 
+                               || (pReader->nb_channels != file_nb_channels)
+                               || (is_wav_file_16_bits(pFormat) == false);
+        pReader->nb_bytes_left -= data_size % get_wav_frame_size(pFormat);
+
+        if (   (pFormat->sample_rate != SAMPLE_RATE_HZ) 
+            && (init_resampler(pFormat->sample_rate, SAMPLE_RATE_HZ, pReader->nb_channels) == false))
+        {
+            return false;
+        }
+        if (pFormat->sample_rate != SAMPLE_RATE_HZ)
+        {
+            g_hw.PrintLine("Resampling %ld Hz -> %d Hz", pFormat->sample_rate, SAMPLE_RATE_HZ);
+        }
+        if (pReader->nb_channels != file_nb_channels)
+        {
+            g_hw.PrintLine("Mixing down stereo to mono");
+        }
+        if (is_wav_file_16_bits(pFormat) == false)
+        {
+            g_hw.PrintLine("Converting %d bits %s samples to 16 bits", pFormat->bits_per_sample,
+                           (pFormat->float_samples == 1) ? "float" : "integer");
+        }
+    }
+    pReader->max_nb_frames = max_nb_samples / pReader->nb_channels;
+
+    // Data copied as it is: the frames that don't fit in RAM are not read.
+    if ((pReader->converted == false) && (pReader->nb_bytes_left > pReader->max_nb_frames * 2 * pReader->nb_channels))
+    {
+        g_hw.PrintLine("Error: not enough RAM. Sound truncated");
+        pReader->nb_bytes_left = pReader->max_nb_frames * 2 * pReader->nb_channels;
+    }
+
+    result = f_open(&pReader->file, file_name, FA_READ);
+    if (result != FR_OK)
     {
         g_hw.PrintLine("f_open result KO. result=%d", result);
+        return false;
+    }
+    pReader->open = true;
+    f_lseek(&pReader->file, data_offset);
+
+    return true;
+}
+
+/* Read the next chunk of the data of a file open by open_wav_reader: at most max_nb_bytes bytes 
+   of data copied as it is, or one chunk of g_wav_read_buffer of converted data. The file is 
+   closed after its last chunk (the end of the resampling is flushed).
+   Return true while data is left to read. */
+bool read_wav_reader_chunk(TWavReader *pReader, size_t max_nb_bytes)
+{
+    const TBankIndexEntry *pFormat = pReader->pFormat;
+    uint8_t nb_channels = pReader->nb_channels;
+    int16_t *pDest = &pReader->ram_address[pReader->nb_frames * nb_channels];
+    size_t nb_frames_left = pReader->max_nb_frames - pReader->nb_frames;
+    size_t nb_bytes_to_read = pReader->nb_bytes_left;
+    size_t file_frame_size;
+    size_t nb_frames_read;
+    size_t bytesRead = 0;
+    FRESULT result = FR_OK;
+
+    if (pReader->open == false)
+    {
+        return false;
+    }
+
+    if (pReader->converted == false)
+    {
+        if (nb_bytes_to_read > max_nb_bytes)
+        {
+            nb_bytes_to_read = max_nb_bytes;
+        }
+        if (nb_bytes_to_read > 0)
+        {
+            result = f_read(&pReader->file, pDest, nb_bytes_to_read, &bytesRead);
+        }
+        pReader->nb_frames += bytesRead / (2 * nb_channels); // bytes to frames
+    }
+    else if (nb_bytes_to_read > 0)
+    {
+        file_frame_size = get_wav_frame_size(pFormat);
+        if (nb_bytes_to_read > (sizeof(g_wav_read_buffer) / file_frame_size) * file_frame_size)
+        {
+            nb_bytes_to_read = (sizeof(g_wav_read_buffer) / file_frame_size) * file_frame_size;
+        }
+
+        result = f_read(&pReader->file, g_wav_read_buffer, nb_bytes_to_read, &bytesRead);
+        nb_frames_read = bytesRead / file_frame_size;
+
+        if (is_wav_file_16_bits(pFormat) == false)
+        {
+            convert_samples_to_16_bits(g_wav_read_buffer, nb_frames_read * pFormat->nb_channels, pFormat);
+        }
+
+        if (nb_channels != pFormat->nb_channels)
+        {
+            mix_down_to_mono(g_wav_read_buffer, nb_frames_read);
+        }
+
+        if (pFormat->sample_rate != SAMPLE_RATE_HZ)
+        {
+            pReader->nb_frames += resample(g_wav_read_buffer, nb_frames_read, pDest, nb_frames_left);
+        }
+        else
+        {
+            if (nb_frames_read > nb_frames_left)
+            {
+                nb_frames_read = nb_frames_left;
+            }
+            memcpy(pDest, g_wav_read_buffer, nb_frames_read * 2 * nb_channels);
+            pReader->nb_frames += nb_frames_read;
+        }
+    }
+    pReader->nb_bytes_left -= nb_bytes_to_read;
+
+    if (result != FR_OK)
+    {
+        g_hw.PrintLine("f_read result KO. result=%d", result);
+        pReader->nb_bytes_left = 0;
+    }
+    if (pReader->nb_bytes_left > 0)
+    {
+        return true;
+    }
+
+    // End of the data.
+    if (pReader->converted == true)
+    {
+        if (pFormat->sample_rate != SAMPLE_RATE_HZ)
+        {
+            pReader->nb_frames += flush_resampler(&pReader->ram_address[pReader->nb_frames * nb_channels], 
+                                                  pReader->max_nb_frames - pReader->nb_frames);
+        }
+        if (pReader->nb_frames >= pReader->max_nb_frames)
+        {
+            g_hw.PrintLine("Error: not enough RAM. Sound truncated");
+        }
+    }
+    close_wav_reader(pReader);
+
+    return false;
+}
+
+/* Close the file of a reader (see open_wav_reader), if it is open: the data left is not read. */
+void close_wav_reader(TWavReader *pReader)
+{
+    if (pReader->open == true)
+    {
+        f_close(&pReader->file);
+        pReader->open = false;
+    }
+}
+
+/* Read the wav data of a wav file (format pEntry). Copy the data at RAM address ram_address.
+   The stereo data is copied interleaved (left, right), or mixed down to mono when 
+   ENABLE_STEREO_SAMPLES is 0. The number of channels copied is returned in p_nb_channels.
+   If the samples are not 16 bits integers (see convert_samples_to_16_bits), if the sample rate 
+   of the wav file is not SAMPLE_RATE_HZ or if the data is mixed down, the data is converted 
+   while it is read, chunk by chunk (g_wav_read_buffer): the file is read once, without a copy of
+   the whole file. At most max_nb_samples samples are copied.
+   Return the number of samples copied (all channels). */
+size_t read_wav_file(char *file_name, const TBankIndexEntry *pEntry, int16_t* ram_address, 
+                     size_t max_nb_samples, uint8_t* p_nb_channels)
+{
+    static TWavReader reader;
+
+    if (open_wav_reader(&reader, file_name, pEntry->data_offset, pEntry->data_size, pEntry, 
+                        ram_address, max_nb_samples) == true)
+    {
+        while (read_wav_reader_chunk(&reader, pEntry->data_size) == true)
+        {
+        }
     }
+    close_wav_reader(&reader);
+
+    *p_nb_channels = reader.nb_channels;
 
-    return(wav_data_size);
+    return reader.nb_frames * reader.nb_channels;
 }
 
 /* The Arduino manages 7 keys per satellite board but only 6 piano keys are systematically connected. 
    For 2 boards the 7th key is connected:
    - Board 0:  Arduino key 6 is mapped to piano key 0 which is the leftmost key.
    - Board 6:  Arduino key 48 is mapped to piano key 85 which is the pedal.
+   The 7th key of 2 other boards can be connected to the other pedals:
+   - Board 1:  Arduino key 13 is mapped to piano key 86 which is the sostenuto pedal.
+   - Board 13: Arduino key 97 is mapped to piano key 87 which is the una corda pedal.
    This function does the mapping between Arduino keys and Piano keys.
    Board:         0                     1                       12                    13
    Arduino keys:  0  1  2  3  4  5  6   7  8  9 10 11 12 13 ... 84 85 86 87 88 89 90  91 92 93 94 95 96 97 
    Piano keys:    1  2  3  4  5  6  0   7  8  9 10 11 12 NC ... 73 74 75 76 77 78 NC  79 80 81 82 83 84 NC
-   NC stands for Not Connected. 
+   NC stands for Not Connected (13 and 97: optional pedals). 
    */
 uint16_t arduino_to_piano_key_index(uint16_t key_index_arduino)
 {
@@ -878,6 +2280,14 @@ uint16_t arduino_to_piano_key_index(uint16_t key_index_arduino)
     {
         key_index_piano = PEDAL_KEY_IDX;
     } 
+    else if (key_index_arduino == 13)
+    {
+        key_index_piano = SOSTENUTO_KEY_IDX;
+    } 
+    else if (key_index_arduino == 97)
+    {
+        key_index_piano = UNA_CORDA_KEY_IDX;
+    } 
     else 
     {
         key_index_piano = key_index_arduino + 1 - (key_index_arduino / 7);
@@ -920,30 +2330,27 @@ float compute_volume(uint32_t attack_time)
     return amp_factor; 
 }
 
-/* Display data of a note. Useful for debugging.
+/* Display data of a sound. Useful for debugging.
    Positions are displayed relatively to the first position.*/
 void display_sound_data(uint16_t idx) 
 {
     size_t first_pos = g_sounds[idx].first_sample_pos;
 
     g_hw.Print("idx=%d ", idx);
-    g_hw.Print("playing=%d ", g_sounds[idx].playing);
-    g_hw.Print("key_up=%d ", g_sounds[idx].key_up);
-    // g_hw.Print("first_pos=%d ", g_sounds[idx].first_sample_pos);
-    g_hw.Print("last_pos=%d ", g_sounds[idx].last_sample_pos - first_pos);
-    g_hw.Print("cur_pos=%d ", g_sounds[idx].cur_playing_pos - first_pos);
-    g_hw.Print("kup_pos=%d ", g_sounds[idx].key_up_pos - first_pos);
-    g_hw.PrintLine("pup_pos=%d", g_sounds[idx].pedal_up_pos - first_pos);
+    g_hw.Print("first_pos=%d ", first_pos);
+    g_hw.PrintLine("last_pos=%d", g_sounds[idx].last_sample_pos - first_pos);
 }
 
-/* Display data of all sounds. Useful for debugging.
-   Positions are displayed relatively to the first position.*/
+/* Display data of all sounds (all the velocity layers) and of the voices playing. Useful for 
+   debugging. Positions are displayed relatively to the first position.*/
 void display_all_sounds_data(void)
 {
-    for( uint16_t idx=0; idx<NB_SOUNDS; idx++)
+    for( uint16_t idx=0; idx<NB_SPECIAL_SOUNDS + g_nb_velocity_layers * NB_KEYS; idx++)
     {
         display_sound_data(idx);
     }
+
+    display_active_voices_data();
 }
 
 /* Update the file defining the current program index. */
@@ -1030,6 +2437,9 @@ int main(void)
 
     // Initialise global variables
     initialize_global_variables();
+    init_envelope_tables();
+    init_master_bus();
+    stop_all_sounds();
 
     // Initialise hardware
     g_hw.Init();
@@ -1045,13 +2455,18 @@ int main(void)
     toggle_right_led();
     mount_sd_card();
 
+    // Read the config file
+    g_hw.PrintLine("Reading config file...");
+    read_config_file();
+    set_key_pan_width(g_config.key_pan_width);
+
     // Read current prog
     g_hw.PrintLine("Read current prog...");
     cur_prog_idx = read_current_program();
     g_hw.PrintLine("cur_prog_idx=%d", cur_prog_idx);
     
     // Compute sound bank and demo mode
-    sound_bank_idx = cur_prog_idx % (NB_PROGRAMS / 2);
+    sound_bank_idx = cur_prog_idx % NB_SOUND_BANKS;
     demo_mode = (cur_prog_idx >= (NB_PROGRAMS / 2));
 
     // Read special wav files and load them in RAM.
@@ -1059,15 +2474,15 @@ int main(void)
     toggle_right_led();
     load_special_sounds_wav_files_in_ram();
 
-    // Build a sorted list of wav file name (one per note).
-    g_hw.PrintLine("Building the list of wav files...");
-    toggle_right_led();
-    build_notes_wav_notes_file_name_list(sound_bank_idx);
-
-    // Read notes wav files and load them in RAM.
-    g_hw.PrintLine("Loading notes wav files in RAM...");
-    toggle_right_led();
-    load_notes_wav_files_in_ram(sound_bank_idx);
+    // Read notes wav files of all the velocity layers and load them in RAM (the index and the 
+    // notes are loaded while the keys are played with ENABLE_PROGRESSIVE_LOAD).
+    g_hw.PrintLine("Loading the sound bank in RAM...");
+    #if (ENABLE_PROGRESSIVE_LOAD == 1)
+        start_progressive_load(sound_bank_idx, g_sound_bank_slot, g_first_note_position, MAX_WAV_DATA_SIZE_WORD, 
+                               false, false);
+    #else
+        load_sound_bank(sound_bank_idx, g_sound_bank_slot, g_first_note_position, MAX_WAV_DATA_SIZE_WORD, false);
+    #endif
 
     // Initialize UART
     g_hw.PrintLine("Initializing UART...");
@@ -1075,16 +2490,28 @@ int main(void)
     initialize_uart(&uart);
     flush_uart(&uart);
 
+    #if (ENABLE_AUDIO_BENCHMARK == 1)
+        finish_progressive_load();
+        g_hw.PrintLine("Running audio callback benchmark...");
+        run_audio_callback_benchmark(AudioCallback);
+    #endif
+
+    if (g_config.block_size_sweep == true)
+    {
+        finish_progressive_load();
+        g_hw.PrintLine("Running block size sweep...");
+        run_block_size_sweep();
+    }
+
 	// Prepare and start the audio call back
     g_hw.PrintLine("Preparing and starting audio call back...");
     toggle_right_led();
-    g_hw.SetAudioBlockSize(4); // number of samples handled per callback
-	g_hw.SetAudioSampleRate(SaiHandle::Config::SampleRate::SAI_48KHZ);
-	g_hw.StartAudio(AudioCallback);
+    start_audio(g_config.audio_block_size);
 
-    // Demo mode-> Play some notes of a midi file 
+    // Demo mode-> Play some notes of a midi file (with all the notes loaded)
     if (demo_mode == true)
     {
+        finish_progressive_load();
         g_hw.PrintLine("Play midi file...");
         play_one_midi_file(0, 1, 26);
     }
@@ -0,0 +1,225 @@
+/*
+ * This module processes the sum of all the voices before it is sent to the audio output.
+ *
+ * The voices are summed at unity gain. The sum is multiplied by the headroom gain and goes 
+ * through a look-ahead peak limiter. 
+ *
+ * The headroom gain adapts to the number of voices playing: 1 / sqrt(nb_voices) (the voices are 
+ * not correlated, their powers add up), so a note played alone is played at unity gain and a 
+ * chord keeps about the level of one note. The gain follows the number of voices with a time 
+ * constant of HEADROOM_ATTACK_MS when voices start (the limiter catches the peaks meanwhile) and 
+ * of HEADROOM_RELEASE_MS when voices end (no pumping when the notes of a chord end).
+ *
+ * The limiter delays the signal by LIMITER_LOOKAHEAD_MS and when a sample 
+ * above LIMITER_THRESHOLD enters the delay line, the gain ramps down to the required value 
+ * before the sample leaves the delay line. The gain then goes back to 1.0 with a time constant
+ * of LIMITER_RELEASE_MS. A soft clipper after the limiter catches the remaining overshoots.
+ *
+ * The bus is stereo: the same limiter gain is applied to both channels (linked limiter, the 
+ * stereo image does not move), computed from the highest of the two channels.
+ *
+ * The limiter activity is counted in g_limiter_activity and can be logged from the main loop.
+ */
+
+/*************************************************************************************************
+* Includes
+*************************************************************************************************/
+#include "daisy_seed.h"
+#include "common.h"
+#include "master_bus.h"
+#include <math.h>
+
+/*************************************************************************************************
+* Variables
+*************************************************************************************************/
+// Activity of the limiter (see master_bus.h).
+volatile TLimiterActivity g_limiter_activity;
+
+// Delay lines of the look-ahead (left and right).
+static float   g_lookahead_buffer_left[LIMITER_LOOKAHEAD_NB_SAMPLES];
+static float   g_lookahead_buffer_right[LIMITER_LOOKAHEAD_NB_SAMPLES];
+static size_t  g_lookahead_idx;
+
+// Gain of the limiter and ramp to reach the target gain.
+static float   g_limiter_gain;
+static float   g_limiter_target_gain;
+static float   g_limiter_gain_step;
+static size_t  g_limiter_nb_ramp_frames;
+
+// Gain recovery coefficient per sample (one pole filter).
+static float   g_limiter_release_coef;
+
+// Headroom gain and its coefficients per sample (one pole filter) when it decreases or increases.
+static float   g_headroom_gain;
+static float   g_headroom_attack_coef;
+static float   g_headroom_release_coef;
+
+// Activity counters updated by the audio callback and copied to g_limiter_activity per block.
+static TLimiterActivity g_activity;
+
+// Activity displayed by the last call of display_limiter_activity.
+static TLimiterActivity g_displayed_activity;
+
+/*************************************************************************************************
+* Functions implementation
+*************************************************************************************************/
+/* Initialise the limiter. */
+void init_master_bus(void)
+{
+    memset(g_lookahead_buffer_left, 0, sizeof(g_lookahead_buffer_left));
+    memset(g_lookahead_buffer_right, 0, sizeof(g_lookahead_buffer_right));
+    g_lookahead_idx          = 0;
+    g_limiter_gain           = 1.0f;
+    g_limiter_target_gain    = 1.0f;
+    g_limiter_gain_step      = 0.0f;
+    g_limiter_nb_ramp_frames = 0;
+    g_limiter_release_coef   = 1.0f - expf(-1000.0f / (float)(LIMITER_RELEASE_MS * SAMPLE_RATE_HZ));
+    g_headroom_gain          = 1.0f;
+    g_headroom_attack_coef   = 1.0f - expf(-1000.0f / (float)(HEADROOM_ATTACK_MS * SAMPLE_RATE_HZ));
+    g_headroom_release_coef  = 1.0f - expf(-1000.0f / (float)(HEADROOM_RELEASE_MS * SAMPLE_RATE_HZ));
+
+    g_activity.nb_limited_frames = 0;
+    g_activity.nb_clipped_frames = 0;
+    g_activity.min_gain          = 1.0f;
+    g_activity.min_headroom_gain = 1.0f;
+    g_limiter_activity.nb_limited_frames = 0;
+    g_limiter_activity.nb_clipped_frames = 0;
+    g_limiter_activity.min_gain          = 1.0f;
+    g_limiter_activity.min_headroom_gain = 1.0f;
+    g_displayed_activity = g_activity;
+}
+
+/* Soft clipper: linear up to SOFT_CLIP_THRESHOLD, then a smooth curve reaching 1.0. */
+static float soft_clip(float x)
+{
+    const float knee = 1.0f - SOFT_CLIP_THRESHOLD;
+    float abs_x = fabsf(x);
+    float over;
+
+    if (abs_x <= SOFT_CLIP_THRESHOLD)
+    {
+        return x;
+    }
+
+    over = (abs_x - SOFT_CLIP_THRESHOLD) / knee;
+    abs_x = SOFT_CLIP_THRESHOLD + knee * (over / (1.0f + over));
+
+    return (x < 0.0f) ? -abs_x : abs_x;
+}
+
+/* Apply the headroom gain (nb_voices voices playing), the limiter and the soft clipper to 
+   nb_frames frames of the left and right signals (in place). */
+void process_master_bus(float *left, float *right, size_t nb_frames, size_t nb_voices)
+{
+    const float headroom_target = (nb_voices > 1) ? 1.0f / sqrtf((float)nb_voices) : 1.0f;
+    const float headroom_coef = (headroom_target < g_headroom_gain) ? g_headroom_attack_coef : g_headroom_release_coef;
+    float in_left;
+    float in_right;
+    float out_left;
+    float out_right;
+    float abs_sig;
+    float required_gain;
+    float gain_step;
+
+    for (size_t frame_idx = 0; frame_idx < nb_frames; frame_idx++)
+    {
+        g_headroom_gain += (headroom_target - g_headroom_gain) * headroom_coef;
+        in_left  = left[frame_idx] * g_headroom_gain;
+        in_right = right[frame_idx] * g_headroom_gain;
+        abs_sig  = fmaxf(fabsf(in_left), fabsf(in_right));
+
+        // A new peak enters the delay line: the gain must reach the required gain when this 
+        // peak leaves the delay line.
+        if (abs_sig > LIMITER_THRESHOLD)
+        {
+            required_gain = LIMITER_THRESHOLD / abs_sig;
+            if (required_gain < g_limiter_target_gain)
+            {
+                // The ramp never gets slower, so that the previous peaks are also reached.
+                gain_step = (required_gain - g_limiter_gain) / (float)LIMITER_LOOKAHEAD_NB_SAMPLES;
+                if ((g_limiter_nb_ramp_frames == 0) || (gain_step < g_limiter_gain_step))
+                {
+                    g_limiter_gain_step = gain_step;
+                }
+                g_limiter_target_gain    = required_gain;
+                g_limiter_nb_ramp_frames = LIMITER_LOOKAHEAD_NB_SAMPLES;
+            }
+        }
+
+        if (g_limiter_nb_ramp_frames > 0)
+        {
+            // Gain reduction ramp (down to the target gain).
+            g_limiter_gain += g_limiter_gain_step;
+            if (g_limiter_gain < g_limiter_target_gain)
+            {
+                g_limiter_gain = g_limiter_target_gain;
+            }
+            g_limiter_nb_ramp_frames--;
+        }
+
+        if (g_limiter_gain < 0.999f)
+        {
+            g_activity.nb_limited_frames++;
+            if (g_limiter_gain < g_activity.min_gain)
+            {
+                g_activity.min_gain = g_limiter_gain;
+            }
+        }
+
+        // Delay line
+        out_left  = g_lookahead_buffer_left[g_lookahead_idx] * g_limiter_gain;
+        out_right = g_lookahead_buffer_right[g_lookahead_idx] * g_limiter_gain;
+        if ((fabsf(out_left) > SOFT_CLIP_THRESHOLD) || (fabsf(out_right) > SOFT_CLIP_THRESHOLD))
+        {
+            g_activity.nb_clipped_frames++;
+        }
+        left[frame_idx]  = soft_clip(out_left);
+        right[frame_idx] = soft_clip(out_right);
+        g_lookahead_buffer_left[g_lookahead_idx]  = in_left;
+        g_lookahead_buffer_right[g_lookahead_idx] = in_right;
+        g_lookahead_idx++;
+        if (g_lookahead_idx >= LIMITER_LOOKAHEAD_NB_SAMPLES)
+        {
+            g_lookahead_idx = 0;
+        }
+
+        // Gain recovery (after the output so that the last peak gets the target gain).
+        if ((g_limiter_nb_ramp_frames == 0) && (g_limiter_gain < 1.0f))
+        {
+            g_limiter_gain += (1.0f - g_limiter_gain) * g_limiter_release_coef;
+            g_limiter_target_gain = g_limiter_gain;
+        }
+    }
+
+    if (g_headroom_gain < g_activity.min_headroom_gain)
+    {
+        g_activity.min_headroom_gain = g_headroom_gain;
+    }
+
+    g_limiter_activity.nb_limited_frames = g_activity.nb_limited_frames;
+    g_limiter_activity.nb_clipped_frames = g_activity.nb_clipped_frames;
+    g_limiter_activity.min_gain          = g_activity.min_gain;
+    g_limiter_activity.min_headroom_gain = g_activity.min_headroom_gain;
+}
+
+/* Display the limiter activity if it has changed since the last display. */
+void display_limiter_activity(void)
+{
+    TLimiterActivity activity;
+
+    activity.nb_limited_frames = g_limiter_activity.nb_limited_frames;
+    activity.nb_clipped_frames = g_limiter_activity.nb_clipped_frames;
+    activity.min_gain          = g_limiter_activity.min_gain;
+    activity.min_headroom_gain = g_limiter_activity.min_headroom_gain;
+
+    if (   (activity.nb_limited_frames != g_displayed_activity.nb_limited_frames)
+        || (activity.nb_clipped_frames != g_displayed_activity.nb_clipped_frames))
+    {
+        g_hw.Print("LIMITER limited_frames=%ld clipped_frames=%ld", 
+                   activity.nb_limited_frames, activity.nb_clipped_frames);
+        g_hw.Print(" min_gain="FLT_FMT3, FLT_VAR3(activity.min_gain));
+        g_hw.PrintLine(" min_headroom_gain="FLT_FMT3, FLT_VAR3(activity.min_headroom_gain));
+
+        g_displayed_activity = activity;
+    }
+}
@@ -0,0 +1,47 @@
+/* 
+ *  Header file of master_bus.cpp. See this file for more details
+ */ 
+#ifndef MASTER_BUS
+#define MASTER_BUS
+
+/*************************************************************************************************
+* Includes
+*************************************************************************************************/
+#include "daisy_seed.h"
+
+/*************************************************************************************************
+* Defines
+*************************************************************************************************/
+#define HEADROOM_ATTACK_MS          5       // Time constant of the headroom gain decrease (voices started).
+#define HEADROOM_RELEASE_MS         500     // Time constant of the headroom gain recovery (voices ended).
+#define LIMITER_THRESHOLD           0.9f    // Maximum output amplitude of the limiter (-1 dBFS).
+#define SOFT_CLIP_THRESHOLD         0.95f   // Amplitude above which the soft clipper is active.
+#define LIMITER_LOOKAHEAD_MS        1       // Look-ahead of the limiter in milliseconds.
+#define LIMITER_RELEASE_MS          100     // Time constant of the gain recovery in milliseconds.
+#define LIMITER_LOOKAHEAD_NB_SAMPLES ((SAMPLE_RATE_HZ * LIMITER_LOOKAHEAD_MS) / 1000)
+
+/*************************************************************************************************
+* Types
+*************************************************************************************************/
+// Activity of the limiter since the startup.
+typedef struct
+{
+    uint32_t nb_limited_frames;  // Number of frames with a gain reduction.
+    uint32_t nb_clipped_frames;  // Number of frames soft clipped (peak not caught by the limiter).
+    float    min_gain;           // Lowest gain applied by the limiter.
+    float    min_headroom_gain;  // Lowest headroom gain (most voices playing).
+} TLimiterActivity;
+
+/*************************************************************************************************
+* Variables 
+*************************************************************************************************/
+extern volatile TLimiterActivity g_limiter_activity;
+
+/*************************************************************************************************
+* Functions 
+*************************************************************************************************/
+extern void init_master_bus(void);
+extern void process_master_bus(float *left, float *right, size_t nb_frames, size_t nb_voices);
+extern void display_limiter_activity(void);
+
+#endif //#ifndef MASTER_BUS
@@ -0,0 +1,243 @@
+/* 
+ * Fixed-point mixing kernel: adds a sound (int16 samples) multiplied by a linear gain ramp to 
+ * an int32 accumulator buffer.
+ *
+ * Formats:
+ * - Samples are Q15 (int16).
+ * - Gains are Q26 in an int32 (MIX_GAIN_UNITY = 1.0).
+ * - The accumulator receives (sample * gain) >> 16, so a full scale sound at unity gain is 
+ *   2^25 (MIX_ACC_FULL_SCALE). The 6 remaining bits are guard bits: 64 sounds at full scale 
+ *   can be summed without overflow.
+ *
+ * On the Cortex-M7 the kernel reads two samples per 32-bit load and uses the DSP instructions 
+ * SMLAWB/SMLAWT (32x16 multiply-accumulate on the bottom/top halfword). The portable scalar 
+ * version gives exactly the same results and builds on any host (no Daisy dependency). On the 
+ * host, the DSP kernels are built with the portable equivalents of SMLAWB/SMLAWT: both versions
+ * are checked by the host unit test tests/test_mixing_kernel.cpp.
+ *
+ * The interpolating kernel plays a sound at another pitch: the read position is a Q16 phase 
+ * (MIX_PHASE_UNITY = 1 sample) incremented by a phase step per frame, and the sample at the read 
+ * position is linearly interpolated between its two neighbours.
+ *
+ * The stereo kernels mix interleaved samples (left, right) in two accumulator buffers (left and 
+ * right): one 32-bit load reads the two samples of a frame.
+ */ 
+#ifndef MIXING_KERNEL
+#define MIXING_KERNEL
+
+/*************************************************************************************************
+* Includes
+*************************************************************************************************/
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+/*************************************************************************************************
+* Defines
+*************************************************************************************************/
+#define MIX_GAIN_SHIFT          26
+#define MIX_GAIN_UNITY          (1L << MIX_GAIN_SHIFT)
+#define MIX_ACC_SHIFT           (MIX_GAIN_SHIFT + 15 - 16)
+#define MIX_ACC_FULL_SCALE      (1L << MIX_ACC_SHIFT)
+#define MIX_PHASE_SHIFT         16
+#define MIX_PHASE_UNITY         (1UL << MIX_PHASE_SHIFT)
+#define MIX_PHASE_FRAC_MASK     (MIX_PHASE_UNITY - 1)
+
+/*************************************************************************************************
+* Functions
+*************************************************************************************************/
+/* Convert a float gain (1.0 = unity) to Q26. */
+static inline int32_t mix_gain_to_q(float gain)
+{
+    return (int32_t)(gain * (float)MIX_GAIN_UNITY);
+}
+
+/* Convert an accumulator value to a float sample (1.0 = full scale). */
+static inline float mix_acc_to_float(int32_t acc)
+{
+    return (float)acc * (1.0f / (float)MIX_ACC_FULL_SCALE);
+}
+
+/* Portable equivalent of SMLAWB: acc + ((gain * bottom halfword of samples) >> 16). */
+static inline int32_t mix_smlawb_ref(int32_t gain, uint32_t samples, int32_t acc)
+{
+    return acc + (int32_t)(((int64_t)gain * (int16_t)(samples & 0xFFFF)) >> 16);
+}
+
+/* Portable equivalent of SMLAWT: acc + ((gain * top halfword of samples) >> 16). */
+static inline int32_t mix_smlawt_ref(int32_t gain, uint32_t samples, int32_t acc)
+{
+    return acc + (int32_t)(((int64_t)gain * (int16_t)(samples >> 16)) >> 16);
+}
+
+/* Scalar reference kernel: acc[i] += (samples[i] * gain_i) >> 16 with gain_i = gain + i * gain_step. */
+static inline void mix_samples_q_ref(int32_t *acc, const int16_t *samples, size_t nb_frames, 
+                                     int32_t gain, int32_t gain_step)
+{
+    for (size_t frame_idx = 0; frame_idx < nb_frames; frame_idx++)
+    {
+        acc[frame_idx] = mix_smlawb_ref(gain, (uint16_t)samples[frame_idx], acc[frame_idx]);
+        gain += gain_step;
+    }
+}
+
+/* Scalar reference stereo kernel: acc_left[i] += (left_i * gain_i) >> 16 and 
+   acc_right[i] += (right_i * gain_i) >> 16, the samples are interleaved (left, right). */
+static inline void mix_samples_q_stereo_ref(int32_t *acc_left, int32_t *acc_right, const int16_t *samples, 
+                                            size_t nb_frames, int32_t gain, int32_t gain_step)
+{
+    for (size_t frame_idx = 0; frame_idx < nb_frames; frame_idx++)
+    {
+        acc_left[frame_idx]  = mix_smlawb_ref(gain, (uint16_t)samples[2 * frame_idx], acc_left[frame_idx]);
+        acc_right[frame_idx] = mix_smlawb_ref(gain, (uint16_t)samples[2 * frame_idx + 1], acc_right[frame_idx]);
+        gain += gain_step;
+    }
+}
+
+#if defined(__ARM_FEATURE_DSP)
+
+static inline int32_t mix_smlawb(int32_t gain, uint32_t samples, int32_t acc)
+{
+    int32_t result;
+    __asm__ ("smlawb %0, %1, %2, %3" : "=r" (result) : "r" (gain), "r" (samples), "r" (acc));
+    return result;
+}
+
+static inline int32_t mix_smlawt(int32_t gain, uint32_t samples, int32_t acc)
+{
+    int32_t result;
+    __asm__ ("smlawt %0, %1, %2, %3" : "=r" (result) : "r" (gain), "r" (samples), "r" (acc));
+    return result;
+}
+
+#else
+
+/* Host build: the portable equivalents replace the DSP instructions, so that the DSP kernels 
+   (loads of two samples, last odd frame, order of the gain steps) are checked on the host. */
+static inline int32_t mix_smlawb(int32_t gain, uint32_t samples, int32_t acc)
+{
+    return mix_smlawb_ref(gain, samples, acc);
+}
+
+static inline int32_t mix_smlawt(int32_t gain, uint32_t samples, int32_t acc)
+{
+    return mix_smlawt_ref(gain, samples, acc);
+}
+
+#endif //#if defined(__ARM_FEATURE_DSP)
+
+/* DSP kernel: same result as mix_samples_q_ref. Two samples are read per 32-bit load (the 
+   Cortex-M7 supports unaligned word loads, the samples of a sound can start at any position). */
+static inline void mix_samples_q_dsp(int32_t *acc, const int16_t *samples, size_t nb_frames, 
+                                     int32_t gain, int32_t gain_step)
+{
+    uint32_t two_samples;
+    size_t frame_idx = 0;
+
+    for (; frame_idx + 1 < nb_frames; frame_idx += 2)
+    {
+        memcpy(&two_samples, &samples[frame_idx], sizeof(two_samples));
+        acc[frame_idx]     = mix_smlawb(gain, two_samples, acc[frame_idx]);
+        gain += gain_step;
+        acc[frame_idx + 1] = mix_smlawt(gain, two_samples, acc[frame_idx + 1]);
+        gain += gain_step;
+    }
+
+    if (frame_idx < nb_frames)
+    {
+        acc[frame_idx] = mix_smlawb(gain, (uint16_t)samples[frame_idx], acc[frame_idx]);
+    }
+}
+
+/* DSP stereo kernel: same result as mix_samples_q_stereo_ref. The two samples of a frame are 
+   read with one 32-bit load. */
+static inline void mix_samples_q_stereo_dsp(int32_t *acc_left, int32_t *acc_right, const int16_t *samples, 
+                                            size_t nb_frames, int32_t gain, int32_t gain_step)
+{
+    uint32_t two_samples;
+
+    for (size_t frame_idx = 0; frame_idx < nb_frames; frame_idx++)
+    {
+        memcpy(&two_samples, &samples[2 * frame_idx], sizeof(two_samples));
+        acc_left[frame_idx]  = mix_smlawb(gain, two_samples, acc_left[frame_idx]);
+        acc_right[frame_idx] = mix_smlawt(gain, two_samples, acc_right[frame_idx]);
+        gain += gain_step;
+    }
+}
+
+/* Interpolating kernel: acc[i] += (sample(phase_i) * gain_i) >> 16 with 
+   phase_i = phase + i * phase_step (Q16, relative to samples) and gain_i = gain + i * gain_step.
+   sample(phase_i) is interpolated between samples[phase_i >> 16] and the next sample.
+   Return the phase after the last frame. */
+static inline uint32_t mix_samples_q_interp(int32_t *acc, const int16_t *samples, size_t nb_frames, 
+                                            int32_t gain, int32_t gain_step, 
+                                            uint32_t phase, uint32_t phase_step)
+{
+    const int16_t *pSample;
+    int32_t frac;
+    int32_t sample;
+
+    for (size_t frame_idx = 0; frame_idx < nb_frames; frame_idx++)
+    {
+        pSample = &samples[phase >> MIX_PHASE_SHIFT];
+        frac    = (int32_t)((phase & MIX_PHASE_FRAC_MASK) >> 1); // Q15: the product fits in 32 bits.
+        sample  = pSample[0] + (((pSample[1] - pSample[0]) * frac) >> 15);
+
+        acc[frame_idx] = mix_smlawb(gain, (uint16_t)sample, acc[frame_idx]);
+        gain  += gain_step;
+        phase += phase_step;
+    }
+
+    return phase;
+}
+
+/* Interpolating stereo kernel: same as mix_samples_q_interp for interleaved samples (left, right)
+   mixed in two accumulator buffers. The phase is in frames. Return the phase after the last frame. */
+static inline uint32_t mix_samples_q_interp_stereo(int32_t *acc_left, int32_t *acc_right, const int16_t *samples, 
+                                                   size_t nb_frames, int32_t gain, int32_t gain_step, 
+                                                   uint32_t phase, uint32_t phase_step)
+{
+    const int16_t *pSample;
+    int32_t frac;
+    int32_t left;
+    int32_t right;
+
+    for (size_t frame_idx = 0; frame_idx < nb_frames; frame_idx++)
+    {
+        pSample = &samples[2 * (phase >> MIX_PHASE_SHIFT)];
+        frac    = (int32_t)((phase & MIX_PHASE_FRAC_MASK) >> 1);
+        left    = pSample[0] + (((pSample[2] - pSample[0]) * frac) >> 15);
+        right   = pSample[1] + (((pSample[3] - pSample[1]) * frac) >> 15);
+
+        acc_left[frame_idx]  = mix_smlawb(gain, (uint16_t)left, acc_left[frame_idx]);
+        acc_right[frame_idx] = mix_smlawb(gain, (uint16_t)right, acc_right[frame_idx]);
+        gain  += gain_step;
+        phase += phase_step;
+    }
+
+    return phase;
+}
+
+/* Kernel used by the audio engine: DSP version when available, scalar version otherwise. */
+static inline void mix_samples_q(int32_t *acc, const int16_t *samples, size_t nb_frames, 
+                                 int32_t gain, int32_t gain_step)
+{
+#if defined(__ARM_FEATURE_DSP)
+    mix_samples_q_dsp(acc, samples, nb_frames, gain, gain_step);
+#else
+    mix_samples_q_ref(acc, samples, nb_frames, gain, gain_step);
+#endif
+}
+
+/* Stereo kernel used by the audio engine: DSP version when available, scalar version otherwise. */
+static inline void mix_samples_q_stereo(int32_t *acc_left, int32_t *acc_right, const int16_t *samples, 
+                                        size_t nb_frames, int32_t gain, int32_t gain_step)
+{
+#if defined(__ARM_FEATURE_DSP)
+    mix_samples_q_stereo_dsp(acc_left, acc_right, samples, nb_frames, gain, gain_step);
+#else
+    mix_samples_q_stereo_ref(acc_left, acc_right, samples, nb_frames, gain, gain_step);
+#endif
+}
+
+#endif //#ifndef MIXING_KERNEL
@@ -7,6 +7,8 @@
 *************************************************************************************************/
 #include "daisy_seed.h"
 #include "common.h"
+#include "audio_engine.h"
+#include "disk_streamer.h"
 #include "play_midi_files.h"
 
 using namespace daisy;
@@ -281,7 +283,7 @@ void play_midi_file_from_ram(uint16_t nb_tracks_to_play, uint32_t nb_notes_to_pl
             idx += len;
             
             time_ms = (tempo * value) / ((uint32_t)time_unit);
-            System::Delay(time_ms);
+            wait_and_service_streams(time_ms);
             g_hw.PrintLine("time_ms=%d", time_ms);
 
             if (g_midi_file_data[idx] == 0xFF)
@@ -408,11 +410,11 @@ void play_midi_file_from_ram(uint16_t nb_tracks_to_play, uint32_t nb_notes_to_pl
                     {
                         note_counter++;
                         // We consider that velocity = 80 corresponds to max amplification (= 1.0).
-                        start_playing_a_note(key_idx, velocity / 80.0);
+                        start_playing_a_note(key_idx, velocity / 80.0, get_sample_time());
                     }
                     else
                     {
-                        stop_playing_a_note(key_idx);
+                        stop_playing_a_note(key_idx, get_sample_time());
                     }
                 }
             
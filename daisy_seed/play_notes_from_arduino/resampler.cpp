@@ -0,0 +1,211 @@
+/*
+ * This module converts the sample rate of the wav files (e.g. 44100 Hz) to the sample rate of 
+ * the audio output (SAMPLE_RATE_HZ) when the samples are loaded in RAM.
+ *
+ * The resampler is a polyphase filter: the rate is multiplied by L and divided by M 
+ * (48000 / 44100 = 160 / 147). The low pass filter (windowed sinc, cutoff at RESAMPLER_CUTOFF of 
+ * the lowest Nyquist frequency) is split in L phases of RESAMPLER_NB_TAPS taps. Each output 
+ * sample is computed with one phase only: RESAMPLER_NB_TAPS multiplications per output sample.
+ *
+ * The resampler is streaming: the input samples can be given in chunks of any size (e.g. the 
+ * chunks read from the SD card), the state (last input samples and phase) is kept between the 
+ * chunks. The output is delayed by RESAMPLER_NB_TAPS / 2 input samples. flush_resampler 
+ * outputs the last samples at the end of a file.
+ *
+ * The stereo samples are interleaved (left, right): each channel has its own history, the 
+ * sizes are given in frames.
+ */
+
+/*************************************************************************************************
+* Includes
+*************************************************************************************************/
+#include "daisy_seed.h"
+#include "common.h"
+#include "resampler.h"
+#include <math.h>
+
+using namespace daisy;
+
+/*************************************************************************************************
+* Variables
+*************************************************************************************************/
+// Coefficients of the filter: RESAMPLER_NB_TAPS coefficients per phase.
+static float    g_filter_bank[RESAMPLER_MAX_NB_PHASES][RESAMPLER_NB_TAPS];
+
+// Last input samples of each channel (g_history[channel][0] is the last one).
+static float    g_history[RESAMPLER_MAX_NB_CHANNELS][RESAMPLER_NB_TAPS];
+
+// Number of channels of the samples (interleaved).
+static uint8_t  g_nb_channels;
+
+// Interpolation (L) and decimation (M) factors.
+static uint32_t g_interpolation_factor;
+static uint32_t g_decimation_factor;
+
+// Phase of the next output sample (0 to L - 1, L if a new input sample is needed).
+static uint32_t g_phase;
+
+/*************************************************************************************************
+* Functions implementation
+*************************************************************************************************/
+
+/* Greatest common divisor. */
+static uint32_t gcd(uint32_t a, uint32_t b)
+{
+    uint32_t tmp;
+
+    while (b != 0)
+    {
+        tmp = a % b;
+        a = b;
+        b = tmp;
+    }
+
+    return a;
+}
+
+/* Initialise the resampler to convert nb_channels interleaved channels from in_sample_rate to
+   out_sample_rate. Compute the coefficients of the filter and clear the state.
+   Return false if the conversion needs more than RESAMPLER_MAX_NB_PHASES phases or more than
+   RESAMPLER_MAX_NB_CHANNELS channels. */
+bool init_resampler(uint32_t in_sample_rate, uint32_t out_sample_rate, uint8_t nb_channels)
+{
+    const uint32_t nb_coefs_total = RESAMPLER_NB_TAPS * (out_sample_rate / gcd(in_sample_rate, out_sample_rate));
+    const float center = (float)(nb_coefs_total - 1) / 2.0f;
+    float cutoff;
+    float t;
+    float window;
+    float phase_sum;
+    uint32_t coef_idx;
+
+    g_interpolation_factor = out_sample_rate / gcd(in_sample_rate, out_sample_rate);
+    g_decimation_factor    = in_sample_rate / gcd(in_sample_rate, out_sample_rate);
+
+    if (g_interpolation_factor > RESAMPLER_MAX_NB_PHASES)
+    {
+        g_hw.PrintLine("Error: resampling %ld Hz -> %ld Hz not supported", in_sample_rate, out_sample_rate);
+        return false;
+    }
+    if ((nb_channels == 0) || (nb_channels > RESAMPLER_MAX_NB_CHANNELS))
+    {
+        g_hw.PrintLine("Error: resampling %d channels not supported", nb_channels);
+        return false;
+    }
+    g_nb_channels = nb_channels;
+
+    // Cutoff frequency in cycles per input sample.
+    cutoff = 0.5f * RESAMPLER_CUTOFF;
+    if (g_decimation_factor > g_interpolation_factor)
+    {
+        cutoff = cutoff * (float)g_interpolation_factor / (float)g_decimation_factor;
+    }
+
+    // Windowed sinc (Blackman window). The coefficient idx of the prototype filter is the
+    // coefficient tap_idx of the phase idx % L (tap_idx = idx / L).
+    for (uint32_t phase = 0; phase < g_interpolation_factor; phase++)
+    {
+        phase_sum = 0.0f;
+
+        for (uint32_t tap_idx = 0; tap_idx < RESAMPLER_NB_TAPS; tap_idx++)
+        {
+            coef_idx = phase + tap_idx * g_interpolation_factor;
+            t = ((float)coef_idx - center) / (float)g_interpolation_factor;
+            window =   0.42f 
+                     - 0.5f  * cosf(2.0f * (float)M_PI * (float)coef_idx / (float)(nb_coefs_total - 1))
+                     + 0.08f * cosf(4.0f * (float)M_PI * (float)coef_idx / (float)(nb_coefs_total - 1));
+
+            if (fabsf(t) < 1e-6f)
+            {
+                g_filter_bank[phase][tap_idx] = 2.0f * cutoff * window;
+            }
+            else
+            {
+                g_filter_bank[phase][tap_idx] = sinf(2.0f * (float)M_PI * cutoff * t) / ((float)M_PI * t) * window;
+            }
+            phase_sum += g_filter_bank[phase][tap_idx];
+        }
+
+        // Unity gain at DC for each phase.
+        for (uint32_t tap_idx = 0; tap_idx < RESAMPLER_NB_TAPS; tap_idx++)
+        {
+            g_filter_bank[phase][tap_idx] /= phase_sum;
+        }
+    }
+
+    memset(g_history, 0, sizeof(g_history));
+    g_phase = 0;
+
+    return true;
+}
+
+/* Convert a float sample to 16 bits with rounding and saturation. */
+static int16_t float_to_sample(float value)
+{
+    value = roundf(value);
+
+    if (value > 32767.0f)
+    {
+        return 32767;
+    }
+    if (value < -32768.0f)
+    {
+        return -32768;
+    }
+
+    return (int16_t)value;
+}
+
+/* Resample nb_in_frames input frames. Write at most max_nb_out_frames frames in out.
+   Return the number of frames written (the input frames not converted when out is full
+   are lost). */
+size_t resample(const int16_t *in, size_t nb_in_frames, int16_t *out, size_t max_nb_out_frames)
+{
+    size_t nb_out_frames = 0;
+    const float *coefs;
+    float acc;
+
+    for (size_t in_idx = 0; in_idx < nb_in_frames; in_idx++)
+    {
+        // New input frame.
+        for (uint8_t channel = 0; channel < g_nb_channels; channel++)
+        {
+            memmove(&g_history[channel][1], &g_history[channel][0], (RESAMPLER_NB_TAPS - 1) * sizeof(float));
+            g_history[channel][0] = (float)in[in_idx * g_nb_channels + channel];
+        }
+
+        // Output frames between this input frame and the next one.
+        while (g_phase < g_interpolation_factor)
+        {
+            if (nb_out_frames >= max_nb_out_frames)
+            {
+                return nb_out_frames;
+            }
+
+            coefs = g_filter_bank[g_phase];
+            for (uint8_t channel = 0; channel < g_nb_channels; channel++)
+            {
+                acc = 0.0f;
+                for (uint32_t tap_idx = 0; tap_idx < RESAMPLER_NB_TAPS; tap_idx++)
+                {
+                    acc += coefs[tap_idx] * g_history[channel][tap_idx];
+                }
+                out[nb_out_frames * g_nb_channels + channel] = float_to_sample(acc);
+            }
+            nb_out_frames++;
+
+            g_phase += g_decimation_factor;
+        }
+        g_phase -= g_interpolation_factor;
+    }
+
+    return nb_out_frames;
+}
+
+/* Output the last frames still in the filter (end of the input). 
+   Return the number of frames written in out. */
+size_t flush_resampler(int16_t *out, size_t max_nb_out_frames)
+{
+    static const int16_t k_zeros[RESAMPLER_MAX_NB_CHANNELS * RESAMPLER_NB_TAPS / 2] = {0};
+
+    return resample(k_zeros, RESAMPLER_NB_TAPS / 2, out, max_nb_out_frames);
+}
@@ -0,0 +1,27 @@
+/* 
+ *  Header file of resampler.cpp. See this file for more details
+ */ 
+#ifndef RESAMPLER
+#define RESAMPLER
+
+/*************************************************************************************************
+* Includes
+*************************************************************************************************/
+#include "daisy_seed.h"
+
+/*************************************************************************************************
+* Defines
+*************************************************************************************************/
+#define RESAMPLER_NB_TAPS           16      // Number of taps of each phase of the filter.
+#define RESAMPLER_MAX_NB_PHASES     320     // Maximum number of phases (e.g. 22050 Hz -> 48000 Hz).
+#define RESAMPLER_CUTOFF            0.9f    // Cutoff frequency relatively to the lowest Nyquist frequency.
+#define RESAMPLER_MAX_NB_CHANNELS   2       // Stereo samples are interleaved (left, right).
+
+/*************************************************************************************************
+* Functions 
+*************************************************************************************************/
+extern bool init_resampler(uint32_t in_sample_rate, uint32_t out_sample_rate, uint8_t nb_channels);
+extern size_t resample(const int16_t *in, size_t nb_in_frames, int16_t *out, size_t max_nb_out_frames);
+extern size_t flush_resampler(int16_t *out, size_t max_nb_out_frames);
+
+#endif //#ifndef RESAMPLER
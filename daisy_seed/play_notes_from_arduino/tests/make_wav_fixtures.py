@@ -0,0 +1,77 @@
+# Write the small wav files of the wav directory, read by the host unit test test_wav_format.cpp
+# (see wav_format.cpp). Each file has a few frames and a layout of chunks found in the wav files
+# of the sound banks (or a broken one). The files are committed: run the tool only to change them.
+#
+# Usage: python make_wav_fixtures.py (from this directory)
+import os
+import struct
+
+WAV_DIR = "wav"
+WAV_FORMAT_PCM = 1
+WAV_FORMAT_FLOAT = 3
+WAV_FORMAT_EXTENSIBLE = 0xFFFE
+NB_FRAMES = 10
+
+def chunk(chunk_id, data, size=None):
+    """Return a chunk (padded to an even size). size: size written in the header (size of data if None)."""
+
+    if size is None:
+        size = len(data)
+    #end if
+    return chunk_id + struct.pack("<I", size) + data + bytes(len(data) & 1)
+#end def
+
+def fmt_chunk(audio_format, nb_channels, bits_per_sample, sample_rate=44100):
+    """Return a fmt chunk of 16 bytes, or of 40 bytes for the extensible format."""
+
+    block_align = nb_channels * bits_per_sample // 8
+    data = struct.pack("<HHIIHH", audio_format, nb_channels, sample_rate, sample_rate * block_align, block_align,
+                       bits_per_sample)
+    if audio_format == WAV_FORMAT_EXTENSIBLE:
+        # Extension: valid bits, channel mask and GUID of the PCM format.
+        data += struct.pack("<HHIH14s", 22, bits_per_sample, 3 if nb_channels == 2 else 4, WAV_FORMAT_PCM,
+                            b"\x00\x00\x00\x00\x10\x00\x80\x00\x00\xaa\x00\x38\x9b\x71")
+    #end if
+    return chunk(b"fmt ", data)
+#end def
+
+def data_chunk(nb_channels, bits_per_sample, nb_frames=NB_FRAMES):
+    """Return a data chunk of nb_frames frames."""
+
+    return chunk(b"data", bytes(range(nb_frames * nb_channels * bits_per_sample // 8)))
+#end def
+
+def smpl_chunk(loop_start, loop_end):
+    """Return a smpl chunk with one loop (loop_end included)."""
+
+    return chunk(b"smpl", struct.pack("<9I", 0, 0, 22676, 60, 0, 0, 0, 1, 0)
+                          + struct.pack("<6I", 0, 0, loop_start, loop_end, 0, 0))
+#end def
+
+def write_wav(file_name, chunks, riff_id=b"RIFF"):
+    """Write a wav file with its chunks."""
+
+    data = b"".join(chunks)
+    wav_file = open(os.path.join(WAV_DIR, file_name), "wb")
+    wav_file.write(riff_id + struct.pack("<I", len(data) + 4) + b"WAVE" + data)
+    wav_file.close()
+#end def
+
+if not os.path.isdir(WAV_DIR):
+    os.mkdir(WAV_DIR)
+#end if
+
+write_wav("list_fact_before_fmt.wav", [chunk(b"LIST", b"INFOISFT\x06\x00\x00\x00Lavf\x00\x00"),
+                                       chunk(b"fact", struct.pack("<I", NB_FRAMES)),
+                                       fmt_chunk(WAV_FORMAT_PCM, 1, 16), data_chunk(1, 16)])
+write_wav("smpl_after_data.wav", [fmt_chunk(WAV_FORMAT_PCM, 2, 16), data_chunk(2, 16), smpl_chunk(2, 7)])
+write_wav("odd_junk.wav", [chunk(b"JUNK", b"abc"), fmt_chunk(WAV_FORMAT_PCM, 1, 16), data_chunk(1, 16)])
+write_wav("extensible_16.wav", [fmt_chunk(WAV_FORMAT_EXTENSIBLE, 2, 16), data_chunk(2, 16)])
+write_wav("extensible_24.wav", [fmt_chunk(WAV_FORMAT_EXTENSIBLE, 1, 24), data_chunk(1, 24)])
+write_wav("float32.wav", [fmt_chunk(WAV_FORMAT_FLOAT, 2, 32), chunk(b"fact", struct.pack("<I", NB_FRAMES)),
+                          data_chunk(2, 32)])
+# Data chunk of 100 bytes in its header, 21 bytes in the file (10 frames and a half of 16 bits).
+write_wav("truncated_data.wav", [fmt_chunk(WAV_FORMAT_PCM, 1, 16), chunk(b"data", bytes(21), 100)[:-1]])
+write_wav("missing_data.wav", [fmt_chunk(WAV_FORMAT_PCM, 1, 16), chunk(b"LIST", b"INFO")])
+write_wav("not_riff.wav", [fmt_chunk(WAV_FORMAT_PCM, 1, 16), data_chunk(1, 16)], b"RIFX")
+write_wav("3_channels.wav", [fmt_chunk(WAV_FORMAT_PCM, 3, 16), data_chunk(3, 16)])
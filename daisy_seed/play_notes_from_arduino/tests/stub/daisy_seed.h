@@ -0,0 +1,135 @@
+/*
+ * Minimal host stub of the libDaisy API used by the modules under test (audio engine, envelope,
+ * event queue, master bus, disk streamer, ADPCM codec, resampler). The hardware does nothing:
+ * the audio is never started (the tests call AudioCallback directly), the logs are printed on
+ * stdout, the interrupts are never masked and the SD card has no file unless a test gives it
+ * one (see stub.cpp).
+ */
+#ifndef DAISY_SEED_STUB
+#define DAISY_SEED_STUB
+
+/*************************************************************************************************
+* Includes
+*************************************************************************************************/
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/*************************************************************************************************
+* Defines
+*************************************************************************************************/
+#define DSY_SDRAM_BSS
+#define FLT_FMT3        "%d.%03d"
+#define FLT_VAR3(x)     (int)(x), abs((int)(((x) - (int)(x)) * 1000))
+
+/*************************************************************************************************
+* FatFS
+*************************************************************************************************/
+typedef size_t UINT;             // Same size as size_t, as on the Cortex-M7.
+typedef uint8_t BYTE;
+typedef uint32_t FSIZE_t;
+typedef enum { FR_OK = 0, FR_DISK_ERR, FR_INT_ERR, FR_NOT_READY, FR_NO_FILE } FRESULT;
+
+typedef struct
+{
+    FSIZE_t fptr;
+    FSIZE_t obj_size;
+} FIL;
+
+#define FA_READ         0x01
+#define f_size(fp)      ((fp)->obj_size)
+#define f_tell(fp)      ((fp)->fptr)
+
+extern FRESULT f_open(FIL *fp, const char *path, BYTE mode);
+extern FRESULT f_close(FIL *fp);
+extern FRESULT f_read(FIL *fp, void *buff, UINT btr, UINT *br);
+extern FRESULT f_lseek(FIL *fp, FSIZE_t ofs);
+
+// Simulated SD card: without file by default. A test can give it one file (opened by any path) of
+// g_stub_file_size bytes, whose first g_stub_file_readable_size bytes can be read (zeros): a 
+// read after them is short, or fails. g_stub_nb_reads counts the calls of f_read.
+extern bool g_stub_file_exists;
+extern FSIZE_t g_stub_file_size;
+extern FSIZE_t g_stub_file_readable_size;
+extern uint32_t g_stub_nb_reads;
+
+/*************************************************************************************************
+* Cortex-M7
+*************************************************************************************************/
+extern void __disable_irq(void);
+extern uint32_t __get_PRIMASK(void);
+extern void __set_PRIMASK(uint32_t primask);
+extern void __DMB(void);
+extern void SCB_CleanInvalidateDCache_by_Addr(uint32_t *addr, int32_t dsize);
+
+/*************************************************************************************************
+* libDaisy
+*************************************************************************************************/
+namespace daisy
+{
+struct System
+{
+    static uint32_t GetNow(void);
+    static uint32_t GetUs(void);
+};
+
+struct SaiHandle
+{
+    struct Config
+    {
+        enum class SampleRate { SAI_48KHZ };
+    };
+};
+
+struct AudioHandle
+{
+    typedef const float *InterleavingInputBuffer;
+    typedef float *InterleavingOutputBuffer;
+    typedef void (*InterleavingAudioCallback)(InterleavingInputBuffer in, InterleavingOutputBuffer out, size_t size);
+};
+
+class CpuLoadMeter
+{
+  public:
+    void Init(float sample_rate, int block_size, float smoothing = 1.0f) {}
+    void OnBlockStart(void) {}
+    void OnBlockEnd(void) {}
+    float GetAvgCpuLoad(void) const { return 0.0f; }
+    float GetMinCpuLoad(void) const { return 0.0f; }
+    float GetMaxCpuLoad(void) const { return 0.0f; }
+    void Reset(void) {}
+};
+
+class DaisySeed
+{
+  public:
+    void SetLed(bool state) {}
+    void SetAudioBlockSize(size_t block_size) { m_block_size = block_size; }
+    void SetAudioSampleRate(SaiHandle::Config::SampleRate sample_rate) {}
+    void StartAudio(AudioHandle::InterleavingAudioCallback callback) {}
+    void StopAudio(void) {}
+    size_t AudioBlockSize(void) { return m_block_size; }
+    float AudioSampleRate(void) { return 48000.0f; }
+
+    template <typename... Args> void Print(const char *format, Args... args) 
+    { 
+        printf(format, args...); 
+    }
+    template <typename... Args> void PrintLine(const char *format, Args... args) 
+    { 
+        printf(format, args...); 
+        printf("\n"); 
+    }
+
+  private:
+    size_t m_block_size = 48;
+};
+
+namespace seed
+{
+}
+}
+
+#endif //#ifndef DAISY_SEED_STUB
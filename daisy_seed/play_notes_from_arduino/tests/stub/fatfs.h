@@ -0,0 +1,4 @@
+/*
+ * Minimal host stub of FatFS: see daisy_seed.h.
+ */
+#include "daisy_seed.h"
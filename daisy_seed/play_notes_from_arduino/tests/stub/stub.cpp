@@ -0,0 +1,68 @@
+/*
+ * Minimal host stub of the libDaisy API (see daisy_seed.h).
+ */
+
+/*************************************************************************************************
+* Includes
+*************************************************************************************************/
+#include "daisy_seed.h"
+
+/*************************************************************************************************
+* Functions implementation
+*************************************************************************************************/
+void __disable_irq(void) {}
+uint32_t __get_PRIMASK(void) { return 0; }
+void __set_PRIMASK(uint32_t primask) {}
+void __DMB(void) {}
+void SCB_CleanInvalidateDCache_by_Addr(uint32_t *addr, int32_t dsize) {}
+
+uint32_t daisy::System::GetNow(void) { return 0; }
+uint32_t daisy::System::GetUs(void) { return 0; }
+
+// Simulated SD card (see daisy_seed.h).
+bool g_stub_file_exists = false;
+FSIZE_t g_stub_file_size = 0;
+FSIZE_t g_stub_file_readable_size = 0;
+uint32_t g_stub_nb_reads = 0;
+
+FRESULT f_open(FIL *fp, const char *path, BYTE mode)
+{
+    if (g_stub_file_exists == false)
+    {
+        return FR_NO_FILE;
+    }
+    fp->fptr     = 0;
+    fp->obj_size = g_stub_file_size;
+    return FR_OK;
+}
+
+FRESULT f_close(FIL *fp) { return FR_OK; }
+
+FRESULT f_read(FIL *fp, void *buff, UINT btr, UINT *br)
+{
+    FSIZE_t end = (g_stub_file_readable_size < fp->obj_size) ? g_stub_file_readable_size : fp->obj_size;
+
+    g_stub_nb_reads++;
+    *br = 0;
+    if ((g_stub_file_exists == false) || ((fp->fptr >= end) && (end < fp->obj_size)))
+    {
+        return FR_DISK_ERR;
+    }
+    if (fp->fptr < end)
+    {
+        *br = (btr < end - fp->fptr) ? btr : end - fp->fptr;
+    }
+    memset(buff, 0, *br);
+    fp->fptr += *br;
+    return FR_OK;
+}
+
+FRESULT f_lseek(FIL *fp, FSIZE_t ofs)
+{
+    if ((g_stub_file_exists == false) || (ofs > fp->obj_size))
+    {
+        return FR_DISK_ERR;
+    }
+    fp->fptr = ofs;
+    return FR_OK;
+}
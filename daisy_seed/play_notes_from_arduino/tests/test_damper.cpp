@@ -0,0 +1,151 @@
+/*
+ * Host unit test of the damped releases near the end of the samples (audio_engine.cpp): a note
+ * is released with a half pedal (release shortened to the end of its samples), then the pedal is
+ * raised during the release, a few hundred frames before the end of the samples. The new release
+ * is shortened to the remaining frames too: it must end with the samples (gain down to 0), not be
+ * cut before its end (click).
+ *
+ * The pedal is raised at several frames before the end of the samples, so the remaining frames
+ * are not always a multiple of the number of points of the release table.
+ */
+
+/*************************************************************************************************
+* Includes
+*************************************************************************************************/
+#include "daisy_seed.h"
+#include "common.h"
+#include "audio_engine.h"
+#include "master_bus.h"
+#include <math.h>
+
+/*************************************************************************************************
+* Defines
+*************************************************************************************************/
+#define NOTE_KEY            39
+#define NOTE_NB_SAMPLES     24000   // Samples of each note.
+#define NOTE_SAMPLE_VALUE   4096    // Value of all the samples (the output is the gain of the voice).
+#define BLOCK_SIZE          16
+#define HALF_PEDAL_POSITION 0.79f   // Damping 1: release PEDAL_NB_DAMPING_LEVELS times longer.
+#define MAX_END_LEVEL       0.01f   // Maximum last output level relative to the sustain level.
+
+/*************************************************************************************************
+* Variables
+*************************************************************************************************/
+// Samples of the notes (defined by main.cpp in the firmware).
+int16_t g_sample_data[NB_SOUNDS * NOTE_NB_SAMPLES];
+
+static float    g_out[2 * BLOCK_SIZE];
+static uint32_t g_nb_errors = 0;
+
+/*************************************************************************************************
+* Functions implementation
+*************************************************************************************************/
+/* Give NOTE_NB_SAMPLES mono samples of NOTE_SAMPLE_VALUE to each sound of the bank played. */
+static void init_sounds(void)
+{
+    TSoundData *pSound;
+
+    memset(g_sound_banks, 0, sizeof(g_sound_banks));
+    for (size_t idx = 0; idx < NB_SOUNDS * NOTE_NB_SAMPLES; idx++)
+    {
+        g_sample_data[idx] = NOTE_SAMPLE_VALUE;
+    }
+    for (uint16_t sound_idx = 0; sound_idx < NB_SOUNDS; sound_idx++)
+    {
+        pSound = &g_sounds[sound_idx];
+        pSound->first_sample_pos = sound_idx * NOTE_NB_SAMPLES;
+        pSound->nb_samples       = NOTE_NB_SAMPLES;
+        pSound->last_sample_pos  = pSound->first_sample_pos + NOTE_NB_SAMPLES;
+        pSound->nb_channels      = 1;
+    }
+    g_sound_banks[0].nb_velocity_layers = 1;
+    g_nb_velocity_layers = 1;
+    build_sound_map(0);
+}
+
+/* Play a note released with a half pedal, raise the pedal pedal_up_nb_frames frames before the
+   end of its samples and check that its release ends with the samples. */
+static void check_damped_release(size_t pedal_up_nb_frames)
+{
+    const TVoice *pVoice = NULL;
+    size_t nb_remaining_frames;
+    float sustain_level = 0.0f;
+    float last_level = 0.0f;
+    bool pedal_up = false;
+    bool release_too_long = false;
+    uint32_t nb_blocks = 0;
+    char name[80];
+
+    stop_all_sounds();
+    set_pedal_position(PEDAL_SUSTAIN, HALF_PEDAL_POSITION, g_block_start_frame);
+    start_playing_a_note(NOTE_KEY, 1.0f, g_block_start_frame);
+    for (uint32_t block_idx = 0; block_idx < 100; block_idx++)
+    {
+        AudioCallback(NULL, g_out, 2 * BLOCK_SIZE);
+    }
+    sustain_level = fabsf(g_out[0]);
+    stop_playing_a_note(NOTE_KEY, g_block_start_frame);
+
+    while ((g_nb_active_voices > 0) && (nb_blocks < 2 * NOTE_NB_SAMPLES / BLOCK_SIZE))
+    {
+        pVoice = &g_voices[g_active_voices[0]];
+        nb_remaining_frames = (pVoice->last_sample_pos - pVoice->cur_playing_pos) / pVoice->nb_channels;
+        if ((pedal_up == false) && (nb_remaining_frames <= pedal_up_nb_frames + EVENT_LATENCY_NB_SAMPLES + BLOCK_SIZE))
+        {
+            set_pedal_position(PEDAL_SUSTAIN, 0.0f, g_block_start_frame);
+            pedal_up = true;
+        }
+
+        AudioCallback(NULL, g_out, 2 * BLOCK_SIZE);
+        nb_blocks++;
+
+        for (size_t frame_idx = 0; frame_idx < BLOCK_SIZE; frame_idx++)
+        {
+            if (g_out[2 * frame_idx] != 0.0f)
+            {
+                last_level = fabsf(g_out[2 * frame_idx]);
+            }
+        }
+
+        // The rest of the release must fit in the rest of the samples.
+        if (   (g_nb_active_voices > 0) && (pVoice->env_stage == ENV_RELEASE)
+            && (  pVoice->env_release.nb_samples - pVoice->env_pos
+                > (pVoice->last_sample_pos - pVoice->cur_playing_pos) / pVoice->nb_channels))
+        {
+            release_too_long = true;
+        }
+    }
+
+    snprintf(name, sizeof(name), "Pedal up %d frames before the end of the samples", (int)pedal_up_nb_frames);
+    if (   (sustain_level == 0.0f) || (pedal_up == false) || (g_nb_active_voices > 0)
+        || (release_too_long == true) || (last_level > MAX_END_LEVEL * sustain_level))
+    {
+        printf("sustain_level=%f last_level=%f release_too_long=%d\n", sustain_level, last_level,
+               (int)release_too_long);
+        printf("%-60s KO\n", name);
+        g_nb_errors++;
+    }
+    else
+    {
+        printf("%-60s OK\n", name);
+    }
+}
+
+int main(void)
+{
+    // Remaining frames around multiples of ENV_RELEASE_NB_STEPS (375) and in between.
+    const size_t pedal_up_nb_frames[] = {300, 400, 600, 700, 1000, 2000, 5000};
+
+    init_envelope_tables();
+    init_master_bus();
+    init_sounds();
+
+    for (size_t test_idx = 0; test_idx < sizeof(pedal_up_nb_frames) / sizeof(pedal_up_nb_frames[0]); test_idx++)
+    {
+        check_damped_release(pedal_up_nb_frames[test_idx]);
+    }
+
+    printf("test_damper: %s\n", (g_nb_errors == 0) ? "OK" : "KO");
+
+    return (g_nb_errors == 0) ? 0 : 1;
+}
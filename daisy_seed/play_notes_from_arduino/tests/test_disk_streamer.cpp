@@ -0,0 +1,116 @@
+/*
+ * Host unit test of the read errors of the disk streamer (disk_streamer.cpp), with the simulated
+ * SD card of the stub: a stream whose file can't be read (short read, error, seek out of the
+ * file) must be closed after one attempt, not read again at each call of service_streams (log
+ * flooded, other streams starved, frames misaligned by the short read). Its voice plays the rest
+ * of the tail silent: no frame of the tail is loaded.
+ *
+ * A file read without error is checked too: the two halves of its stream buffer are loaded
+ * (the voice is still in the head).
+ */
+
+/*************************************************************************************************
+* Includes
+*************************************************************************************************/
+#include "daisy_seed.h"
+#include "common.h"
+#include "audio_engine.h"
+#include "disk_streamer.h"
+
+/*************************************************************************************************
+* Defines
+*************************************************************************************************/
+#define STREAM_IDX          0
+#define SOUND_IDX           NB_SPECIAL_SOUNDS
+#define TAIL_FILE_OFFSET    (44 + STREAM_HEAD_NB_FRAMES * 2) // Tail after the header and the head.
+#define TAIL_NB_FRAMES      (3 * STREAM_HALF_NB_FRAMES)
+#define NB_SERVICE_CALLS    100                         // Calls of service_streams after the error.
+
+/*************************************************************************************************
+* Variables
+*************************************************************************************************/
+// Samples of the notes (defined by main.cpp in the firmware): the tail is not in RAM.
+int16_t g_sample_data[2];
+
+static uint32_t g_nb_errors = 0;
+
+/*************************************************************************************************
+* Functions implementation
+*************************************************************************************************/
+/* Log the result of a check and count the errors. */
+static void check(bool ok, const char *name)
+{
+    printf("%-60s %s\n", name, ok ? "OK" : "KO");
+    if (ok == false)
+    {
+        g_nb_errors++;
+    }
+}
+
+/* Give a mono streamed sound (head and tail of TAIL_NB_FRAMES frames) to the bank played. */
+static void init_streamed_sound(void)
+{
+    TSoundData *pSound = &g_sounds[SOUND_IDX];
+
+    memset(g_sound_banks, 0, sizeof(g_sound_banks));
+    pSound->nb_channels        = 1;
+    pSound->nb_head_samples    = STREAM_HEAD_NB_FRAMES;
+    pSound->nb_samples         = STREAM_HEAD_NB_FRAMES + TAIL_NB_FRAMES;
+    pSound->stream_file_offset = TAIL_FILE_OFFSET;
+    set_stream_file_path(0, SOUND_IDX, "0:/bank/layer_1/note.wav");
+}
+
+/* Start the stream of the sound with a file of which readable_size bytes can be read, serve the
+   streams NB_SERVICE_CALLS times and return the number of reads of the file and in
+   p_nb_loaded_frames the number of frames of the tail loaded. */
+static uint32_t stream_file(uint32_t file_size, uint32_t readable_size, size_t *p_nb_loaded_frames)
+{
+    g_stub_file_exists        = true;
+    g_stub_file_size          = file_size;
+    g_stub_file_readable_size = readable_size;
+    g_stub_nb_reads           = 0;
+
+    start_stream(STREAM_IDX, SOUND_IDX);
+    for (uint32_t call_idx = 0; call_idx < NB_SERVICE_CALLS; call_idx++)
+    {
+        service_streams();
+    }
+    get_stream_samples(STREAM_IDX, 0, p_nb_loaded_frames);
+    stop_stream(STREAM_IDX);
+    service_streams();
+
+    return g_stub_nb_reads;
+}
+
+int main(void)
+{
+    const uint32_t file_size = TAIL_FILE_OFFSET + TAIL_NB_FRAMES * 2;
+    size_t nb_loaded_frames;
+    uint32_t nb_reads;
+
+    init_streamed_sound();
+
+    // Whole file: the stream buffer is loaded, the next half waits for the voice.
+    nb_reads = stream_file(file_size, file_size, &nb_loaded_frames);
+    check((nb_reads == 2) && (nb_loaded_frames == STREAM_BUFFER_NB_FRAMES), "Read without error: stream buffer loaded");
+
+    // Short read: half of the first half.
+    nb_reads = stream_file(file_size, TAIL_FILE_OFFSET + STREAM_HALF_NB_FRAMES, &nb_loaded_frames);
+    check((nb_reads == 1) && (nb_loaded_frames == 0), "Short read: stream closed after one read");
+
+    // Read error at the start of the tail.
+    nb_reads = stream_file(file_size, TAIL_FILE_OFFSET, &nb_loaded_frames);
+    check((nb_reads == 1) && (nb_loaded_frames == 0), "Read error: stream closed after one read");
+
+    // Tail after the end of the file: the seek fails, the file is not read.
+    nb_reads = stream_file(TAIL_FILE_OFFSET - 2, TAIL_FILE_OFFSET - 2, &nb_loaded_frames);
+    check((nb_reads == 0) && (nb_loaded_frames == 0), "Seek error: stream not read");
+
+    // A new stream of the voice reads its file again.
+    nb_reads = stream_file(file_size, file_size, &nb_loaded_frames);
+    check((nb_reads == 2) && (nb_loaded_frames == STREAM_BUFFER_NB_FRAMES), "New stream after an error: stream buffer loaded");
+
+    printf("test_disk_streamer: %s\n", (g_nb_errors == 0) ? "OK" : "KO");
+
+    return (g_nb_errors == 0) ? 0 : 1;
+}
@@ -0,0 +1,135 @@
+/*
+ * Host unit test of the releases (envelope.cpp): releases of several durations and curves are
+ * computed ramp by ramp, as the audio engine does, with several audio block sizes. The gain of
+ * each sample must follow the curve, the release must end at 0 after exactly the number of samples
+ * asked, and a short release must not cut a block in more ramps than a long one.
+ */
+
+/*************************************************************************************************
+* Includes
+*************************************************************************************************/
+#include "daisy_seed.h"
+#include "common.h"
+#include "envelope.h"
+#include <math.h>
+
+/*************************************************************************************************
+* Defines
+*************************************************************************************************/
+#define MAX_GAIN_ERROR      0.02f   // Maximum error of the gain of a sample (chord of the curve).
+#define MAX_END_GAIN        0.01f   // Maximum gain of the last sample of a release.
+
+/*************************************************************************************************
+* Variables
+*************************************************************************************************/
+static uint32_t g_nb_errors = 0;
+
+/*************************************************************************************************
+* Functions implementation
+*************************************************************************************************/
+/* Log the result of a check and count the errors. */
+static void check(bool ok, const char *name)
+{
+    printf("%-60s %s\n", name, ok ? "OK" : "KO");
+    if (ok == false)
+    {
+        g_nb_errors++;
+    }
+}
+
+/* Exact gain of the release curve at the relative position x (0.0 to 1.0). */
+static float expected_gain(e_env_curve curve, float x)
+{
+    if (curve == ENV_CURVE_EXPONENTIAL)
+    {
+        return (expf(-5.0f * x) - expf(-5.0f)) / (1.0f - expf(-5.0f));
+    }
+    if (curve == ENV_CURVE_EQUAL_POWER)
+    {
+        return cosf(x * (float)M_PI_2);
+    }
+    return 1.0f - x;
+}
+
+/* Play a release of release_nb_samples samples with blocks of block_size frames and check it. */
+static void check_release(uint32_t release_nb_samples, e_env_curve curve, size_t block_size)
+{
+    TEnvRelease release;
+    size_t env_pos = 0;
+    size_t block_pos;
+    size_t nb_seg_frames;
+    uint32_t nb_block_ramps;
+    uint32_t max_block_ramps = 0;
+    float gain;
+    float gain_step;
+    float last_gain = 1.0f;
+    float max_error = 0.0f;
+    char name[80];
+
+    set_release(&release, release_nb_samples, curve);
+
+    while (env_pos < release.nb_samples)
+    {
+        nb_block_ramps = 0;
+        for (block_pos = 0; (block_pos < block_size) && (env_pos < release.nb_samples); block_pos += nb_seg_frames)
+        {
+            nb_seg_frames = block_size - block_pos;
+            if (nb_seg_frames > release.nb_samples - env_pos)
+            {
+                nb_seg_frames = release.nb_samples - env_pos;
+            }
+            nb_seg_frames = envelope_release_ramp(&release, env_pos, 1.0f, nb_seg_frames, &gain, &gain_step);
+            for (size_t idx = 0; idx < nb_seg_frames; idx++)
+            {
+                max_error = fmaxf(max_error, fabsf(gain - expected_gain(curve, (float)env_pos / release_nb_samples)));
+                last_gain = gain;
+                gain += gain_step;
+                env_pos++;
+            }
+            nb_block_ramps++;
+        }
+        if (nb_block_ramps > max_block_ramps)
+        {
+            max_block_ramps = nb_block_ramps;
+        }
+    }
+
+    snprintf(name, sizeof(name), "Release %d samples, curve %d, blocks of %d frames", (int)release_nb_samples,
+             (int)curve, (int)block_size);
+    if (   (release.nb_samples != release_nb_samples) || (max_error > MAX_GAIN_ERROR)
+        || (fabsf(last_gain) > MAX_END_GAIN)
+        || (max_block_ramps > block_size / ENV_TABLE_STEP_NB_SAMPLES + 2))
+    {
+        printf("nb_samples=%d max_error=%f last_gain=%f max_block_ramps=%d\n", (int)release.nb_samples,
+               max_error, last_gain, (int)max_block_ramps);
+        check(false, name);
+    }
+    else
+    {
+        check(true, name);
+    }
+}
+
+int main(void)
+{
+    // 10 ms, not a multiple of ENV_RELEASE_NB_STEPS, default (250 ms), 1 s and 10 s.
+    const uint32_t release_nb_samples[] = {480, 600, 1000, WAV_ENV_END_NB_SAMPLES, 48000, 480000};
+    const size_t block_sizes[] = {4, 48, 256};
+
+    init_envelope_tables();
+
+    for (size_t release_idx = 0; release_idx < sizeof(release_nb_samples) / sizeof(release_nb_samples[0]); release_idx++)
+    {
+        for (uint8_t curve = 0; curve < NB_ENV_CURVES; curve++)
+        {
+            for (size_t block_idx = 0; block_idx < sizeof(block_sizes) / sizeof(block_sizes[0]); block_idx++)
+            {
+                check_release(release_nb_samples[release_idx], (e_env_curve)curve, block_sizes[block_idx]);
+            }
+        }
+    }
+
+    printf("test_envelope: %s\n", (g_nb_errors == 0) ? "OK" : "KO");
+
+    return (g_nb_errors == 0) ? 0 : 1;
+}
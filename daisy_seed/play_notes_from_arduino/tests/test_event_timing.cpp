@@ -0,0 +1,184 @@
+/*
+ * Host unit test of the timing of the events (audio_engine.cpp, event_queue.cpp): a trill of
+ * NB_NOTES notes (two keys alternately) is played with a note every NOTE_NB_FRAMES frames, for
+ * several audio block sizes. Each note is posted when its timestamp is in the past, as the main
+ * loop posts the notes received from the arduino, and must start exactly EVENT_LATENCY_NB_SAMPLES
+ * plus one block after its timestamp, whatever the frame of the block.
+ *
+ * After each block, the playing position of each voice (notes played and notes stolen by the
+ * next note of their key) is checked to the sample.
+ */
+
+/*************************************************************************************************
+* Includes
+*************************************************************************************************/
+#include "daisy_seed.h"
+#include "common.h"
+#include "audio_engine.h"
+#include "master_bus.h"
+
+/*************************************************************************************************
+* Defines
+*************************************************************************************************/
+#define NB_NOTES            12      // Number of notes of the trill.
+#define NOTE_NB_FRAMES      7       // Number of frames between 2 notes.
+#define TRILL_LOW_KEY       39      // Keys of the trill.
+#define TRILL_HIGH_KEY      40
+#define FIRST_NOTE_OFFSET   3       // Frame of the first note in its block.
+#define NOTE_NB_SAMPLES     48000   // Samples of each note (longer than the test).
+#define NB_WARMUP_BLOCKS    100     // Blocks played before the first note.
+#define MAX_BLOCK_SIZE      64
+
+/*************************************************************************************************
+* Variables
+*************************************************************************************************/
+// Samples of the notes (defined by main.cpp in the firmware).
+int16_t g_sample_data[NB_SOUNDS * NOTE_NB_SAMPLES];
+
+static float    g_out[2 * MAX_BLOCK_SIZE];
+static uint32_t g_nb_errors = 0;
+
+/*************************************************************************************************
+* Functions implementation
+*************************************************************************************************/
+/* Give NOTE_NB_SAMPLES silent mono samples to each sound of the bank played. */
+static void init_sounds(void)
+{
+    TSoundData *pSound;
+
+    memset(g_sound_banks, 0, sizeof(g_sound_banks));
+    for (uint16_t sound_idx = 0; sound_idx < NB_SOUNDS; sound_idx++)
+    {
+        pSound = &g_sounds[sound_idx];
+        pSound->first_sample_pos = sound_idx * NOTE_NB_SAMPLES;
+        pSound->nb_samples       = NOTE_NB_SAMPLES;
+        pSound->last_sample_pos  = pSound->first_sample_pos + NOTE_NB_SAMPLES;
+        pSound->nb_channels      = 1;
+    }
+    g_sound_banks[0].nb_velocity_layers = 1;
+    g_nb_velocity_layers = 1;
+    build_sound_map(0);
+}
+
+/* Check the position of each voice at the end of a block (block_end_frame): the voice of the
+   note note_idx (order of the start of the voices from first_start_order) has played the frames
+   from first_note_frame + note_idx * NOTE_NB_FRAMES. The notes checked are set in notes_checked. */
+static void check_voices(uint32_t block_end_frame, uint32_t first_note_frame, uint32_t first_start_order,
+                         bool notes_checked[NB_NOTES], size_t block_size)
+{
+    const TVoice *pVoice;
+    uint32_t note_idx;
+    uint16_t expected_key;
+    size_t expected_pos;
+    size_t pos;
+
+    for (size_t list_idx = 0; list_idx < g_nb_active_voices; list_idx++)
+    {
+        pVoice       = &g_voices[g_active_voices[list_idx]];
+        note_idx     = pVoice->start_order - first_start_order;
+        expected_key = ((note_idx % 2) == 0) ? TRILL_LOW_KEY : TRILL_HIGH_KEY;
+        expected_pos = block_end_frame - (first_note_frame + note_idx * NOTE_NB_FRAMES);
+        pos          = (pVoice->cur_playing_pos - g_sounds[pVoice->sound_idx].first_sample_pos) / pVoice->nb_channels;
+
+        if (   (note_idx >= NB_NOTES) || (pVoice->sound_idx != NB_SPECIAL_SOUNDS + expected_key)
+            || (pos != expected_pos))
+        {
+            printf("Block size %d: note %d key=%d pos=%d expected=%d\n", (int)block_size, (int)note_idx,
+                   pVoice->sound_idx - NB_SPECIAL_SOUNDS, (int)pos, (int)expected_pos);
+            g_nb_errors++;
+        }
+        else
+        {
+            notes_checked[note_idx] = true;
+        }
+    }
+}
+
+/* Play the trill with blocks of block_size frames and check the voices after each block. */
+static void check_trill(size_t block_size)
+{
+    bool notes_checked[NB_NOTES];
+    uint32_t first_note_frame;
+    uint32_t first_start_order = 0;
+    bool first_note_started = false;
+    uint32_t timestamp;
+    uint32_t block_start_frame;
+    uint16_t nb_notes_posted = 0;
+    uint32_t nb_errors = g_nb_errors;
+    bool all_checked = true;
+    char name[80];
+
+    stop_all_sounds();
+    memset(notes_checked, 0, sizeof(notes_checked));
+    for (uint32_t block_idx = 0; block_idx < NB_WARMUP_BLOCKS; block_idx++)
+    {
+        AudioCallback(NULL, g_out, 2 * block_size);
+    }
+
+    // The first note is in the middle of a block.
+    first_note_frame = g_block_start_frame + 2 * block_size + EVENT_LATENCY_NB_SAMPLES + FIRST_NOTE_OFFSET;
+
+    while (g_block_start_frame < first_note_frame + NB_NOTES * NOTE_NB_FRAMES + block_size)
+    {
+        // Notes received before the next block (timestamp in the past).
+        block_start_frame = g_block_start_frame + block_size;
+        while (nb_notes_posted < NB_NOTES)
+        {
+            timestamp =   first_note_frame + nb_notes_posted * NOTE_NB_FRAMES
+                        - EVENT_LATENCY_NB_SAMPLES - block_size;
+            if (timestamp >= block_start_frame)
+            {
+                break;
+            }
+            start_playing_a_note(((nb_notes_posted % 2) == 0) ? TRILL_LOW_KEY : TRILL_HIGH_KEY, 1.0f, timestamp);
+            nb_notes_posted++;
+        }
+
+        AudioCallback(NULL, g_out, 2 * block_size);
+
+        // The first voice started is the voice of the first note.
+        if ((first_note_started == false) && (g_nb_active_voices > 0))
+        {
+            first_start_order = g_voices[g_active_voices[0]].start_order;
+            for (size_t list_idx = 1; list_idx < g_nb_active_voices; list_idx++)
+            {
+                if (g_voices[g_active_voices[list_idx]].start_order < first_start_order)
+                {
+                    first_start_order = g_voices[g_active_voices[list_idx]].start_order;
+                }
+            }
+            first_note_started = true;
+        }
+        check_voices(g_block_start_frame + block_size, first_note_frame, first_start_order, notes_checked, block_size);
+    }
+
+    for (uint16_t note_idx = 0; note_idx < NB_NOTES; note_idx++)
+    {
+        all_checked = all_checked && notes_checked[note_idx];
+    }
+
+    snprintf(name, sizeof(name), "Trill every %d frames, %d frames per block", NOTE_NB_FRAMES, (int)block_size);
+    printf("%-60s %s\n", name, ((all_checked == true) && (g_nb_errors == nb_errors)) ? "OK" : "KO");
+    if (all_checked == false)
+    {
+        g_nb_errors++;
+    }
+}
+
+int main(void)
+{
+    const size_t block_sizes[] = {4, 16, 64};
+
+    init_envelope_tables();
+    init_master_bus();
+    init_sounds();
+
+    for (size_t test_idx = 0; test_idx < sizeof(block_sizes) / sizeof(block_sizes[0]); test_idx++)
+    {
+        check_trill(block_sizes[test_idx]);
+    }
+
+    printf("test_event_timing: %s\n", (g_nb_errors == 0) ? "OK" : "KO");
+
+    return (g_nb_errors == 0) ? 0 : 1;
+}
@@ -0,0 +1,333 @@
+/*
+ * Host unit test of the mixing kernels (mixing_kernel.h): the scalar reference kernels, the DSP
+ * kernels (built with the portable equivalents of SMLAWB/SMLAWT on the host) and the
+ * interpolating kernels, mono and stereo, are checked against a model computed in double:
+ * acc + floor(sample * gain / 2^16), exact for the reference and DSP kernels, within the
+ * interpolation error for the interpolating kernels.
+ *
+ * The edges are checked too: full scale samples at unity gain (64 sounds summed in the guard bits
+ * of the accumulator), gain ramps down to zero, and zero gain (accumulator unchanged).
+ */
+
+/*************************************************************************************************
+* Includes
+*************************************************************************************************/
+#include "mixing_kernel.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+/*************************************************************************************************
+* Defines
+*************************************************************************************************/
+#define NB_FRAMES       61      // Odd number of frames to check the last frame too.
+#define NB_TESTS        1000    // Number of random tests of each kernel.
+#define NB_SUMMED_SOUNDS 64     // Number of full scale sounds summed in the guard bits.
+
+/*************************************************************************************************
+* Variables
+*************************************************************************************************/
+static int16_t  g_samples[2 * NB_FRAMES + 2];
+static int32_t  g_acc_left[NB_FRAMES];
+static int32_t  g_acc_right[NB_FRAMES];
+static int32_t  g_model_left[NB_FRAMES];
+static int32_t  g_model_right[NB_FRAMES];
+
+static uint32_t g_nb_errors = 0;
+
+/*************************************************************************************************
+* Functions implementation
+*************************************************************************************************/
+/* Log the result of a check and count the errors. */
+static void check(bool ok, const char *name)
+{
+    printf("%-60s %s\n", name, ok ? "OK" : "KO");
+    if (ok == false)
+    {
+        g_nb_errors++;
+    }
+}
+
+/* Model of the mixing of one sample: acc + floor(sample * gain / 2^16). */
+static int32_t model_mix(int32_t acc, int64_t gain, double sample)
+{
+    return acc + (int32_t)floor((double)gain * sample / 65536.0);
+}
+
+/* Fill the samples and the accumulators (and their models) with random values. */
+static void fill_random(void)
+{
+    for (size_t idx = 0; idx < sizeof(g_samples) / sizeof(g_samples[0]); idx++)
+    {
+        g_samples[idx] = (int16_t)rand();
+    }
+    for (size_t idx = 0; idx < NB_FRAMES; idx++)
+    {
+        g_acc_left[idx]    = rand() - (RAND_MAX / 2);
+        g_acc_right[idx]   = rand() - (RAND_MAX / 2);
+        g_model_left[idx]  = g_acc_left[idx];
+        g_model_right[idx] = g_acc_right[idx];
+    }
+}
+
+/* Random gain (0 to unity) and gain step (ramp of at most +/- unity over the frames). */
+static void random_gain(int32_t *p_gain, int32_t *p_gain_step)
+{
+    *p_gain      = rand() % MIX_GAIN_UNITY;
+    *p_gain_step = (rand() % (MIX_GAIN_UNITY / 256)) - (MIX_GAIN_UNITY / 512);
+}
+
+/* Mono reference kernel and DSP kernel (built with the portable SMLAWB/SMLAWT on the host): 
+   exact result of the model. The DSP kernel reads two samples per load: the samples start at an 
+   even or odd position, the number of frames is odd (last frame alone) or even. */
+static void check_mono_kernels(void)
+{
+    int32_t gain;
+    int32_t gain_step;
+    const int16_t *samples;
+    size_t nb_frames;
+    bool ref_ok = true;
+    bool dsp_ok = true;
+
+    for (uint32_t test_idx = 0; test_idx < NB_TESTS; test_idx++)
+    {
+        fill_random();
+        random_gain(&gain, &gain_step);
+        samples   = &g_samples[test_idx % 2];
+        nb_frames = NB_FRAMES - ((test_idx / 2) % 2);
+        for (size_t idx = 0; idx < nb_frames; idx++)
+        {
+            g_model_left[idx] = model_mix(g_model_left[idx], (int64_t)gain + (int64_t)idx * gain_step, samples[idx]);
+        }
+
+        memcpy(g_acc_right, g_acc_left, sizeof(g_acc_left));
+        mix_samples_q_ref(g_acc_left, samples, nb_frames, gain, gain_step);
+        mix_samples_q_dsp(g_acc_right, samples, nb_frames, gain, gain_step);
+        ref_ok = ref_ok && (memcmp(g_acc_left, g_model_left, sizeof(g_acc_left)) == 0);
+        dsp_ok = dsp_ok && (memcmp(g_acc_right, g_model_left, sizeof(g_acc_right)) == 0);
+    }
+
+    check(ref_ok, "mix_samples_q_ref: random samples and gain ramps");
+    check(dsp_ok, "mix_samples_q_dsp: random samples and gain ramps, odd and even frames");
+}
+
+/* Stereo reference kernel and stereo DSP kernel: exact result of the model. */
+static void check_stereo_kernels(void)
+{
+    int32_t gain;
+    int32_t gain_step;
+    int32_t saved_left[NB_FRAMES];
+    int32_t saved_right[NB_FRAMES];
+    bool ref_ok = true;
+    bool dsp_ok = true;
+
+    for (uint32_t test_idx = 0; test_idx < NB_TESTS; test_idx++)
+    {
+        fill_random();
+        random_gain(&gain, &gain_step);
+        for (size_t idx = 0; idx < NB_FRAMES; idx++)
+        {
+            g_model_left[idx]  = model_mix(g_model_left[idx], (int64_t)gain + (int64_t)idx * gain_step, g_samples[2 * idx]);
+            g_model_right[idx] = model_mix(g_model_right[idx], (int64_t)gain + (int64_t)idx * gain_step, g_samples[2 * idx + 1]);
+        }
+
+        memcpy(saved_left, g_acc_left, sizeof(saved_left));
+        memcpy(saved_right, g_acc_right, sizeof(saved_right));
+        mix_samples_q_stereo_ref(g_acc_left, g_acc_right, g_samples, NB_FRAMES, gain, gain_step);
+        ref_ok =    ref_ok && (memcmp(g_acc_left, g_model_left, sizeof(g_acc_left)) == 0)
+                 && (memcmp(g_acc_right, g_model_right, sizeof(g_acc_right)) == 0);
+
+        mix_samples_q_stereo_dsp(saved_left, saved_right, g_samples, NB_FRAMES, gain, gain_step);
+        dsp_ok =    dsp_ok && (memcmp(saved_left, g_model_left, sizeof(saved_left)) == 0)
+                 && (memcmp(saved_right, g_model_right, sizeof(saved_right)) == 0);
+    }
+
+    check(ref_ok, "mix_samples_q_stereo_ref: random samples and gain ramps");
+    check(dsp_ok, "mix_samples_q_stereo_dsp: random samples and gain ramps");
+}
+
+/* Interpolating kernels (mono and stereo): at the original pitch (phase step of one sample) the
+   result is the result of the reference kernel; at another pitch the result is the model of the
+   linear interpolation within 2 LSB of the sample (Q15 fraction and truncation). */
+static void check_interp_kernels(void)
+{
+    int32_t gain;
+    int32_t gain_step;
+    int64_t gain_i;
+    uint32_t phase;
+    uint32_t phase_step;
+    uint32_t end_phase;
+    uint32_t frame_phase;
+    size_t pos;
+    double frac;
+    double left;
+    double right;
+    double tolerance;
+    int32_t ref_acc[NB_FRAMES];
+    int32_t ref_acc_right[NB_FRAMES];
+    bool unity_ok = true;
+    bool mono_ok = true;
+    bool stereo_ok = true;
+
+    for (uint32_t test_idx = 0; test_idx < NB_TESTS; test_idx++)
+    {
+        // Original pitch.
+        fill_random();
+        random_gain(&gain, &gain_step);
+        memcpy(ref_acc, g_acc_left, sizeof(ref_acc));
+        memcpy(ref_acc_right, g_acc_right, sizeof(ref_acc_right));
+        mix_samples_q_ref(ref_acc, g_samples, NB_FRAMES, gain, gain_step);
+        end_phase = mix_samples_q_interp(g_acc_left, g_samples, NB_FRAMES, gain, gain_step, 0, MIX_PHASE_UNITY);
+        unity_ok =    unity_ok && (memcmp(g_acc_left, ref_acc, sizeof(ref_acc)) == 0)
+                   && (end_phase == NB_FRAMES * MIX_PHASE_UNITY);
+
+        memcpy(g_acc_left, g_model_left, sizeof(g_acc_left));
+        memcpy(ref_acc, g_model_left, sizeof(ref_acc));
+        mix_samples_q_stereo_ref(ref_acc, ref_acc_right, g_samples, NB_FRAMES, gain, gain_step);
+        mix_samples_q_interp_stereo(g_acc_left, g_acc_right, g_samples, NB_FRAMES, gain, gain_step, 0, MIX_PHASE_UNITY);
+        unity_ok =    unity_ok && (memcmp(g_acc_left, ref_acc, sizeof(ref_acc)) == 0)
+                   && (memcmp(g_acc_right, ref_acc_right, sizeof(ref_acc_right)) == 0);
+
+        // Other pitch: at most one octave up or down, the samples read stay in g_samples.
+        fill_random();
+        random_gain(&gain, &gain_step);
+        phase      = rand() % MIX_PHASE_UNITY;
+        phase_step = MIX_PHASE_UNITY / 2 + rand() % (MIX_PHASE_UNITY / 2);
+        if ((test_idx % 2) == 1)
+        {
+            phase_step = MIX_PHASE_UNITY + rand() % (MIX_PHASE_UNITY / 2);
+        }
+
+        memcpy(ref_acc, g_acc_left, sizeof(ref_acc));
+        memcpy(ref_acc_right, g_acc_right, sizeof(ref_acc_right));
+        end_phase = mix_samples_q_interp(g_acc_left, g_samples, NB_FRAMES, gain, gain_step, phase, phase_step);
+        mono_ok = mono_ok && (end_phase == phase + NB_FRAMES * phase_step);
+
+        // The stereo kernel reads the frames of the samples.
+        mix_samples_q_interp_stereo(ref_acc, ref_acc_right, g_samples, NB_FRAMES / 2, gain, gain_step, phase, phase_step);
+
+        for (size_t idx = 0; idx < NB_FRAMES; idx++)
+        {
+            gain_i      = (int64_t)gain + (int64_t)idx * gain_step;
+            frame_phase = phase + idx * phase_step;
+            pos         = frame_phase >> MIX_PHASE_SHIFT;
+            frac        = (double)(frame_phase & MIX_PHASE_FRAC_MASK) / (double)MIX_PHASE_UNITY;
+            tolerance   = 2.0 * (double)llabs(gain_i) / 65536.0 + 1.0;
+
+            left = g_samples[pos] + (g_samples[pos + 1] - g_samples[pos]) * frac;
+            mono_ok = mono_ok && (fabs((double)g_acc_left[idx] - ((double)g_model_left[idx] + (double)gain_i * left / 65536.0)) <= tolerance);
+
+            if (idx < NB_FRAMES / 2)
+            {
+                left  = g_samples[2 * pos] + (g_samples[2 * pos + 2] - g_samples[2 * pos]) * frac;
+                right = g_samples[2 * pos + 1] + (g_samples[2 * pos + 3] - g_samples[2 * pos + 1]) * frac;
+                stereo_ok =    stereo_ok
+                            && (fabs((double)ref_acc[idx] - ((double)g_model_left[idx] + (double)gain_i * left / 65536.0)) <= tolerance)
+                            && (fabs((double)ref_acc_right[idx] - ((double)g_model_right[idx] + (double)gain_i * right / 65536.0)) <= tolerance);
+            }
+        }
+    }
+
+    check(unity_ok, "mix_samples_q_interp(_stereo): original pitch = reference");
+    check(mono_ok, "mix_samples_q_interp: other pitch, linear interpolation");
+    check(stereo_ok, "mix_samples_q_interp_stereo: other pitch, linear interpolation");
+}
+
+/* Full scale samples at unity gain: NB_SUMMED_SOUNDS sounds are summed without overflow in the
+   guard bits of the accumulator, and one sound is exactly full scale (mix_acc_to_float). */
+static void check_saturation(void)
+{
+    bool sum_ok = true;
+    bool ramp_ok = true;
+    bool stereo_ok = true;
+    int32_t gain_step = -(int32_t)(MIX_GAIN_UNITY / (NB_FRAMES - 1));
+
+    for (size_t idx = 0; idx < NB_FRAMES; idx++)
+    {
+        g_samples[idx] = (idx % 2 == 0) ? -32768 : 32767;
+    }
+
+    memset(g_acc_left, 0, sizeof(g_acc_left));
+    for (uint32_t sound_idx = 0; sound_idx < NB_SUMMED_SOUNDS; sound_idx++)
+    {
+        mix_samples_q_ref(g_acc_left, g_samples, NB_FRAMES, MIX_GAIN_UNITY, 0);
+    }
+    for (size_t idx = 0; idx < NB_FRAMES; idx++)
+    {
+        sum_ok = sum_ok && ((int64_t)g_acc_left[idx] == (int64_t)NB_SUMMED_SOUNDS * g_samples[idx] * (MIX_ACC_FULL_SCALE / 32768));
+    }
+
+    memset(g_acc_left, 0, sizeof(g_acc_left));
+    mix_samples_q_ref(g_acc_left, g_samples, 1, MIX_GAIN_UNITY, 0);
+    check(mix_acc_to_float(g_acc_left[0]) == -1.0f, "mix_acc_to_float: full scale sample at unity gain");
+    check(sum_ok, "mix_samples_q_ref: 64 full scale sounds at unity gain");
+
+    // Ramp from unity gain down to zero over the frames.
+    memset(g_acc_left, 0, sizeof(g_acc_left));
+    mix_samples_q_ref(g_acc_left, g_samples, NB_FRAMES, MIX_GAIN_UNITY, gain_step);
+    for (size_t idx = 0; idx < NB_FRAMES; idx++)
+    {
+        ramp_ok = ramp_ok && (g_acc_left[idx] == model_mix(0, (int64_t)MIX_GAIN_UNITY + (int64_t)idx * gain_step, g_samples[idx]));
+    }
+    check(ramp_ok, "mix_samples_q_ref: full scale, ramp from unity to zero");
+
+    // Stereo: full scale left and right channels of opposite signs.
+    for (size_t idx = 0; idx < 2 * NB_FRAMES; idx++)
+    {
+        g_samples[idx] = (idx % 2 == 0) ? 32767 : -32768;
+    }
+    memset(g_acc_left, 0, sizeof(g_acc_left));
+    memset(g_acc_right, 0, sizeof(g_acc_right));
+    for (uint32_t sound_idx = 0; sound_idx < NB_SUMMED_SOUNDS; sound_idx++)
+    {
+        mix_samples_q_stereo_ref(g_acc_left, g_acc_right, g_samples, NB_FRAMES, MIX_GAIN_UNITY, 0);
+    }
+    for (size_t idx = 0; idx < NB_FRAMES; idx++)
+    {
+        stereo_ok =    stereo_ok && (g_acc_left[idx] == NB_SUMMED_SOUNDS * 32767 * (MIX_ACC_FULL_SCALE / 32768))
+                    && ((int64_t)g_acc_right[idx] == -(int64_t)NB_SUMMED_SOUNDS * MIX_ACC_FULL_SCALE);
+    }
+    check(stereo_ok, "mix_samples_q_stereo_ref: 64 full scale sounds at unity gain");
+}
+
+/* Zero gain: the accumulators are unchanged (all the kernels), and a ramp from zero leaves the
+   first frame unchanged. */
+static void check_zero_gain(void)
+{
+    int32_t saved_left[NB_FRAMES];
+    int32_t saved_right[NB_FRAMES];
+    bool ok = true;
+
+    fill_random();
+    memcpy(saved_left, g_acc_left, sizeof(saved_left));
+    memcpy(saved_right, g_acc_right, sizeof(saved_right));
+
+    mix_samples_q_ref(g_acc_left, g_samples, NB_FRAMES, 0, 0);
+    mix_samples_q_dsp(g_acc_left, g_samples, NB_FRAMES, 0, 0);
+    mix_samples_q_interp(g_acc_left, g_samples, NB_FRAMES / 2, 0, 0, 0, MIX_PHASE_UNITY + MIX_PHASE_UNITY / 3);
+    mix_samples_q_stereo_ref(g_acc_left, g_acc_right, g_samples, NB_FRAMES, 0, 0);
+    mix_samples_q_stereo_dsp(g_acc_left, g_acc_right, g_samples, NB_FRAMES, 0, 0);
+    mix_samples_q_interp_stereo(g_acc_left, g_acc_right, g_samples, NB_FRAMES / 2, 0, 0, 0, MIX_PHASE_UNITY / 3);
+    ok =    (memcmp(g_acc_left, saved_left, sizeof(saved_left)) == 0)
+         && (memcmp(g_acc_right, saved_right, sizeof(saved_right)) == 0);
+    check(ok, "all kernels: zero gain leaves the accumulators unchanged");
+
+    g_samples[0] = -32768;
+    mix_samples_q_ref(g_acc_left, g_samples, NB_FRAMES, 0, MIX_GAIN_UNITY / NB_FRAMES);
+    check(g_acc_left[0] == saved_left[0], "mix_samples_q_ref: ramp from zero gain");
+}
+
+int main(void)
+{
+    srand(1);
+
+    check_mono_kernels();
+    check_stereo_kernels();
+    check_interp_kernels();
+    check_saturation();
+    check_zero_gain();
+
+    printf("test_mixing_kernel: %s\n", (g_nb_errors == 0) ? "OK" : "KO");
+
+    return (g_nb_errors == 0) ? 0 : 1;
+}
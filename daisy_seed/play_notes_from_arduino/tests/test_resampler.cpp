@@ -0,0 +1,145 @@
+/*
+ * Host unit test of the resampler (resampler.cpp): one second of a A4 (440 Hz) sampled at
+ * 44100 Hz is resampled to SAMPLE_RATE_HZ in chunks (as the chunks read from the SD card), then
+ * the resampler is flushed. The pitch of the output is measured with its rising zero crossings
+ * (linear interpolation between two samples) and must be 440 Hz within PITCH_MAX_ERROR_HZ. The
+ * number of frames of the output must be the duration of the input at SAMPLE_RATE_HZ, and a
+ * stereo A4 (left and right in opposite phase) must give the same pitch on both channels.
+ */
+
+/*************************************************************************************************
+* Includes
+*************************************************************************************************/
+#include "daisy_seed.h"
+#include "common.h"
+#include "resampler.h"
+#include <math.h>
+
+/*************************************************************************************************
+* Defines
+*************************************************************************************************/
+#define PITCH_FREQ_HZ       440     // Frequency of the A4.
+#define PITCH_RATE_HZ       44100   // Sample rate of the A4 before resampling.
+#define PITCH_AMPLITUDE     16000.0f
+#define CHUNK_NB_FRAMES     980     // Number of frames resampled at once (not a multiple of 147).
+#define MAX_OUT_NB_FRAMES   (SAMPLE_RATE_HZ + SAMPLE_RATE_HZ / 10)
+#define PITCH_MAX_ERROR_HZ  0.05f   // Maximum frequency error.
+#define TRANSIENT_NB_FRAMES 64      // Frames skipped at the start and at the end (filter transients).
+
+/*************************************************************************************************
+* Variables
+*************************************************************************************************/
+static int16_t  g_in[2 * CHUNK_NB_FRAMES];
+static int16_t  g_out[2 * MAX_OUT_NB_FRAMES];
+static uint32_t g_nb_errors = 0;
+
+/*************************************************************************************************
+* Functions implementation
+*************************************************************************************************/
+/* Log the result of a check and count the errors. */
+static void check(bool ok, const char *name)
+{
+    printf("%-60s %s\n", name, ok ? "OK" : "KO");
+    if (ok == false)
+    {
+        g_nb_errors++;
+    }
+}
+
+/* Resample one second of a A4 with nb_channels channels (the right channel is the opposite of the
+   left channel). Return the number of frames of the output in g_out. */
+static size_t resample_a4(uint8_t nb_channels)
+{
+    size_t nb_out_frames = 0;
+    int16_t sample;
+
+    init_resampler(PITCH_RATE_HZ, SAMPLE_RATE_HZ, nb_channels);
+
+    for (uint32_t chunk_pos = 0; chunk_pos < PITCH_RATE_HZ; chunk_pos += CHUNK_NB_FRAMES)
+    {
+        for (uint32_t idx = 0; idx < CHUNK_NB_FRAMES; idx++)
+        {
+            // Exact phase: PITCH_FREQ_HZ periods per second.
+            sample = (int16_t)lroundf(PITCH_AMPLITUDE * sinf(  2.0f * (float)M_PI / PITCH_RATE_HZ
+                                                             * (float)(((chunk_pos + idx) * PITCH_FREQ_HZ) % PITCH_RATE_HZ)));
+            g_in[nb_channels * idx] = sample;
+            if (nb_channels == 2)
+            {
+                g_in[2 * idx + 1] = -sample;
+            }
+        }
+
+        nb_out_frames += resample(g_in, CHUNK_NB_FRAMES, &g_out[nb_channels * nb_out_frames],
+                                  MAX_OUT_NB_FRAMES - nb_out_frames);
+    }
+    nb_out_frames += flush_resampler(&g_out[nb_channels * nb_out_frames], MAX_OUT_NB_FRAMES - nb_out_frames);
+
+    return nb_out_frames;
+}
+
+/* Measure the frequency of a channel of the output (nb_frames frames of nb_channels channels)
+   with its rising zero crossings. */
+static float measure_frequency(size_t nb_frames, uint8_t nb_channels, uint8_t channel)
+{
+    int16_t prev_sample = g_out[nb_channels * TRANSIENT_NB_FRAMES + channel];
+    int16_t sample;
+    double crossing_pos;
+    double first_crossing_pos = 0.0;
+    double last_crossing_pos = 0.0;
+    uint32_t nb_crossings = 0;
+
+    for (size_t frame_idx = TRANSIENT_NB_FRAMES + 1; frame_idx < nb_frames - TRANSIENT_NB_FRAMES; frame_idx++)
+    {
+        sample = g_out[nb_channels * frame_idx + channel];
+        if ((prev_sample < 0) && (sample >= 0))
+        {
+            crossing_pos = (double)frame_idx - 1.0 + (double)(-prev_sample) / (double)(sample - prev_sample);
+            if (nb_crossings == 0)
+            {
+                first_crossing_pos = crossing_pos;
+            }
+            last_crossing_pos = crossing_pos;
+            nb_crossings++;
+        }
+        prev_sample = sample;
+    }
+
+    if (nb_crossings < 2)
+    {
+        return 0.0f;
+    }
+
+    return (float)((double)(nb_crossings - 1) * SAMPLE_RATE_HZ / (last_crossing_pos - first_crossing_pos));
+}
+
+int main(void)
+{
+    size_t nb_frames;
+    float freq;
+    float freq_right;
+    char name[80];
+
+    // Mono A4.
+    nb_frames = resample_a4(1);
+    freq = measure_frequency(nb_frames, 1, 0);
+    printf("Mono: %d frames, freq=%.4f Hz\n", (int)nb_frames, freq);
+    snprintf(name, sizeof(name), "A4 %d Hz -> %d Hz: 440 Hz +/- %.2f Hz", PITCH_RATE_HZ, SAMPLE_RATE_HZ, PITCH_MAX_ERROR_HZ);
+    check(fabsf(freq - PITCH_FREQ_HZ) <= PITCH_MAX_ERROR_HZ, name);
+
+    // One second of input plus the delay of the filter (flushed).
+    check(   (nb_frames >= SAMPLE_RATE_HZ)
+          && (nb_frames <= SAMPLE_RATE_HZ + (RESAMPLER_NB_TAPS / 2) * SAMPLE_RATE_HZ / PITCH_RATE_HZ + 1),
+          "Number of frames: 1 second plus the flushed delay of the filter");
+
+    // Stereo A4.
+    nb_frames = resample_a4(2);
+    freq = measure_frequency(nb_frames, 2, 0);
+    freq_right = measure_frequency(nb_frames, 2, 1);
+    printf("Stereo: %d frames, freq=%.4f Hz / %.4f Hz\n", (int)nb_frames, freq, freq_right);
+    check(   (fabsf(freq - PITCH_FREQ_HZ) <= PITCH_MAX_ERROR_HZ)
+          && (fabsf(freq_right - PITCH_FREQ_HZ) <= PITCH_MAX_ERROR_HZ), "Stereo A4: 440 Hz on both channels");
+
+    printf("test_resampler: %s\n", (g_nb_errors == 0) ? "OK" : "KO");
+
+    return (g_nb_errors == 0) ? 0 : 1;
+}
@@ -0,0 +1,127 @@
+/*
+ * Host unit test of the wav chunk walker (wav_format.cpp): the small wav files of the wav
+ * directory (written by make_wav_fixtures.py) are parsed with a read function on the host files,
+ * and the format read must be the format of each file: chunks before the fmt chunk or after the
+ * data chunk, chunk of odd size, extensible and float formats, truncated data. The files without
+ * data chunk, not RIFF or with 3 channels must be rejected.
+ */
+
+/*************************************************************************************************
+* Includes
+*************************************************************************************************/
+#include "daisy_seed.h"
+#include "common.h"
+#include "bank_index.h"
+#include "wav_format.h"
+
+/*************************************************************************************************
+* Defines
+*************************************************************************************************/
+#define WAV_DIR             "wav/"  // Directory of the wav files (run from the tests directory).
+
+/*************************************************************************************************
+* Types
+*************************************************************************************************/
+// Wav file and format expected.
+typedef struct
+{
+    const char *file_name;
+    bool valid;                 // False: the file must be rejected (other fields not checked).
+    uint8_t nb_channels;
+    uint8_t bits_per_sample;
+    uint8_t float_samples;
+    uint32_t data_offset;
+    uint32_t data_size;
+    uint32_t loop_start;
+    uint32_t loop_end;
+} TWavFixture;
+
+/*************************************************************************************************
+* Variables
+*************************************************************************************************/
+static const TWavFixture k_wav_fixtures[] =
+{
+    // file_name                     valid  ch  bits float offset size  loop
+    {"list_fact_before_fmt.wav",     true,  1,  16,  0,    82,    20,   0, 0},
+    {"smpl_after_data.wav",          true,  2,  16,  0,    44,    40,   2, 8},
+    {"odd_junk.wav",                 true,  1,  16,  0,    56,    20,   0, 0},
+    {"extensible_16.wav",            true,  2,  16,  0,    68,    40,   0, 0},
+    {"extensible_24.wav",            true,  1,  24,  0,    68,    30,   0, 0},
+    {"float32.wav",                  true,  2,  32,  1,    56,    80,   0, 0},
+    {"truncated_data.wav",           true,  1,  16,  0,    44,    20,   0, 0},
+    {"missing_data.wav",             false, 0,  0,   0,    0,     0,    0, 0},
+    {"not_riff.wav",                 false, 0,  0,   0,    0,     0,    0, 0},
+    {"3_channels.wav",               false, 0,  0,   0,    0,     0,    0, 0},
+};
+
+static uint32_t g_nb_errors = 0;
+
+/*************************************************************************************************
+* Functions implementation
+*************************************************************************************************/
+/* Read size bytes at position pos of a host file (context: its FILE) in buffer. */
+static bool read_host_file_at(void *context, uint32_t pos, void *buffer, size_t size)
+{
+    FILE *pFile = (FILE *)context;
+
+    return (fseek(pFile, pos, SEEK_SET) == 0) && (fread(buffer, 1, size, pFile) == size);
+}
+
+/* Parse a wav file and check its format. */
+static void check_wav_file(const TWavFixture *pFixture)
+{
+    TBankIndexEntry entry;
+    char file_path[MAX_FILE_PATH_LEN];
+    FILE *pFile;
+    long file_size;
+    bool valid;
+    bool ok;
+
+    snprintf(file_path, sizeof(file_path), "%s%s", WAV_DIR, pFixture->file_name);
+    pFile = fopen(file_path, "rb");
+    if (pFile == NULL)
+    {
+        printf("%-60s KO (no file)\n", pFixture->file_name);
+        g_nb_errors++;
+        return;
+    }
+    fseek(pFile, 0, SEEK_END);
+    file_size = ftell(pFile);
+
+    memset(&entry, 0, sizeof(entry));
+    valid = parse_wav_format(file_path, (uint32_t)file_size, read_host_file_at, pFile, &entry);
+    fclose(pFile);
+
+    ok = (valid == pFixture->valid);
+    if ((ok == true) && (valid == true))
+    {
+        ok =    (entry.nb_channels == pFixture->nb_channels) && (entry.bits_per_sample == pFixture->bits_per_sample)
+             && (entry.float_samples == pFixture->float_samples) && (entry.sample_rate == 44100)
+             && (entry.data_offset == pFixture->data_offset) && (entry.data_size == pFixture->data_size)
+             && (entry.loop_start == pFixture->loop_start) && (entry.loop_end == pFixture->loop_end);
+        if (ok == false)
+        {
+            printf("ch=%d bits=%d float=%d rate=%d offset=%d size=%d loop=%d-%d\n", entry.nb_channels,
+                   entry.bits_per_sample, entry.float_samples, (int)entry.sample_rate, (int)entry.data_offset,
+                   (int)entry.data_size, (int)entry.loop_start, (int)entry.loop_end);
+        }
+    }
+
+    printf("%-60s %s\n", pFixture->file_name, ok ? "OK" : "KO");
+    if (ok == false)
+    {
+        g_nb_errors++;
+    }
+}
+
+int main(void)
+{
+    for (size_t fixture_idx = 0; fixture_idx < sizeof(k_wav_fixtures) / sizeof(k_wav_fixtures[0]); fixture_idx++)
+    {
+        check_wav_file(&k_wav_fixtures[fixture_idx]);
+    }
+
+    printf("test_wav_format: %s\n", (g_nb_errors == 0) ? "OK" : "KO");
+
+    return (g_nb_errors == 0) ? 0 : 1;
+}
@@ -0,0 +1,193 @@
+# Build the index files of a sound bank directory for the Daisy Seed (see bank_index.cpp): one
+# index.bin file in the bank directory and in each velocity layer directory (layer_1 to
+# layer_N). With the index files, the bank is loaded without scanning the directories nor
+# reading the header of each file.
+#
+# Usage: python build_bank_index.py <bank directory>
+#
+# Run the tool on the SD card (or copy the files with their modification date): the index of a
+# directory is rebuilt by the Daisy Seed when the size or the date of one of its files is
+# different from the index.
+import os
+import struct
+import sys
+import time
+
+# Constants (see bank_index.h, common.h and adpcm.h)
+BANK_INDEX_FILE_NAME = "index.bin"
+BANK_INDEX_MAGIC = b"BIDX"
+BANK_INDEX_VERSION = 3
+NB_KEYS = 85
+MAX_FILE_NAME_LEN = 40
+WAV_LAYER_DIR_NAME = "layer_"
+MAX_NB_VELOCITY_LAYERS = 4
+ADPCM_FILE_MAGIC = b"ADPC"
+ADPCM_BLOCK_SIZE_BYTES = 256
+WAV_FORMAT_PCM = 1
+WAV_FORMAT_FLOAT = 3
+WAV_FORMAT_EXTENSIBLE = 0xFFFE
+
+HEADER_FORMAT = "<4sIII"
+ENTRY_FORMAT = "<%dsIHHBBBBIIIII" % MAX_FILE_NAME_LEN
+
+FNV_OFFSET_BASIS = 2166136261
+FNV_PRIME = 16777619
+
+def compute_checksum(data):
+    """FNV-1a of the entries."""
+
+    checksum = FNV_OFFSET_BASIS
+    for byte in data:
+        checksum = ((checksum ^ byte) * FNV_PRIME) & 0xFFFFFFFF
+    #end for
+
+    return checksum
+#end def
+
+def fat_date_time(path):
+    """Date and time of the last modification of a file (FAT format, local time)."""
+
+    mtime = time.localtime(os.path.getmtime(path))
+    fat_date = ((mtime.tm_year - 1980) << 9) | (mtime.tm_mon << 5) | mtime.tm_mday
+    fat_time = (mtime.tm_hour << 11) | (mtime.tm_min << 5) | (mtime.tm_sec // 2)
+
+    return fat_date, fat_time
+#end def
+
+def read_wav_format(path):
+    """Return the number of channels, sample rate, bits per sample, float samples (1 or 0),
+    position and size of the samples and first sample loop (frames, end excluded, 0 and 0 without loop) of a wav file.
+    Return None if the file is not supported."""
+
+    audio_format = nb_channels = sample_rate = bits_per_sample = 0
+    data_offset = data_size = 0
+    loop_start = loop_end = 0
+
+    wav_file = open(path, "rb")
+    riff_header = wav_file.read(12)
+    if len(riff_header) != 12 or riff_header[0:4] != b"RIFF" or riff_header[8:12] != b"WAVE":
+        print("%s: not a wav file" % path)
+        wav_file.close()
+        return None
+    #end if
+
+    # Walk the chunks of the file (chunks are padded to an even size).
+    chunk_pos = 12
+    while True:
+        wav_file.seek(chunk_pos)
+        chunk_header = wav_file.read(8)
+        if len(chunk_header) != 8:
+            break
+        #end if
+        chunk_id, chunk_size = struct.unpack("<4sI", chunk_header)
+        if chunk_id == b"fmt ":
+            format_chunk = wav_file.read(min(chunk_size, 40))
+            audio_format, nb_channels, sample_rate, byte_rate, block_align, bits_per_sample = struct.unpack("<HHIIHH", format_chunk[:16])
+            # The extensible format gives the audio format in its sub-format.
+            if audio_format == WAV_FORMAT_EXTENSIBLE and len(format_chunk) == 40:
+                audio_format = struct.unpack("<H", format_chunk[24:26])[0]
+            #end if
+        elif chunk_id == b"data":
+            data_offset = chunk_pos + 8
+            data_size = min(chunk_size, os.path.getsize(path) - data_offset)
+        elif chunk_id == b"smpl" and chunk_size >= 36 + 24:
+            nb_sample_loops = struct.unpack("<9I", wav_file.read(36))[7]
+            cue_point_id, loop_type, start, end, fraction, play_count = struct.unpack("<6I", wav_file.read(24))
+            if nb_sample_loops > 0 and end > start:
+                loop_start = start
+                loop_end = end + 1
+            #end if
+        #end if
+        chunk_pos += 8 + chunk_size + (chunk_size & 1)
+    #end while
+    wav_file.close()
+
+    # Same checks as the Daisy Seed (read_wav_format in main.cpp): the file is not indexed if its
+    # format is not supported.
+    float_samples = 1 if audio_format == WAV_FORMAT_FLOAT else 0
+    if (data_offset == 0 or nb_channels not in (1, 2) or sample_rate == 0
+        or not ((audio_format == WAV_FORMAT_PCM and bits_per_sample in (16, 24, 32))
+                or (audio_format == WAV_FORMAT_FLOAT and bits_per_sample == 32))):
+        print("%s: format not supported (16, 24 or 32 bits PCM or 32 bits float, mono or stereo)" % path)
+        return None
+    #end if
+    data_size -= data_size % (bits_per_sample // 8 * nb_channels)
+
+    return nb_channels, sample_rate, bits_per_sample, float_samples, data_offset, data_size, loop_start, loop_end
+#end def
+
+def read_adpcm_format(path):
+    """Return the number of channels, sample rate and size of the blocks of a compressed file."""
+
+    adp_file = open(path, "rb")
+    magic, nb_channels, sample_rate, nb_frames, nb_blocks = struct.unpack("<4sB3xIII", adp_file.read(16))
+    adp_file.close()
+    if magic != ADPCM_FILE_MAGIC:
+        raise Exception("%s: not a compressed file" % path)
+    #end if
+
+    return nb_channels, sample_rate, nb_blocks * ADPCM_BLOCK_SIZE_BYTES * nb_channels
+#end def
+
+def build_index(dir_path):
+    """Write the index file of a directory of notes. The key of a file is given by the 3 first
+    characters of its name (001 to 085)."""
+
+    entries = [struct.pack(ENTRY_FORMAT, b"", 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0)] * NB_KEYS
+    nb_files = 0
+
+    for file_name in sorted(os.listdir(dir_path)):
+        path = os.path.join(dir_path, file_name)
+        is_wav = file_name.lower().endswith(".wav")
+        is_adpcm = ".adp" in file_name.lower()
+        if file_name.startswith(".") or os.path.isdir(path) or not (is_wav or is_adpcm):
+            continue
+        #end if
+        if len(file_name) >= MAX_FILE_NAME_LEN:
+            raise Exception("%s: file name longer than %d characters" % (path, MAX_FILE_NAME_LEN - 1))
+        #end if
+        key_idx = int(file_name[:3]) - 1
+        if key_idx < 0 or key_idx >= NB_KEYS:
+            raise Exception("%s: key %d not in [1, %d]" % (path, key_idx + 1, NB_KEYS))
+        #end if
+
+        fat_date, fat_time = fat_date_time(path)
+        if is_adpcm:
+            nb_channels, sample_rate, data_size = read_adpcm_format(path)
+            entry = (1, nb_channels, 16, 0, sample_rate, 0, data_size, 0, 0)
+        else:
+            wav_format = read_wav_format(path)
+            if wav_format is None:
+                continue
+            #end if
+            nb_channels, sample_rate, bits_per_sample, float_samples, data_offset, data_size, loop_start, loop_end = wav_format
+            entry = (0, nb_channels, bits_per_sample, float_samples, sample_rate, data_offset, data_size, loop_start, loop_end)
+        #end if
+        entries[key_idx] = struct.pack(ENTRY_FORMAT, file_name.encode(), os.path.getsize(path), fat_date, fat_time, *entry)
+        nb_files += 1
+    #end for
+
+    entries_data = b"".join(entries)
+    index_file = open(os.path.join(dir_path, BANK_INDEX_FILE_NAME), "wb")
+    index_file.write(struct.pack(HEADER_FORMAT, BANK_INDEX_MAGIC, BANK_INDEX_VERSION, NB_KEYS, compute_checksum(entries_data)))
+    index_file.write(entries_data)
+    index_file.close()
+
+    print("%s: %d files indexed" % (dir_path, nb_files))
+#end def
+
+# Index of the bank directory and of each velocity layer directory
+if len(sys.argv) != 2:
+    print("Usage: python build_bank_index.py <bank directory>")
+    sys.exit(1)
+#end if
+bank_dir = sys.argv[1]
+
+build_index(bank_dir)
+for layer_idx in range(1, MAX_NB_VELOCITY_LAYERS + 1):
+    layer_dir = os.path.join(bank_dir, WAV_LAYER_DIR_NAME + str(layer_idx))
+    if not os.path.isdir(layer_dir):
+        break
+    #end if
+    build_index(layer_dir)
+#end for
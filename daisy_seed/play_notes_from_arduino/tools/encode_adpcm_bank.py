@@ -0,0 +1,208 @@
+# Encode the wav files of a sound bank directory in the ADPCM format of the Daisy Seed (see
+# adpcm.cpp): one .adp file per wav file, with the same name. The .adp files replace the wav
+# files in the bank directory of the SD card (about 4 times less RAM).
+#
+# Usage: python encode_adpcm_bank.py <wav directory> <adp directory>
+#
+# The wav files must be 16 bits PCM, mono or stereo, at 48000 Hz. The signal to noise ratio of
+# each file (after encoding and decoding) is displayed.
+import math
+import os
+import struct
+import sys
+import wave
+
+# Constants (see adpcm.h)
+SAMPLE_RATE_HZ = 48000
+ADPCM_FILE_MAGIC = b"ADPC"
+ADPCM_BLOCK_NB_FRAMES = 505
+ADPCM_BLOCK_HEADER_SIZE = 4
+ADPCM_BLOCK_SIZE_BYTES = 256
+
+ADPCM_STEP_TABLE = [
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45, 50, 55, 60, 66,
+    73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307, 337, 371, 408,
+    449, 494, 544, 598, 658, 724, 796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+    2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630,
+    9493, 10442, 11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767]
+ADPCM_INDEX_TABLE = [-1, -1, -1, -1, 2, 4, 6, 8]
+
+def decode_code(code, predictor, step_index):
+
+    step = ADPCM_STEP_TABLE[step_index]
+    diff = step >> 3
+    if code & 4:
+        diff += step
+    #end if
+    if code & 2:
+        diff += step >> 1
+    #end if
+    if code & 1:
+        diff += step >> 2
+    #end if
+    if code & 8:
+        predictor -= diff
+    else:
+        predictor += diff
+    #end if
+    predictor = max(-32768, min(32767, predictor))
+    step_index = max(0, min(len(ADPCM_STEP_TABLE) - 1, step_index + ADPCM_INDEX_TABLE[code & 7]))
+
+    return predictor, step_index
+#end def
+
+def encode_sample(sample, predictor, step_index):
+
+    step = ADPCM_STEP_TABLE[step_index]
+    diff = sample - predictor
+    code = 0
+    if diff < 0:
+        code = 8
+        diff = -diff
+    #end if
+    if diff >= step:
+        code |= 4
+        diff -= step
+    #end if
+    step >>= 1
+    if diff >= step:
+        code |= 2
+        diff -= step
+    #end if
+    step >>= 1
+    if diff >= step:
+        code |= 1
+    #end if
+
+    # The encoder follows the decoder.
+    predictor, step_index = decode_code(code, predictor, step_index)
+
+    return code, predictor, step_index
+#end def
+
+def find_first_step_index(samples, nb_frames, nb_channels, channel):
+    """Return the step index giving the lowest error over the first block of a channel."""
+
+    best_step_index = 0
+    min_total_error = None
+    if nb_frames == 0:
+        return best_step_index
+    #end if
+    for first_step_index in range(len(ADPCM_STEP_TABLE)):
+        predictor = samples[channel]
+        step_index = first_step_index
+        total_error = 0
+        for frame in range(1, min(nb_frames, ADPCM_BLOCK_NB_FRAMES)):
+            sample = samples[frame * nb_channels + channel]
+            code, predictor, step_index = encode_sample(sample, predictor, step_index)
+            total_error += (sample - predictor) ** 2
+        #end for
+        if min_total_error is None or total_error < min_total_error:
+            min_total_error = total_error
+            best_step_index = first_step_index
+        #end if
+    #end for
+
+    return best_step_index
+#end def
+
+def encode(samples, nb_frames, nb_channels):
+    """Return the blocks and the decoded samples (interleaved)."""
+
+    blocks = bytearray()
+    decoded = [0] * len(samples)
+    predictor = [0] * nb_channels
+
+    # The step index of the first block follows the attack of the sound.
+    step_index = [find_first_step_index(samples, nb_frames, nb_channels, channel) for channel in range(nb_channels)]
+
+    for block_first_frame in range(0, nb_frames, ADPCM_BLOCK_NB_FRAMES):
+        block = bytearray(ADPCM_BLOCK_SIZE_BYTES * nb_channels)
+
+        # Block header: first sample and step index of each channel.
+        for channel in range(nb_channels):
+            predictor[channel] = samples[block_first_frame * nb_channels + channel]
+            decoded[block_first_frame * nb_channels + channel] = predictor[channel]
+            struct.pack_into("<hBB", block, ADPCM_BLOCK_HEADER_SIZE * channel, predictor[channel], step_index[channel], 0)
+        #end for
+
+        # 4 bits codes of the other frames (channels interleaved, low nibble first).
+        code_idx = 0
+        block_last_frame = min(block_first_frame + ADPCM_BLOCK_NB_FRAMES, nb_frames)
+        for frame in range(block_first_frame + 1, block_last_frame):
+            for channel in range(nb_channels):
+                sample_idx = frame * nb_channels + channel
+                code, predictor[channel], step_index[channel] = encode_sample(samples[sample_idx], predictor[channel], step_index[channel])
+                decoded[sample_idx] = predictor[channel]
+                block[ADPCM_BLOCK_HEADER_SIZE * nb_channels + (code_idx >> 1)] |= code << ((code_idx & 1) * 4)
+                code_idx += 1
+            #end for
+        #end for
+
+        blocks += block
+    #end for
+
+    return blocks, decoded
+#end def
+
+def compute_snr_db(samples, decoded):
+
+    signal_energy = sum(sample * sample for sample in samples)
+    noise_energy = sum((sample - decoded_sample) ** 2 for sample, decoded_sample in zip(samples, decoded))
+    if noise_energy == 0:
+        return float("inf")
+    #end if
+
+    return 10.0 * math.log10(signal_energy / noise_energy)
+#end def
+
+def encode_wav_file(wav_path, adp_path):
+    """Encode a wav file. Return the size of the wav data and of the adp file (bytes)."""
+
+    wav_file = wave.open(wav_path, "rb")
+    nb_channels = wav_file.getnchannels()
+    sample_rate = wav_file.getframerate()
+    nb_frames = wav_file.getnframes()
+    if wav_file.getsampwidth() != 2 or nb_channels > 2 or sample_rate != SAMPLE_RATE_HZ:
+        raise Exception("%s: 16 bits mono or stereo at %d Hz only" % (wav_path, SAMPLE_RATE_HZ))
+    #end if
+    data = wav_file.readframes(nb_frames)
+    wav_file.close()
+
+    samples = list(struct.unpack("<%dh" % (nb_frames * nb_channels), data))
+    blocks, decoded = encode(samples, nb_frames, nb_channels)
+    nb_blocks = (nb_frames + ADPCM_BLOCK_NB_FRAMES - 1) // ADPCM_BLOCK_NB_FRAMES
+
+    adp_file = open(adp_path, "wb")
+    adp_file.write(struct.pack("<4sB3xIII", ADPCM_FILE_MAGIC, nb_channels, sample_rate, nb_frames, nb_blocks))
+    adp_file.write(blocks)
+    adp_file.close()
+
+    print("%s: %d channels, %d frames, SNR=%.1f dB" % (os.path.basename(adp_path), nb_channels, nb_frames, compute_snr_db(samples, decoded)))
+
+    return len(data), os.path.getsize(adp_path)
+#end def
+
+# Encode all the wav files of the directory
+if len(sys.argv) != 3:
+    print("Usage: python encode_adpcm_bank.py <wav directory> <adp directory>")
+    sys.exit(1)
+#end if
+wav_dir = sys.argv[1]
+adp_dir = sys.argv[2]
+os.makedirs(adp_dir, exist_ok=True)
+
+wav_size = 0
+adp_size = 0
+for file_name in sorted(os.listdir(wav_dir)):
+    if not file_name.lower().endswith(".wav"):
+        continue
+    #end if
+    file_wav_size, file_adp_size = encode_wav_file(os.path.join(wav_dir, file_name), os.path.join(adp_dir, file_name[:-4] + ".adp"))
+    wav_size += file_wav_size
+    adp_size += file_adp_size
+#end for
+
+if adp_size > 0:
+    print("Bank: wav data %.1f MB, adp files %.1f MB (ratio %.2f)" % (wav_size / 1e6, adp_size / 1e6, wav_size / adp_size))
+#end if
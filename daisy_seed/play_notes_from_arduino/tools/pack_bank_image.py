@@ -0,0 +1,193 @@
+# Pack the notes of a sound bank directory in one image file for the Daisy Seed (see
+# bank_image.cpp): the notes of all the velocity layers (layer_1 to layer_N directories, or the
+# bank directory without layer directories) are stored as they are loaded in RAM, each note on a
+# new sector of the SD card. The image is loaded with a few big reads instead of opening each
+# file of the bank.
+#
+# Usage: python pack_bank_image.py <bank directory> [image file]
+#
+# The image file is written in the bank directory (bank.img) by default. The wav files must be
+# 16 bits PCM, mono or stereo, at 48000 Hz (the compressed .adp files are packed as they are).
+# Rebuild the image after any change of the files of the bank: the image is loaded instead of
+# the files when it is present.
+import os
+import struct
+import sys
+
+# Constants (see bank_image.h, common.h and adpcm.h)
+BANK_IMAGE_FILE_NAME = "bank.img"
+BANK_IMAGE_MAGIC = b"BIMG"
+BANK_IMAGE_VERSION = 1
+BANK_IMAGE_ALIGN_BYTES = 512
+SAMPLE_RATE_HZ = 48000
+NB_KEYS = 85
+WAV_LAYER_DIR_NAME = "layer_"
+MAX_NB_VELOCITY_LAYERS = 4
+ADPCM_FILE_MAGIC = b"ADPC"
+ADPCM_BLOCK_SIZE_BYTES = 256
+
+HEADER_FORMAT = "<4sIIIIIII"
+ENTRY_FORMAT = "<IIIBBHII"
+
+FNV_OFFSET_BASIS = 2166136261
+FNV_PRIME = 16777619
+
+def compute_checksum(data):
+    """FNV-1a of the entries."""
+
+    checksum = FNV_OFFSET_BASIS
+    for byte in data:
+        checksum = ((checksum ^ byte) * FNV_PRIME) & 0xFFFFFFFF
+    #end for
+
+    return checksum
+#end def
+
+def align(size):
+    """Size rounded up to a whole number of sectors."""
+
+    return (size + BANK_IMAGE_ALIGN_BYTES - 1) // BANK_IMAGE_ALIGN_BYTES * BANK_IMAGE_ALIGN_BYTES
+#end def
+
+def read_wav_note(path):
+    """Return the samples (bytes), number of channels and first sample loop (frames, end
+    excluded, 0 and 0 without loop) of a wav file."""
+
+    audio_format = nb_channels = sample_rate = bits_per_sample = 0
+    data = None
+    loop_start = loop_end = 0
+
+    wav_file = open(path, "rb")
+    riff_header = wav_file.read(12)
+    if len(riff_header) != 12 or riff_header[0:4] != b"RIFF" or riff_header[8:12] != b"WAVE":
+        raise Exception("%s: not a wav file" % path)
+    #end if
+
+    # Walk the chunks of the file (chunks are padded to an even size).
+    chunk_pos = 12
+    while True:
+        wav_file.seek(chunk_pos)
+        chunk_header = wav_file.read(8)
+        if len(chunk_header) != 8:
+            break
+        #end if
+        chunk_id, chunk_size = struct.unpack("<4sI", chunk_header)
+        if chunk_id == b"fmt ":
+            audio_format, nb_channels, sample_rate, byte_rate, block_align, bits_per_sample = struct.unpack("<HHIIHH", wav_file.read(16))
+        elif chunk_id == b"data":
+            data = wav_file.read(chunk_size)
+        elif chunk_id == b"smpl" and chunk_size >= 36 + 24:
+            nb_sample_loops = struct.unpack("<9I", wav_file.read(36))[7]
+            cue_point_id, loop_type, start, end, fraction, play_count = struct.unpack("<6I", wav_file.read(24))
+            if nb_sample_loops > 0 and end > start:
+                loop_start = start
+                loop_end = end + 1
+            #end if
+        #end if
+        chunk_pos += 8 + chunk_size + (chunk_size & 1)
+    #end while
+    wav_file.close()
+
+    if audio_format != 1 or bits_per_sample != 16 or nb_channels not in (1, 2) or sample_rate != SAMPLE_RATE_HZ:
+        raise Exception("%s: must be 16 bits PCM, mono or stereo, %d Hz" % (path, SAMPLE_RATE_HZ))
+    #end if
+    if data is None:
+        raise Exception("%s: no data chunk" % path)
+    #end if
+    data = data[:len(data) // (2 * nb_channels) * (2 * nb_channels)]
+
+    return data, nb_channels, loop_start, loop_end
+#end def
+
+def read_adpcm_note(path):
+    """Return the blocks (bytes), number of channels and number of frames of a compressed file."""
+
+    adp_file = open(path, "rb")
+    magic, nb_channels, sample_rate, nb_frames, nb_blocks = struct.unpack("<4sB3xIII", adp_file.read(16))
+    data = adp_file.read(nb_blocks * ADPCM_BLOCK_SIZE_BYTES * nb_channels)
+    adp_file.close()
+    if magic != ADPCM_FILE_MAGIC or len(data) != nb_blocks * ADPCM_BLOCK_SIZE_BYTES * nb_channels:
+        raise Exception("%s: not a compressed file" % path)
+    #end if
+
+    return data, nb_channels, nb_frames
+#end def
+
+def list_notes(dir_path):
+    """Return the path of the file of each key of a directory of notes (None: no file). The key
+    of a file is given by the 3 first characters of its name (001 to 085)."""
+
+    note_paths = [None] * NB_KEYS
+    for file_name in sorted(os.listdir(dir_path)):
+        path = os.path.join(dir_path, file_name)
+        lower_name = file_name.lower()
+        if file_name.startswith(".") or os.path.isdir(path) or not (lower_name.endswith(".wav") or ".adp" in lower_name):
+            continue
+        #end if
+        key_idx = int(file_name[:3]) - 1
+        if key_idx < 0 or key_idx >= NB_KEYS:
+            raise Exception("%s: key %d not in [1, %d]" % (path, key_idx + 1, NB_KEYS))
+        #end if
+        note_paths[key_idx] = path
+    #end for
+
+    return note_paths
+#end def
+
+# Directories of the velocity layers (layer 0 is the softest)
+if len(sys.argv) not in (2, 3):
+    print("Usage: python pack_bank_image.py <bank directory> [image file]")
+    sys.exit(1)
+#end if
+bank_dir = sys.argv[1]
+image_path = sys.argv[2] if len(sys.argv) == 3 else os.path.join(bank_dir, BANK_IMAGE_FILE_NAME)
+
+layer_dirs = []
+for layer_idx in range(1, MAX_NB_VELOCITY_LAYERS + 1):
+    layer_dir = os.path.join(bank_dir, WAV_LAYER_DIR_NAME + str(layer_idx))
+    if not os.path.isdir(layer_dir):
+        break
+    #end if
+    layer_dirs.append(layer_dir)
+#end for
+if len(layer_dirs) == 0:
+    layer_dirs = [bank_dir]
+#end if
+
+# Data of the notes: each note starts on a new sector, after the header and the table.
+data_offset = align(struct.calcsize(HEADER_FORMAT) + len(layer_dirs) * NB_KEYS * struct.calcsize(ENTRY_FORMAT))
+entries = []
+notes_data = []
+cur_offset = data_offset
+for layer_dir in layer_dirs:
+    for path in list_notes(layer_dir):
+        if path is None:
+            entries.append(struct.pack(ENTRY_FORMAT, 0, 0, 0, 1, 0, 0, 0, 0))
+            continue
+        #end if
+        if ".adp" in os.path.basename(path).lower():
+            data, nb_channels, nb_frames = read_adpcm_note(path)
+            entries.append(struct.pack(ENTRY_FORMAT, cur_offset, len(data), nb_frames * nb_channels, nb_channels, 1, 0, 0, 0))
+        else:
+            data, nb_channels, loop_start, loop_end = read_wav_note(path)
+            entries.append(struct.pack(ENTRY_FORMAT, cur_offset, len(data), len(data) // 2, nb_channels, 0, 0, loop_start, loop_end))
+        #end if
+        notes_data.append(data + bytes(align(len(data)) - len(data)))
+        cur_offset += align(len(data))
+    #end for
+    print("%s: packed" % layer_dir)
+#end for
+
+entries_data = b"".join(entries)
+header = struct.pack(HEADER_FORMAT, BANK_IMAGE_MAGIC, BANK_IMAGE_VERSION, len(layer_dirs), NB_KEYS, data_offset,
+                     cur_offset - data_offset, compute_checksum(entries_data), 0)
+image_file = open(image_path, "wb")
+image_file.write(header)
+image_file.write(entries_data)
+image_file.write(bytes(data_offset - len(header) - len(entries_data)))
+for data in notes_data:
+    image_file.write(data)
+#end for
+image_file.close()
+
+print("%s: %d velocity layers, %d bytes" % (image_path, len(layer_dirs), cur_offset))
@@ -0,0 +1,138 @@
+/*
+ * This module reads the format of the data of a wav file from its chunks: fmt chunk (format),
+ * data chunk (samples) and smpl chunk (first sample loop). The other chunks (LIST, fact, cue,
+ * JUNK...) are skipped, wherever they are.
+ *
+ * The file is read with a read function given by the caller (read_wav_format in main.cpp reads
+ * the SD card with FatFS), so the module is built on the host too: the chunk walker is checked
+ * with a set of small wav files by the host unit test tests/test_wav_format.cpp.
+ */
+
+/*************************************************************************************************
+* Includes
+*************************************************************************************************/
+#include "daisy_seed.h"
+#include "common.h"
+#include "bank_index.h"
+#include "wav_format.h"
+
+using namespace daisy;
+
+/*************************************************************************************************
+* Functions implementation
+*************************************************************************************************/
+/* Read the format of the data of a wav file of file_size bytes (number of channels, sample rate,
+   bits per sample, position and size of the samples, first sample loop) in the index entry of
+   the file. The bytes of the file are read with read_function(context, ...). The chunks are
+   walked once. The size of the samples is limited to the end of the file (truncated file) and to
+   whole frames. file_name is only used by the error messages.
+   Return false if the file is not a wav file with fmt and data chunks, or if its format is not
+   supported: 16, 24 or 32 bits PCM or 32 bits float, mono or stereo (converted while the file
+   is read, see read_wav_file). */
+bool parse_wav_format(const char *file_name, uint32_t file_size, TWavReadFunction read_function,
+                      void *context, TBankIndexEntry *pEntry)
+{
+    TWavChunkHeader chunk_header;
+    TWavFormatChunk format_chunk;
+    TWavSamplerChunk sampler_chunk;
+    TWavSampleLoop sample_loop;
+    uint32_t riff_header[3];
+    uint64_t chunk_pos = sizeof(riff_header);
+    size_t format_size;
+    bool format_found = false;
+    bool data_found = false;
+
+    pEntry->compressed      = 0;
+    pEntry->nb_channels     = 0;
+    pEntry->bits_per_sample = 0;
+    pEntry->float_samples   = 0;
+    pEntry->sample_rate     = 0;
+    pEntry->data_offset     = 0;
+    pEntry->data_size       = 0;
+    pEntry->loop_start      = 0;
+    pEntry->loop_end        = 0;
+
+    if (   (read_function(context, 0, riff_header, sizeof(riff_header)) == false)
+        || (memcmp(&riff_header[0], "RIFF", 4) != 0) || (memcmp(&riff_header[2], "WAVE", 4) != 0))
+    {
+        g_hw.PrintLine("Error: %s is not a wav file", file_name);
+        return false;
+    }
+
+    // Walk the chunks of the file up to its end (chunks are padded to an even size).
+    while (   (chunk_pos + sizeof(chunk_header) <= file_size)
+           && (read_function(context, (uint32_t)chunk_pos, &chunk_header, sizeof(chunk_header)) == true))
+    {
+        if (memcmp(chunk_header.id, "fmt ", 4) == 0)
+        {
+            memset(&format_chunk, 0, sizeof(format_chunk));
+            format_size = (chunk_header.size < sizeof(format_chunk)) ? chunk_header.size : sizeof(format_chunk);
+            format_found =    (format_size >= WAV_FORMAT_MIN_SIZE)
+                           && (read_function(context, (uint32_t)chunk_pos + sizeof(chunk_header),
+                                             &format_chunk, format_size) == true);
+
+            // The extensible format gives the audio format in its extension.
+            if ((format_chunk.audio_format == WAV_FORMAT_EXTENSIBLE) && (format_size == sizeof(format_chunk)))
+            {
+                format_chunk.audio_format = format_chunk.sub_format;
+            }
+        }
+        else if (memcmp(chunk_header.id, "data", 4) == 0)
+        {
+            data_found = true;
+            pEntry->data_offset = chunk_pos + sizeof(chunk_header);
+            pEntry->data_size   = chunk_header.size;
+            if (pEntry->data_size > file_size - pEntry->data_offset)
+            {
+                pEntry->data_size = file_size - pEntry->data_offset;
+            }
+        }
+        else if (memcmp(chunk_header.id, "smpl", 4) == 0)
+        {
+            if (   (chunk_header.size >= sizeof(sampler_chunk) + sizeof(sample_loop))
+                && (read_function(context, (uint32_t)chunk_pos + sizeof(chunk_header),
+                                  &sampler_chunk, sizeof(sampler_chunk)) == true)
+                && (sampler_chunk.nb_sample_loops > 0)
+                && (read_function(context, (uint32_t)chunk_pos + sizeof(chunk_header) + sizeof(sampler_chunk),
+                                  &sample_loop, sizeof(sample_loop)) == true)
+                && (sample_loop.end > sample_loop.start))
+            {
+                pEntry->loop_start = sample_loop.start;
+                pEntry->loop_end   = sample_loop.end + 1;
+            }
+        }
+        chunk_pos += sizeof(chunk_header) + (uint64_t)chunk_header.size + (chunk_header.size & 1);
+    }
+
+    if ((format_found == false) || (data_found == false))
+    {
+        g_hw.PrintLine("Error: %s has no fmt or data chunk", file_name);
+        return false;
+    }
+    if (   (   (   (format_chunk.audio_format != WAV_FORMAT_PCM)
+                || (   (format_chunk.bits_per_sample != 16) && (format_chunk.bits_per_sample != 24)
+                    && (format_chunk.bits_per_sample != 32)))
+            && ((format_chunk.audio_format != WAV_FORMAT_FLOAT) || (format_chunk.bits_per_sample != 32)))
+        || (format_chunk.nb_channels == 0) || (format_chunk.nb_channels > 2) || (format_chunk.sample_rate == 0))
+    {
+        g_hw.PrintLine("Error: %s: format %d, %d bits, %d channels not supported", file_name,
+                       format_chunk.audio_format, format_chunk.bits_per_sample, format_chunk.nb_channels);
+        return false;
+    }
+
+    pEntry->nb_channels     = format_chunk.nb_channels;
+    pEntry->bits_per_sample = format_chunk.bits_per_sample;
+    pEntry->float_samples   = (format_chunk.audio_format == WAV_FORMAT_FLOAT) ? 1 : 0;
+    pEntry->sample_rate     = format_chunk.sample_rate;
+
+    // Whole frames only.
+    pEntry->data_size -= pEntry->data_size % get_wav_frame_size(pEntry);
+
+    return true;
+}
+
+/* Return the size of a frame of a wav file (format pEntry) in bytes. */
+size_t get_wav_frame_size(const TBankIndexEntry *pEntry)
+{
+    return (pEntry->bits_per_sample / 8) * pEntry->nb_channels;
+}
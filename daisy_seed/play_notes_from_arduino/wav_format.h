@@ -0,0 +1,88 @@
+/*
+ *  Header file of wav_format.cpp. See this file for more details
+ */
+#ifndef WAV_FORMAT
+#define WAV_FORMAT
+
+/*************************************************************************************************
+* Includes
+*************************************************************************************************/
+#include "daisy_seed.h"
+#include "common.h"
+#include "bank_index.h"
+
+/*************************************************************************************************
+* Defines
+*************************************************************************************************/
+// Audio formats of the fmt chunk of the wav files supported.
+#define WAV_FORMAT_PCM              1
+#define WAV_FORMAT_FLOAT            3
+#define WAV_FORMAT_EXTENSIBLE       0xFFFE
+#define WAV_FORMAT_MIN_SIZE         16      // Size of the fmt chunk without extension.
+
+/*************************************************************************************************
+* Types
+*************************************************************************************************/
+// Read size bytes at position pos of a file (context: the file) in buffer. Return false if the
+// bytes can't be read (error or end of the file).
+typedef bool (*TWavReadFunction)(void *context, uint32_t pos, void *buffer, size_t size);
+
+// Header of a chunk of a wav file, followed by size bytes (padded to an even size).
+typedef struct
+{
+    char id[4];
+    uint32_t size;
+} TWavChunkHeader;
+
+// Format chunk of a wav file (fmt ): 16 bytes, or 40 bytes with the extension of the
+// extensible format.
+typedef struct
+{
+    uint16_t audio_format;      // WAV_FORMAT_PCM, WAV_FORMAT_FLOAT or WAV_FORMAT_EXTENSIBLE.
+    uint16_t nb_channels;
+    uint32_t sample_rate;
+    uint32_t byte_rate;
+    uint16_t block_align;
+    uint16_t bits_per_sample;
+    uint16_t extension_size;
+    uint16_t valid_bits_per_sample;
+    uint32_t channel_mask;
+    uint16_t sub_format;        // Audio format of the extensible format (start of its GUID).
+    uint8_t sub_format_guid[14];
+} TWavFormatChunk;
+
+// Sampler chunk of a wav file (smpl), followed by the sample loops.
+typedef struct
+{
+    uint32_t manufacturer;
+    uint32_t product;
+    uint32_t sample_period;
+    uint32_t midi_unity_note;
+    uint32_t midi_pitch_fraction;
+    uint32_t smpte_format;
+    uint32_t smpte_offset;
+    uint32_t nb_sample_loops;
+    uint32_t sampler_data;
+} TWavSamplerChunk;
+
+// Sample loop of a sampler chunk (start and end are frames of the file, end included).
+typedef struct
+{
+    uint32_t cue_point_id;
+    uint32_t type;
+    uint32_t start;
+    uint32_t end;
+    uint32_t fraction;
+    uint32_t play_count;
+} TWavSampleLoop;
+
+static_assert(sizeof(TWavFormatChunk) == 40, "TWavFormatChunk must not be padded");
+
+/*************************************************************************************************
+* Functions
+*************************************************************************************************/
+extern bool parse_wav_format(const char *file_name, uint32_t file_size, TWavReadFunction read_function,
+                             void *context, TBankIndexEntry *pEntry);
+extern size_t get_wav_frame_size(const TBankIndexEntry *pEntry);
+
+#endif //#ifndef WAV_FORMAT